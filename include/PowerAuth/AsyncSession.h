@@ -0,0 +1,236 @@
+/*
+ * Copyright 2019 Wultra s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <PowerAuth/Session.h>
+#include <PowerAuth/ECIES.h>
+#include <PowerAuth/Executor.h>
+#include <future>
+
+namespace io
+{
+namespace getlime
+{
+namespace powerAuth
+{
+	/**
+	 The AsyncResult structure contains result of an asynchronous operation.
+	 */
+	template <typename T>
+	struct AsyncResult
+	{
+		/**
+		 Result of the operation. If the operation has been cancelled before
+		 its last phase started, then the code is EC_WrongState.
+		 */
+		ErrorCode code;
+		/**
+		 True if the operation has been cancelled before its result was reported.
+		 If the cancellation was requested while the last phase was running, then
+		 |code| and |value| contain the real result of that phase, because
+		 the phase may already change the state of the session.
+		 */
+		bool cancelled;
+		/**
+		 Output of the operation. The value is valid only if code is EC_Ok.
+		 */
+		T value;
+
+		AsyncResult() : code(EC_Ok), cancelled(false), value() {}
+	};
+
+	/**
+	 The AsyncNoValue is a type of AsyncResult::value for operations
+	 without an output.
+	 */
+	struct AsyncNoValue {};
+
+	/**
+	 The AsyncCompletion is a completion callback for an asynchronous operation.
+	 The callback is called exactly once, on the thread provided by the executor.
+	 */
+	template <typename T>
+	using AsyncCompletion = std::function<void(AsyncResult<T> && result)>;
+
+	/**
+	 Returns completion callback which fulfills the future, stored to |out_future|.
+	 You can use the callback when you prefer to wait for the result of operation
+	 with std::future.
+	 */
+	template <typename T>
+	AsyncCompletion<T> MakeAsyncFutureCompletion(std::future<AsyncResult<T>> & out_future)
+	{
+		auto promise = std::make_shared<std::promise<AsyncResult<T>>>();
+		out_future = promise->get_future();
+		return [promise](AsyncResult<T> && result) {
+			promise->set_value(std::move(result));
+		};
+	}
+
+	/**
+	 The ECIESEncryptedRequest structure contains result of asynchronous ECIES
+	 request encryption.
+	 */
+	struct ECIESEncryptedRequest
+	{
+		/**
+		 Encryptor which has been used for the request encryption. You need
+		 this object for the subsequent response decryption.
+		 */
+		ECIESEncryptor encryptor;
+		/**
+		 Encrypted request.
+		 */
+		ECIESCryptogram cryptogram;
+	};
+
+	/**
+	 The AsyncSession class provides asynchronous variants of Session operations,
+	 which may take a significant time to complete, like the signature calculation
+	 with knowledge factor (PBKDF2), activation steps, or operations with EC keys.
+
+	 Each operation is executed by the provided executor and the result is reported
+	 to the completion callback. All input parameters are copied, so you don't need
+	 to keep them alive for the whole operation. On the opposite, the session and
+	 executor objects must be valid until all scheduled operations are completed.
+
+	 The returned AsyncOperation object allows you to cancel the operation. The
+	 cancellation is honored before each phase of the operation. Most operations
+	 have only one phase, so they can be cancelled only before they start. The phase
+	 which changes the state of the session is never interrupted, so once it's started,
+	 the operation reports its real result, with AsyncResult::cancelled set when
+	 the cancellation was requested meanwhile.
+
+	 Note that the Session object is still synchronized by its internal lock, so
+	 the operations scheduled for the same session are executed serially.
+	 */
+	class AsyncSession
+	{
+	public:
+
+		/**
+		 Constructs an asynchronous interface for |session|, using |executor| for
+		 the execution of operations.
+		 */
+		AsyncSession(Session & session, Executor & executor);
+
+		/**
+		 Returns underlying session.
+		 */
+		Session & session() const;
+
+		/**
+		 Returns executor used for operations.
+		 */
+		Executor & executor() const;
+
+		// MARK: - Activation -
+
+		/**
+		 Asynchronous variant of Session::startActivation().
+		 */
+		AsyncOperation startActivation(const ActivationStep1Param & param,
+									   AsyncCompletion<ActivationStep1Result> completion);
+
+		/**
+		 Asynchronous variant of Session::validateActivationResponse().
+		 */
+		AsyncOperation validateActivationResponse(const ActivationStep2Param & param,
+												  AsyncCompletion<ActivationStep2Result> completion);
+
+		/**
+		 Asynchronous variant of Session::completeActivation().
+		 */
+		AsyncOperation completeActivation(const SignatureUnlockKeys & keys,
+										  AsyncCompletion<AsyncNoValue> completion);
+
+		/**
+		 Asynchronous variant of Session::decodeActivationStatus().
+		 */
+		AsyncOperation decodeActivationStatus(const std::string & status_blob, const SignatureUnlockKeys & keys,
+											  AsyncCompletion<ActivationStatus> completion);
+
+		// MARK: - Signatures -
+
+		/**
+		 Asynchronous variant of Session::signHTTPRequestData(). Like in the synchronous
+		 variant, you have to save session's state after the successful operation.
+		 */
+		AsyncOperation signHTTPRequestData(const HTTPRequestData & request_data,
+										   const SignatureUnlockKeys & keys, SignatureFactor signature_factor,
+										   AsyncCompletion<HTTPRequestDataSignature> completion);
+
+		// MARK: - Vault operations -
+
+		/**
+		 Asynchronous variant of Session::addBiometryFactor().
+		 */
+		AsyncOperation addBiometryFactor(const std::string & c_vault_key, const SignatureUnlockKeys & keys,
+										 AsyncCompletion<AsyncNoValue> completion);
+
+		/**
+		 Asynchronous variant of Session::deriveCryptographicKeyFromVaultKey().
+		 */
+		AsyncOperation deriveCryptographicKeyFromVaultKey(const std::string & c_vault_key, const SignatureUnlockKeys & keys,
+														  cc7::U64 key_index, AsyncCompletion<cc7::ByteArray> completion);
+
+		/**
+		 Asynchronous variant of Session::signDataWithDevicePrivateKey().
+		 */
+		AsyncOperation signDataWithDevicePrivateKey(const std::string & c_vault_key, const SignatureUnlockKeys & keys,
+													const cc7::ByteRange & data, AsyncCompletion<cc7::ByteArray> completion);
+
+		/**
+		 Asynchronous variant of Session::getActivationRecoveryData().
+		 */
+		AsyncOperation getActivationRecoveryData(const std::string & c_vault_key, const SignatureUnlockKeys & keys,
+												 AsyncCompletion<RecoveryData> completion);
+
+		// MARK: - ECIES -
+
+		/**
+		 Constructs ECIES encryptor for |scope| and encrypts request |data|. The operation has
+		 two phases, the encryptor construction (see Session::getEciesEncryptor()) and the
+		 request encryption (see ECIESEncryptor::encryptRequest()).
+		 */
+		AsyncOperation eciesEncryptRequest(ECIESEncryptorScope scope, const SignatureUnlockKeys & keys,
+										   const cc7::ByteRange & shared_info1, const cc7::ByteRange & data,
+										   AsyncCompletion<ECIESEncryptedRequest> completion);
+
+		/**
+		 Decrypts response |cryptogram| with |encryptor| used for the request encryption.
+		 See ECIESEncryptor::decryptResponse().
+		 */
+		AsyncOperation eciesDecryptResponse(const ECIESEncryptor & encryptor, const ECIESCryptogram & cryptogram,
+											AsyncCompletion<cc7::ByteArray> completion);
+
+	private:
+
+		/**
+		 Session used for all operations.
+		 */
+		Session & _session;
+
+		/**
+		 Executor used for all operations.
+		 */
+		Executor & _executor;
+	};
+
+} // io::getlime::powerAuth
+} // io::getlime
+} // io
@@ -17,6 +17,7 @@
 #pragma once
 
 #include <PowerAuth/PublicTypes.h>
+#include <chrono>
 
 /*
  The ECIES.h header file contains a set of interfaces prepared for ECIES data
@@ -134,6 +135,13 @@ namespace getlime
 {
 namespace powerAuth
 {
+	// Forward declarations of internal cryptographic objects
+	namespace crypto
+	{
+		struct AESDecryptionKey;
+		class HMAC_SHA256_Context;
+	}
+	
 	/// The ECIESCryptogram structure represents cryptogram transmitted
 	/// over the network.
 	struct ECIESCryptogram
@@ -148,6 +156,37 @@ namespace powerAuth
 		cc7::ByteArray	body;
 	};
 	
+	/// Returns number of bytes required for JSON representation of |cryptogram|. The JSON object contains
+	/// Base64 encoded "ephemeralPublicKey", "encryptedData" and "mac" properties. The "ephemeralPublicKey"
+	/// property is present only if cryptogram's key is not empty (e.g. for request cryptogram).
+	size_t ECIESCryptogram_JSONSize(const ECIESCryptogram & cryptogram);
+	
+	/// Serializes |cryptogram| into JSON object, encoded in UTF-8, and stores the result into |out_buffer|,
+	/// which has capacity for |buffer_size| bytes. The number of written bytes is stored into |out_size|.
+	/// The function doesn't allocate memory and doesn't append the null terminator.
+	///
+	/// Returns
+	///		EC_Ok 			- when everything's OK and buffer contains JSON object
+	///		EC_WrongParam	- if buffer is too small. In this case, |out_size| contains required size.
+	ErrorCode ECIESCryptogram_EncodeJSON(const ECIESCryptogram & cryptogram, cc7::byte * out_buffer, size_t buffer_size, size_t & out_size);
+	
+	/// Serializes |cryptogram| into JSON object and stores the result into |out_json|. If the array has
+	/// enough capacity, then no memory is allocated.
+	///
+	/// Returns
+	///		EC_Ok 			- when everything's OK and |out_json| contains JSON object
+	ErrorCode ECIESCryptogram_EncodeJSON(const ECIESCryptogram & cryptogram, cc7::ByteArray & out_json);
+	
+	/// Parses |json| object, encoded in UTF-8, and stores decoded "ephemeralPublicKey", "encryptedData" and "mac"
+	/// properties into |out_cryptogram|. The missing or null property produces an empty array and unknown properties
+	/// with simple values are ignored. If cryptogram's arrays have enough capacity, then no memory is allocated.
+	///
+	/// Returns
+	///		EC_Ok 			- when everything's OK and |out_cryptogram| contains decoded data
+	///		EC_WrongParam	- if |json| is not a valid JSON object, or if some property is not a valid Base64 string
+	ErrorCode ECIESCryptogram_DecodeJSON(const cc7::ByteRange & json, ECIESCryptogram & out_cryptogram);
+	
+	
 	/// The ECIESEnvelopeKey represents a temporary key for ECIES encryption and decryption
 	/// process. The key is derived from shared secret, produced in ECDH key agreement.
 	class ECIESEnvelopeKey {
@@ -270,6 +309,93 @@ namespace powerAuth
 	};
 	
 	
+	/// The ECIESRetryContext class allows you to retry an idempotent request without repeating the whole
+	/// request encryption. The context keeps the envelope key, prepared AES and HMAC key states and the
+	/// request cryptogram, so re-sending the same cryptogram, or decrypting a re-fetched response, costs
+	/// no EC operation. The context is opt-in and it's valid only for a limited time and for a limited
+	/// number of attempts. The request re-sends and the response decryption attempts have separate budgets,
+	/// so the response to a re-sent request can always be decrypted. The context is invalidated once
+	/// the response is successfully decrypted, or when the last decryption attempt fails.
+	///
+	/// The class is not thread safe and it's not copyable.
+	class ECIESRetryContext
+	{
+	public:
+		
+		/// Constructs an invalid context.
+		ECIESRetryContext();
+		
+		/// Constructs a context from |encryptor|, which has just produced |request_cryptogram| in encryptRequest().
+		/// The context is valid for |validity| period and allows |max_attempts| request re-sends and |max_attempts|
+		/// response decryption attempts. If the encryptor has no valid envelope key, then the constructed context
+		/// is invalid.
+		ECIESRetryContext(const ECIESEncryptor & encryptor, const ECIESCryptogram & request_cryptogram,
+						  size_t max_attempts, std::chrono::milliseconds validity);
+		
+		/// Destroys the context and wipes all keys.
+		~ECIESRetryContext();
+		
+		/// Returns true if the context is not expired and has at least one remaining decryption attempt.
+		bool isValid() const;
+		
+		/// Returns number of remaining response decryption attempts, or 0 if the context is no longer valid.
+		size_t remainingAttempts() const;
+		
+		/// Returns number of remaining request re-sends, or 0 if the context is no longer valid.
+		size_t remainingRequests() const;
+		
+		/// Invalidates the context and wipes all keys.
+		void invalidate();
+		
+		/// Returns true if the context still keeps the prepared keys. The keys are wiped once the context
+		/// is invalidated, or when its last decryption attempt fails.
+		bool hasKeys() const;
+		
+		/// Copies request cryptogram, which has to be sent again to the server, to |out_cryptogram|.
+		///
+		/// Returns
+		///		EC_Ok 			- when everything's OK and |out_cryptogram| contains the request cryptogram.
+		///		EC_WrongState	- if the context is no longer valid, or if there's no re-send left
+		ErrorCode requestCryptogram(ECIESCryptogram & out_cryptogram);
+		
+		/// Decrypts a |cryptogram| received from the server and stores the result into |out_data| reference.
+		/// The operation uses prepared key states, so no key derivation is performed.
+		///
+		/// Returns
+		///		EC_Ok 			- when everything's OK and |out_data| contains a valid data.
+		///		EC_WrongState	- if the context is no longer valid
+		///		EC_Encryption	- if MAC doesn't match or if some cryptographic operation did fail
+		ErrorCode decryptResponse(const ECIESCryptogram & cryptogram, cc7::ByteArray & out_data);
+		
+	private:
+		
+		// Not copyable
+		ECIESRetryContext(const ECIESRetryContext &) = delete;
+		ECIESRetryContext & operator=(const ECIESRetryContext &) = delete;
+		
+		/// Returns true if the context is still valid. Otherwise wipes the keys and returns false.
+		bool checkValidity();
+		
+		/// Decrypts a |cryptogram| with the prepared keys and stores the result into |out_data| reference.
+		ErrorCode decryptWithPreparedKeys(const ECIESCryptogram & cryptogram, cc7::ByteArray & out_data);
+		
+		/// Request cryptogram for re-sending.
+		ECIESCryptogram _request;
+		/// Content of shared info2 optional parameter.
+		cc7::ByteArray _shared_info2;
+		/// Prepared AES key schedule for response decryption.
+		crypto::AESDecryptionKey * _dec_key;
+		/// Prepared HMAC state, initialized with the MAC key.
+		crypto::HMAC_SHA256_Context * _mac_key;
+		/// Number of remaining request re-sends.
+		size_t _remaining_requests;
+		/// Number of remaining response decryption attempts.
+		size_t _remaining_attempts;
+		/// Time when the context expires.
+		std::chrono::steady_clock::time_point _expiration;
+	};
+	
+	
 	/// The ECIESDecryptor class implements a request decryption and response encryption for our custom ECIES scheme.
 	/// In most cases, you don't need to use this object in the client software, because a similar implementation is running
 	/// on the server. The PowerAuth library is using this object only for unit testing purposes.
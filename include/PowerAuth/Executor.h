@@ -0,0 +1,158 @@
+/*
+ * Copyright 2019 Wultra s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cc7/Platform.h>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <thread>
+
+namespace io
+{
+namespace getlime
+{
+namespace powerAuth
+{
+	/**
+	 The Executor class is an abstract interface for objects executing tasks
+	 scheduled by asynchronous operations. You can implement your own executor,
+	 for example to dispatch tasks to a platform specific thread pool, or you can
+	 use WorkerPoolExecutor provided by this library.
+	 */
+	class Executor
+	{
+	public:
+
+		virtual ~Executor() {}
+
+		/**
+		 Schedules |task| for execution. The task may be executed on any thread,
+		 but the executor must execute every scheduled task exactly once.
+		 */
+		virtual void execute(std::function<void()> task) = 0;
+	};
+
+
+	/**
+	 The WorkerPoolExecutor class implements Executor with a bounded pool of worker
+	 threads. The threads are created on demand, when there's a pending task and
+	 no idle worker, up to the maximum number of threads. Tasks are executed in
+	 the order in which they were scheduled.
+	 */
+	class WorkerPoolExecutor : public Executor
+	{
+	public:
+
+		/**
+		 Constructs a pool with at most |max_threads| worker threads. If the value is 0,
+		 then the number of threads is equal to number of CPU cores.
+		 */
+		explicit WorkerPoolExecutor(size_t max_threads = 0);
+
+		/**
+		 Destructs the pool. The destructor blocks until all scheduled tasks are finished.
+		 */
+		~WorkerPoolExecutor();
+
+		WorkerPoolExecutor(const WorkerPoolExecutor &) = delete;
+		WorkerPoolExecutor & operator=(const WorkerPoolExecutor &) = delete;
+
+		/**
+		 Returns maximum number of worker threads.
+		 */
+		size_t maxThreads() const;
+
+		/**
+		 Blocks until all scheduled tasks are finished.
+		 */
+		void waitUntilIdle();
+
+		// Executor interface
+
+		void execute(std::function<void()> task) override;
+
+	private:
+
+		/**
+		 Main loop of worker thread.
+		 */
+		void workerLoop();
+
+		std::mutex								_lock;
+		std::condition_variable					_task_available;
+		std::condition_variable					_idle;
+		std::deque<std::function<void()>>		_tasks;
+		std::vector<std::thread>				_threads;
+		size_t									_max_threads;
+		size_t									_idle_threads;
+		size_t									_running_tasks;
+		bool									_stop;
+	};
+
+
+	/**
+	 The AsyncOperation class represents an operation scheduled for asynchronous
+	 execution. You can use it to cancel the operation. The object can be freely
+	 copied and all copies refer to the same operation.
+	 */
+	class AsyncOperation
+	{
+	public:
+
+		/**
+		 Constructs a new, not cancelled operation.
+		 */
+		AsyncOperation();
+
+		/**
+		 Requests cancellation of the operation. The cancellation is honored only
+		 before the operation starts, or between its phases. If the operation is
+		 already finished, then the request has no effect. If its last phase is
+		 already running, then the operation reports its real result, marked
+		 as cancelled.
+		 */
+		void cancel();
+
+		/**
+		 Returns true if the cancellation was requested.
+		 */
+		bool isCancelled() const;
+
+	private:
+
+		std::shared_ptr<std::atomic<bool>> _cancelled;
+	};
+	
+	
+	/**
+	 Splits range of indexes from 0 to |count| into chunks and executes |task| for each
+	 chunk on |executor|. The |task| receives the beginning and the end of the chunk.
+	 If |chunk_size| is 0, then the size is calculated from the number of CPU cores.
+	 The function blocks until all chunks are processed, so it must not be called from
+	 the thread owned by the same executor.
+	 */
+	void ExecuteParallel(Executor & executor, size_t count, size_t chunk_size,
+						 const std::function<void(size_t begin, size_t end)> & task);
+
+} // io::getlime::powerAuth
+} // io::getlime
+} // io
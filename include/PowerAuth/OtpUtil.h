@@ -17,6 +17,8 @@
 #pragma once
 
 #include <cc7/Platform.h>
+#include <cc7/ByteRange.h>
+#include <vector>
 
 namespace io
 {
@@ -110,6 +112,25 @@ namespace powerAuth
 		 */
 		static bool validateActivationCode(const std::string & activation_code);
 		
+		/**
+		 Validates |count| activation codes from |codes| array at once. If |out_results| is not null, then it must point
+		 to an array with capacity for at least |count| elements and the result of validation for each code is stored
+		 to this array. The method is useful for bulk validation of imported codes.
+		 
+		 The |max_threads| parameter limits number of threads used for the validation. If 0 is provided, then
+		 the number of threads is equal to number of available CPU cores. Note that the additional threads are
+		 created only for large batches, where the cost of thread creation is negligible.
+		 
+		 Returns number of valid codes.
+		 */
+		static size_t validateActivationCodes(const std::string * codes, size_t count, bool * out_results = nullptr, size_t max_threads = 1);
+		
+		/**
+		 Validates all activation codes from |codes| vector at once. Check `validateActivationCodes(codes, count, ...)`
+		 for details.
+		 */
+		static size_t validateActivationCodes(const std::vector<std::string> & codes, bool * out_results = nullptr, size_t max_threads = 1);
+		
 		/**
 		 Returns true if |signature| contains a valid Base64 string.
 		 */
@@ -128,6 +149,41 @@ namespace powerAuth
 		 as a valid PUK.
 		 */
 		static bool validateRecoveryPuk(const std::string & recovery_puk);
+		
+		
+		// Generators
+		
+		/**
+		 Generates |count| activation codes and stores them to |out_codes| vector. The method is the counterpart
+		 of the validation methods and is intended for testing purposes, for example, to prepare data for load tests.
+		 
+		 The generated codes are deterministic. The code at position N is derived only from the |seed| and
+		 (|first_index| + N) values, so the same code is produced regardless of how you split the generation
+		 into batches. Note that the codes must not be used in production, because they are predictable.
+		 
+		 If |master_private_key| is not empty, then it must contain a private key for the master server public key,
+		 in the same format as produced by ECC_ExportPrivateKey() function. In this case, each code is also
+		 signed in the format accepted by the activation process. Unlike the codes, the ECDSA signatures are
+		 randomized, so they're different in each run.
+		 
+		 The |max_threads| parameter limits number of threads used for the generation. If 0 is provided, then
+		 the number of threads is equal to number of available CPU cores.
+		 
+		 Returns false if the |master_private_key| cannot be imported, or if some signature calculation failed.
+		 */
+		static bool generateActivationCodes(cc7::U64 seed, cc7::U64 first_index, size_t count,
+											const cc7::ByteRange & master_private_key,
+											std::vector<OtpComponents> & out_codes,
+											size_t max_threads = 1);
+		
+		/**
+		 Generates |count| recovery codes and stores them to |out_codes| vector. If |add_r_prefix| is true, then
+		 each code starts with "R:" prefix, like the code scanned from QR code. The codes are generated in the same
+		 way as codes produced by `generateActivationCodes()` method, so check its documentation for details.
+		 */
+		static void generateRecoveryCodes(cc7::U64 seed, cc7::U64 first_index, size_t count, bool add_r_prefix,
+										  std::vector<std::string> & out_codes,
+										  size_t max_threads = 1);
 	};
 	
 } // io::getlime::powerAuth
@@ -17,6 +17,9 @@
 #pragma once
 
 #include <cc7/ByteArray.h>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
 
 namespace io
 {
@@ -24,6 +27,9 @@ namespace getlime
 {
 namespace powerAuth
 {
+	class Executor;
+	class PasswordKeyDerivation;
+	
 	/**
 	 The Password class implements simple class for wrapping
 	 and manipulating with an user's passphrase. 
@@ -32,6 +38,15 @@ namespace powerAuth
 	 C++ implementation supports both mutable and immutable passphrases.
 	 The immutability depends only on how the object was initialized
 	 for the last time.
+	 
+	 The passphrase is stored in a secure memory, which is locked in RAM
+	 and wiped when it's no longer needed. The passphrase is never copied
+	 out of the secure memory, so all accessors return a range of bytes,
+	 pointing directly to the storage. The mutable passphrase is kept in
+	 a gap buffer, so inserting or removing characters at the last
+	 edited position is O(1) and no copy of passphrase is left in the
+	 released memory. The contiguous passphrase is materialized in place,
+	 on demand, when it's requested by passwordRange().
 	 */
 	class Password
 	{
@@ -48,6 +63,12 @@ namespace powerAuth
 		 */
 		~Password();
 		
+		/**
+		 Password object cannot be copied.
+		 */
+		Password(const Password &) = delete;
+		Password & operator=(const Password &) = delete;
+		
 		/**
 		 Initializes object for immutable password data.
 		 The existing password is replaced with content of data.
@@ -75,9 +96,21 @@ namespace powerAuth
 		size_t length() const;
 		
 		/**
-		 Returns reference to plaintext password data.
+		 Returns byte range with plaintext password data. The method
+		 is equal to passwordRange().
+		 */
+		cc7::ByteRange passwordData() const;
+		
+		/**
+		 Returns byte range with plaintext password data, pointing directly
+		 to the secure storage. The range is valid until the password is
+		 modified or destroyed. For mutable password, the first call after
+		 the modification joins the content of the gap buffer in place.
+		 The join is synchronized, so it's safe to call the method from
+		 multiple threads, as long as the password is not modified at
+		 the same time.
 		 */
-		const cc7::ByteArray & passwordData() const;
+		cc7::ByteRange passwordRange() const;
 		
 		/**
 		 Returns true when both objects contains equal passphrase.
@@ -121,37 +154,152 @@ namespace powerAuth
 		 */
 		bool removeCharacter(size_t index);
 		
+		
+		// MARK: - Speculative key derivation -
+		
+		/**
+		 Starts derivation of the knowledge unlock key from the current passphrase,
+		 with using PBKDF2 |salt| and |iterations|. The derivation is executed by
+		 |executor|, so you can start it as soon as the user finishes the passphrase
+		 entry and hide the PBKDF2 latency behind the rest of the application's logic.
+		 You typically use Session::startPasswordKeyDerivation(), which provides the session's
+		 salt and iterations count.
+		 
+		 The returned handle can be assigned to SignatureUnlockKeys.userPasswordKey and
+		 is consumed by the first signature key unlock. The handle is invalidated once
+		 the password is modified or destroyed, or when a new derivation is started.
+		 Returns nullptr if password is empty, or if secure memory cannot be allocated.
+		 */
+		std::shared_ptr<PasswordKeyDerivation> startKeyDerivation(const cc7::ByteRange & salt, cc7::U32 iterations, Executor & executor);
+		
 	private:
 		
 		// MARK: - Private section -
 		
-		typedef std::vector<size_t> PosVector;
+		struct Storage;
 		
 		/**
-		 Passphrase
+		 Secure storage with passphrase, nullptr for empty password.
 		 */
-		cc7::ByteArray	_pass;
+		Storage *				_storage;
 		
 		/**
-		 Character positions, valid only for mutable instances.
+		 True if object was initialized as mutable.
 		 */
-		PosVector *		_char_pos;
+		bool					_mutable;
 		
 		/**
-		 In mutable object, converts character index into position to 
-		 _pass array.
+		 Speculative key derivation started for the current passphrase.
 		 */
-		size_t indexToPos(size_t index);
+		std::weak_ptr<PasswordKeyDerivation> _derivation;
 		
 		/**
-		 Updates all offsets in_char_pos array, from begin index
-		 to the end of the vector.
+		 Lock for joining the gap buffer in passwordRange().
 		 */
-		void updateIndexes(size_t begin, ptrdiff_t offset);
+		mutable std::mutex		_join_lock;
+		
+		/**
+		 Releases secure storage and invalidates speculative key derivation.
+		 */
+		void releaseStorage();
+		
+		/**
+		 Invalidates speculative key derivation started for the passphrase.
+		 */
+		void invalidatePasswordData();
 		
 	};
 	
 	
+	/**
+	 The PasswordKeyDerivation class is a one-shot handle to the knowledge unlock
+	 key, speculatively derived from the password in background. You can get the
+	 handle from Password::startKeyDerivation(). The copy of passphrase and the
+	 derived key are kept in a secure memory and wiped once the handle is consumed,
+	 invalidated or destroyed.
+	 */
+	class PasswordKeyDerivation
+	{
+	public:
+		
+		/**
+		 Destructs handle and wipes its secure memory.
+		 */
+		~PasswordKeyDerivation();
+		
+		PasswordKeyDerivation(const PasswordKeyDerivation &) = delete;
+		PasswordKeyDerivation & operator=(const PasswordKeyDerivation &) = delete;
+		
+		/**
+		 Returns true if the handle was not consumed or invalidated yet.
+		 */
+		bool isValid() const;
+		
+		/**
+		 Returns true if the key derivation is finished and the key is ready for use.
+		 */
+		bool isFinished() const;
+		
+		/**
+		 Invalidates the handle and wipes its secure memory. If the derivation is just
+		 running, then the memory is wiped once the derivation is finished.
+		 */
+		void invalidate();
+		
+		/**
+		 Consumes the handle. If the derivation was started for the same |password|,
+		 |salt| and |iterations|, then stores the derived key to |out_key| and returns
+		 true. If the derivation is still running, then waits for its completion.
+		 If the derivation was not started yet, or if the parameters don't match, then
+		 returns false and you have to derive the key on your own. The handle is always
+		 invalidated after this call.
+		 */
+		bool consumeDerivedKey(const cc7::ByteRange & password, const cc7::ByteRange & salt, cc7::U32 iterations,
+							   cc7::ByteArray & out_key);
+		
+	private:
+		
+		friend class Password;
+		
+		enum State
+		{
+			Pending,
+			Running,
+			Finished,
+			Invalid
+		};
+		
+		/**
+		 Private constructor, the object is created by Password::startKeyDerivation().
+		 */
+		PasswordKeyDerivation();
+		
+		/**
+		 Allocates secure memory and copies |password|, |salt| and |iterations| to
+		 the object. Returns false if memory cannot be allocated.
+		 */
+		bool init(const cc7::ByteRange & password, const cc7::ByteRange & salt, cc7::U32 iterations);
+		
+		/**
+		 Derives the key. The method is called from the executor's thread.
+		 */
+		void derive();
+		
+		/**
+		 Wipes and releases the secure memory. The lock must be acquired.
+		 */
+		void releaseMemory();
+		
+		mutable std::mutex		_lock;
+		std::condition_variable	_finished;
+		State					_state;
+		bool					_discard;
+		cc7::byte *				_memory;
+		size_t					_memory_size;
+		size_t					_password_size;
+		cc7::ByteArray			_salt;
+		cc7::U32				_iterations;
+	};
 	
 
 	
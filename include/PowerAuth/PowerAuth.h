@@ -22,5 +22,10 @@
  */
 
 #include <PowerAuth/Session.h>
+#include <PowerAuth/VaultSession.h>
+#include <PowerAuth/SignatureCounterReservation.h>
+#include <PowerAuth/AsyncSession.h>
+#include <PowerAuth/SessionStateMigrator.h>
+#include <PowerAuth/SessionStateBundle.h>
 #include <PowerAuth/ECIES.h>
 #include <PowerAuth/Debug.h>
@@ -17,6 +17,8 @@
 #pragma once
 
 #include <cc7/ByteArray.h>
+#include <functional>
+#include <memory>
 
 namespace io
 {
@@ -190,6 +192,9 @@ namespace powerAuth
 	 */
 	const SignatureFactor SF_Possession_Knowledge_Biometry	= SF_Possession | SF_Knowledge | SF_Biometry;
 	
+	// Forward declaration, see Password.h
+	class PasswordKeyDerivation;
+	
 	/**
 	 The SignatureUnlockKeys object contains all keys, required for signature computation.
 	 You have to provide all keys involved into the signature computation, for selected combination
@@ -249,6 +254,27 @@ namespace powerAuth
 		 Constants.h and MINIMAL_PASSWORD_LENGTH constant for details)
 		 */
 		cc7::ByteArray userPassword;
+		/**
+		 Optional password provided as a range of bytes, typically pointing directly
+		 to the secure storage of Password object. If the range is not empty, then it's
+		 used instead of userPassword, so the passphrase doesn't need to be copied to
+		 the heap. The range must stay valid until the operation with keys is finished.
+		 */
+		cc7::ByteRange userPasswordRange;
+		/**
+		 Optional handle to the knowledge unlock key, speculatively derived from
+		 the userPassword in background. If the handle was created for the same
+		 password and session's PBKDF2 parameters, then the key is used instead
+		 of a new PBKDF2 derivation. The handle is consumed by the first unlock.
+		 See Password::startKeyDerivation() for details.
+		 */
+		std::shared_ptr<PasswordKeyDerivation> userPasswordKey;
+		
+		/**
+		 Returns password for "knowledge" factor, provided either in userPasswordRange,
+		 or in userPassword.
+		 */
+		cc7::ByteRange password() const;
 	};
 	
 	
@@ -313,6 +339,82 @@ namespace powerAuth
 		bool isOfflineRequest() const;
 	};
 	
+	/**
+	 The HTTPRequestDataView structure is a non-owning variant of HTTPRequestData. All members
+	 only refer to memory owned by the caller, so the body, which may be very large, doesn't
+	 need to be copied before the signature calculation. The referenced memory must remain
+	 valid while the view is in use.
+	 */
+	struct HTTPRequestDataView
+	{
+		/**
+		 A whole POST body or data blob. See HTTPRequestData::body for details.
+		 */
+		cc7::ByteRange body;
+		/**
+		 HTTP method ("POST", "GET", "HEAD", "PUT", "DELETE" value is expected)
+		 */
+		cc7::ByteRange method;
+		/**
+		 Relative URI of the request.
+		 */
+		cc7::ByteRange uri;
+		/**
+		 Optional, contains NONCE generated externally, in Base64 format. The value should
+		 be used for offline data signing purposes only.
+		 */
+		cc7::ByteRange offlineNonce;
+		
+		/**
+		 Constructs an empty HTTPRequestDataView structure.
+		 */
+		HTTPRequestDataView();
+		
+		/**
+		 Constructs a view referring to all members of |data| structure.
+		 */
+		HTTPRequestDataView(const HTTPRequestData & data);
+		
+		/**
+		 Constructs a HTTPRequestDataView structure with provided |body|, |method|, |uri|
+		 and optional |nonce| parameters.
+		 */
+		HTTPRequestDataView(const cc7::ByteRange & body,
+							const cc7::ByteRange & method,
+							const cc7::ByteRange & uri,
+							const cc7::ByteRange & nonce = cc7::ByteRange());
+		
+		/**
+		 Returns true when structure contains valid data.
+		 */
+		bool hasValidData() const;
+		
+		/**
+		 Returns true when this signature calculation request is for offline
+		 signature. This is exclusively affected by the offlineNonce property.
+		 */
+		bool isOfflineRequest() const;
+	};
+	
+	/**
+	 The HTTPRequestBodyStream is a function which provides a body of HTTP request in chunks.
+	 It's useful for signing large bodies, which you don't want to keep in the memory at once.
+	 
+	 The function has to copy up to |capacity| bytes of the body into |buffer| and store the
+	 number of copied bytes into |out_size|. Zero stored to |out_size| means that there are no
+	 more data available. The function should return false in case of failure. In this case,
+	 the whole operation which reads the stream also fails.
+	 */
+	typedef std::function<bool (cc7::byte * buffer, size_t capacity, size_t & out_size)> HTTPRequestBodyStream;
+	
+	/**
+	 Returns HTTPRequestBodyStream which reads data from given file descriptor, from its
+	 current position to the end of the file. The returned function doesn't close the descriptor,
+	 so you have to keep |fd| open until the stream is completely consumed and then close
+	 it on your own.
+	 */
+	HTTPRequestBodyStream HTTPRequestBodyStreamFromFileDescriptor(int fd);
+	
 	/**
 	 The HTTPRequestDataSignature structure contains result from HTTP request data signing
 	 operation.
@@ -350,6 +452,49 @@ namespace powerAuth
 		std::string buildAuthHeaderValue() const;
 	};
 	
+	/**
+	 The HTTPAuthHeaderView structure contains components of "X-PowerAuth-Authorization"
+	 header value, parsed by the parse() method. All components are ranges pointing to the
+	 parsed value, so no data is copied, but the value must be valid for the whole lifetime
+	 of the view. The structure is useful for tests, or for a server simulation.
+	 */
+	struct HTTPAuthHeaderView
+	{
+		/**
+		 Version of PowerAuth protocol.
+		 */
+		cc7::ByteRange version;
+		/**
+		 Activation identifier.
+		 */
+		cc7::ByteRange activationId;
+		/**
+		 Application key.
+		 */
+		cc7::ByteRange applicationKey;
+		/**
+		 NONCE used for the signature calculation, in Base64 format.
+		 */
+		cc7::ByteRange nonce;
+		/**
+		 String representation of signature factor or combination of factors.
+		 */
+		cc7::ByteRange factor;
+		/**
+		 Calculated signature.
+		 */
+		cc7::ByteRange signature;
+		
+		/**
+		 Parses |header_value| in the format produced by HTTPRequestDataSignature::buildAuthHeaderValue()
+		 or by Session::signHTTPRequestDataToHeader().
+		 
+		 Returns EC_Ok, if the value has been parsed, or EC_WrongParam if the value is not valid.
+		 In case of failure, all components are cleared.
+		 */
+		ErrorCode parse(const cc7::ByteRange & header_value);
+	};
+	
 	/**
 	 The SignedData structure contains data and signature calculated from data.
 	 */
@@ -389,6 +534,49 @@ namespace powerAuth
 		}
 	};
 	
+	/**
+	 The SignedDataView structure is a non-owning variant of SignedData. The data and
+	 the signature refer to memory owned by the caller, which must remain valid while
+	 the view is in use.
+	 */
+	struct SignedDataView
+	{
+		/**
+		 A key type used for signature calculation.
+		 */
+		SignedData::SigningKey signingKey;
+		/**
+		 An arbitrary data
+		 */
+		cc7::ByteRange data;
+		/**
+		 A signature calculated for data
+		 */
+		cc7::ByteRange signature;
+		
+		/**
+		 Constructs a view with provided |data| and |signature|.
+		 */
+		SignedDataView(const cc7::ByteRange & data = cc7::ByteRange(),
+					   const cc7::ByteRange & signature = cc7::ByteRange(),
+					   SignedData::SigningKey signingKey = SignedData::ECDSA_MasterServerKey) :
+			signingKey(signingKey),
+			data(data),
+			signature(signature)
+		{
+		}
+		
+		/**
+		 Constructs a view referring to all members of |signed_data| structure.
+		 */
+		SignedDataView(const SignedData & signed_data) :
+			signingKey(signed_data.signingKey),
+			data(signed_data.data),
+			signature(signed_data.signature)
+		{
+		}
+	};
+	
 	
 	//
 	// MARK: - Recovery Codes -
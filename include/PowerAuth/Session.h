@@ -17,8 +17,13 @@
 #pragma once
 
 #include <PowerAuth/PublicTypes.h>
+#include <PowerAuth/Password.h>
+#include <PowerAuth/VaultSession.h>
+#include <PowerAuth/SignatureCounterReservation.h>
 #include <map>
 #include <mutex>
+#include <vector>
+#include <iterator>
 
 namespace io
 {
@@ -39,6 +44,10 @@ namespace powerAuth
 		struct PersistentData;
 		struct ActivationData;
 	}
+	namespace crypto
+	{
+		struct AESDecryptionKey;
+	}
 	
 	/**
 	 The Session class provides all cryptographic operations defined in PowerAuth2
@@ -242,10 +251,55 @@ namespace powerAuth
 		 Compatibility note
 		 
 		 This interface doesn't support multiple values for the same key. This is a known limitation, due to fact, that
-		 std::map<> doesn't allow duplicit keys. The arrays in GET requests are so rare that I've decided to do not support
-		 them. You can still implement your own data normalization, if this is your situation.
+		 std::map<> doesn't allow duplicit keys. If you need to sign array parameters, then use
+		 'prepareKeyValuePairsForDataSigning' method instead.
 		 */
 		static cc7::ByteArray prepareKeyValueMapForDataSigning(const std::map<std::string, std::string> & key_value_map);
+		
+		/**
+		 Converts range of key-value pairs, defined by |begin| and |end| iterators, into normalized data, suitable
+		 for data signing. The method works like 'prepareKeyValueMapForDataSigning', but accepts any forward range
+		 of pairs with std::string members, like std::multimap, std::vector of std::pair, or a plain array.
+		 Multiple values for the same key are supported, so you can sign also array parameters of GET request.
+		 
+		 The pairs are sorted by key only if the range is not sorted yet. The sort is stable, so values for
+		 the same key keep their original order in the normalized data.
+		 */
+		template <typename Iterator>
+		static cc7::ByteArray prepareKeyValuePairsForDataSigning(Iterator begin, Iterator end)
+		{
+			std::vector<KeyValueRef> pairs;
+			pairs.reserve(std::distance(begin, end));
+			for (; begin != end; ++begin) {
+				pairs.push_back(KeyValueRef(&begin->first, &begin->second));
+			}
+			return prepareKeyValueRefsForDataSigning(pairs);
+		}
+		
+		/**
+		 Converts all key-value pairs from |container| into normalized data, suitable for data signing.
+		 Check 'prepareKeyValuePairsForDataSigning(begin, end)' for details.
+		 */
+		template <typename Container>
+		static cc7::ByteArray prepareKeyValuePairsForDataSigning(const Container & container)
+		{
+			return prepareKeyValuePairsForDataSigning(std::begin(container), std::end(container));
+		}
+		
+	private:
+		
+		/**
+		 Pair of pointers to key and value strings.
+		 */
+		typedef std::pair<const std::string *, const std::string *> KeyValueRef;
+		
+		/**
+		 Common implementation for 'prepareKeyValuePairsForDataSigning' variants. The content of
+		 |pairs| vector is sorted by key, if it's not sorted yet.
+		 */
+		static cc7::ByteArray prepareKeyValueRefsForDataSigning(std::vector<KeyValueRef> & pairs);
+		
+	public:
 
 		/**
 		 Calculates signature from given |request_data| structure. You have to provide all involved unlock keys
@@ -272,6 +326,112 @@ namespace powerAuth
 									  const SignatureUnlockKeys & keys, SignatureFactor signature_factor,
 									  HTTPRequestDataSignature & out_signature);
 		
+		/**
+		 Calculates signature from given |request_data| view, exactly like 'signHTTPRequestData' with
+		 HTTPRequestData structure. The body, method, uri and nonce are referenced by the view, so you don't
+		 need to copy a large body into HTTPRequestData before the signature is calculated.
+		 
+		 WARNING
+		 
+		 You have to save session's state after the successful operation, due to internal counter change.
+		 
+		 Returns EC_Ok,         if operation succeeded
+				 EC_Encryption, if some cryptographic operation failed
+				 EC_WrongState, if the session has no valid activation
+				 EC_WrongParam, if some required parameter is missing
+		 */
+		ErrorCode signHTTPRequestData(const HTTPRequestDataView & request_data,
+									  const SignatureUnlockKeys & keys, SignatureFactor signature_factor,
+									  HTTPRequestDataSignature & out_signature);
+		
+		/**
+		 Calculates signature from given |request_data| structure and from the body provided by |body_stream|.
+		 The method works exactly like 'signHTTPRequestData', but the body is read from the stream in chunks and
+		 is never kept in the memory at once. This is useful for signing large requests, for example, when the body
+		 is stored in a file (see HTTPRequestBodyStreamFromFileDescriptor() function). The |request_data.body|
+		 member must be empty.
+		 
+		 The produced signature is equal to the signature calculated by 'signHTTPRequestData' for the same body.
+		 
+		 WARNING
+		 
+		 You have to save session's state after the successful operation, due to internal counter change.
+		 
+		 Returns EC_Ok,         if operation succeeded
+				 EC_Encryption, if some cryptographic operation failed, or if the stream reported failure
+				 EC_WrongState, if the session has no valid activation
+				 EC_WrongParam, if some required parameter is missing
+		 */
+		ErrorCode signHTTPRequestStream(const HTTPRequestData & request_data,
+										const HTTPRequestBodyStream & body_stream,
+										const SignatureUnlockKeys & keys, SignatureFactor signature_factor,
+										HTTPRequestDataSignature & out_signature);
+		
+		/**
+		 Calculates signature from given |request_data| structure, exactly like 'signHTTPRequestData', but
+		 stores the final value for X-PowerAuth-Authorization header to |out_header_value|. The value is
+		 written into one buffer with precalculated size and the nonce and the signature are written directly
+		 into that buffer. So, there's at most one allocation of the output string, or no allocation at all,
+		 if the string already has enough capacity. You can use HTTPAuthHeaderView to access components
+		 of the produced value.
+		 
+		 WARNING
+		 
+		 You have to save session's state after the successful operation, due to internal counter change.
+		 
+		 Returns EC_Ok,         if operation succeeded
+				 EC_Encryption, if some cryptographic operation failed
+				 EC_WrongState, if the session has no valid activation
+				 EC_WrongParam, if some required parameter is missing
+		 */
+		ErrorCode signHTTPRequestDataToHeader(const HTTPRequestData & request_data,
+											  const SignatureUnlockKeys & keys, SignatureFactor signature_factor,
+											  std::string & out_header_value);
+		
+		/**
+		 Works exactly like 'signHTTPRequestDataToHeader' with HTTPRequestData structure, but the request
+		 data is referenced by |request_data| view.
+		 */
+		ErrorCode signHTTPRequestDataToHeader(const HTTPRequestDataView & request_data,
+											  const SignatureUnlockKeys & keys, SignatureFactor signature_factor,
+											  std::string & out_header_value);
+		
+		/**
+		 Reserves a block of |count| consecutive signature counter values for |signature_factor|. You have to
+		 provide all involved unlock keys in |keys| structure, like for 'signHTTPRequestData'. The keys are
+		 unlocked and the counter values are calculated in one short operation, and the session's counter is
+		 moved behind the end of the block. The signatures for the reserved values can be then calculated
+		 with |out_reservation| in parallel, on multiple threads. The previous content of |out_reservation|
+		 is always cleared.
+		 
+		 WARNING
+		 
+		 You have to save session's state after the successful operation, due to internal counter change.
+		 
+		 Returns EC_Ok,         if operation succeeded
+				 EC_Encryption, if some cryptographic operation failed
+				 EC_WrongState, if the session has no valid activation
+				 EC_WrongParam, if some required parameter is missing, or if |count| is 0 or too big
+		 */
+		ErrorCode reserveSignatureCounters(size_t count, const SignatureUnlockKeys & keys, SignatureFactor signature_factor,
+										   SignatureCounterReservation & out_reservation);
+		
+	private:
+		
+		/**
+		 Common implementation for all 'signHTTPRequest*' variants. If |body_stream| is nullptr, then
+		 the |request_data.body| is signed. The result is stored either to |out_header_value|, as the value
+		 for X-PowerAuth-Authorization header, or to |out_signature| structure. Only one of these two
+		 parameters can be provided.
+		 */
+		ErrorCode signHTTPRequestImpl(const HTTPRequestDataView & request_data,
+									  const HTTPRequestBodyStream * body_stream,
+									  const SignatureUnlockKeys & keys, SignatureFactor signature_factor,
+									  std::string * out_header_value,
+									  HTTPRequestDataSignature * out_signature);
+		
+	public:
+		
 		/**
 		 Returns name of authorization header. The value is constant and is equal to "X-PowerAuth-Authorization".
 		 You can calculate appropriate value with using signHTTPRequest() method.
@@ -287,6 +447,12 @@ namespace powerAuth
 				 EC_WrongParam	if data structure doesn't contain signature
 		 */
 		ErrorCode verifyServerSignedData(const SignedData & data) const;
+		
+		/**
+		 Validates whether the data has been signed with master server private key, exactly like
+		 the previous method, but the data and the signature are referenced by |data| view.
+		 */
+		ErrorCode verifyServerSignedData(const SignedDataView & data) const;
 
 		
 		// MARK: - Signature keys management -
@@ -320,6 +486,20 @@ namespace powerAuth
 		 */
 		ErrorCode changeUserPassword(const cc7::ByteRange & old_password, const cc7::ByteRange & new_password);
 		
+		/**
+		 Starts speculative derivation of the knowledge unlock key from |password|, with using
+		 the session's PBKDF2 salt and iterations count. The derivation is executed by |executor|
+		 and the handle is stored to |out_derivation|. You can call this method as soon as the user
+		 finishes the password entry and then assign the handle to SignatureUnlockKeys.userPasswordKey
+		 for the subsequent operation. See Password::startKeyDerivation() for details.
+		 
+		 Returns EC_Ok,         if operation succeeded
+				 EC_WrongState, if the session has no valid activation
+				 EC_WrongParam, if password is empty
+		 */
+		ErrorCode startPasswordKeyDerivation(Password & password, Executor & executor,
+											 std::shared_ptr<PasswordKeyDerivation> & out_derivation) const;
+		
 		/**
 		 Adds a key for biometry factor. You have to provide encrypted vault key |c_vault_key| and
 		 |keys| structure where the valid possessionUnlockKey is set. The |keys| structure also must
@@ -397,8 +577,25 @@ namespace powerAuth
 		ErrorCode signDataWithDevicePrivateKey(const std::string & c_vault_key, const SignatureUnlockKeys & keys,
 											   const cc7::ByteRange & data, cc7::ByteArray & out_signature);
 		
+		/**
+		 Opens a vault session for a sequence of vault operations. You have to provide encrypted |c_vault_key|
+		 and |keys| structure with a valid possessionUnlockKey. The vault key and the device's private key are
+		 decrypted only once and kept in |out_vault_session| until it's closed, destroyed, or until the session's
+		 state is changed (see VaultSession class for details). The previous content of |out_vault_session| is
+		 always closed.
+		 
+		 Returns EC_Ok,         if operation succeeded
+				 EC_Encryption, if general encryption error occurs
+				 EC_WrongState, if the session has no valid activation
+				 EC_WrongParam, if some required parameter is missing
+		 */
+		ErrorCode openVaultSession(const std::string & c_vault_key, const SignatureUnlockKeys & keys,
+								   VaultSession & out_vault_session);
+		
 	private:
 
+		friend class VaultSession;
+		
 		/**
 		 Decrypts vault key received from the server. The method is private and is used internally for vault
 		 unlocking. The keys.possessionUnlockKey is required.
@@ -406,6 +603,29 @@ namespace powerAuth
 		ErrorCode decryptVaultKey(const std::string & c_vault_key, const SignatureUnlockKeys & keys,
 								  cc7::ByteArray & out_key);
 		
+		/**
+		 Decrypts device's private key with |vault_key| and imports it to a new EC_KEY object,
+		 stored to |out_key|. The caller is responsible for releasing the key.
+		 */
+		ErrorCode importDevicePrivateKey(const cc7::ByteRange & vault_key, struct ec_key_st *& out_key);
+		
+		/**
+		 Common implementation for 'addBiometryFactor', with already unlocked |vault_key|
+		 and |device_private_key|.
+		 */
+		ErrorCode addBiometryFactorImpl(const cc7::ByteRange & vault_key, struct ec_key_st * device_private_key,
+										const SignatureUnlockKeys & keys);
+		
+		/**
+		 Common implementation for 'getActivationRecoveryData', with already unlocked |vault_key|.
+		 */
+		ErrorCode getActivationRecoveryDataImpl(const cc7::ByteRange & vault_key, RecoveryData & out_recovery_data);
+		
+		/**
+		 Invalidates all open vault sessions. The method is called when the persistent data is changed.
+		 */
+		void invalidateVaultSessions();
+		
 	public:
 		
 		// MARK: - External encryption key -
@@ -646,6 +866,47 @@ namespace powerAuth
 		 */
 		protocol::ActivationData * _ad;
 		
+		/**
+		 Prototype of ECIES encryptor for application scope. The object is created
+		 on the first request and stays valid for the whole lifetime of the session.
+		 */
+		mutable ECIESEncryptor * _ecies_app_prototype;
+		
+		/**
+		 Master server public key as uncompressed affine coordinates. The coordinates are calculated
+		 on the first server signature verification and stay valid for the whole lifetime of the session.
+		 */
+		mutable cc7::ByteArray _master_server_public_key_coordinates;
+		
+		/**
+		 Prototype of ECIES encryptor for activation scope. The object is created
+		 on the first request and is released when the session's state or EEK is changed.
+		 */
+		mutable ECIESEncryptor * _ecies_act_prototype;
+		
+		/**
+		 SHA256 of possession key used for unlocking the transport key, when the
+		 activation scoped prototype was created.
+		 */
+		mutable cc7::ByteArray _ecies_act_key_hash;
+		
+		/**
+		 Prepared AES key schedule of transport key, used for the activation status
+		 decryption. The key is released when the session's state or EEK is changed.
+		 */
+		mutable crypto::AESDecryptionKey * _status_key;
+		
+		/**
+		 SHA256 of possession key used for unlocking the transport key, when
+		 the |_status_key| was created.
+		 */
+		mutable cc7::byte _status_key_hash[32];
+		
+		/**
+		 All open vault sessions. The objects are invalidated when the persistent data is changed.
+		 */
+		std::vector<VaultSession*> _vault_sessions;
+		
 		/**
 		 Commits a |new_pd| and |new_state| as a new valid session state.
 		 Check documentation in method's implementation for details.
@@ -663,6 +924,11 @@ namespace powerAuth
 		 */
 		const cc7::ByteArray * eek() const;
 		
+		/**
+		 Releases cached ECIES encryptor and status decryption key for activation scope.
+		 */
+		void resetActivationScopeCache() const;
+		
 	};
 	
 } // io::getlime::powerAuth
@@ -0,0 +1,201 @@
+/*
+ * Copyright 2019 Wultra s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <PowerAuth/Session.h>
+#include <PowerAuth/Executor.h>
+#include <vector>
+
+namespace io
+{
+namespace getlime
+{
+namespace powerAuth
+{
+	/*
+	 Forward declaration for private objects
+	 */
+	namespace utils
+	{
+		class MappedFile;
+	}
+	
+	/**
+	 The SessionStateBundle class implements a binary bundle, which contains serialized
+	 states of many sessions. The bundle starts with an index, where for each session's
+	 identifier there's an offset, length and checksum of the session's state. The states
+	 follow the index. All numbers are stored in big endian byte order:
+	 
+		| 'B' | '1' | count: U32 | index: count * { id: U32 | offset: U32 | length: U32 | crc16: U16 | 0: U16 } | states... |
+	 
+	 The index is sorted by the session's identifier, so it's possible to look for the
+	 state without decoding the whole bundle. The states are not touched until they're
+	 requested, and their checksums are validated on access. The bundle is typically
+	 memory mapped from the file, so restoring a large number of sessions requires mostly
+	 sequential I/O.
+	 */
+	class SessionStateBundle
+	{
+	public:
+		
+		/**
+		 The Record structure represents one session's state in the bundle.
+		 */
+		struct Record
+		{
+			/**
+			 Session's identifier, must be unique in the bundle.
+			 */
+			cc7::U32 sessionIdentifier;
+			/**
+			 Serialized session's state, produced by Session::saveSessionState().
+			 */
+			cc7::ByteRange state;
+			
+			Record(cc7::U32 session_identifier = 0, const cc7::ByteRange & state_data = cc7::ByteRange()) :
+				sessionIdentifier(session_identifier),
+				state(state_data)
+			{
+			}
+		};
+		
+		/**
+		 Constructs an empty bundle.
+		 */
+		SessionStateBundle();
+		
+		/**
+		 Destructs the bundle and unmaps the file.
+		 */
+		~SessionStateBundle();
+		
+		SessionStateBundle(const SessionStateBundle &) = delete;
+		SessionStateBundle & operator=(const SessionStateBundle &) = delete;
+		
+		// MARK: - Export -
+		
+		/**
+		 Builds a bundle from |records| and stores it to |out_bundle|.
+		 
+		 Returns EC_Ok,         if operation succeeded
+				 EC_WrongParam, if the session's identifiers are not unique, or the bundle
+								would be larger than 4GB.
+		 */
+		static ErrorCode build(std::vector<Record> records, cc7::ByteArray & out_bundle);
+		
+		/**
+		 Serializes states of all |sessions| in parallel, on |executor|, and builds a bundle
+		 from them. The result is stored to |out_bundle|.
+		 
+		 Returns EC_Ok,         if operation succeeded
+				 EC_WrongParam, if the session's identifiers are not unique, or the bundle
+								would be larger than 4GB.
+		 */
+		static ErrorCode exportSessions(const std::vector<const Session*> & sessions, Executor & executor, cc7::ByteArray & out_bundle);
+		
+		// MARK: - Import -
+		
+		/**
+		 Maps a bundle file at |path| into the memory and validates its index. The previously
+		 opened bundle is closed.
+		 
+		 Returns EC_Ok,         if operation succeeded
+				 EC_WrongParam, if file cannot be mapped, or the index is invalid.
+		 */
+		ErrorCode open(const std::string & path);
+		
+		/**
+		 Opens bundle from |bundle| range and validates its index. The range must be valid
+		 for the whole lifetime of the object, or until it's closed.
+		 
+		 Returns EC_Ok,         if operation succeeded
+				 EC_WrongParam, if the index is invalid.
+		 */
+		ErrorCode open(const cc7::ByteRange & bundle);
+		
+		/**
+		 Closes the bundle.
+		 */
+		void close();
+		
+		/**
+		 Returns number of session's states in the bundle.
+		 */
+		size_t count() const;
+		
+		/**
+		 Returns session's identifiers stored in the bundle, in ascending order.
+		 */
+		std::vector<cc7::U32> sessionIdentifiers() const;
+		
+		/**
+		 Looks for the state of session with |session_identifier| and validates its checksum.
+		 The range pointing to the bundle's data is stored to |out_state|.
+		 
+		 Returns EC_Ok,         if operation succeeded
+				 EC_WrongParam, if there's no such session, or the checksum doesn't match.
+		 */
+		ErrorCode stateForSession(cc7::U32 session_identifier, cc7::ByteRange & out_state) const;
+		
+		/**
+		 Loads state stored in the bundle for the |session|. The state is identified by
+		 the session's identifier.
+		 
+		 Returns EC_Ok,         if operation succeeded
+				 EC_WrongParam, if there's no such session, or the state is invalid.
+		 */
+		ErrorCode loadSession(Session & session) const;
+		
+		/**
+		 Loads states for all |sessions| in parallel, on |executor|. The result code
+		 at each index corresponds to the session at the same index. See loadSession()
+		 for possible error codes.
+		 */
+		std::vector<ErrorCode> loadSessions(const std::vector<Session*> & sessions, Executor & executor) const;
+		
+	private:
+		
+		/**
+		 Validates index of |bundle| and keeps the range for later use.
+		 */
+		ErrorCode parseIndex(const cc7::ByteRange & bundle);
+		
+		/**
+		 Returns pointer to the index entry for |session_identifier|, or nullptr if
+		 there's no such entry.
+		 */
+		const cc7::byte * findEntry(cc7::U32 session_identifier) const;
+		
+		/**
+		 Mapped file, or nullptr if bundle was opened from the range.
+		 */
+		utils::MappedFile * _file;
+		
+		/**
+		 Content of whole bundle.
+		 */
+		cc7::ByteRange _bundle;
+		
+		/**
+		 Number of entries in the index.
+		 */
+		size_t _count;
+	};
+	
+} // io::getlime::powerAuth
+} // io::getlime
+} // io
@@ -0,0 +1,171 @@
+/*
+ * Copyright 2019 Wultra s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <PowerAuth/PublicTypes.h>
+#include <PowerAuth/Executor.h>
+#include <vector>
+
+namespace io
+{
+namespace getlime
+{
+namespace powerAuth
+{
+	/**
+	 The SessionStateFormat enumeration defines formats of serialized
+	 session's state, produced by various versions of the library.
+	 */
+	enum SessionStateFormat
+	{
+		/**
+		 The format of data is not recognized.
+		 */
+		SSF_Unknown = 0,
+		/**
+		 The state has no activation.
+		 */
+		SSF_Empty,
+		/**
+		 The old data format, produced by the very first versions of the library.
+		 */
+		SSF_Legacy,
+		/**
+		 Persistent data for protocol V2.
+		 */
+		SSF_PD_V2,
+		/**
+		 Persistent data for protocol V3, without recovery data.
+		 */
+		SSF_PD_V3,
+		/**
+		 Persistent data for protocol V3, with recovery data.
+		 */
+		SSF_PD_V4,
+		/**
+		 Persistent data for protocol V3, with recovery data and server's public
+		 key stored also as uncompressed coordinates.
+		 */
+		SSF_PD_V5
+	};
+	
+	/**
+	 The SessionStateMigrationResult structure contains result of migration
+	 of one serialized session's state.
+	 */
+	struct SessionStateMigrationResult
+	{
+		/**
+		 EC_Ok if the state was migrated, or EC_WrongParam if the state
+		 cannot be deserialized.
+		 */
+		ErrorCode code;
+		/**
+		 Format of the state before the migration.
+		 */
+		SessionStateFormat sourceFormat;
+		/**
+		 Version of protocol used by the activation stored in the state, or
+		 Version_NA if there's no activation. Note that the migration doesn't
+		 upgrade the protocol. The V2 activations still have to be upgraded
+		 online, with using Session::startProtocolUpgrade().
+		 */
+		Version protocolVersion;
+		/**
+		 True if the migrated state is different than the source state.
+		 */
+		bool migrated;
+		/**
+		 The state in current format, which can be loaded with
+		 Session::loadSessionState().
+		 */
+		cc7::ByteArray state;
+		
+		SessionStateMigrationResult() :
+			code(EC_WrongParam),
+			sourceFormat(SSF_Unknown),
+			protocolVersion(Version_NA),
+			migrated(false)
+		{
+		}
+	};
+	
+	/**
+	 The SessionStateMigrator class migrates serialized session's states, produced
+	 by older versions of the library, into the current format. The migration is
+	 performed offline, so you can process large archives of stored states in bulk.
+	 All states are processed in parallel, on provided executor.
+	 
+	 The archive processed by migrateArchive() is a sequence of serialized states,
+	 where each state is prefixed with its length, encoded in the same way as
+	 the length of byte sequences in the session's state. You can create such
+	 archive with buildArchive().
+	 */
+	class SessionStateMigrator
+	{
+	public:
+		
+		/**
+		 Constructs migrator which uses |executor| for the processing. The WorkerPoolExecutor
+		 with the default number of threads will use all available CPU cores.
+		 */
+		explicit SessionStateMigrator(Executor & executor);
+		
+		/**
+		 Detects format of serialized session's |state|. The function only peeks into
+		 the headers, so the rest of data is not validated.
+		 */
+		static SessionStateFormat detectFormat(const cc7::ByteRange & state);
+		
+		/**
+		 Migrates one serialized session's |state| into the current format.
+		 */
+		static SessionStateMigrationResult migrateState(const cc7::ByteRange & state);
+		
+		/**
+		 Migrates all |states| in parallel. The result at each index corresponds
+		 to the state at the same index.
+		 */
+		std::vector<SessionStateMigrationResult> migrateStates(const std::vector<cc7::ByteRange> & states);
+		
+		/**
+		 Maps archive file at |path| into the memory and migrates all states stored in
+		 the archive in parallel. The results are stored to |out_results| in the same order
+		 as states in the archive.
+		 
+		 Returns EC_Ok,         if the archive was processed. Check each result for
+								a status of individual state.
+				 EC_WrongParam, if file cannot be mapped, or archive is corrupted.
+		 */
+		ErrorCode migrateArchive(const std::string & path, std::vector<SessionStateMigrationResult> & out_results);
+		
+		/**
+		 Returns content of archive, which contains all provided |states|.
+		 */
+		static cc7::ByteArray buildArchive(const std::vector<cc7::ByteRange> & states);
+		
+	private:
+		
+		/**
+		 Executor used for the processing.
+		 */
+		Executor & _executor;
+	};
+	
+} // io::getlime::powerAuth
+} // io::getlime
+} // io
@@ -0,0 +1,138 @@
+/*
+ * Copyright 2019 Wultra s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <PowerAuth/PublicTypes.h>
+#include <vector>
+
+namespace io
+{
+namespace getlime
+{
+namespace powerAuth
+{
+	class Session;
+	
+	/*
+	 Forward declaration for private objects
+	 */
+	namespace protocol
+	{
+		struct SignatureKeys;
+	}
+	
+	/**
+	 The SignatureCounterReservation class contains a block of consecutive signature counter values,
+	 reserved with Session::reserveSignatureCounters(). The object keeps signature keys unlocked for
+	 one signature factor and the counter data for each reserved value, so the signatures can be
+	 calculated in parallel, without locking the Session.
+	 
+	 The session's persistent state is moved behind the last reserved value at the time of reservation.
+	 The server accepts signatures only in limited window of counter values, so you should use
+	 the reserved values in order and all of them, otherwise the server may lose synchronization
+	 with the client.
+	 */
+	class SignatureCounterReservation
+	{
+	public:
+		
+		/**
+		 Constructs an empty reservation.
+		 */
+		SignatureCounterReservation();
+		
+		/**
+		 Destroys the reservation and wipes all unlocked keys.
+		 */
+		~SignatureCounterReservation();
+		
+		/**
+		 Returns true if object contains reserved counter values.
+		 */
+		bool isValid() const;
+		
+		/**
+		 Returns number of reserved counter values.
+		 */
+		size_t count() const;
+		
+		/**
+		 Returns signature factor, for which the signature keys were unlocked.
+		 */
+		SignatureFactor signatureFactor() const;
+		
+		/**
+		 Releases all reserved counter values and wipes all unlocked keys.
+		 */
+		void clear();
+		
+		/**
+		 Calculates signature from given |request_data| for reserved counter value at |index| and stores the
+		 final value for X-PowerAuth-Authorization header to |out_header_value|. The produced value is equal
+		 to the value produced by Session::signHTTPRequestDataToHeader(), called in order for each counter value.
+		 The method can be called from multiple threads at the same time.
+		 
+		 Returns EC_Ok,         if operation succeeded
+				 EC_Encryption, if some cryptographic operation failed
+				 EC_WrongState, if the reservation is not valid, or if offline signature is requested
+								during the pending protocol upgrade
+				 EC_WrongParam, if |index| is out of range, or if some required parameter is missing
+		 */
+		ErrorCode signHTTPRequestData(size_t index, const HTTPRequestDataView & request_data, std::string & out_header_value) const;
+		
+	private:
+		
+		friend class Session;
+		
+		// Not copyable
+		SignatureCounterReservation(const SignatureCounterReservation &) = delete;
+		SignatureCounterReservation & operator=(const SignatureCounterReservation &) = delete;
+		
+		/**
+		 Unlocked signature keys.
+		 */
+		protocol::SignatureKeys * _keys;
+		
+		/**
+		 Signature factor used for keys unlocking.
+		 */
+		SignatureFactor _factor;
+		
+		/**
+		 Counter data for each reserved counter value.
+		 */
+		std::vector<cc7::ByteArray> _ctr_data;
+		
+		/**
+		 Version of protocol, activation identifier and application's key & secret,
+		 captured at the time of reservation.
+		 */
+		std::string _version;
+		std::string _activation_id;
+		std::string _application_key;
+		std::string _application_secret;
+		
+		/**
+		 If false, then offline signatures are not allowed, due to pending protocol upgrade.
+		 */
+		bool _offline_allowed;
+	};
+	
+} // io::getlime::powerAuth
+} // io::getlime
+} // io
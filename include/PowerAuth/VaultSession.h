@@ -0,0 +1,158 @@
+/*
+ * Copyright 2019 Wultra s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <PowerAuth/PublicTypes.h>
+#include <atomic>
+
+/*
+ Forward declaration of OpenSSL's EC_KEY
+ */
+struct ec_key_st;
+
+namespace io
+{
+namespace getlime
+{
+namespace powerAuth
+{
+	class Session;
+	
+	/**
+	 The VaultSession class keeps an unlocked vault for a sequence of vault operations. The object
+	 is opened with Session::openVaultSession() and holds the decrypted vault key in secure memory
+	 (see utils/SecureMemory.h) and the device's private key, imported to OpenSSL's EC_KEY. So, all
+	 operations provided by this object don't need to decrypt the vault key or the device's private
+	 key again.
+	 
+	 The vault session stays valid until it's closed or destroyed, or until the Session's persistent
+	 state is changed. That happens, for example, when the session is reset, when the activation is
+	 removed, or when a different state is loaded. The invalidated object wipes all keys immediately
+	 and all its operations fail with EC_WrongState.
+	 
+	 The object must not outlive the Session which opened it. All operations are synchronized with
+	 the Session, so the object can be used from any thread.
+	 */
+	class VaultSession
+	{
+	public:
+		
+		/**
+		 Constructs a closed vault session.
+		 */
+		VaultSession();
+		
+		/**
+		 Destroys the object. The vault session is closed and all keys are wiped.
+		 */
+		~VaultSession();
+		
+		/**
+		 Returns true if vault session is open and can be used for vault operations.
+		 */
+		bool isValid() const;
+		
+		/**
+		 Closes the vault session and wipes all keys. It's safe to call this method
+		 on already closed object.
+		 */
+		void close();
+		
+		/**
+		 Calculates a cryptographic key, derived from unlocked vault key. The behavior is equal to
+		 Session::deriveCryptographicKeyFromVaultKey().
+		 
+		 Returns EC_Ok,         if operation succeeded
+				 EC_Encryption, if general encryption error occurs
+				 EC_WrongState, if the vault session is not valid
+		 */
+		ErrorCode deriveCryptographicKey(cc7::U64 key_index, cc7::ByteArray & out_key);
+		
+		/**
+		 Computes a ECDSA-SHA256 signature of given |data| with using device's private key. The behavior
+		 is equal to Session::signDataWithDevicePrivateKey().
+		 
+		 Returns EC_Ok,         if operation succeeded
+				 EC_Encryption, if general encryption error occurs
+				 EC_WrongState, if the vault session is not valid
+		 */
+		ErrorCode signDataWithDevicePrivateKey(const cc7::ByteRange & data, cc7::ByteArray & out_signature);
+		
+		/**
+		 Adds a key for biometry factor. The |keys| structure must contain a new biometryUnlockKey.
+		 The behavior is equal to Session::addBiometryFactor(). You should always save session's state
+		 after this operation, whether it ends with error or not.
+		 
+		 Returns EC_Ok,         if operation succeeded
+				 EC_Encryption, if general encryption error occurs
+				 EC_WrongState, if the vault session is not valid
+				 EC_WrongParam, if some required parameter is missing
+		 */
+		ErrorCode addBiometryFactor(const SignatureUnlockKeys & keys);
+		
+		/**
+		 Gets an activation recovery data. The behavior is equal to Session::getActivationRecoveryData().
+		 
+		 Returns EC_Ok,         if operation succeeded
+				 EC_Encryption, if general encryption error occurs
+				 EC_WrongState, if the vault session is not valid, or
+								if no activation recovery data is available.
+		 */
+		ErrorCode getActivationRecoveryData(RecoveryData & out_recovery_data);
+	
+	private:
+		
+		friend class Session;
+		
+		// Not copyable
+		VaultSession(const VaultSession &) = delete;
+		VaultSession & operator=(const VaultSession &) = delete;
+		
+		/**
+		 Wipes all keys and detaches the object from the session. The session's lock must be acquired.
+		 */
+		void invalidate();
+		
+		/**
+		 Returns vault key as a range of bytes.
+		 */
+		cc7::ByteRange vaultKey() const;
+		
+		/**
+		 Session which opened this vault session, or nullptr if object is not valid.
+		 */
+		std::atomic<Session*> _session;
+		
+		/**
+		 Unlocked vault key, allocated in secure memory.
+		 */
+		cc7::byte * _vault_key;
+		
+		/**
+		 Size of memory allocated for |_vault_key|.
+		 */
+		size_t _vault_key_allocated_size;
+		
+		/**
+		 Imported device's private key.
+		 */
+		struct ec_key_st * _device_private_key;
+	};
+
+} // io::getlime::powerAuth
+} // io::getlime
+} // io
@@ -227,6 +227,26 @@ public class EciesEncryptor {
      */
     public native byte[] decryptResponse(EciesCryptogram cryptogram);
 
+    /**
+     * Encrypts an input request data and returns the cryptogram serialized into UTF-8 encoded JSON
+     * object with "ephemeralPublicKey", "encryptedData" and "mac" properties. The JSON can be directly
+     * used as a body of HTTP request. Like <code>encryptRequest</code>, each call for this method
+     * regenerates an internal envelope key.
+     *
+     * @param requestData data to be encrypted
+     * @return bytes with JSON object or null in case of failure
+     */
+    public native byte[] encryptRequestToJson(byte[] requestData);
+
+    /**
+     * Decrypts a cryptogram received from the server as UTF-8 encoded JSON object with "encryptedData"
+     * and "mac" properties and returns decrypted data or null in case of failure.
+     *
+     * @param responseJson bytes with JSON object received from the server
+     * @return decrypted bytes or null in case of error
+     */
+    public native byte[] decryptJsonResponse(byte[] responseJson);
+
 
     //
     // Metadata
@@ -105,6 +105,24 @@
  */
 - (nullable NSData *) decryptResponse:(nonnull PA2ECIESCryptogram *)cryptogram;
 
+/**
+ Encrypts an input |data| and returns the cryptogram serialized into UTF-8 encoded JSON object with
+ "ephemeralPublicKey", "encryptedData" and "mac" properties, or nil in case of failure. The returned
+ data can be directly used as a body of HTTP request. Like `encryptRequest:`, each call for this method
+ regenerates an internal envelope key.
+ 
+ The DEBUG version of the SDK prints detailed error about the failure reason into the log.
+ */
+- (nullable NSData *) encryptRequestToJSON:(nullable NSData *)data;
+
+/**
+ Decrypts a cryptogram received from the server as UTF-8 encoded JSON object with "encryptedData" and
+ "mac" properties and returns decrypted data or nil in case of failure.
+ 
+ The DEBUG version of the SDK prints detailed error about the failure reason into the log.
+ */
+- (nullable NSData *) decryptJSONResponse:(nonnull NSData *)responseJSON;
+
 /**
  This is a special, thread-safe version of request encryption. The method encrypts provided data
  and makes a copy of itself in thread synchronized block. Then the completion block is called with
@@ -16,6 +16,7 @@
 
 #include <PowerAuth/ECIES.h>
 #include <cc7/objc/ObjcHelper.h>
+#include "Base64.h"			// Accessing private header
 
 #import "PA2ECIESEncryptor.h"
 #import "PA2PrivateImpl.h"
@@ -118,6 +119,36 @@ using namespace io::getlime::powerAuth;
 	return ec == EC_Ok ? cc7::objc::CopyToNSData(data) : nil;
 }
 
+- (nullable NSData *) encryptRequestToJSON:(nullable NSData *)data
+{
+	ECIESCryptogram cryptogram;
+	auto ec = _encryptor.encryptRequest(cc7::objc::CopyFromNSData(data), cryptogram);
+	PA2Objc_DebugDumpError(self, @"EncryptRequest", ec);
+	if (ec != EC_Ok) {
+		return nil;
+	}
+	// Serialize directly into NSData's buffer
+	NSMutableData * json = [NSMutableData dataWithLength:ECIESCryptogram_JSONSize(cryptogram)];
+	size_t size = 0;
+	ec = ECIESCryptogram_EncodeJSON(cryptogram, (cc7::byte*)json.mutableBytes, json.length, size);
+	PA2Objc_DebugDumpError(self, @"EncodeJSON", ec);
+	return ec == EC_Ok ? json : nil;
+}
+
+- (nullable NSData *) decryptJSONResponse:(nonnull NSData *)responseJSON
+{
+	ECIESCryptogram cryptogram;
+	auto ec = ECIESCryptogram_DecodeJSON(cc7::ByteRange(responseJSON.bytes, responseJSON.length), cryptogram);
+	PA2Objc_DebugDumpError(self, @"DecodeJSON", ec);
+	if (ec != EC_Ok) {
+		return nil;
+	}
+	cc7::ByteArray data;
+	ec = _encryptor.decryptResponse(cryptogram, data);
+	PA2Objc_DebugDumpError(self, @"DecryptResponse", ec);
+	return ec == EC_Ok ? cc7::objc::CopyToNSData(data) : nil;
+}
+
 - (BOOL) encryptRequest:(NSData *)data
 			 completion:(void (NS_NOESCAPE ^)(PA2ECIESCryptogram * cryptogram, PA2ECIESEncryptor * decryptor))completion
 {
@@ -184,29 +215,29 @@ using namespace io::getlime::powerAuth;
 
 - (void) setBodyBase64:(NSString *)bodyBase64
 {
-	_c.body.readFromBase64String(cc7::objc::CopyFromNSString(bodyBase64));
+	utils::Base64_Decode(cc7::MakeRange(cc7::objc::CopyFromNSString(bodyBase64)), _c.body);
 }
 - (NSString*) bodyBase64
 {
-	return cc7::objc::CopyToNullableNSString(_c.body.base64String());
+	return cc7::objc::CopyToNullableNSString(utils::Base64_Encode(_c.body));
 }
 
 - (void) setMacBase64:(NSString *)macBase64
 {
-	_c.mac.readFromBase64String(cc7::objc::CopyFromNSString(macBase64));
+	utils::Base64_Decode(cc7::MakeRange(cc7::objc::CopyFromNSString(macBase64)), _c.mac);
 }
 - (NSString*) macBase64
 {
-	return cc7::objc::CopyToNullableNSString(_c.mac.base64String());
+	return cc7::objc::CopyToNullableNSString(utils::Base64_Encode(_c.mac));
 }
 
 - (void) setKeyBase64:(NSString *)keyBase64
 {
-	_c.key.readFromBase64String(cc7::objc::CopyFromNSString(keyBase64));
+	utils::Base64_Decode(cc7::MakeRange(cc7::objc::CopyFromNSString(keyBase64)), _c.key);
 }
 - (NSString*) keyBase64
 {
-	return cc7::objc::CopyToNullableNSString(_c.key.base64String());
+	return cc7::objc::CopyToNullableNSString(utils::Base64_Encode(_c.key));
 }
 
 @end
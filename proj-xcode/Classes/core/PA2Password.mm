@@ -62,9 +62,9 @@
 - (BOOL) validatePasswordComplexity:(BOOL (NS_NOESCAPE ^)(const UInt8* passphrase, NSUInteger length))validationBlock
 {
 	BOOL result = NO;
-	const cc7::byte * plaintext_bytes = _password.passwordData().data();
-	if (validationBlock && plaintext_bytes) {
-		result = validationBlock(plaintext_bytes, _password.passwordData().size());
+	cc7::ByteRange plaintext = _password.passwordRange();
+	if (validationBlock && plaintext.data()) {
+		result = validationBlock(plaintext.data(), plaintext.size());
 	}
 	return result;
 }
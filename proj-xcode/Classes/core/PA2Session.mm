@@ -209,20 +209,21 @@ using namespace io::getlime::powerAuth;
 
 - (nullable NSData*) prepareKeyValueDictionaryForDataSigning:(nonnull NSDictionary<NSString*, NSString*>*)dictionary
 {
-	__block std::map<std::string, std::string> map;
+	__block std::vector<std::pair<std::string, std::string>> pairs;
 	__block BOOL error = NO;
+	pairs.reserve(dictionary.count);
 	[dictionary enumerateKeysAndObjectsUsingBlock:^(NSString * key, NSString * value, BOOL * stop) {
 		if (![key isKindOfClass:[NSString class]] || ![value isKindOfClass:[NSString class]]) {
 			CC7_ASSERT(false, "Wrong type of object or key in provided NSDictionary.");
 			*stop = error = YES;
 			return;
 		}
-		map[std::string(key.UTF8String)] = std::string(value.UTF8String);
+		pairs.push_back(std::make_pair(std::string(key.UTF8String), std::string(value.UTF8String)));
 	}];
 	if (error) {
 		return nil;
 	}
-	cc7::ByteArray normalized_data = Session::prepareKeyValueMapForDataSigning(map);
+	cc7::ByteArray normalized_data = Session::prepareKeyValuePairsForDataSigning(pairs);
 	return cc7::objc::CopyToNSData(normalized_data);
 }
 
@@ -231,8 +232,12 @@ using namespace io::getlime::powerAuth;
 														 keys:(nonnull PA2SignatureUnlockKeys*)unlockKeys
 													   factor:(PA2SignatureFactor)factor
 {
-	HTTPRequestData request;
-	PA2HTTPRequestDataToStruct(requestData, request);
+	// The body is not copied, the view refers to bytes of NSData object, which is retained by requestData.
+	NSData * body				= requestData.body;
+	std::string cpp_method		= cc7::objc::CopyFromNSString(requestData.method);
+	std::string cpp_uri			= cc7::objc::CopyFromNSString(requestData.uri);
+	std::string cpp_nonce		= cc7::objc::CopyFromNSString(requestData.offlineNonce);
+	HTTPRequestDataView request(cc7::ByteRange(body.bytes, body.length), cc7::MakeRange(cpp_method), cc7::MakeRange(cpp_uri), cc7::MakeRange(cpp_nonce));
 	SignatureFactor cpp_factor	= static_cast<SignatureFactor>(factor);
 	SignatureUnlockKeys cpp_keys;
 	PA2SignatureUnlockKeysToStruct(unlockKeys, cpp_keys);
@@ -272,7 +277,7 @@ using namespace io::getlime::powerAuth;
 {
 	ErrorCode error;
 	if (old_password != nil && new_password != nil) {
-		error = _session->changeUserPassword([old_password passObjRef].passwordData(), [new_password passObjRef].passwordData());
+		error = _session->changeUserPassword([old_password passObjRef].passwordRange(), [new_password passObjRef].passwordRange());
 	} else {
 		error = EC_WrongParam;
 	}
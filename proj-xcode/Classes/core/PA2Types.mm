@@ -283,9 +283,10 @@ void PA2SignatureUnlockKeysToStruct(PA2SignatureUnlockKeys * keys, io::getlime::
 	cpp_keys.possessionUnlockKey	= cc7::objc::CopyFromNSData(keys.possessionUnlockKey);
 	cpp_keys.biometryUnlockKey		= cc7::objc::CopyFromNSData(keys.biometryUnlockKey);
 	if (keys.userPassword != nil) {
-		cpp_keys.userPassword		= [keys.userPassword passObjRef].passwordData();
+		// The range points to the password's secure storage, which is retained by the keys object.
+		cpp_keys.userPasswordRange = [keys.userPassword passObjRef].passwordRange();
 	} else {
-		cpp_keys.userPassword.clear();
+		cpp_keys.userPasswordRange = cc7::ByteRange();
 	}
 }
 
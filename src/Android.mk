@@ -57,7 +57,16 @@ LOCAL_SRC_FILES := \
 	PowerAuth/utils/DataReader.cpp \
 	PowerAuth/utils/DataWriter.cpp \
 	PowerAuth/utils/URLEncoding.cpp \
-	PowerAuth/utils/CRC16.cpp
+	PowerAuth/utils/CRC16.cpp \
+	PowerAuth/utils/Base64.cpp \
+	PowerAuth/utils/SecureMemory.cpp \
+	PowerAuth/Executor.cpp \
+	PowerAuth/AsyncSession.cpp \
+	PowerAuth/SessionStateMigrator.cpp \
+	PowerAuth/utils/MappedFile.cpp \
+	PowerAuth/SessionStateBundle.cpp \
+	PowerAuth/VaultSession.cpp \
+	PowerAuth/SignatureCounterReservation.cpp
 
 include $(BUILD_STATIC_LIBRARY)
 
@@ -103,6 +112,11 @@ LOCAL_SRC_FILES := \
 	PowerAuthTests/pa2OtpUtilTests.cpp \
 	PowerAuthTests/pa2ECIESTests.cpp \
 	PowerAuthTests/pa2CRC16Tests.cpp \
+	PowerAuthTests/pa2Base64Tests.cpp \
+	PowerAuthTests/pa2AsyncSessionTests.cpp \
+	PowerAuthTests/pa2SessionStateMigratorTests.cpp \
+	PowerAuthTests/pa2SessionStateBundleTests.cpp \
+	PowerAuthTests/pa2CryptoECCTests.cpp \
 	PowerAuthTests/TestData/pa2.generated/g_pa2Files.cpp
 
 include $(BUILD_STATIC_LIBRARY)
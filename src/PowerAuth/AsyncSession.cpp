@@ -0,0 +1,311 @@
+/*
+ * Copyright 2019 Wultra s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <PowerAuth/AsyncSession.h>
+#include "utils/SecureMemory.h"
+#include <string.h>
+
+namespace io
+{
+namespace getlime
+{
+namespace powerAuth
+{
+	/**
+	 One phase of asynchronous operation. The phase stores its output to |value|
+	 and returns result of the operation.
+	 */
+	template <typename T>
+	using AsyncPhase = std::function<ErrorCode(T & value)>;
+
+	/**
+	 Schedules execution of |phases| to the |executor|. The phases are executed in
+	 order, until one of them fails, or until the operation is cancelled. The cancellation
+	 is checked before each phase and once more before the final result is reported
+	 to |completion|.
+	 */
+	template <typename T>
+	static AsyncOperation _ScheduleOperation(Executor & executor, std::vector<AsyncPhase<T>> phases, AsyncCompletion<T> completion)
+	{
+		AsyncOperation operation;
+		// C++11 lambda cannot capture by move, so keep the captured objects in shared pointers.
+		auto phases_ptr = std::make_shared<std::vector<AsyncPhase<T>>>(std::move(phases));
+		auto completion_ptr = std::make_shared<AsyncCompletion<T>>(std::move(completion));
+		executor.execute([operation, phases_ptr, completion_ptr]() {
+			AsyncResult<T> result;
+			for (auto & phase : *phases_ptr) {
+				if (operation.isCancelled()) {
+					result.code = EC_WrongState;
+					result.cancelled = true;
+					result.value = T();
+					break;
+				}
+				result.code = phase(result.value);
+				if (result.code != EC_Ok) {
+					break;
+				}
+			}
+			// Release the phases before the result is reported, so the sensitive data captured
+			// in them is wiped even if the executor keeps the task alive.
+			phases_ptr->clear();
+			if (!result.cancelled && operation.isCancelled()) {
+				// Cancelled while the last phase was running. The phase may already change
+				// the state of the session, so its real result is reported.
+				result.cancelled = true;
+			}
+			if (*completion_ptr) {
+				(*completion_ptr)(std::move(result));
+			}
+		});
+		return operation;
+	}
+
+
+	/**
+	 The _KeysCopy class keeps copy of unlock keys, which can be used after the function
+	 returns. The password is copied to the secure memory, because the range provided by
+	 the caller may not be valid when the operation is executed. The whole copy is wiped
+	 when the object is destroyed.
+	 */
+	class _KeysCopy
+	{
+	public:
+
+		explicit _KeysCopy(const SignatureUnlockKeys & keys) :
+			_password(nullptr),
+			_password_allocated_size(0)
+		{
+			_keys.possessionUnlockKey = keys.possessionUnlockKey;
+			_keys.biometryUnlockKey = keys.biometryUnlockKey;
+			_keys.userPasswordKey = keys.userPasswordKey;
+			cc7::ByteRange password = keys.password();
+			if (!password.empty()) {
+				_password = utils::SecureMemory_Alloc(password.size(), _password_allocated_size);
+				if (_password) {
+					memcpy(_password, password.data(), password.size());
+					_keys.userPasswordRange = cc7::ByteRange(_password, password.size());
+				} else {
+					// Failed to allocate secure memory, keep the copy on the heap.
+					_keys.userPassword.assign(password);
+				}
+			}
+		}
+
+		~_KeysCopy()
+		{
+			utils::SecureMemory_Wipe(_keys.possessionUnlockKey.data(), _keys.possessionUnlockKey.size());
+			utils::SecureMemory_Wipe(_keys.biometryUnlockKey.data(), _keys.biometryUnlockKey.size());
+			utils::SecureMemory_Wipe(_keys.userPassword.data(), _keys.userPassword.size());
+			utils::SecureMemory_Free(_password, _password_allocated_size);
+		}
+
+		_KeysCopy(const _KeysCopy &) = delete;
+		_KeysCopy & operator=(const _KeysCopy &) = delete;
+
+		const SignatureUnlockKeys & keys() const
+		{
+			return _keys;
+		}
+
+	private:
+
+		SignatureUnlockKeys _keys;
+		cc7::byte * _password;
+		size_t _password_allocated_size;
+	};
+
+	/**
+	 Returns copy of |keys| shared between phases of an operation.
+	 */
+	static std::shared_ptr<_KeysCopy> _CopyKeys(const SignatureUnlockKeys & keys)
+	{
+		return std::make_shared<_KeysCopy>(keys);
+	}
+
+
+	// MARK: - Construction -
+
+	AsyncSession::AsyncSession(Session & session, Executor & executor) :
+		_session(session),
+		_executor(executor)
+	{
+	}
+
+	Session & AsyncSession::session() const
+	{
+		return _session;
+	}
+
+	Executor & AsyncSession::executor() const
+	{
+		return _executor;
+	}
+
+
+	// MARK: - Activation -
+
+	AsyncOperation AsyncSession::startActivation(const ActivationStep1Param & param,
+												 AsyncCompletion<ActivationStep1Result> completion)
+	{
+		Session * session = &_session;
+		return _ScheduleOperation<ActivationStep1Result>(_executor, {
+			[session, param](ActivationStep1Result & out) {
+				return session->startActivation(param, out);
+			}
+		}, std::move(completion));
+	}
+
+	AsyncOperation AsyncSession::validateActivationResponse(const ActivationStep2Param & param,
+															AsyncCompletion<ActivationStep2Result> completion)
+	{
+		Session * session = &_session;
+		return _ScheduleOperation<ActivationStep2Result>(_executor, {
+			[session, param](ActivationStep2Result & out) {
+				return session->validateActivationResponse(param, out);
+			}
+		}, std::move(completion));
+	}
+
+	AsyncOperation AsyncSession::completeActivation(const SignatureUnlockKeys & keys,
+													AsyncCompletion<AsyncNoValue> completion)
+	{
+		Session * session = &_session;
+		auto keys_copy = _CopyKeys(keys);
+		return _ScheduleOperation<AsyncNoValue>(_executor, {
+			[session, keys_copy](AsyncNoValue &) {
+				return session->completeActivation(keys_copy->keys());
+			}
+		}, std::move(completion));
+	}
+
+	AsyncOperation AsyncSession::decodeActivationStatus(const std::string & status_blob, const SignatureUnlockKeys & keys,
+														AsyncCompletion<ActivationStatus> completion)
+	{
+		Session * session = &_session;
+		auto keys_copy = _CopyKeys(keys);
+		return _ScheduleOperation<ActivationStatus>(_executor, {
+			[session, status_blob, keys_copy](ActivationStatus & out) {
+				return session->decodeActivationStatus(status_blob, keys_copy->keys(), out);
+			}
+		}, std::move(completion));
+	}
+
+
+	// MARK: - Signatures -
+
+	AsyncOperation AsyncSession::signHTTPRequestData(const HTTPRequestData & request_data,
+													 const SignatureUnlockKeys & keys, SignatureFactor signature_factor,
+													 AsyncCompletion<HTTPRequestDataSignature> completion)
+	{
+		Session * session = &_session;
+		auto keys_copy = _CopyKeys(keys);
+		return _ScheduleOperation<HTTPRequestDataSignature>(_executor, {
+			[session, request_data, keys_copy, signature_factor](HTTPRequestDataSignature & out) {
+				return session->signHTTPRequestData(request_data, keys_copy->keys(), signature_factor, out);
+			}
+		}, std::move(completion));
+	}
+
+
+	// MARK: - Vault operations -
+
+	AsyncOperation AsyncSession::addBiometryFactor(const std::string & c_vault_key, const SignatureUnlockKeys & keys,
+												   AsyncCompletion<AsyncNoValue> completion)
+	{
+		Session * session = &_session;
+		auto keys_copy = _CopyKeys(keys);
+		return _ScheduleOperation<AsyncNoValue>(_executor, {
+			[session, c_vault_key, keys_copy](AsyncNoValue &) {
+				return session->addBiometryFactor(c_vault_key, keys_copy->keys());
+			}
+		}, std::move(completion));
+	}
+
+	AsyncOperation AsyncSession::deriveCryptographicKeyFromVaultKey(const std::string & c_vault_key, const SignatureUnlockKeys & keys,
+																	cc7::U64 key_index, AsyncCompletion<cc7::ByteArray> completion)
+	{
+		Session * session = &_session;
+		auto keys_copy = _CopyKeys(keys);
+		return _ScheduleOperation<cc7::ByteArray>(_executor, {
+			[session, c_vault_key, keys_copy, key_index](cc7::ByteArray & out) {
+				return session->deriveCryptographicKeyFromVaultKey(c_vault_key, keys_copy->keys(), key_index, out);
+			}
+		}, std::move(completion));
+	}
+
+	AsyncOperation AsyncSession::signDataWithDevicePrivateKey(const std::string & c_vault_key, const SignatureUnlockKeys & keys,
+															  const cc7::ByteRange & data, AsyncCompletion<cc7::ByteArray> completion)
+	{
+		Session * session = &_session;
+		auto keys_copy = _CopyKeys(keys);
+		cc7::ByteArray data_copy(data);
+		return _ScheduleOperation<cc7::ByteArray>(_executor, {
+			[session, c_vault_key, keys_copy, data_copy](cc7::ByteArray & out) {
+				return session->signDataWithDevicePrivateKey(c_vault_key, keys_copy->keys(), data_copy, out);
+			}
+		}, std::move(completion));
+	}
+
+	AsyncOperation AsyncSession::getActivationRecoveryData(const std::string & c_vault_key, const SignatureUnlockKeys & keys,
+														   AsyncCompletion<RecoveryData> completion)
+	{
+		Session * session = &_session;
+		auto keys_copy = _CopyKeys(keys);
+		return _ScheduleOperation<RecoveryData>(_executor, {
+			[session, c_vault_key, keys_copy](RecoveryData & out) {
+				return session->getActivationRecoveryData(c_vault_key, keys_copy->keys(), out);
+			}
+		}, std::move(completion));
+	}
+
+
+	// MARK: - ECIES -
+
+	AsyncOperation AsyncSession::eciesEncryptRequest(ECIESEncryptorScope scope, const SignatureUnlockKeys & keys,
+													 const cc7::ByteRange & shared_info1, const cc7::ByteRange & data,
+													 AsyncCompletion<ECIESEncryptedRequest> completion)
+	{
+		Session * session = &_session;
+		auto keys_copy = _CopyKeys(keys);
+		cc7::ByteArray shared_info1_copy(shared_info1);
+		cc7::ByteArray data_copy(data);
+		return _ScheduleOperation<ECIESEncryptedRequest>(_executor, {
+			// Phase 1, construct encryptor. This may require transport key unlock.
+			[session, scope, keys_copy, shared_info1_copy](ECIESEncryptedRequest & out) {
+				return session->getEciesEncryptor(scope, keys_copy->keys(), shared_info1_copy, out.encryptor);
+			},
+			// Phase 2, encrypt the request data.
+			[data_copy](ECIESEncryptedRequest & out) {
+				return out.encryptor.encryptRequest(data_copy, out.cryptogram);
+			}
+		}, std::move(completion));
+	}
+
+	AsyncOperation AsyncSession::eciesDecryptResponse(const ECIESEncryptor & encryptor, const ECIESCryptogram & cryptogram,
+													  AsyncCompletion<cc7::ByteArray> completion)
+	{
+		return _ScheduleOperation<cc7::ByteArray>(_executor, {
+			[encryptor, cryptogram](cc7::ByteArray & out) {
+				// The lambda's copy of encryptor is const, so use a local copy.
+				ECIESEncryptor decryptor = encryptor;
+				return decryptor.decryptResponse(cryptogram, out);
+			}
+		}, std::move(completion));
+	}
+
+} // io::getlime::powerAuth
+} // io::getlime
+} // io
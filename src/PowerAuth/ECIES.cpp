@@ -16,7 +16,12 @@
 
 #include <PowerAuth/ECIES.h>
 #include "crypto/CryptoUtils.h"
+#include "crypto/PKCS7Padding.h"
 #include "protocol/Constants.h"
+#include "utils/Base64.h"
+#include <string.h>
+#include <ctype.h>
+#include <openssl/crypto.h>
 
 namespace io
 {
@@ -254,6 +259,140 @@ namespace powerAuth
 	}
 	
 	
+	// ----------------------------------------------------------------------------------------------
+	// MARK: - Retry context -
+	//
+	
+	ECIESRetryContext::ECIESRetryContext() :
+		_dec_key(nullptr),
+		_mac_key(nullptr),
+		_remaining_requests(0),
+		_remaining_attempts(0)
+	{
+	}
+	
+	ECIESRetryContext::ECIESRetryContext(const ECIESEncryptor & encryptor, const ECIESCryptogram & request_cryptogram,
+										 size_t max_attempts, std::chrono::milliseconds validity) :
+		_request(request_cryptogram),
+		_shared_info2(encryptor.sharedInfo2()),
+		_dec_key(nullptr),
+		_mac_key(nullptr),
+		_remaining_requests(0),
+		_remaining_attempts(0),
+		_expiration(std::chrono::steady_clock::now() + validity)
+	{
+		const ECIESEnvelopeKey & ek = encryptor.envelopeKey();
+		if (!ek.isValid() || max_attempts == 0) {
+			return;
+		}
+		_dec_key = crypto::AES_CreateDecryptionKey(ek.encKey());
+		_mac_key = new crypto::HMAC_SHA256_Context();
+		if (!_dec_key || !_mac_key->init(ek.macKey())) {
+			invalidate();
+			return;
+		}
+		_remaining_requests = max_attempts;
+		_remaining_attempts = max_attempts;
+	}
+	
+	ECIESRetryContext::~ECIESRetryContext()
+	{
+		invalidate();
+	}
+	
+	bool ECIESRetryContext::isValid() const
+	{
+		return _remaining_attempts > 0 && std::chrono::steady_clock::now() < _expiration;
+	}
+	
+	size_t ECIESRetryContext::remainingAttempts() const
+	{
+		return isValid() ? _remaining_attempts : 0;
+	}
+	
+	size_t ECIESRetryContext::remainingRequests() const
+	{
+		return isValid() ? _remaining_requests : 0;
+	}
+	
+	bool ECIESRetryContext::hasKeys() const
+	{
+		return _dec_key != nullptr || _mac_key != nullptr;
+	}
+	
+	void ECIESRetryContext::invalidate()
+	{
+		crypto::AES_DestroyDecryptionKey(_dec_key);
+		_dec_key = nullptr;
+		delete _mac_key;
+		_mac_key = nullptr;
+		_remaining_requests = 0;
+		_remaining_attempts = 0;
+	}
+	
+	bool ECIESRetryContext::checkValidity()
+	{
+		if (!isValid()) {
+			// Wipe keys as soon as possible
+			invalidate();
+			return false;
+		}
+		return true;
+	}
+	
+	ErrorCode ECIESRetryContext::requestCryptogram(ECIESCryptogram & out_cryptogram)
+	{
+		if (!checkValidity() || _remaining_requests == 0) {
+			return EC_WrongState;
+		}
+		// Re-sending doesn't consume decryption attempts, so the response
+		// to the re-sent request can always be decrypted.
+		_remaining_requests--;
+		out_cryptogram = _request;
+		return EC_Ok;
+	}
+	
+	ErrorCode ECIESRetryContext::decryptResponse(const ECIESCryptogram & cryptogram, cc7::ByteArray & out_data)
+	{
+		if (!_dec_key || !checkValidity()) {
+			return EC_WrongState;
+		}
+		_remaining_attempts--;
+		ErrorCode code = decryptWithPreparedKeys(cryptogram, out_data);
+		if (code == EC_Ok || _remaining_attempts == 0) {
+			// The response has been received, or the last attempt has failed,
+			// so the context is no longer needed.
+			invalidate();
+		}
+		return code;
+	}
+	
+	ErrorCode ECIESRetryContext::decryptWithPreparedKeys(const ECIESCryptogram & cryptogram, cc7::ByteArray & out_data)
+	{
+		// Verify MAC, calculated from the prepared state
+		crypto::HMAC_SHA256_Context mac_ctx;
+		if (!mac_ctx.init(*_mac_key) || !mac_ctx.update(cryptogram.body) || !mac_ctx.update(_shared_info2)) {
+			return EC_Encryption;
+		}
+		auto mac = mac_ctx.final();
+		if (mac.empty() || mac.size() != cryptogram.mac.size() || CRYPTO_memcmp(mac.data(), cryptogram.mac.data(), mac.size()) != 0) {
+			return EC_Encryption;
+		}
+		// Decrypt data with the prepared key schedule
+		const size_t size = cryptogram.body.size();
+		if (size == 0 || (size % protocol::ZERO_IV.size()) != 0) {
+			return EC_Encryption;
+		}
+		out_data.assign(cryptogram.body);
+		if (!crypto::AES_CBC_Decrypt_InPlace(_dec_key, protocol::ZERO_IV, out_data.data(), size) ||
+			!crypto::PKCS7_ValidateAndUpdateData(out_data, protocol::ZERO_IV.size())) {
+			out_data.clear();
+			return EC_Encryption;
+		}
+		return EC_Ok;
+	}
+	
+	
 	// ----------------------------------------------------------------------------------------------
 	// MARK: - Decryptor class -
 	//
@@ -336,6 +475,242 @@ namespace powerAuth
 		return EC_WrongState;
 	}
 	
+	// ----------------------------------------------------------------------------------------------
+	// MARK: - JSON codec -
+	//
+	
+	static const char JSON_KEY[]  = "ephemeralPublicKey";
+	static const char JSON_BODY[] = "encryptedData";
+	static const char JSON_MAC[]  = "mac";
+	
+	static inline size_t _JSONPropertySize(size_t name_length, size_t data_size)
+	{
+		// "name":"base64"
+		return name_length + 5 + utils::Base64_EncodedLength(data_size);
+	}
+	
+	size_t ECIESCryptogram_JSONSize(const ECIESCryptogram & cryptogram)
+	{
+		size_t size = 2;	// {}
+		if (!cryptogram.key.empty()) {
+			size += _JSONPropertySize(sizeof(JSON_KEY) - 1, cryptogram.key.size()) + 1;
+		}
+		size += _JSONPropertySize(sizeof(JSON_BODY) - 1, cryptogram.body.size()) + 1;
+		size += _JSONPropertySize(sizeof(JSON_MAC) - 1, cryptogram.mac.size());
+		return size;
+	}
+	
+	static char * _WriteJSONProperty(char * p, const char * name, size_t name_length, const cc7::ByteRange & data, bool last)
+	{
+		*p++ = '"';
+		memcpy(p, name, name_length);
+		p += name_length;
+		*p++ = '"';
+		*p++ = ':';
+		*p++ = '"';
+		p += utils::Base64_EncodeToBuffer(data, p);
+		*p++ = '"';
+		*p++ = last ? '}' : ',';
+		return p;
+	}
+	
+	ErrorCode ECIESCryptogram_EncodeJSON(const ECIESCryptogram & cryptogram, cc7::byte * out_buffer, size_t buffer_size, size_t & out_size)
+	{
+		out_size = ECIESCryptogram_JSONSize(cryptogram);
+		if (!out_buffer || buffer_size < out_size) {
+			return EC_WrongParam;
+		}
+		char * p = reinterpret_cast<char*>(out_buffer);
+		*p++ = '{';
+		if (!cryptogram.key.empty()) {
+			p = _WriteJSONProperty(p, JSON_KEY, sizeof(JSON_KEY) - 1, cryptogram.key, false);
+		}
+		p = _WriteJSONProperty(p, JSON_BODY, sizeof(JSON_BODY) - 1, cryptogram.body, false);
+		p = _WriteJSONProperty(p, JSON_MAC, sizeof(JSON_MAC) - 1, cryptogram.mac, true);
+		CC7_ASSERT(p == reinterpret_cast<char*>(out_buffer) + out_size, "Wrong JSON size calculation");
+		return EC_Ok;
+	}
+	
+	ErrorCode ECIESCryptogram_EncodeJSON(const ECIESCryptogram & cryptogram, cc7::ByteArray & out_json)
+	{
+		out_json.resize(ECIESCryptogram_JSONSize(cryptogram));
+		size_t size = 0;
+		ErrorCode code = ECIESCryptogram_EncodeJSON(cryptogram, out_json.data(), out_json.size(), size);
+		if (code != EC_Ok) {
+			out_json.clear();
+		}
+		return code;
+	}
+	
+	/**
+	 Simple JSON scanner. The scanner supports only a flat JSON object with strings,
+	 numbers, boolean or null values, which is enough for ECIES envelope.
+	 */
+	struct _JSONScanner
+	{
+		const char * p;
+		const char * end;
+		
+		void skipWhitespace()
+		{
+			while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+				p++;
+			}
+		}
+		
+		bool consume(char c)
+		{
+			skipWhitespace();
+			if (p < end && *p == c) {
+				p++;
+				return true;
+			}
+			return false;
+		}
+		
+		// Scans string content, the opening quote is already consumed.
+		bool scanString(cc7::ByteRange & out_content, bool & out_has_escape)
+		{
+			const char * begin = p;
+			out_has_escape = false;
+			while (p < end) {
+				char c = *p;
+				if (c == '"') {
+					out_content = cc7::ByteRange(reinterpret_cast<const cc7::byte*>(begin), p - begin);
+					p++;
+					return true;
+				} else if (c == '\\') {
+					out_has_escape = true;
+					p += 2;
+				} else if ((unsigned char)c < 0x20) {
+					return false;
+				} else {
+					p++;
+				}
+			}
+			return false;
+		}
+		
+		// Scans number, true or false literal.
+		bool scanSimpleValue()
+		{
+			const char * begin = p;
+			while (p < end && (isalnum((unsigned char)*p) || *p == '-' || *p == '+' || *p == '.')) {
+				p++;
+			}
+			return p > begin;
+		}
+	};
+	
+	static bool _DecodeJSONBase64(const cc7::ByteRange & content, bool has_escape, cc7::ByteArray & out_data)
+	{
+		size_t size = 0;
+		const size_t max_size = utils::Base64_MaxDecodedSize(content.size());
+		if (!has_escape) {
+			out_data.resize(max_size);
+			if (!utils::Base64_DecodeToBuffer(content, out_data.data(), size)) {
+				out_data.clear();
+				return false;
+			}
+			out_data.resize(size);
+			return true;
+		}
+		// Some JSON encoders escape '/' character, so unescape the content behind the area
+		// for decoded data first. No other escape sequence is valid in Base64 string.
+		out_data.resize(max_size + content.size());
+		cc7::byte * unescaped = out_data.data() + max_size;
+		size_t unescaped_size = 0;
+		for (size_t i = 0; i < content.size(); i++) {
+			cc7::byte c = content[i];
+			if (c == '\\') {
+				if (++i >= content.size() || content[i] != '/') {
+					out_data.clear();
+					return false;
+				}
+				c = '/';
+			}
+			unescaped[unescaped_size++] = c;
+		}
+		if (!utils::Base64_DecodeToBuffer(cc7::ByteRange(unescaped, unescaped_size), out_data.data(), size)) {
+			out_data.clear();
+			return false;
+		}
+		out_data.resize(size);
+		return true;
+	}
+	
+	static cc7::ByteArray * _JSONPropertyTarget(const cc7::ByteRange & name, ECIESCryptogram & cryptogram)
+	{
+		if (name.size() == sizeof(JSON_KEY) - 1 && memcmp(name.data(), JSON_KEY, name.size()) == 0) {
+			return &cryptogram.key;
+		} else if (name.size() == sizeof(JSON_BODY) - 1 && memcmp(name.data(), JSON_BODY, name.size()) == 0) {
+			return &cryptogram.body;
+		} else if (name.size() == sizeof(JSON_MAC) - 1 && memcmp(name.data(), JSON_MAC, name.size()) == 0) {
+			return &cryptogram.mac;
+		}
+		return nullptr;
+	}
+	
+	ErrorCode ECIESCryptogram_DecodeJSON(const cc7::ByteRange & json, ECIESCryptogram & out_cryptogram)
+	{
+		out_cryptogram.key.clear();
+		out_cryptogram.body.clear();
+		out_cryptogram.mac.clear();
+		
+		_JSONScanner scanner;
+		scanner.p = reinterpret_cast<const char*>(json.data());
+		scanner.end = scanner.p + json.size();
+		
+		bool valid = scanner.consume('{');
+		if (valid && !scanner.consume('}')) {
+			while (true) {
+				// "name" : value
+				cc7::ByteRange name, content;
+				bool has_escape;
+				if (!scanner.consume('"') || !scanner.scanString(name, has_escape) || !scanner.consume(':')) {
+					valid = false;
+					break;
+				}
+				cc7::ByteArray * target = has_escape ? nullptr : _JSONPropertyTarget(name, out_cryptogram);
+				if (scanner.consume('"')) {
+					if (!scanner.scanString(content, has_escape)) {
+						valid = false;
+						break;
+					}
+					if (target && !_DecodeJSONBase64(content, has_escape, *target)) {
+						valid = false;
+						break;
+					}
+				} else {
+					const char * value = scanner.p;
+					if (!scanner.scanSimpleValue()) {
+						valid = false;
+						break;
+					}
+					bool is_null = scanner.p - value == 4 && memcmp(value, "null", 4) == 0;
+					if (target && !is_null) {
+						valid = false;
+						break;
+					}
+				}
+				if (scanner.consume(',')) {
+					continue;
+				}
+				valid = scanner.consume('}');
+				break;
+			}
+		}
+		scanner.skipWhitespace();
+		if (!valid || scanner.p != scanner.end) {
+			CC7_LOG("ECIESCryptogram_DecodeJSON: Invalid JSON envelope.");
+			out_cryptogram.key.clear();
+			out_cryptogram.body.clear();
+			out_cryptogram.mac.clear();
+			return EC_WrongParam;
+		}
+		return EC_Ok;
+	}
+	
 } // io::getlime::powerAuth
 } // io::getlime
 } // io
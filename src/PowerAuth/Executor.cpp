@@ -0,0 +1,162 @@
+/*
+ * Copyright 2019 Wultra s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <PowerAuth/Executor.h>
+#include <algorithm>
+
+namespace io
+{
+namespace getlime
+{
+namespace powerAuth
+{
+	// MARK: - WorkerPoolExecutor -
+
+	WorkerPoolExecutor::WorkerPoolExecutor(size_t max_threads) :
+		_max_threads(max_threads),
+		_idle_threads(0),
+		_running_tasks(0),
+		_stop(false)
+	{
+		if (_max_threads == 0) {
+			_max_threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+	}
+
+	WorkerPoolExecutor::~WorkerPoolExecutor()
+	{
+		{
+			std::unique_lock<std::mutex> lock(_lock);
+			_stop = true;
+		}
+		_task_available.notify_all();
+		for (auto & thread : _threads) {
+			thread.join();
+		}
+	}
+
+	size_t WorkerPoolExecutor::maxThreads() const
+	{
+		return _max_threads;
+	}
+
+	void WorkerPoolExecutor::execute(std::function<void()> task)
+	{
+		std::unique_lock<std::mutex> lock(_lock);
+		CC7_ASSERT(!_stop, "Executor is already destroyed");
+		_tasks.push_back(std::move(task));
+		if (_idle_threads == 0 && _threads.size() < _max_threads) {
+			try {
+				_threads.push_back(std::thread(&WorkerPoolExecutor::workerLoop, this));
+			} catch (...) {
+				// Failed to create a new thread. If there's no thread at all, then execute
+				// the task on the current thread.
+				if (_threads.empty()) {
+					auto pending = std::move(_tasks.back());
+					_tasks.pop_back();
+					lock.unlock();
+					pending();
+					return;
+				}
+			}
+		}
+		lock.unlock();
+		_task_available.notify_one();
+	}
+
+	void WorkerPoolExecutor::waitUntilIdle()
+	{
+		std::unique_lock<std::mutex> lock(_lock);
+		_idle.wait(lock, [this] { return _tasks.empty() && _running_tasks == 0; });
+	}
+
+	void WorkerPoolExecutor::workerLoop()
+	{
+		std::unique_lock<std::mutex> lock(_lock);
+		while (true) {
+			_idle_threads++;
+			_task_available.wait(lock, [this] { return _stop || !_tasks.empty(); });
+			_idle_threads--;
+			if (_tasks.empty()) {
+				// Stopped and there's no pending task
+				break;
+			}
+			auto task = std::move(_tasks.front());
+			_tasks.pop_front();
+			_running_tasks++;
+			lock.unlock();
+			task();
+			task = nullptr;
+			lock.lock();
+			_running_tasks--;
+			if (_tasks.empty() && _running_tasks == 0) {
+				_idle.notify_all();
+			}
+		}
+	}
+
+
+	// MARK: - AsyncOperation -
+
+	AsyncOperation::AsyncOperation() :
+		_cancelled(std::make_shared<std::atomic<bool>>(false))
+	{
+	}
+
+	void AsyncOperation::cancel()
+	{
+		_cancelled->store(true);
+	}
+
+	bool AsyncOperation::isCancelled() const
+	{
+		return _cancelled->load();
+	}
+	
+	
+	// MARK: - Parallel execution -
+	
+	void ExecuteParallel(Executor & executor, size_t count, size_t chunk_size,
+						 const std::function<void(size_t begin, size_t end)> & task)
+	{
+		if (count == 0) {
+			return;
+		}
+		if (chunk_size == 0) {
+			// Use few chunks per core, to balance chunks with different processing time.
+			size_t chunks = 4 * std::max(1u, std::thread::hardware_concurrency());
+			chunk_size = std::max<size_t>(1, (count + chunks - 1) / chunks);
+		}
+		std::mutex lock;
+		std::condition_variable finished;
+		size_t pending = (count + chunk_size - 1) / chunk_size;
+		for (size_t begin = 0; begin < count; begin += chunk_size) {
+			size_t end = std::min(count, begin + chunk_size);
+			executor.execute([&, begin, end]() {
+				task(begin, end);
+				std::lock_guard<std::mutex> guard(lock);
+				if (--pending == 0) {
+					finished.notify_one();
+				}
+			});
+		}
+		std::unique_lock<std::mutex> guard(lock);
+		finished.wait(guard, [&pending] { return pending == 0; });
+	}
+
+} // io::getlime::powerAuth
+} // io::getlime
+} // io
@@ -17,8 +17,12 @@
 
 #include <PowerAuth/OtpUtil.h>
 #include <cc7/Base64.h>
-#include <cc7/Base32.h>
 #include "utils/CRC16.h"
+#include "utils/Base64.h"
+#include "crypto/ECC.h"
+#include <thread>
+#include <functional>
+#include <algorithm>
 
 namespace io
 {
@@ -34,47 +38,229 @@ namespace powerAuth
 		return !activationSignature.empty();
 	}
 	
-	// MARK: - OtpUtil -
+	// MARK: - Private functions -
 	
-	// Parser
+	/**
+	 Base32 decoding table. Contains 0xFF for all characters which are not allowed in the activation code.
+	 */
+	static constexpr cc7::byte s_base32_decode_table[256] =
+	{
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+		0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	};
 	
-	bool OtpUtil::parseActivationCode(const std::string &activationCode, OtpComponents &out_components)
+	/**
+	 Validates activation code stored in |code| buffer with |length| characters. The function
+	 decodes Base32 characters directly into the stack buffer, so no memory is allocated.
+	 */
+	static bool _ValidateActivationCode(const char * code, size_t length)
+	{
+		// ABCDE-ABCDE-ABCDE-ABCDE
+		if (length != 23) {
+			return false;
+		}
+		// 20 Base32 characters are decoded into 12 bytes. The last 4 bits are ignored.
+		cc7::byte code_bytes[12];
+		size_t code_bytes_count = 0;
+		cc7::U32 bit_buffer = 0;
+		size_t bit_count = 0;
+		for (size_t i = 0; i < length; i++) {
+			auto c = (cc7::byte)code[i];
+			// validate dash at right position
+			if ((i % 6) == 5) {
+				if (c != '-') {
+					return false;
+				}
+				continue;
+			}
+			const cc7::byte value = s_base32_decode_table[c];
+			if (value == 0xFF) {
+				// Not a valid Base32 character
+				return false;
+			}
+			bit_buffer = (bit_buffer << 5) | value;
+			bit_count += 5;
+			if (bit_count >= 8) {
+				bit_count -= 8;
+				code_bytes[code_bytes_count++] = (cc7::byte)(bit_buffer >> bit_count);
+			}
+		}
+		// Finally, validate CRC-16 checksum
+		return utils::CRC16_Validate(cc7::ByteRange(code_bytes, code_bytes_count));
+	}
+	
+	/**
+	 Validates |count| codes from |codes| array and returns number of valid codes.
+	 */
+	static size_t _ValidateActivationCodes(const std::string * codes, size_t count, bool * out_results)
+	{
+		size_t valid_count = 0;
+		for (size_t i = 0; i < count; i++) {
+			const bool valid = _ValidateActivationCode(codes[i].data(), codes[i].length());
+			if (out_results) {
+				out_results[i] = valid;
+			}
+			valid_count += valid;
+		}
+		return valid_count;
+	}
+	
+	/**
+	 Splits |count| items into batches and calls |batch_function| for each batch. The batches are processed
+	 in up to |max_threads| threads (0 means number of CPU cores), but each batch contains at least |min_batch_size|
+	 items. The first batch is always processed on the current thread. Returns sum of values returned from
+	 all |batch_function| calls.
+	 */
+	static size_t _ProcessInBatches(size_t count, size_t max_threads, size_t min_batch_size,
+									const std::function<size_t (size_t begin, size_t size)> & batch_function)
+	{
+		if (max_threads == 0) {
+			max_threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+		size_t threads_count = std::min(max_threads, count / min_batch_size);
+		if (threads_count <= 1) {
+			return batch_function(0, count);
+		}
+		const size_t batch_size = (count + threads_count - 1) / threads_count;
+		// Rounding of batch size up may leave the last threads without work.
+		threads_count = (count + batch_size - 1) / batch_size;
+		std::vector<size_t> batch_results(threads_count, 0);
+		std::vector<std::thread> threads;
+		threads.reserve(threads_count - 1);
+		for (size_t t = 1; t < threads_count; t++) {
+			const size_t begin = t * batch_size;
+			const size_t size = std::min(batch_size, count - begin);
+			size_t * batch_result = &batch_results[t];
+			try {
+				threads.emplace_back([&batch_function, begin, size, batch_result]() {
+					*batch_result = batch_function(begin, size);
+				});
+			} catch (...) {
+				// Thread creation failed, so process this batch on the current thread.
+				*batch_result = batch_function(begin, size);
+			}
+		}
+		batch_results[0] = batch_function(0, batch_size);
+		for (auto && thread : threads) {
+			thread.join();
+		}
+		size_t result = 0;
+		for (auto batch_result : batch_results) {
+			result += batch_result;
+		}
+		return result;
+	}
+	
+	/**
+	 Finalization function from SplitMix64 generator.
+	 */
+	static inline cc7::U64 _MixBits(cc7::U64 z)
+	{
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+	
+	/**
+	 Writes 23 characters long activation code, derived from |seed| and |index|, to |out| buffer.
+	 */
+	static void _GenerateActivationCode(cc7::U64 seed, cc7::U64 index, char * out)
+	{
+		static const char * s_base32_alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+		// Derive 10 bytes of code from seed and index, with using SplitMix64 sequence.
+		const cc7::U64 GAMMA = 0x9E3779B97F4A7C15ULL;
+		const cc7::U64 a = _MixBits(seed + (2 * index + 1) * GAMMA);
+		const cc7::U64 b = _MixBits(seed + (2 * index + 2) * GAMMA);
+		cc7::byte code_bytes[12];
+		for (size_t i = 0; i < 8; i++) {
+			code_bytes[i] = (cc7::byte)(a >> (i * 8));
+		}
+		code_bytes[8] = (cc7::byte)b;
+		code_bytes[9] = (cc7::byte)(b >> 8);
+		// Append CRC-16 in big endian order
+		const cc7::U16 crc = utils::CRC16_Calculate(cc7::ByteRange(code_bytes, 10));
+		code_bytes[10] = (cc7::byte)(crc >> 8);
+		code_bytes[11] = (cc7::byte)crc;
+		// Encode 96 bits into 20 Base32 characters. The last 4 bits are zero.
+		cc7::U32 bit_buffer = 0;
+		size_t bit_count = 0;
+		size_t byte_index = 0;
+		for (size_t i = 0; i < 23; i++) {
+			if ((i % 6) == 5) {
+				out[i] = '-';
+				continue;
+			}
+			if (bit_count < 5) {
+				bit_buffer = (bit_buffer << 8) | (byte_index < 12 ? code_bytes[byte_index++] : 0);
+				bit_count += 8;
+			}
+			bit_count -= 5;
+			out[i] = s_base32_alphabet[(bit_buffer >> bit_count) & 0x1F];
+		}
+	}
+	
+	/**
+	 Parses activation code from |activation_code| string, starting at |offset|.
+	 */
+	static bool _ParseActivationCode(const std::string & activation_code, size_t offset, OtpComponents & out_components)
 	{
 		// At first, look for #
-		auto hash_pos = activationCode.find('#');
+		auto hash_pos = activation_code.find('#', offset);
 		auto has_signature = hash_pos != std::string::npos;
 		if (has_signature) {
 			// split activationCode to code and signature
-			out_components.activationCode = activationCode.substr(0, hash_pos);
-			out_components.activationSignature = activationCode.substr(hash_pos + 1);
+			out_components.activationCode.assign(activation_code, offset, hash_pos - offset);
+			out_components.activationSignature.assign(activation_code, hash_pos + 1, std::string::npos);
 			// validate Base64 signature
-			if (!validateSignature(out_components.activationSignature)) {
+			if (!OtpUtil::validateSignature(out_components.activationSignature)) {
 				return false;
 			}
 		} else {
 			// use a whole input string as a code
-			out_components.activationCode = activationCode;
+			out_components.activationCode.assign(activation_code, offset, std::string::npos);
 			out_components.activationSignature.clear();
 		}
 		// Now validate just the code
-		return validateActivationCode(out_components.activationCode);
+		return _ValidateActivationCode(out_components.activationCode.data(), out_components.activationCode.length());
+	}
+	
+	
+	// MARK: - OtpUtil -
+	
+	// Parser
+	
+	bool OtpUtil::parseActivationCode(const std::string &activationCode, OtpComponents &out_components)
+	{
+		return _ParseActivationCode(activationCode, 0, out_components);
 	}
 	
-	static const std::string RECOVERY_QR_MARKER("R:");
+	static const char * RECOVERY_QR_MARKER = "R:";
 	
 	bool OtpUtil::parseRecoveryCode(const std::string &recovery_code, OtpComponents &out_components)
 	{
-		std::string code_to_test;
+		size_t offset = 0;
 		auto recovery_marker_pos = recovery_code.find(RECOVERY_QR_MARKER);
 		if (recovery_marker_pos != std::string::npos) {
 			if (recovery_marker_pos != 0) {
 				return false;	// "R:" is not at the beginning of string
 			}
-			code_to_test = recovery_code.substr(2);
-		} else {
-			code_to_test = recovery_code;
+			offset = 2;
 		}
-		if (!parseActivationCode(code_to_test, out_components)) {
+		if (!_ParseActivationCode(recovery_code, offset, out_components)) {
 			return false;
 		}
 		return out_components.hasSignature() == false;
@@ -110,30 +296,96 @@ namespace powerAuth
 	
 	bool OtpUtil::validateActivationCode(const std::string &code)
 	{
-		// ABCDE-ABCDE-ABCDE-ABCDE
-		if (code.length() != 23) {
-			return false;
+		return _ValidateActivationCode(code.data(), code.length());
+	}
+	
+	
+	size_t OtpUtil::validateActivationCodes(const std::string * codes, size_t count, bool * out_results, size_t max_threads)
+	{
+		// Each thread should validate a large enough batch of codes, otherwise
+		// the cost of thread creation is higher than the validation itself.
+		return _ProcessInBatches(count, max_threads, 8192, [=](size_t begin, size_t size) -> size_t {
+			return _ValidateActivationCodes(codes + begin, size, out_results ? out_results + begin : nullptr);
+		});
+	}
+	
+	
+	size_t OtpUtil::validateActivationCodes(const std::vector<std::string> & codes, bool * out_results, size_t max_threads)
+	{
+		return validateActivationCodes(codes.data(), codes.size(), out_results, max_threads);
+	}
+	
+	
+	// Generators
+	
+	bool OtpUtil::generateActivationCodes(cc7::U64 seed, cc7::U64 first_index, size_t count,
+										  const cc7::ByteRange & master_private_key,
+										  std::vector<OtpComponents> & out_codes,
+										  size_t max_threads)
+	{
+		const bool sign_codes = !master_private_key.empty();
+		if (sign_codes) {
+			// Validate private key before the batch is processed
+			EC_KEY * key = crypto::ECC_ImportPrivateKey(nullptr, master_private_key);
+			if (!key) {
+				out_codes.clear();
+				return false;
+			}
+			EC_KEY_free(key);
 		}
-		std::string code_base32;
-		code_base32.reserve(20);
-		for (size_t i = 0; i < code.length(); i++) {
-			auto c = code[i];
-			// validate dash at right position
-			if ((i % 6) == 5) {
-				if (c != '-') {
-					return false;
+		out_codes.resize(count);
+		OtpComponents * codes = out_codes.data();
+		// The ECDSA signature is way more expensive than the code generation, so use smaller batches for signed codes.
+		const size_t min_batch_size = sign_codes ? 64 : 8192;
+		size_t failures = _ProcessInBatches(count, max_threads, min_batch_size, [=, &master_private_key](size_t begin, size_t size) -> size_t {
+			// Each batch uses its own copy of the private key
+			EC_KEY * key = sign_codes ? crypto::ECC_ImportPrivateKey(nullptr, master_private_key) : nullptr;
+			if (sign_codes && !key) {
+				return size;
+			}
+			size_t batch_failures = 0;
+			cc7::ByteArray signature;
+			for (size_t i = begin; i < begin + size; i++) {
+				OtpComponents & code = codes[i];
+				code.activationCode.resize(23);
+				_GenerateActivationCode(seed, first_index + i, &code.activationCode[0]);
+				if (key) {
+					if (crypto::ECDSA_ComputeSignature(cc7::MakeRange(code.activationCode), key, signature)) {
+						code.activationSignature = utils::Base64_Encode(signature);
+					} else {
+						code.activationSignature.clear();
+						batch_failures++;
+					}
+				} else {
+					code.activationSignature.clear();
 				}
-			} else {
-				code_base32.push_back(c);
 			}
-		}
-		cc7::ByteArray code_bytes;
-		if (!cc7::Base32_Decode(code_base32, false, code_bytes)) {
-			// Not a valid Base32 string
-			return false;
-		}
-		// Finally, validate CRC-16 checksum
-		return utils::CRC16_Validate(code_bytes);
+			EC_KEY_free(key);
+			return batch_failures;
+		});
+		return failures == 0;
+	}
+	
+	
+	void OtpUtil::generateRecoveryCodes(cc7::U64 seed, cc7::U64 first_index, size_t count, bool add_r_prefix,
+										std::vector<std::string> & out_codes,
+										size_t max_threads)
+	{
+		out_codes.resize(count);
+		std::string * codes = out_codes.data();
+		const size_t prefix_length = add_r_prefix ? 2 : 0;
+		_ProcessInBatches(count, max_threads, 8192, [=](size_t begin, size_t size) -> size_t {
+			for (size_t i = begin; i < begin + size; i++) {
+				std::string & code = codes[i];
+				code.resize(prefix_length + 23);
+				if (add_r_prefix) {
+					code[0] = 'R';
+					code[1] = ':';
+				}
+				_GenerateActivationCode(seed, first_index + i, &code[prefix_length]);
+			}
+			return 0;
+		});
 	}
 	
 	
@@ -150,9 +402,9 @@ namespace powerAuth
 	bool OtpUtil::validateRecoveryCode(const std::string &recovery_code, bool allow_r_prefix)
 	{
 		if (recovery_code.find(RECOVERY_QR_MARKER) == std::string::npos) {
-			return validateActivationCode(recovery_code);
+			return _ValidateActivationCode(recovery_code.data(), recovery_code.length());
 		}
-		return allow_r_prefix && validateActivationCode(recovery_code.substr(2));
+		return allow_r_prefix && _ValidateActivationCode(recovery_code.data() + 2, recovery_code.length() - 2);
 	}
 	
 	
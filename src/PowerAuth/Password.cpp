@@ -15,7 +15,13 @@
  */
 
 #include <PowerAuth/Password.h>
-#include <iterator>
+#include <PowerAuth/Executor.h>
+#include "protocol/ProtocolUtils.h"
+#include "protocol/Constants.h"
+#include "utils/SecureMemory.h"
+#include <openssl/crypto.h>
+#include <string.h>
+#include <algorithm>
 
 namespace io
 {
@@ -24,32 +30,239 @@ namespace getlime
 namespace powerAuth
 {
 	/**
-	 Converts one UTF codepoint into sequence of UTF8 encoded bytes.
+	 Converts one UTF codepoint into sequence of UTF8 encoded bytes. The |out| buffer
+	 must have capacity for at least 4 bytes. Returns number of bytes written to the buffer,
+	 or 0 if codepoint is invalid.
 	 */
-	static bool _UTF8Encode(cc7::U32 codepoint, cc7::ByteArray & out)
+	static size_t _UTF8Encode(cc7::U32 codepoint, cc7::byte * out)
 	{
-		cc7::byte buffer[4];
 		if(codepoint < 0x80) {
-			buffer[0] = (char)codepoint;
-			out.append(buffer, 1);
+			out[0] = (char)codepoint;
+			return 1;
 		} else if(codepoint < 0x800) {
-			buffer[0] = 0xC0 + ((codepoint & 0x7C0) >> 6);
-			buffer[1] = 0x80 + ((codepoint & 0x03F));
-			out.append(buffer, 2);
+			out[0] = 0xC0 + ((codepoint & 0x7C0) >> 6);
+			out[1] = 0x80 + ((codepoint & 0x03F));
+			return 2;
 		} else if(codepoint < 0x10000) {
-			buffer[0] = 0xE0 + ((codepoint & 0xF000) >> 12);
-			buffer[1] = 0x80 + ((codepoint & 0x0FC0) >> 6);
-			buffer[2] = 0x80 + ((codepoint & 0x003F));
-			out.append(buffer, 3);
+			out[0] = 0xE0 + ((codepoint & 0xF000) >> 12);
+			out[1] = 0x80 + ((codepoint & 0x0FC0) >> 6);
+			out[2] = 0x80 + ((codepoint & 0x003F));
+			return 3;
 		} else if(codepoint <= 0x10FFFF) {
-			buffer[0] = 0xF0 + ((codepoint & 0x1C0000) >> 18);
-			buffer[1] = 0x80 + ((codepoint & 0x03F000) >> 12);
-			buffer[2] = 0x80 + ((codepoint & 0x000FC0) >> 6);
-			buffer[3] = 0x80 + ((codepoint & 0x00003F));
-			out.append(buffer, 4);
-		} else {
+			out[0] = 0xF0 + ((codepoint & 0x1C0000) >> 18);
+			out[1] = 0x80 + ((codepoint & 0x03F000) >> 12);
+			out[2] = 0x80 + ((codepoint & 0x000FC0) >> 6);
+			out[3] = 0x80 + ((codepoint & 0x00003F));
+			return 4;
+		}
+		return 0;
+	}
+	
+	
+	// MARK: - Secure storage -
+	
+	/**
+	 Maximum number of bytes required for one UTF-8 encoded character.
+	 */
+	const size_t kMaxCharacterSize = 4;
+	
+	/*
+	 The Storage structure keeps passphrase in one block of secure memory. For mutable
+	 passwords, the block contains two gap buffers with the same logical layout:
+	 
+	   bytes:   [ UTF-8 bytes before gap | gap | UTF-8 bytes after gap ]
+	   lengths: [ lengths before gap     | gap | lengths after gap     ]
+	 
+	 where |lengths| contains number of bytes for each stored character. The gap is
+	 moved to the edited index before each modification and it stays there, so the
+	 subsequent edits at the same position are O(1) and there's no index of byte
+	 offsets to update. Both segments are joined in place, by moving the gap to
+	 the end, only when the contiguous passphrase is requested.
+	 
+	 Immutable passwords use only the |bytes| buffer, with the gap at the end.
+	 */
+	struct Password::Storage
+	{
+		cc7::byte *	memory;
+		size_t		memory_size;
+		
+		cc7::byte *	bytes;
+		size_t		bytes_capacity;
+		size_t		bytes_gap_begin;
+		size_t		bytes_gap_end;
+		
+		cc7::byte *	lengths;
+		size_t		capacity;
+		size_t		gap_begin;
+		size_t		gap_end;
+		
+		size_t charactersCount() const
+		{
+			return capacity - (gap_end - gap_begin);
+		}
+		
+		size_t bytesCount() const
+		{
+			return bytes_capacity - (bytes_gap_end - bytes_gap_begin);
+		}
+		
+		static Storage * createMutable(size_t capacity);
+		static Storage * createImmutable(const cc7::ByteRange & data);
+		static void destroy(Storage * storage);
+		static bool ensureCapacity(Storage *& storage);
+		void moveGap(size_t index);
+		
+		void moveGapToEnd()
+		{
+			moveGap(charactersCount());
+		}
+	};
+	
+	/**
+	 Initial capacity for mutable password, in characters. The storage is allocated
+	 from the pool of small secure memory blocks, so the real capacity is usually higher.
+	 */
+	const size_t kInitialCapacity = 16;
+	
+	/**
+	 Creates a new storage for mutable password, with at least |capacity| characters.
+	 */
+	Password::Storage * Password::Storage::createMutable(size_t capacity)
+	{
+		size_t memory_size;
+		cc7::byte * memory = utils::SecureMemory_Alloc(capacity * (kMaxCharacterSize + 1), memory_size);
+		if (!memory) {
+			return nullptr;
+		}
+		// Use the whole allocated block.
+		capacity = memory_size / (kMaxCharacterSize + 1);
+		auto storage = new Storage();
+		storage->memory = memory;
+		storage->memory_size = memory_size;
+		storage->bytes = memory;
+		storage->bytes_capacity = capacity * kMaxCharacterSize;
+		storage->bytes_gap_begin = 0;
+		storage->bytes_gap_end = storage->bytes_capacity;
+		storage->lengths = memory + storage->bytes_capacity;
+		storage->capacity = capacity;
+		storage->gap_begin = 0;
+		storage->gap_end = capacity;
+		return storage;
+	}
+	
+	/**
+	 Creates a new storage for immutable password with content of |data|.
+	 */
+	Password::Storage * Password::Storage::createImmutable(const cc7::ByteRange & data)
+	{
+		size_t memory_size;
+		cc7::byte * memory = utils::SecureMemory_Alloc(data.size(), memory_size);
+		if (!memory) {
+			return nullptr;
+		}
+		if (!data.empty()) {
+			memcpy(memory, data.data(), data.size());
+		}
+		auto storage = new Storage();
+		storage->memory = memory;
+		storage->memory_size = memory_size;
+		storage->bytes = memory;
+		storage->bytes_capacity = data.size();
+		storage->bytes_gap_begin = data.size();
+		storage->bytes_gap_end = data.size();
+		storage->lengths = nullptr;
+		storage->capacity = 0;
+		storage->gap_begin = 0;
+		storage->gap_end = 0;
+		return storage;
+	}
+	
+	/**
+	 Wipes and releases the storage.
+	 */
+	void Password::Storage::destroy(Storage * storage)
+	{
+		if (storage) {
+			utils::SecureMemory_Free(storage->memory, storage->memory_size);
+			delete storage;
+		}
+	}
+	
+	/**
+	 Moves gap in mutable storage to the character |index|.
+	 */
+	void Password::Storage::moveGap(size_t index)
+	{
+		if (index < gap_begin) {
+			// Move characters before the gap behind the gap
+			const size_t count = gap_begin - index;
+			size_t bytes_count = 0;
+			for (size_t i = index; i < gap_begin; i++) {
+				bytes_count += lengths[i];
+			}
+			const size_t old_bytes_gap_begin = bytes_gap_begin;
+			gap_begin -= count;
+			gap_end -= count;
+			bytes_gap_begin -= bytes_count;
+			bytes_gap_end -= bytes_count;
+			memmove(lengths + gap_end, lengths + gap_begin, count);
+			memmove(bytes + bytes_gap_end, bytes + bytes_gap_begin, bytes_count);
+			// Wipe bytes, which are now in the gap
+			const size_t wipe_end = std::min(old_bytes_gap_begin, bytes_gap_end);
+			utils::SecureMemory_Wipe(bytes + bytes_gap_begin, wipe_end - bytes_gap_begin);
+			
+		} else if (index > gap_begin) {
+			// Move characters after the gap before the gap
+			const size_t count = index - gap_begin;
+			size_t bytes_count = 0;
+			for (size_t i = gap_end; i < gap_end + count; i++) {
+				bytes_count += lengths[i];
+			}
+			const size_t old_bytes_gap_end = bytes_gap_end;
+			memmove(lengths + gap_begin, lengths + gap_end, count);
+			memmove(bytes + bytes_gap_begin, bytes + bytes_gap_end, bytes_count);
+			gap_begin += count;
+			gap_end += count;
+			bytes_gap_begin += bytes_count;
+			bytes_gap_end += bytes_count;
+			// Wipe bytes, which are now in the gap
+			const size_t wipe_begin = std::max(old_bytes_gap_end, bytes_gap_begin);
+			utils::SecureMemory_Wipe(bytes + wipe_begin, bytes_gap_end - wipe_begin);
+		}
+	}
+	
+	/**
+	 Makes sure that mutable storage has capacity for at least one more character.
+	 If there's no storage yet, then creates a new one. If the storage has to be
+	 reallocated, then the old one is wiped and released. Returns false if there's
+	 not enough memory.
+	 */
+	bool Password::Storage::ensureCapacity(Storage *& s)
+	{
+		if (!s) {
+			s = createMutable(kInitialCapacity);
+			return s != nullptr;
+		}
+		if (s->gap_begin < s->gap_end) {
+			return true;
+		}
+		auto new_storage = createMutable(s->capacity * 2);
+		if (!new_storage) {
 			return false;
 		}
+		// The gap in the old storage is empty, so just copy characters before and after the gap.
+		const size_t tail_count = s->capacity - s->gap_end;
+		const size_t tail_bytes_count = s->bytes_capacity - s->bytes_gap_end;
+		memcpy(new_storage->lengths, s->lengths, s->gap_begin);
+		memcpy(new_storage->lengths + new_storage->capacity - tail_count, s->lengths + s->gap_end, tail_count);
+		memcpy(new_storage->bytes, s->bytes, s->bytes_gap_begin);
+		memcpy(new_storage->bytes + new_storage->bytes_capacity - tail_bytes_count, s->bytes + s->bytes_gap_end, tail_bytes_count);
+		new_storage->gap_begin = s->gap_begin;
+		new_storage->gap_end = new_storage->capacity - tail_count;
+		new_storage->bytes_gap_begin = s->bytes_gap_begin;
+		new_storage->bytes_gap_end = new_storage->bytes_capacity - tail_bytes_count;
+		destroy(s);
+		s = new_storage;
 		return true;
 	}
 	
@@ -57,13 +270,14 @@ namespace powerAuth
 	// MARK: - Construction / Destruction -
 	
 	Password::Password() :
-		_char_pos(nullptr)
+		_storage(nullptr),
+		_mutable(false)
 	{
 	}
 	
 	Password::~Password()
 	{
-		delete _char_pos;
+		releaseStorage();
 	}
 	
 	
@@ -71,22 +285,31 @@ namespace powerAuth
 	
 	void Password::initAsImmutable(const cc7::ByteRange & data)
 	{
-		delete _char_pos;
-		_char_pos = nullptr;
 		// We're very paranoid here, Let's clear previous content
 		// and assign new one
-		_pass.secureClear();
-		_pass.assign(data);
+		releaseStorage();
+		_mutable = false;
+		if (!data.empty()) {
+			_storage = Storage::createImmutable(data);
+			CC7_ASSERT(_storage != nullptr, "Failed to allocate secure memory");
+		}
 	}
 	
 	void Password::initAsMutable()
 	{
-		if (_char_pos) {
-			_char_pos->clear();
-		} else {
-			_char_pos = new PosVector();
+		if (_mutable && _storage) {
+			// Reuse the existing storage.
+			invalidatePasswordData();
+			utils::SecureMemory_Wipe(_storage->memory, _storage->memory_size);
+			_storage->gap_begin = 0;
+			_storage->gap_end = _storage->capacity;
+			_storage->bytes_gap_begin = 0;
+			_storage->bytes_gap_end = _storage->bytes_capacity;
+			return;
 		}
-		_pass.secureClear();
+		// The storage is allocated with the first character.
+		releaseStorage();
+		_mutable = true;
 	}
 	
 	
@@ -94,26 +317,43 @@ namespace powerAuth
 	
 	bool Password::isMutable() const
 	{
-		return _char_pos != nullptr;
+		return _mutable;
 	}
 	
 	size_t Password::length() const
 	{
+		if (!_storage) {
+			return 0;
+		}
 		if (isMutable()) {
-			return _char_pos->size();
+			return _storage->charactersCount();
 		} else {
-			return _pass.size();
+			return _storage->bytesCount();
 		}
 	}
 	
-	const cc7::ByteArray & Password::passwordData() const
+	cc7::ByteRange Password::passwordData() const
 	{
-		return _pass;
+		return passwordRange();
+	}
+	
+	cc7::ByteRange Password::passwordRange() const
+	{
+		if (!_storage) {
+			return cc7::ByteRange();
+		}
+		if (isMutable()) {
+			// Join segments before and after the gap. The join happens only once after
+			// the modification, so the returned ranges are stable for all readers.
+			std::lock_guard<std::mutex> lock(_join_lock);
+			_storage->moveGapToEnd();
+		}
+		return cc7::ByteRange(_storage->bytes, _storage->bytes_gap_begin);
 	}
 	
 	bool Password::isEqualToPassword(const Password & p) const
 	{
-		return _pass == p.passwordData();
+		return passwordRange() == p.passwordRange();
 	}
 	
 	
@@ -130,35 +370,26 @@ namespace powerAuth
 	
 	bool Password::addCharacter(cc7::U32 utf_codepoint)
 	{
-		if (CC7_CHECK(isMutable(), "Object is immutable")) {
-			cc7::ByteArray bytes;
-			bytes.reserve(4);
-			if (CC7_CHECK(_UTF8Encode(utf_codepoint, bytes), "Wrong codepoint")) {
-				// store current position (e.g. current size of pass)
-				_char_pos->push_back(_pass.size());
-				// append bytes...
-				_pass.append(bytes);
-				return true;
-			}
-		}
-		return false;
+		return insertCharacter(utf_codepoint, length());
 	}
 	
 	bool Password::insertCharacter(cc7::U32 utf_codepoint, size_t index)
 	{
 		if (CC7_CHECK(isMutable(), "Object is immutable")) {
-			if (CC7_CHECK(index <= _char_pos->size(), "Index is out of range")) {
-				cc7::ByteArray bytes;
-				bytes.reserve(4);
-				if (CC7_CHECK(_UTF8Encode(utf_codepoint, bytes), "Wrong codepoint")) {
-					size_t offset = indexToPos(index);
-					// store actual position to the positions
-					_char_pos->insert(_char_pos->begin() + index, offset);
-					// insert bytes
-					_pass.insert(_pass.begin() + offset, bytes.begin(), bytes.end());
-					// update positions after the inserted one
-					updateIndexes(index + 1, bytes.size());
-					return true;
+			if (CC7_CHECK(index <= length(), "Index is out of range")) {
+				cc7::byte bytes[kMaxCharacterSize];
+				size_t size = _UTF8Encode(utf_codepoint, bytes);
+				if (CC7_CHECK(size > 0, "Wrong codepoint")) {
+					bool result = Storage::ensureCapacity(_storage);
+					if (CC7_CHECK(result, "Failed to allocate secure memory")) {
+						invalidatePasswordData();
+						_storage->moveGap(index);
+						memcpy(_storage->bytes + _storage->bytes_gap_begin, bytes, size);
+						_storage->bytes_gap_begin += size;
+						_storage->lengths[_storage->gap_begin++] = size;
+						utils::SecureMemory_Wipe(bytes, size);
+						return true;
+					}
 				}
 			}
 		}
@@ -169,12 +400,7 @@ namespace powerAuth
 	{
 		if (CC7_CHECK(isMutable(), "Object is immutable")) {
 			if (CC7_CHECK(length() > 0, "Password is already empty")) {
-				size_t offset = indexToPos(_char_pos->size() - 1);
-				// remove bytes from the password
-				_pass.erase(_pass.begin() + offset, _pass.end());
-				// remove the position
-				_char_pos->pop_back();
-				return true;
+				return removeCharacter(length() - 1);
 			}
 		}
 		return false;
@@ -183,39 +409,182 @@ namespace powerAuth
 	bool Password::removeCharacter(size_t index)
 	{
 		if (CC7_CHECK(isMutable(), "Object is immutable")) {
-			if (CC7_CHECK(index < _char_pos->size(), "Index is out of range")) {
-				size_t offset = indexToPos(index);
-				size_t bytes  = indexToPos(index + 1) - offset;
-				// remove bytes from the password
-				_pass.erase(_pass.begin() + offset, _pass.begin() + offset + bytes);
-				// remove the position
-				_char_pos->erase(_char_pos->begin() + index);
-				// update positions after the removed one
-				updateIndexes(index, -bytes);
+			if (CC7_CHECK(index < length(), "Index is out of range")) {
+				invalidatePasswordData();
+				// Move gap behind the removed character and then extend the gap.
+				_storage->moveGap(index + 1);
+				size_t size = _storage->lengths[--_storage->gap_begin];
+				_storage->bytes_gap_begin -= size;
+				utils::SecureMemory_Wipe(_storage->bytes + _storage->bytes_gap_begin, size);
 				return true;
 			}
 		}
 		return false;
 	}
 
+	// MARK: - Speculative key derivation -
+	
+	std::shared_ptr<PasswordKeyDerivation> Password::startKeyDerivation(const cc7::ByteRange & salt, cc7::U32 iterations, Executor & executor)
+	{
+		// Only one derivation can be valid for the passphrase
+		auto previous = _derivation.lock();
+		if (previous) {
+			previous->invalidate();
+		}
+		_derivation.reset();
+		
+		cc7::ByteRange password = passwordRange();
+		if (password.empty() || salt.empty() || iterations == 0) {
+			CC7_LOG("Password: Empty password or wrong PBKDF2 parameters.");
+			return nullptr;
+		}
+		std::shared_ptr<PasswordKeyDerivation> derivation(new PasswordKeyDerivation());
+		if (!derivation->init(password, salt, iterations)) {
+			CC7_LOG("Password: Failed to allocate secure memory for key derivation.");
+			return nullptr;
+		}
+		_derivation = derivation;
+		executor.execute([derivation]() {
+			derivation->derive();
+		});
+		return derivation;
+	}
+	
+	
 	// MARK: - Private interface -
 	
-	size_t Password::indexToPos(size_t index)
+	void Password::releaseStorage()
+	{
+		invalidatePasswordData();
+		Storage::destroy(_storage);
+		_storage = nullptr;
+	}
+	
+	void Password::invalidatePasswordData()
 	{
-		if (index < _char_pos->size()) {
-			return _char_pos->operator[](index);
+		auto derivation = _derivation.lock();
+		if (derivation) {
+			derivation->invalidate();
+			_derivation.reset();
 		}
-		return _pass.size();
 	}
+	
+	
+	// MARK: - PasswordKeyDerivation -
+	
+	PasswordKeyDerivation::PasswordKeyDerivation() :
+		_state(Invalid),
+		_discard(false),
+		_memory(nullptr),
+		_memory_size(0),
+		_password_size(0),
+		_iterations(0)
+	{
+	}
+	
+	PasswordKeyDerivation::~PasswordKeyDerivation()
+	{
+		std::lock_guard<std::mutex> lock(_lock);
+		releaseMemory();
+	}
+	
+	bool PasswordKeyDerivation::init(const cc7::ByteRange & password, const cc7::ByteRange & salt, cc7::U32 iterations)
+	{
+		// Memory layout: | derived key | password |
+		_memory = utils::SecureMemory_Alloc(protocol::SIGNATURE_KEY_SIZE + password.size(), _memory_size);
+		if (!_memory) {
+			return false;
+		}
+		memcpy(_memory + protocol::SIGNATURE_KEY_SIZE, password.data(), password.size());
+		_password_size = password.size();
+		_salt.assign(salt);
+		_iterations = iterations;
+		_state = Pending;
+		return true;
+	}
+	
+	bool PasswordKeyDerivation::isValid() const
+	{
+		std::lock_guard<std::mutex> lock(_lock);
+		return _state != Invalid && !_discard;
+	}
+	
+	bool PasswordKeyDerivation::isFinished() const
+	{
+		std::lock_guard<std::mutex> lock(_lock);
+		return _state == Finished;
+	}
+	
+	void PasswordKeyDerivation::invalidate()
+	{
+		std::lock_guard<std::mutex> lock(_lock);
+		if (_state == Running) {
+			// The worker still uses the memory, so it will wipe it after the derivation.
+			_discard = true;
+		} else {
+			releaseMemory();
+		}
+	}
+	
+	void PasswordKeyDerivation::derive()
+	{
+		std::unique_lock<std::mutex> lock(_lock);
+		if (_state != Pending) {
+			// Already invalidated or consumed
+			return;
+		}
+		_state = Running;
+		lock.unlock();
 		
-	void Password::updateIndexes(size_t begin, ptrdiff_t offset)
+		cc7::ByteRange password(_memory + protocol::SIGNATURE_KEY_SIZE, _password_size);
+		cc7::ByteArray key = protocol::DeriveSecretKeyFromPassword(password, _salt, _iterations);
+		
+		lock.lock();
+		if (key.size() == protocol::SIGNATURE_KEY_SIZE) {
+			memcpy(_memory, key.data(), key.size());
+			_state = Finished;
+		} else {
+			_discard = true;
+		}
+		key.secureClear();
+		if (_discard) {
+			releaseMemory();
+		}
+		_finished.notify_all();
+	}
+	
+	bool PasswordKeyDerivation::consumeDerivedKey(const cc7::ByteRange & password, const cc7::ByteRange & salt, cc7::U32 iterations,
+												  cc7::ByteArray & out_key)
 	{
-		while (begin < _char_pos->size()) {
-			_char_pos->operator[](begin) += offset;
-			++begin;
+		std::unique_lock<std::mutex> lock(_lock);
+		// If the derivation is running, then it's still better to wait than start over.
+		_finished.wait(lock, [this] { return _state != Running; });
+		bool result = false;
+		if (_state == Finished) {
+			cc7::ByteRange stored_password(_memory + protocol::SIGNATURE_KEY_SIZE, _password_size);
+			bool match = password.size() == stored_password.size() &&
+						 CRYPTO_memcmp(password.data(), stored_password.data(), password.size()) == 0;
+			if (match && iterations == _iterations && salt == _salt) {
+				out_key.assign(_memory, _memory + protocol::SIGNATURE_KEY_SIZE);
+				result = true;
+			}
 		}
+		// One-shot, release everything
+		releaseMemory();
+		return result;
+	}
+	
+	void PasswordKeyDerivation::releaseMemory()
+	{
+		utils::SecureMemory_Free(_memory, _memory_size);
+		_memory = nullptr;
+		_memory_size = 0;
+		_password_size = 0;
+		_salt.secureClear();
+		_iterations = 0;
+		_state = Invalid;
+		_discard = false;
 	}
-
 
 } // io::getlime::powerAuth
 } // io::getlime
@@ -16,6 +16,10 @@
 
 #include <PowerAuth/PublicTypes.h>
 #include "protocol/Constants.h"
+#include "protocol/ProtocolUtils.h"
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
 
 namespace io
 {
@@ -24,6 +28,15 @@ namespace getlime
 namespace powerAuth
 {
 
+	//
+	// MARK: - SignatureUnlockKeys -
+	//
+	
+	cc7::ByteRange SignatureUnlockKeys::password() const
+	{
+		return userPasswordRange.empty() ? userPassword.byteRange() : userPasswordRange;
+	}
+	
 	//
 	// MARK: - HTTPRequestData -
 	//
@@ -53,11 +66,56 @@ namespace powerAuth
 	}
 	
 	bool HTTPRequestData::hasValidData() const
+	{
+		return HTTPRequestDataView(*this).hasValidData();
+	}
+	
+	bool HTTPRequestData::isOfflineRequest() const
+	{
+		return !offlineNonce.empty();
+	}
+	
+	
+	//
+	// MARK: - HTTPRequestDataView -
+	//
+	
+	HTTPRequestDataView::HTTPRequestDataView()
+	{
+	}
+	
+	HTTPRequestDataView::HTTPRequestDataView(const HTTPRequestData & data) :
+		body(data.body),
+		method(cc7::MakeRange(data.method)),
+		uri(cc7::MakeRange(data.uri)),
+		offlineNonce(cc7::MakeRange(data.offlineNonce))
+	{
+	}
+	
+	HTTPRequestDataView::HTTPRequestDataView(const cc7::ByteRange & body,
+											 const cc7::ByteRange & method,
+											 const cc7::ByteRange & uri,
+											 const cc7::ByteRange & nonce) :
+		body(body),
+		method(method),
+		uri(uri),
+		offlineNonce(nonce)
+	{
+	}
+	
+	static bool _IsEqualToString(const cc7::ByteRange & range, const char * str)
+	{
+		const size_t len = strlen(str);
+		return range.size() == len && memcmp(range.data(), str, len) == 0;
+	}
+	
+	bool HTTPRequestDataView::hasValidData() const
 	{
 		if (method.empty() || uri.empty()) {
 			return false;
 		}
-		if (!(method == "GET" || method == "POST" || method == "HEAD" || method == "PUT" || method == "DELETE")) {
+		if (!(_IsEqualToString(method, "GET") || _IsEqualToString(method, "POST") || _IsEqualToString(method, "HEAD") ||
+			  _IsEqualToString(method, "PUT") || _IsEqualToString(method, "DELETE"))) {
 			return false;
 		}
 		// 24 magic value is actually 16 bytes encoded in Base64.
@@ -67,41 +125,95 @@ namespace powerAuth
 		return true;
 	}
 	
-	bool HTTPRequestData::isOfflineRequest() const
+	bool HTTPRequestDataView::isOfflineRequest() const
 	{
 		return !offlineNonce.empty();
 	}
 	
 	
+	//
+	// MARK: - HTTPRequestBodyStream -
+	//
+	
+	HTTPRequestBodyStream HTTPRequestBodyStreamFromFileDescriptor(int fd)
+	{
+		return [fd](cc7::byte * buffer, size_t capacity, size_t & out_size) -> bool {
+			out_size = 0;
+			if (fd < 0) {
+				return false;
+			}
+			while (true) {
+				ssize_t rc = read(fd, buffer, capacity);
+				if (rc >= 0) {
+					out_size = (size_t)rc;
+					return true;
+				}
+				if (errno != EINTR) {
+					CC7_LOG("HTTPRequestBodyStream: read() failed with errno %d", errno);
+					return false;
+				}
+			}
+		};
+	}
+	
+	
 	//
 	// MARK: - HTTPRequestDataSignature -
 	//
 	
 	std::string HTTPRequestDataSignature::buildAuthHeaderValue() const
 	{
-		const size_t out_size = activationId.length() + applicationKey.length() + nonce.length() + factor.length() + signature.length() +
-								version.length() + protocol::PA_AUTH_FRAGMENTS_LENGTH;
 		std::string out;
-		out.reserve(out_size);
-		
-		// Build header value
-		out.assign(protocol::PA_AUTH_FRAGMENT_BEGIN_VERSION);
-		out.append(version);
-		out.append(protocol::PA_AUTH_FRAGMENT_ACTIVATION_ID);
-		out.append(activationId);
-		out.append(protocol::PA_AUTH_FRAGMENT_APPLICATION_KEY);
-		out.append(applicationKey);
-		out.append(protocol::PA_AUTH_FRAGMENT_NONCE);
-		out.append(nonce);
-		out.append(protocol::PA_AUTH_FRAGMENT_SIGNATURE_TYPE);
-		out.append(factor);
-		out.append(protocol::PA_AUTH_FRAGMENT_SIGNATURE);
-		out.append(signature);
-		out.append(protocol::PA_AUTH_FRAGMENT_END);
-		
+		size_t nonce_offset, signature_offset;
+		protocol::PrepareAuthHeaderValue(out, version, activationId, applicationKey, nonce.size(), factor, signature.size(),
+										 nonce_offset, signature_offset);
+		out.replace(nonce_offset, nonce.size(), nonce);
+		out.replace(signature_offset, signature.size(), signature);
 		return out;
 	}
-
+	
+	
+	//
+	// MARK: - HTTPAuthHeaderView -
+	//
+	
+	/**
+	 Reads quoted value at |p|, which must be followed by |fragment|. The fragment begins with the
+	 closing quote. Returns pointer behind the fragment, or nullptr if there's no such fragment.
+	 */
+	static const cc7::byte * _ReadHeaderComponent(const cc7::byte * p, const cc7::byte * end, const std::string & fragment, cc7::ByteRange & out_value)
+	{
+		const cc7::byte * quote = static_cast<const cc7::byte*>(memchr(p, '"', end - p));
+		if (!quote || (size_t)(end - quote) < fragment.size() || memcmp(quote, fragment.data(), fragment.size()) != 0) {
+			return nullptr;
+		}
+		out_value = cc7::ByteRange(p, quote - p);
+		return quote + fragment.size();
+	}
+	
+	ErrorCode HTTPAuthHeaderView::parse(const cc7::ByteRange & header_value)
+	{
+		const cc7::byte * p = header_value.data();
+		const cc7::byte * end = p + header_value.size();
+		const std::string & begin = protocol::PA_AUTH_FRAGMENT_BEGIN_VERSION;
+		bool result = header_value.size() > begin.size() && memcmp(p, begin.data(), begin.size()) == 0;
+		if (result) {
+			p += begin.size();
+			p = _ReadHeaderComponent(p, end, protocol::PA_AUTH_FRAGMENT_ACTIVATION_ID, version);
+			p = p ? _ReadHeaderComponent(p, end, protocol::PA_AUTH_FRAGMENT_APPLICATION_KEY, activationId) : nullptr;
+			p = p ? _ReadHeaderComponent(p, end, protocol::PA_AUTH_FRAGMENT_NONCE, applicationKey) : nullptr;
+			p = p ? _ReadHeaderComponent(p, end, protocol::PA_AUTH_FRAGMENT_SIGNATURE_TYPE, nonce) : nullptr;
+			p = p ? _ReadHeaderComponent(p, end, protocol::PA_AUTH_FRAGMENT_SIGNATURE, factor) : nullptr;
+			p = p ? _ReadHeaderComponent(p, end, protocol::PA_AUTH_FRAGMENT_END, signature) : nullptr;
+			result = p == end;
+		}
+		if (!result) {
+			*this = HTTPAuthHeaderView();
+			return EC_WrongParam;
+		}
+		return EC_Ok;
+	}
+	
 	
 	//
 	// MARK: - RecoveryData -
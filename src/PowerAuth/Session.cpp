@@ -18,14 +18,17 @@
 #include <PowerAuth/ECIES.h>
 #include <PowerAuth/OtpUtil.h>
 
-#include <cc7/Base64.h>
 #include "protocol/ProtocolUtils.h"
 #include "protocol/Constants.h"
 #include "crypto/CryptoUtils.h"
 #include "utils/URLEncoding.h"
+#include "utils/Base64.h"
 #include "utils/DataReader.h"
 #include "utils/DataWriter.h"
+#include "utils/SecureMemory.h"
+#include <openssl/crypto.h>
 #include <algorithm>
+#include <string.h>
 
 using namespace cc7;
 
@@ -44,7 +47,10 @@ namespace powerAuth
 		_state(SS_Empty),
 		_setup(setup),
 		_pd(nullptr),
-		_ad(nullptr)
+		_ad(nullptr),
+		_ecies_app_prototype(nullptr),
+		_ecies_act_prototype(nullptr),
+		_status_key(nullptr)
 	{
 		if (protocol::ValidateSessionSetup(_setup, false)) {
 			CC7_LOG("Session %p, %d: Object created.", this, sessionIdentifier());
@@ -56,8 +62,11 @@ namespace powerAuth
 	
 	Session::~Session()
 	{
+		invalidateVaultSessions();
 		delete _pd;
 		delete _ad;
+		delete _ecies_app_prototype;
+		resetActivationScopeCache();
 		
 		CC7_LOG("Session %p, %d: Object destroyed.", this, sessionIdentifier());
 	}
@@ -143,53 +152,29 @@ namespace powerAuth
 	
 	// MARK: - Serialization -
 	
-	const cc7::byte HAS_PERSISTENT_DATA = 1 << 1;
-	const cc7::byte DATA_TAG = 'P';
-	const cc7::byte DATA_VER = 'A';
-	
-	
 	cc7::ByteArray Session::saveSessionState() const
 	{
 		LOCK_GUARD();
-		cc7:byte flags = 0;
-		if (hasValidActivation()) {
-			flags |= HAS_PERSISTENT_DATA;
-		}
-		utils::DataWriter writer;
-		
-		writer.openVersion(DATA_TAG, DATA_VER);
-		writer.writeByte(flags);
+		const protocol::PersistentData * pd = hasValidActivation() ? _pd : nullptr;
+		// Measure the exact size first, to allocate the result only once.
+		utils::DataWriter measure(utils::DataWriter::MEASURE_ONLY);
+		protocol::SerializeSessionState(pd, measure);
 		
-		if (flags & HAS_PERSISTENT_DATA) {
-			protocol::SerializePersistentData(*_pd, writer);
-		}
-		writer.closeVersion();
+		cc7::ByteArray result;
+		result.reserve(measure.serializedSize());
+		utils::DataWriter writer(&result);
+		protocol::SerializeSessionState(pd, writer);
 		
-		return writer.serializedData();
+		return result;
 	}
 	
 	ErrorCode Session::loadSessionState(const cc7::ByteRange & serialized_state)
 	{
 		LOCK_GUARD();
 		utils::DataReader reader(serialized_state);
-		cc7::byte flags = 0;
-		
 		bool has_data  = false;
 		auto new_data = new protocol::PersistentData();
-		
-		bool result = reader.openVersion(DATA_TAG, DATA_VER) &&
-					  reader.readByte(flags);
-		
-		if (result && (flags != 'M')) {
-			if (flags & HAS_PERSISTENT_DATA) {
-				result = result && protocol::DeserializePersistentData(*new_data, reader);
-				has_data = result;
-			}
-		} else {
-			// DATA_MIGRATION_TAG
-			result = protocol::TryDeserializeOldPersistentData(*new_data, reader);
-			has_data = result && !new_data->activationId.empty();
-		}
+		bool result = protocol::DeserializeSessionState(*new_data, has_data, reader);
 		
 		State new_state = has_data ? SS_Activated : SS_Empty;
 		commitNewPersistentState(new_data, new_state);
@@ -273,7 +258,7 @@ namespace powerAuth
 			
 			// V3 activation is much simpler than V2. We need to just store device's public key
 			// in Base64 format. The data encryption & protection is achieved by the ECIES.
-			result.devicePublicKey = ad->devicePublicKeyData.base64String();
+			result.devicePublicKey = utils::Base64_Encode(ad->devicePublicKeyData);
 			
 			// Finally, everything is OK
 			error_code = EC_Ok;
@@ -314,13 +299,13 @@ namespace powerAuth
 				return EC_WrongParam;
 			}
 			// Validate CTR_DATA
-			if (!_ad->ctrData.readFromBase64String(param.ctrData) || _ad->ctrData.size() != protocol::SIGNATURE_KEY_SIZE) {
+			if (!utils::Base64_Decode(cc7::MakeRange(param.ctrData), _ad->ctrData) || _ad->ctrData.size() != protocol::SIGNATURE_KEY_SIZE) {
 				// Note that we treat all B64 decode failures as an encryption error.
 				CC7_LOG("Session %p, %d: Step 2: CTR_DATA is invalid.", this, sessionIdentifier());
 				break;
 			}
 			// Now try to import server's public key
-			_ad->serverPublicKeyData.readFromBase64String(param.serverPublicKey);
+			utils::Base64_Decode(cc7::MakeRange(param.serverPublicKey), _ad->serverPublicKeyData);
 			_ad->serverPublicKey = crypto::ECC_ImportPublicKey(nullptr, _ad->serverPublicKeyData);
 			if (!_ad->serverPublicKey) {
 				CC7_LOG("Session %p, %d: Step 2: Server's public key is not valid.", this, sessionIdentifier());
@@ -382,6 +367,7 @@ namespace powerAuth
 			pd->passwordSalt			= crypto::GetRandomData(protocol::PBKDF2_SALT_SIZE, true);
 			pd->devicePublicKey			= _ad->devicePublicKeyData;
 			pd->serverPublicKey			= _ad->serverPublicKeyData;
+			pd->serverPublicKeyCoordinates = crypto::ECC_ExportPublicKeyToCoordinates(_ad->serverPublicKey);
 			pd->flagsU32				= 0;
 			// Keep information about external key usage in the flags
 			pd->flags.usesExternalKey = eek() ? 1 : 0;
@@ -450,35 +436,47 @@ namespace powerAuth
 			CC7_LOG("Session %p, %d: Status: Missing status blob.", this, sessionIdentifier());
 			return EC_WrongParam;
 		}
-		protocol::SignatureKeys signature_keys;
-		protocol::SignatureUnlockKeysReq unlock_request(protocol::SF_Transport, &keys, eek(), nullptr, 0);
-		if (!protocol::UnlockSignatureKeys(signature_keys, _pd->sk, unlock_request)) {
+		if (keys.possessionUnlockKey.size() != protocol::SIGNATURE_KEY_SIZE) {
 			CC7_LOG("Session %p, %d: Status: You have to provide valid possession key.", this, sessionIdentifier());
 			return EC_WrongParam;
 		}
-		// Decode blob from B64 string
-		cc7::ByteArray encrypted_status_blob;
-		bool result = encrypted_status_blob.readFromBase64String(status_blob);
-		if (encrypted_status_blob.size() != protocol::STATUS_BLOB_SIZE || !result) {
-			// Considered as an attack on protocol
-			return EC_Encryption;
-		}
-		// Decrypt blob and initialize reader for data parsing.
-		utils::DataReader reader(crypto::AES_CBC_Decrypt(signature_keys.transportKey, protocol::ZERO_IV, encrypted_status_blob));
-		cc7::ByteRange hdr;
-		cc7::byte state = 0xdd, fail_ctr = 0xdd, max_fail_ctr = 0xdd;
-		cc7::byte curr_ver = 0xdd, upgrade_ver = 0xdd;
-	
-		result = reader.readMemoryRange(hdr, 4) &&
-				 reader.readByte(state) &&
-				 reader.readByte(curr_ver) &&
-				 reader.readByte(upgrade_ver) &&
-				 reader.skipBytes(6) &&
-				 reader.readByte(fail_ctr) &&
-				 reader.readByte(max_fail_ctr);
+		// The prepared transport key schedule can be used only with the same possession key,
+		// which was used for the transport key unlock.
+		cc7::byte key_hash[crypto::SHA256_HASH_SIZE];
+		crypto::SHA256_ToBuffer(keys.possessionUnlockKey, key_hash);
+		if (!_status_key || CRYPTO_memcmp(key_hash, _status_key_hash, sizeof(key_hash)) != 0) {
+			crypto::AES_DestroyDecryptionKey(_status_key);
+			_status_key = nullptr;
+			protocol::SignatureKeys signature_keys;
+			protocol::SignatureUnlockKeysReq unlock_request(protocol::SF_Transport, &keys, eek(), nullptr, 0);
+			if (!protocol::UnlockSignatureKeys(signature_keys, _pd->sk, unlock_request)) {
+				CC7_LOG("Session %p, %d: Status: You have to provide valid possession key.", this, sessionIdentifier());
+				return EC_WrongParam;
+			}
+			_status_key = crypto::AES_CreateDecryptionKey(signature_keys.transportKey);
+			if (!_status_key) {
+				return EC_Encryption;
+			}
+			memcpy(_status_key_hash, key_hash, sizeof(key_hash));
+		}
+		// Decode blob from B64 string directly to the stack buffer and decrypt it in place.
+		// Note that the decoder needs one additional byte for the padding.
+		cc7::byte blob[protocol::STATUS_BLOB_SIZE + 1];
+		size_t blob_size = 0;
+		bool result = status_blob.size() == utils::Base64_EncodedLength(protocol::STATUS_BLOB_SIZE) &&
+					  utils::Base64_DecodeToBuffer(cc7::MakeRange(status_blob), blob, blob_size) &&
+					  blob_size == protocol::STATUS_BLOB_SIZE &&
+					  crypto::AES_CBC_Decrypt_InPlace(_status_key, protocol::ZERO_IV, blob, protocol::STATUS_BLOB_SIZE);
 		if (!result) {
+			// Considered as an attack on protocol
 			return EC_Encryption;
 		}
+		// Blob layout:
+		//   | HDR[4] | state | curr_ver | upgrade_ver | reserved[6] | fail_ctr | max_fail_ctr | ... |
+		const cc7::byte * hdr = blob;
+		cc7::byte state = blob[4], curr_ver = blob[5], upgrade_ver = blob[6];
+		cc7::byte fail_ctr = blob[13], max_fail_ctr = blob[14];
+		
 		if (hdr[0] != 0xDE || hdr[1] != 0xC0 || hdr[2] != 0xDE || (hdr[3] & 0xF0) != 0xD0) {
 			return EC_Encryption;
 		}
@@ -504,31 +502,40 @@ namespace powerAuth
 	
 	cc7::ByteArray Session::prepareKeyValueMapForDataSigning(const std::map<std::string, std::string> & map)
 	{
-		// Create a vector of keys
-		std::vector<const std::string *> keys;
-		keys.reserve(map.size());
-		size_t expected_result_size = 0;
-		for (auto && kvpair : map) {
-			expected_result_size += 2 + kvpair.first.length() + kvpair.second.length();
-			keys.push_back(&kvpair.first);
-		}
-		// Sort that keys
-		std::sort(keys.begin(), keys.end(), [](const std::string * a, const std::string * b) {
-			return a->compare(*b) < 0;
-		});
-		// Concat sorted keys & values into: 'key1=value1&keyN=valueN' byte blob
-		cc7::ByteArray result;
-		result.reserve(expected_result_size);
-		for (auto && key_ptr : keys) {
-			const std::string & key   = *key_ptr;
-			const std::string & value = map.find(key)->second;
-			if (!result.empty()) {
-				result.append('&');
+		return prepareKeyValuePairsForDataSigning(map);
+	}
+	
+	cc7::ByteArray Session::prepareKeyValueRefsForDataSigning(std::vector<KeyValueRef> & pairs)
+	{
+		// Sort pairs by key, but only if it's required. The stable sort keeps
+		// the original order of values for the same key.
+		auto compare_keys = [](const KeyValueRef & a, const KeyValueRef & b) {
+			return *a.first < *b.first;
+		};
+		if (!std::is_sorted(pairs.begin(), pairs.end(), compare_keys)) {
+			std::stable_sort(pairs.begin(), pairs.end(), compare_keys);
+		}
+		// Calculate exact length of 'key1=value1&keyN=valueN' byte blob
+		if (pairs.empty()) {
+			return cc7::ByteArray();
+		}
+		size_t result_size = 2 * pairs.size() - 1;
+		for (auto && kv : pairs) {
+			result_size += utils::URLEncoding_EncodedLength(cc7::MakeRange(*kv.first));
+			result_size += utils::URLEncoding_EncodedLength(cc7::MakeRange(*kv.second));
+		}
+		// Encode keys & values directly to the result
+		cc7::ByteArray result(result_size, 0);
+		cc7::byte * p = result.data();
+		for (auto && kv : pairs) {
+			if (p != result.data()) {
+				*p++ = '&';
 			}
-			result.append(utils::ConvertStringToUrlEncodedData(key));
-			result.append('=');
-			result.append(utils::ConvertStringToUrlEncodedData(value));
+			p += utils::ConvertStringToUrlEncodedBuffer(cc7::MakeRange(*kv.first), p);
+			*p++ = '=';
+			p += utils::ConvertStringToUrlEncodedBuffer(cc7::MakeRange(*kv.second), p);
 		}
+		CC7_ASSERT(p == result.data() + result.size(), "Unexpected length of normalized data");
 		return result;
 	}
 		
@@ -536,6 +543,49 @@ namespace powerAuth
 										   const SignatureUnlockKeys & keys, SignatureFactor signature_factor,
 										   HTTPRequestDataSignature & out)
 	{
+		return signHTTPRequestData(HTTPRequestDataView(request), keys, signature_factor, out);
+	}
+	
+	ErrorCode Session::signHTTPRequestData(const HTTPRequestDataView & request,
+										   const SignatureUnlockKeys & keys, SignatureFactor signature_factor,
+										   HTTPRequestDataSignature & out)
+	{
+		return signHTTPRequestImpl(request, nullptr, keys, signature_factor, nullptr, &out);
+	}
+	
+	ErrorCode Session::signHTTPRequestStream(const HTTPRequestData & request,
+											 const HTTPRequestBodyStream & body_stream,
+											 const SignatureUnlockKeys & keys, SignatureFactor signature_factor,
+											 HTTPRequestDataSignature & out)
+	{
+		if (!request.body.empty() || !body_stream) {
+			CC7_LOG("Session %p, %d: Sign: Body must be provided only by the stream.", this, sessionIdentifier());
+			return EC_WrongParam;
+		}
+		return signHTTPRequestImpl(HTTPRequestDataView(request), &body_stream, keys, signature_factor, nullptr, &out);
+	}
+	
+	ErrorCode Session::signHTTPRequestDataToHeader(const HTTPRequestData & request,
+												   const SignatureUnlockKeys & keys, SignatureFactor signature_factor,
+												   std::string & out_header_value)
+	{
+		return signHTTPRequestImpl(HTTPRequestDataView(request), nullptr, keys, signature_factor, &out_header_value, nullptr);
+	}
+	
+	ErrorCode Session::signHTTPRequestDataToHeader(const HTTPRequestDataView & request,
+												   const SignatureUnlockKeys & keys, SignatureFactor signature_factor,
+												   std::string & out_header_value)
+	{
+		return signHTTPRequestImpl(request, nullptr, keys, signature_factor, &out_header_value, nullptr);
+	}
+	
+	ErrorCode Session::signHTTPRequestImpl(const HTTPRequestDataView & request,
+										   const HTTPRequestBodyStream * body_stream,
+										   const SignatureUnlockKeys & keys, SignatureFactor signature_factor,
+										   std::string * out_header_value,
+										   HTTPRequestDataSignature * out_signature)
+	{
+		CC7_ASSERT((out_header_value != nullptr) != (out_signature != nullptr), "Exactly one output must be provided");
 		LOCK_GUARD();
 		// Validate session's state & parameters
 		if (!hasValidActivation()) {
@@ -546,8 +596,8 @@ namespace powerAuth
 			CC7_LOG("Session %p, %d: Sign: Wrong request data.", this, sessionIdentifier());
 			return EC_WrongParam;
 		}
-		out.factor = protocol::ConvertSignatureFactorToString(signature_factor);
-		if (out.factor.empty()) {
+		const std::string & factor = protocol::ConvertSignatureFactorToString(signature_factor);
+		if (factor.empty()) {
 			CC7_LOG("Session %p, %d: Sign: Wrong signature factor 0x%04x.", this, sessionIdentifier(), signature_factor);
 			return EC_WrongParam;
 		}
@@ -564,13 +614,11 @@ namespace powerAuth
 		cc7::ByteArray nonce;
 		if (!request.isOfflineRequest()) {
 			nonce = crypto::GetRandomData(protocol::SIGNATURE_KEY_SIZE, true);
-			out.nonce = nonce.base64String();
 		} else {
-			if (!cc7::Base64_Decode(request.offlineNonce, 0, nonce)) {
+			if (!utils::Base64_Decode(request.offlineNonce, nonce)) {
 				CC7_LOG("Session %p, %d: Sign: request.offlineNonce is invalid.", this, sessionIdentifier());
 				return EC_Encryption;
 			}
-			out.nonce = request.offlineNonce;	// already in valid Base64 format
 		}
 		
 		// Unlock keys. This also validates whether the provided unlock keys are present or not.
@@ -581,12 +629,37 @@ namespace powerAuth
 			return EC_Encryption;
 		}
 		
-		// Normalize data and calculate signature
+		// Prepare nonce in Base64 format
+		char nonce_buffer[32];
+		cc7::ByteRange nonce_b64;
+		if (!request.isOfflineRequest()) {
+			nonce_b64 = cc7::ByteRange(nonce_buffer, utils::Base64_EncodeToBuffer(nonce, nonce_buffer));
+		} else {
+			// Already in valid Base64 format
+			nonce_b64 = request.offlineNonce;
+		}
+		
+		// Calculate signature and write the whole header value, or just the signature.
+		const std::string & version = _pd->isV3() ? protocol::PA_VERSION_V3 : protocol::PA_VERSION_V2;
+		const std::string & app_key = request.isOfflineRequest() ? protocol::PA_OFFLINE_APP_SECRET : _setup.applicationKey;
 		const std::string & app_secret = request.isOfflineRequest() ? protocol::PA_OFFLINE_APP_SECRET : _setup.applicationSecret;
-		cc7::ByteArray data = protocol::NormalizeDataForSignature(request.method, request.uri, out.nonce, request.body, app_secret);
 		cc7::ByteArray ctr_data = _pd->isV3() ? _pd->signatureCounterData : protocol::SignatureCounterToData(_pd->signatureCounter);
-		out.signature = protocol::CalculateSignature(plain_keys, signature_factor, ctr_data, data);
-		if (out.signature.empty()) {
+		bool success;
+		if (out_header_value) {
+			success = protocol::CalculateAuthHeaderValue(*out_header_value, plain_keys, signature_factor, ctr_data, version, _pd->activationId,
+														 app_key, app_secret, request, nonce_b64, body_stream);
+		} else {
+			success = protocol::CalculateRequestSignature(out_signature->signature, plain_keys, signature_factor, ctr_data,
+														  app_secret, request, nonce_b64, body_stream);
+			if (success) {
+				out_signature->version			= version;
+				out_signature->activationId		= _pd->activationId;
+				out_signature->applicationKey	= app_key;
+				out_signature->nonce.assign(reinterpret_cast<const char*>(nonce_b64.data()), nonce_b64.size());
+				out_signature->factor			= factor;
+			}
+		}
+		if (!success) {
 			CC7_LOG("Session %p, %d: Sign: Signature calculation failed.", this, sessionIdentifier());
 			return EC_Encryption;
 		}
@@ -594,10 +667,45 @@ namespace powerAuth
 		// Move counter forward
 		protocol::CalculateNextCounterValue(*_pd);
 		
-		// Fill the rest of values to out structure
-		out.version			= _pd->isV3() ? protocol::PA_VERSION_V3 : protocol::PA_VERSION_V2;
-		out.activationId	= _pd->activationId;
-		out.applicationKey	= request.isOfflineRequest() ? protocol::PA_OFFLINE_APP_SECRET : _setup.applicationKey;
+		return EC_Ok;
+	}
+	
+	ErrorCode Session::reserveSignatureCounters(size_t count, const SignatureUnlockKeys & keys, SignatureFactor signature_factor,
+												SignatureCounterReservation & out_reservation)
+	{
+		LOCK_GUARD();
+		out_reservation.clear();
+		if (!hasValidActivation()) {
+			CC7_LOG("Session %p, %d: Reserve: There's no valid activation.", this, sessionIdentifier());
+			return EC_WrongState;
+		}
+		if (count == 0 || count > protocol::MAX_RESERVED_COUNTER_VALUES) {
+			CC7_LOG("Session %p, %d: Reserve: Wrong number of counter values %d.", this, sessionIdentifier(), (int)count);
+			return EC_WrongParam;
+		}
+		if (protocol::ConvertSignatureFactorToString(signature_factor).empty()) {
+			CC7_LOG("Session %p, %d: Reserve: Wrong signature factor 0x%04x.", this, sessionIdentifier(), signature_factor);
+			return EC_WrongParam;
+		}
+		// Re-seed OpenSSL's PRNG.
+		crypto::ReseedPRNG();
+		
+		// Unlock keys. This also validates whether the provided unlock keys are present or not.
+		std::unique_ptr<protocol::SignatureKeys> plain_keys(new protocol::SignatureKeys());
+		protocol::SignatureUnlockKeysReq unlock_request(signature_factor, &keys, eek(), &_pd->passwordSalt, _pd->passwordIterations);
+		if (!protocol::UnlockSignatureKeys(*plain_keys, _pd->sk, unlock_request)) {
+			CC7_LOG("Session %p, %d: Reserve: Unable to unlock signature keys.", this, sessionIdentifier());
+			return EC_Encryption;
+		}
+		// Capture everything required for signature calculation and move counter forward.
+		out_reservation._keys				= plain_keys.release();
+		out_reservation._factor				= signature_factor;
+		out_reservation._version			= _pd->isV3() ? protocol::PA_VERSION_V3 : protocol::PA_VERSION_V2;
+		out_reservation._activation_id		= _pd->activationId;
+		out_reservation._application_key	= _setup.applicationKey;
+		out_reservation._application_secret	= _setup.applicationSecret;
+		out_reservation._offline_allowed	= !hasPendingProtocolUpgrade();
+		protocol::ReserveCounterValues(*_pd, count, out_reservation._ctr_data);
 		
 		return EC_Ok;
 	}
@@ -608,6 +716,11 @@ namespace powerAuth
 	}
 	
 	ErrorCode Session::verifyServerSignedData(const SignedData & data) const
+	{
+		return verifyServerSignedData(SignedDataView(data));
+	}
+	
+	ErrorCode Session::verifyServerSignedData(const SignedDataView & data) const
 	{
 		LOCK_GUARD();
 		if (!hasValidSetup()) {
@@ -628,11 +741,19 @@ namespace powerAuth
 		crypto::BNContext ctx;
 		EC_KEY * ec_public_key;
 		if (use_master_server_key) {
-			// Import master server public key
-			ec_public_key = crypto::ECC_ImportPublicKeyFromB64(nullptr, _setup.masterServerPublicKey, ctx);
+			// Import master server public key. The point is decompressed only once, then the key
+			// is imported from the cached coordinates.
+			if (_master_server_public_key_coordinates.empty()) {
+				ec_public_key = crypto::ECC_ImportPublicKeyFromB64(nullptr, _setup.masterServerPublicKey, ctx);
+				if (ec_public_key) {
+					_master_server_public_key_coordinates = crypto::ECC_ExportPublicKeyToCoordinates(ec_public_key, ctx);
+				}
+			} else {
+				ec_public_key = crypto::ECC_ImportPublicKeyFromCoordinates(nullptr, _master_server_public_key_coordinates, ctx);
+			}
 		} else {
 			// Import server public key, which is personalized and associated with this session.
-			ec_public_key = crypto::ECC_ImportPublicKey(nullptr, _pd->serverPublicKey);
+			ec_public_key = protocol::ImportServerPublicKey(*_pd, ctx);
 		}
 		if (nullptr != ec_public_key) {
 			// validate signature
@@ -661,9 +782,9 @@ namespace powerAuth
 		// structures hidden in implementation and allows you to use password directly.
 		
 		SignatureUnlockKeys old_keys;
-		old_keys.userPassword = old_password;
+		old_keys.userPasswordRange = old_password;
 		SignatureUnlockKeys new_keys;
-		new_keys.userPassword = new_password;
+		new_keys.userPasswordRange = new_password;
 		
 		// Unlock knowledge key with using old password
 		protocol::SignatureKeys plain_keys;
@@ -689,6 +810,21 @@ namespace powerAuth
 		return EC_Ok;
 	}
 
+	ErrorCode Session::startPasswordKeyDerivation(Password & password, Executor & executor,
+												  std::shared_ptr<PasswordKeyDerivation> & out_derivation) const
+	{
+		LOCK_GUARD();
+		if (!hasValidActivation()) {
+			CC7_LOG("Session %p, %d: startPasswordKeyDerivation: There's no valid activation.", this, sessionIdentifier());
+			return EC_WrongState;
+		}
+		out_derivation = password.startKeyDerivation(_pd->passwordSalt, _pd->passwordIterations, executor);
+		if (!out_derivation) {
+			return EC_WrongParam;
+		}
+		return EC_Ok;
+	}
+	
 	ErrorCode Session::addBiometryFactor(const std::string & c_vault_key, const SignatureUnlockKeys & keys)
 	{
 		LOCK_GUARD();
@@ -702,27 +838,34 @@ namespace powerAuth
 		if (code != EC_Ok) {
 			return code;
 		}
+		// Ok, we have vault key and now we can decrypt stored device's private key.
+		EC_KEY * device_private_key = nullptr;
+		code = importDevicePrivateKey(vault_key, device_private_key);
+		if (code == EC_Ok) {
+			code = addBiometryFactorImpl(vault_key, device_private_key, keys);
+		}
+		EC_KEY_free(device_private_key);
+		
+		return code;
+	}
+	
+	ErrorCode Session::addBiometryFactorImpl(const cc7::ByteRange & vault_key, EC_KEY * device_private_key, const SignatureUnlockKeys & keys)
+	{
+		if (keys.biometryUnlockKey.empty()) {
+			CC7_LOG("Session %p, %d: addBiometryKey: The required biometryUnlockKey is missing.", this, sessionIdentifier());
+			return EC_WrongParam;
+		}
 		if (!_pd->sk.biometryKey.empty()) {
 			CC7_LOG("Session %p, %d: WARNING: There's already an existing biometry key.", this, sessionIdentifier());
 		}
 
-		// Ok, we have vault key and now we can decrypt stored device's private key.
 		crypto::BNContext ctx;
-		EC_KEY * device_private_key = nullptr;
 		EC_KEY * server_public_key  = nullptr;
-		code = EC_Encryption;
+		ErrorCode code = EC_Encryption;
 		
 		do {
-			// Decrypt device's private key
-			cc7::ByteArray device_private_key_data = crypto::AES_CBC_Decrypt_Padding(vault_key, protocol::ZERO_IV, _pd->cDevicePrivateKey);
-			if (device_private_key_data.empty()) {
-				// Well, if the key decryption fails here then it seems that we have a problem in vault_key computation.
-				// Error at this point means that we're not able to deduce KEY_ENCRYPTION_VAULT_TRANSPORT correctly.
-				break;
-			}
-			// Import device's private & server's public key
-			device_private_key = crypto::ECC_ImportPrivateKey(nullptr, device_private_key_data, ctx);
-			server_public_key  = crypto::ECC_ImportPublicKey(nullptr, _pd->serverPublicKey, ctx);
+			// Import server's public key
+			server_public_key  = protocol::ImportServerPublicKey(*_pd, ctx);
 			cc7::ByteArray master_secret = protocol::ReduceSharedSecret(crypto::ECDH_SharedSecret(server_public_key, device_private_key));
 			if (master_secret.empty()) {
 				break;
@@ -747,7 +890,6 @@ namespace powerAuth
 
 		} while (false);
 
-		EC_KEY_free(device_private_key);
 		EC_KEY_free(server_public_key);
 
 		return code;
@@ -811,32 +953,35 @@ namespace powerAuth
 		}
 		
 		// Ok, we have vault key and now we can decrypt stored device's private key.
-		crypto::BNContext ctx;
 		EC_KEY * device_private_key = nullptr;
-		code = EC_Encryption;
-		
-		do {
-			// Decrypt device's private key
-			cc7::ByteArray device_private_key_data = crypto::AES_CBC_Decrypt_Padding(vault_key, protocol::ZERO_IV, _pd->cDevicePrivateKey);
-			if (device_private_key_data.empty()) {
-				// Well, if the key decryption fails here then it seems that we have a problem in vault_key computation.
-				// Error at this point means that we're not able to deduce KEY_ENCRYPTION_VAULT_TRANSPORT correctly.
-				break;
-			}
-			// Import device's private key & calculate signature
-			device_private_key = crypto::ECC_ImportPrivateKey(nullptr, device_private_key_data, ctx);
+		code = importDevicePrivateKey(vault_key, device_private_key);
+		if (code == EC_Ok) {
 			if (!crypto::ECDSA_ComputeSignature(in_data, device_private_key, out_signature)) {
 				// Signature calculation failed.
-				break;
+				code = EC_Encryption;
 			}
-			code = EC_Ok;
-		} while (false);
-		
+		}
 		EC_KEY_free(device_private_key);
 		
 		return code;
 	}
 	
+	ErrorCode Session::importDevicePrivateKey(const cc7::ByteRange & vault_key, EC_KEY *& out_key)
+	{
+		// Decrypt device's private key
+		cc7::ByteArray device_private_key_data = crypto::AES_CBC_Decrypt_Padding(vault_key, protocol::ZERO_IV, _pd->cDevicePrivateKey);
+		if (device_private_key_data.empty()) {
+			// Well, if the key decryption fails here then it seems that we have a problem in vault_key computation.
+			// Error at this point means that we're not able to deduce KEY_ENCRYPTION_VAULT_TRANSPORT correctly.
+			return EC_Encryption;
+		}
+		// Import device's private key
+		crypto::BNContext ctx;
+		out_key = crypto::ECC_ImportPrivateKey(nullptr, device_private_key_data, ctx);
+		utils::SecureMemory_Wipe(device_private_key_data.data(), device_private_key_data.size());
+		return out_key != nullptr ? EC_Ok : EC_Encryption;
+	}
+	
 	ErrorCode Session::decryptVaultKey(const std::string & c_vault_key, const SignatureUnlockKeys & keys, cc7::ByteArray & out_key)
 	{
 		LOCK_GUARD();
@@ -851,7 +996,7 @@ namespace powerAuth
 			return EC_WrongParam;
 		}
 		cc7::ByteArray encrypted_vault_key;
-		bool bResult = encrypted_vault_key.readFromBase64String(c_vault_key);
+		bool bResult = utils::Base64_Decode(cc7::MakeRange(c_vault_key), encrypted_vault_key);
 		if (!bResult || encrypted_vault_key.empty()) {
 			// Treat wrong B64 format as attack on the protocol.
 			CC7_LOG("Session %p, %d: Vault: The provided vault key is wrong.", this, sessionIdentifier());
@@ -872,6 +1017,60 @@ namespace powerAuth
 		return EC_Ok;
 	}
 	
+	ErrorCode Session::openVaultSession(const std::string & c_vault_key, const SignatureUnlockKeys & keys, VaultSession & out_vault_session)
+	{
+		LOCK_GUARD();
+		out_vault_session.close();
+		
+		cc7::ByteArray vault_key;
+		ErrorCode code = decryptVaultKey(c_vault_key, keys, vault_key);
+		if (code != EC_Ok) {
+			return code;
+		}
+		EC_KEY * device_private_key = nullptr;
+		code = importDevicePrivateKey(vault_key, device_private_key);
+		if (code == EC_Ok && !_pd->devicePublicKey.empty()) {
+			// Data decrypted with a wrong vault key may still have a valid padding and may be accepted
+			// as a private key. The vault session keeps the key for multiple operations, so it's worth
+			// to verify the key once, against the device's public key.
+			EC_KEY * device_public_key = crypto::ECC_ImportPublicKey(nullptr, _pd->devicePublicKey);
+			if (device_public_key && !crypto::ECC_ValidateKeyPair(device_private_key, device_public_key)) {
+				CC7_LOG("Session %p, %d: Vault: Device's private key doesn't match its public key.", this, sessionIdentifier());
+				EC_KEY_free(device_private_key);
+				device_private_key = nullptr;
+				code = EC_Encryption;
+			}
+			EC_KEY_free(device_public_key);
+		}
+		if (code == EC_Ok) {
+			// Keep the vault key in secure memory
+			size_t allocated_size;
+			cc7::byte * secure_vault_key = utils::SecureMemory_Alloc(vault_key.size(), allocated_size);
+			if (secure_vault_key != nullptr) {
+				memcpy(secure_vault_key, vault_key.data(), vault_key.size());
+				out_vault_session._session = this;
+				out_vault_session._vault_key = secure_vault_key;
+				out_vault_session._vault_key_allocated_size = allocated_size;
+				out_vault_session._device_private_key = device_private_key;
+				_vault_sessions.push_back(&out_vault_session);
+			} else {
+				EC_KEY_free(device_private_key);
+				code = EC_Encryption;
+			}
+		}
+		utils::SecureMemory_Wipe(vault_key.data(), vault_key.size());
+		return code;
+	}
+	
+	void Session::invalidateVaultSessions()
+	{
+		LOCK_GUARD();
+		for (VaultSession * vault_session : _vault_sessions) {
+			vault_session->invalidate();
+		}
+		_vault_sessions.clear();
+	}
+	
 
 	
 	// MARK: - Utilities for generic keys -
@@ -918,6 +1117,7 @@ namespace powerAuth
 			if (_setup.externalEncryptionKey.empty()) {
 				if (eek.size() == protocol::SIGNATURE_KEY_SIZE) {
 					_setup.externalEncryptionKey = eek;
+					resetActivationScopeCache();
 					return EC_Ok;
 				} else {
 					CC7_LOG("Session %p, %d: EEK: Wrong size of EEK.", this, sessionIdentifier());
@@ -950,6 +1150,7 @@ namespace powerAuth
 		}
 		_setup.externalEncryptionKey = eek;
 		_pd->flags.usesExternalKey = true;
+		resetActivationScopeCache();
 		return EC_Ok;
 	}
 	
@@ -974,6 +1175,7 @@ namespace powerAuth
 		}
 		_setup.externalEncryptionKey.clear();
 		_pd->flags.usesExternalKey = false;
+		resetActivationScopeCache();
 		return EC_Ok;
 	}
 	
@@ -996,16 +1198,20 @@ namespace powerAuth
 			CC7_LOG("Session %p, %d: ECIES: Session has no valid setup.", this, sessionIdentifier());
 			return EC_WrongState;
 		}
-		// Other parameters for ECIES encryptor
-		cc7::ByteArray ecPublicKey;
-		cc7::ByteArray sharedInfo2;
+		// All parameters for ECIES encryptor, except sharedInfo1, are constant for the
+		// scope, so the prepared encryptor prototypes are cached.
+		const ECIESEncryptor * prototype = nullptr;
 		//
 		if (scope == ECIES_ApplicationScope) {
 			// For "application" scope, the setup is quite simple.
 			// We have to just compute hash from APP_SECRET (as is) and use
 			// the master server public key.
-			sharedInfo2 = crypto::SHA256(cc7::MakeRange(_setup.applicationSecret));
-			ecPublicKey = cc7::FromBase64String(_setup.masterServerPublicKey);
+			if (!_ecies_app_prototype) {
+				auto sharedInfo2 = crypto::SHA256(cc7::MakeRange(_setup.applicationSecret));
+				auto ecPublicKey = utils::Base64_Decode(cc7::MakeRange(_setup.masterServerPublicKey));
+				_ecies_app_prototype = new ECIESEncryptor(ecPublicKey, cc7::ByteRange(), sharedInfo2);
+			}
+			prototype = _ecies_app_prototype;
 			//
 		} else if (scope == ECIES_ActivationScope) {
 			// For the "activation" scope, we need to at first validate whether there's
@@ -1014,28 +1220,47 @@ namespace powerAuth
 				CC7_LOG("Session %p, %d: ECIES: Session has no valid activation.", this, sessionIdentifier());
 				return EC_WrongState;
 			}
-			// Acquire the transport key
-			protocol::SignatureKeys plain_keys;
-			protocol::SignatureUnlockKeysReq unlock_request(protocol::SF_Transport, &keys, eek(), &_pd->passwordSalt, _pd->passwordIterations);
-			if (!protocol::UnlockSignatureKeys(plain_keys, _pd->sk, unlock_request)) {
-				CC7_LOG("Session %p, %d: ECIES: You have to provide valid possession key.", this, sessionIdentifier());
-				return EC_Encryption;
+			// The cached prototype can be used only with the same possession key, which
+			// has been used for its creation.
+			auto key_hash = crypto::SHA256(keys.possessionUnlockKey);
+			if (!_ecies_act_prototype || key_hash != _ecies_act_key_hash) {
+				// Acquire the transport key
+				protocol::SignatureKeys plain_keys;
+				protocol::SignatureUnlockKeysReq unlock_request(protocol::SF_Transport, &keys, eek(), &_pd->passwordSalt, _pd->passwordIterations);
+				if (!protocol::UnlockSignatureKeys(plain_keys, _pd->sk, unlock_request)) {
+					CC7_LOG("Session %p, %d: ECIES: You have to provide valid possession key.", this, sessionIdentifier());
+					return EC_Encryption;
+				}
+				// The sharedInfo2 is defined as HMAC_SHA256(key: KEY_TRANSPORT, data: APP_SECRET)
+				// We need to also use the server's public key as EC public key.
+				auto sharedInfo2 = crypto::HMAC_SHA256(cc7::MakeRange(_setup.applicationSecret), plain_keys.transportKey);
+				resetActivationScopeCache();
+				_ecies_act_prototype = new ECIESEncryptor(_pd->serverPublicKey, cc7::ByteRange(), sharedInfo2);
+				_ecies_act_key_hash = key_hash;
 			}
-			// The sharedInfo2 is defined as HMAC_SHA256(key: KEY_TRANSPORT, data: APP_SECRET)
-			// We need to also use the server's public key as EC public key.
-			sharedInfo2 = crypto::HMAC_SHA256(cc7::MakeRange(_setup.applicationSecret), plain_keys.transportKey);
-			ecPublicKey = _pd->serverPublicKey;
+			prototype = _ecies_act_prototype;
 			//
 		} else {
 			// Scope is not known
 			CC7_LOG("Session %p, %d: ECIES: Unsupported scope.", this, sessionIdentifier());
 			return EC_WrongParam;
 		}
-		// Now construct the encryptor with prepared setup.
-		out_encryptor = ECIESEncryptor(ecPublicKey, sharedInfo1, sharedInfo2);
+		// Now construct the encryptor from the prototype.
+		out_encryptor = *prototype;
+		out_encryptor.setSharedInfo1(sharedInfo1);
 		return EC_Ok;
 	}
 	
+	void Session::resetActivationScopeCache() const
+	{
+		delete _ecies_act_prototype;
+		_ecies_act_prototype = nullptr;
+		_ecies_act_key_hash.clear();
+		crypto::AES_DestroyDecryptionKey(_status_key);
+		_status_key = nullptr;
+		utils::SecureMemory_Wipe(_status_key_hash, sizeof(_status_key_hash));
+	}
+	
 	// MARK: - Protocol upgrade -
 	
 	ErrorCode Session::startProtocolUpgrade()
@@ -1082,7 +1307,7 @@ namespace powerAuth
 					return EC_WrongState;
 				}
 				cc7::ByteArray ctrData;
-				if (!cc7::Base64_Decode(upgrade_data.toV3.ctrData, 0, ctrData) || ctrData.size() != protocol::SIGNATURE_KEY_SIZE) {
+				if (!utils::Base64_Decode(cc7::MakeRange(upgrade_data.toV3.ctrData), ctrData) || ctrData.size() != protocol::SIGNATURE_KEY_SIZE) {
 					CC7_LOG("Session %p, %d: ApplyUpgradeData: Wrong V3 upgrade data.", this, sessionIdentifier());
 					return EC_WrongParam;
 				}
@@ -1145,14 +1370,24 @@ namespace powerAuth
 		cc7::ByteArray vault_key;
 		auto ec = decryptVaultKey(c_vault_key, keys, vault_key);
 		if (ec == EC_Ok) {
-			if (!protocol::DeserializeRecoveryData(_pd->cRecoveryData, vault_key, out_recovery_data)) {
-				CC7_LOG("Session %p, %d: RecoveryData: Cannot decrypt or deserialize recovery data.", this, sessionIdentifier());
-				ec = EC_Encryption;
-			}
+			ec = getActivationRecoveryDataImpl(vault_key, out_recovery_data);
 		}
 		return ec;
 	}
 	
+	ErrorCode Session::getActivationRecoveryDataImpl(const cc7::ByteRange & vault_key, RecoveryData & out_recovery_data)
+	{
+		if (_pd->cRecoveryData.empty()) {
+			CC7_LOG("Session %p, %d: RecoveryData: Session has no recovery data available.", this, sessionIdentifier());
+			return EC_WrongState;
+		}
+		if (!protocol::DeserializeRecoveryData(_pd->cRecoveryData, vault_key, out_recovery_data)) {
+			CC7_LOG("Session %p, %d: RecoveryData: Cannot decrypt or deserialize recovery data.", this, sessionIdentifier());
+			return EC_Encryption;
+		}
+		return EC_Ok;
+	}
+	
 	// MARK: - Private methods -
 	
 	/*
@@ -1170,6 +1405,9 @@ namespace powerAuth
 	 */
 	void Session::commitNewPersistentState(protocol::PersistentData *new_pd, Session::State new_state)
 	{
+		// Vault sessions depend on the persistent data, so they must be invalidated.
+		invalidateVaultSessions();
+		
 		// At first, delete possible activation data. In all cases, commit must clear
 		// any instance of activation data.
 		delete _ad;
@@ -1223,6 +1461,8 @@ namespace powerAuth
 		if (CC7_CHECK(new_state >= SS_Empty, "Internal error. Changing to SS_Invalid is not allowed!")) {
 			_state = new_state;
 		}
+		// Activation scoped ECIES encryptor depends on the persistent data.
+		resetActivationScopeCache();
 	}
 	
 	
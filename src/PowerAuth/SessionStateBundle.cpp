@@ -0,0 +1,267 @@
+/*
+ * Copyright 2019 Wultra s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <PowerAuth/SessionStateBundle.h>
+#include "utils/DataReader.h"
+#include "utils/DataWriter.h"
+#include "utils/MappedFile.h"
+#include "utils/CRC16.h"
+#include <algorithm>
+
+namespace io
+{
+namespace getlime
+{
+namespace powerAuth
+{
+	const cc7::byte BUNDLE_TAG = 'B';
+	const cc7::byte BUNDLE_VER = '1';
+	// Tag & version + count
+	const size_t BUNDLE_HEADER_SIZE = 2 + 4;
+	// id + offset + length + crc + reserved
+	const size_t BUNDLE_ENTRY_SIZE = 4 + 4 + 4 + 2 + 2;
+	
+	static inline cc7::U32 _ReadU32(const cc7::byte * p)
+	{
+		return (cc7::U32(p[0]) << 24) | (cc7::U32(p[1]) << 16) | (cc7::U32(p[2]) << 8) | cc7::U32(p[3]);
+	}
+	
+	static inline cc7::U16 _ReadU16(const cc7::byte * p)
+	{
+		return (cc7::U16(p[0]) << 8) | cc7::U16(p[1]);
+	}
+	
+	
+	// MARK: - Construction -
+	
+	SessionStateBundle::SessionStateBundle() :
+		_file(nullptr),
+		_count(0)
+	{
+	}
+	
+	SessionStateBundle::~SessionStateBundle()
+	{
+		close();
+	}
+	
+	
+	// MARK: - Export -
+	
+	ErrorCode SessionStateBundle::build(std::vector<Record> records, cc7::ByteArray & out_bundle)
+	{
+		out_bundle.clear();
+		std::sort(records.begin(), records.end(), [](const Record & a, const Record & b) {
+			return a.sessionIdentifier < b.sessionIdentifier;
+		});
+		auto duplicate = std::adjacent_find(records.begin(), records.end(), [](const Record & a, const Record & b) {
+			return a.sessionIdentifier == b.sessionIdentifier;
+		});
+		if (duplicate != records.end()) {
+			CC7_LOG("SessionStateBundle: Duplicate session identifier %u", duplicate->sessionIdentifier);
+			return EC_WrongParam;
+		}
+		// Calculate layout of the bundle
+		cc7::U64 total_size = BUNDLE_HEADER_SIZE + cc7::U64(records.size()) * BUNDLE_ENTRY_SIZE;
+		for (auto && record : records) {
+			total_size += record.state.size();
+		}
+		if (total_size > 0xFFFFFFFFull) {
+			CC7_LOG("SessionStateBundle: Bundle is too large.");
+			return EC_WrongParam;
+		}
+		out_bundle.reserve((size_t)total_size);
+		utils::DataWriter writer(&out_bundle);
+		writer.openVersion(BUNDLE_TAG, BUNDLE_VER);
+		writer.writeU32((cc7::U32)records.size());
+		cc7::U32 offset = (cc7::U32)(BUNDLE_HEADER_SIZE + records.size() * BUNDLE_ENTRY_SIZE);
+		for (auto && record : records) {
+			writer.writeU32(record.sessionIdentifier);
+			writer.writeU32(offset);
+			writer.writeU32((cc7::U32)record.state.size());
+			writer.writeU16(utils::CRC16_Calculate(record.state));
+			writer.writeU16(0);
+			offset += (cc7::U32)record.state.size();
+		}
+		for (auto && record : records) {
+			writer.writeMemory(record.state);
+		}
+		writer.closeVersion();
+		return EC_Ok;
+	}
+	
+	ErrorCode SessionStateBundle::exportSessions(const std::vector<const Session*> & sessions, Executor & executor, cc7::ByteArray & out_bundle)
+	{
+		std::vector<cc7::ByteArray> states(sessions.size());
+		ExecuteParallel(executor, sessions.size(), 0, [&sessions, &states](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				states[i] = sessions[i]->saveSessionState();
+			}
+		});
+		std::vector<Record> records;
+		records.reserve(sessions.size());
+		for (size_t i = 0; i < sessions.size(); i++) {
+			records.push_back(Record(sessions[i]->sessionIdentifier(), states[i]));
+		}
+		return build(std::move(records), out_bundle);
+	}
+	
+	
+	// MARK: - Import -
+	
+	ErrorCode SessionStateBundle::open(const std::string & path)
+	{
+		close();
+		_file = new utils::MappedFile();
+		if (!_file->open(path)) {
+			close();
+			return EC_WrongParam;
+		}
+		ErrorCode code = parseIndex(_file->range());
+		if (code != EC_Ok) {
+			close();
+		}
+		return code;
+	}
+	
+	ErrorCode SessionStateBundle::open(const cc7::ByteRange & bundle)
+	{
+		close();
+		return parseIndex(bundle);
+	}
+	
+	ErrorCode SessionStateBundle::parseIndex(const cc7::ByteRange & bundle)
+	{
+		utils::DataReader reader(bundle);
+		cc7::U32 count = 0;
+		if (!reader.openVersion(BUNDLE_TAG, BUNDLE_VER) || !reader.readU32(count)) {
+			CC7_LOG("SessionStateBundle: Invalid header.");
+			return EC_WrongParam;
+		}
+		if (reader.currentVersion() != BUNDLE_VER) {
+			// The index layout of a future version is unknown.
+			CC7_LOG("SessionStateBundle: Unsupported version.");
+			return EC_WrongParam;
+		}
+		if (cc7::U64(count) * BUNDLE_ENTRY_SIZE > reader.remainingSize()) {
+			CC7_LOG("SessionStateBundle: Index is truncated.");
+			return EC_WrongParam;
+		}
+		// Validate index. Only the index is touched here, the states are validated on access.
+		const cc7::byte * entry = bundle.data() + BUNDLE_HEADER_SIZE;
+		const cc7::U64 data_begin = BUNDLE_HEADER_SIZE + cc7::U64(count) * BUNDLE_ENTRY_SIZE;
+		for (cc7::U32 i = 0; i < count; i++, entry += BUNDLE_ENTRY_SIZE) {
+			cc7::U64 offset = _ReadU32(entry + 4);
+			cc7::U64 length = _ReadU32(entry + 8);
+			if (offset < data_begin || offset + length > bundle.size()) {
+				CC7_LOG("SessionStateBundle: Entry %u points out of the bundle.", i);
+				return EC_WrongParam;
+			}
+			if (i > 0 && _ReadU32(entry - BUNDLE_ENTRY_SIZE) >= _ReadU32(entry)) {
+				CC7_LOG("SessionStateBundle: Index is not sorted.");
+				return EC_WrongParam;
+			}
+		}
+		_bundle = bundle;
+		_count = count;
+		return EC_Ok;
+	}
+	
+	void SessionStateBundle::close()
+	{
+		delete _file;
+		_file = nullptr;
+		_bundle = cc7::ByteRange();
+		_count = 0;
+	}
+	
+	size_t SessionStateBundle::count() const
+	{
+		return _count;
+	}
+	
+	std::vector<cc7::U32> SessionStateBundle::sessionIdentifiers() const
+	{
+		std::vector<cc7::U32> result;
+		result.reserve(_count);
+		const cc7::byte * entry = _bundle.data() + BUNDLE_HEADER_SIZE;
+		for (size_t i = 0; i < _count; i++, entry += BUNDLE_ENTRY_SIZE) {
+			result.push_back(_ReadU32(entry));
+		}
+		return result;
+	}
+	
+	const cc7::byte * SessionStateBundle::findEntry(cc7::U32 session_identifier) const
+	{
+		// Binary search in the sorted index
+		size_t low = 0, high = _count;
+		const cc7::byte * index = _bundle.data() + BUNDLE_HEADER_SIZE;
+		while (low < high) {
+			size_t mid = low + (high - low) / 2;
+			const cc7::byte * entry = index + mid * BUNDLE_ENTRY_SIZE;
+			cc7::U32 id = _ReadU32(entry);
+			if (id == session_identifier) {
+				return entry;
+			} else if (id < session_identifier) {
+				low = mid + 1;
+			} else {
+				high = mid;
+			}
+		}
+		return nullptr;
+	}
+	
+	ErrorCode SessionStateBundle::stateForSession(cc7::U32 session_identifier, cc7::ByteRange & out_state) const
+	{
+		const cc7::byte * entry = findEntry(session_identifier);
+		if (!entry) {
+			CC7_LOG("SessionStateBundle: There's no state for session %u", session_identifier);
+			return EC_WrongParam;
+		}
+		cc7::ByteRange state(_bundle.data() + _ReadU32(entry + 4), _ReadU32(entry + 8));
+		if (utils::CRC16_Calculate(state) != _ReadU16(entry + 12)) {
+			CC7_LOG("SessionStateBundle: Wrong checksum of state for session %u", session_identifier);
+			return EC_WrongParam;
+		}
+		out_state = state;
+		return EC_Ok;
+	}
+	
+	ErrorCode SessionStateBundle::loadSession(Session & session) const
+	{
+		cc7::ByteRange state;
+		ErrorCode code = stateForSession(session.sessionIdentifier(), state);
+		if (code == EC_Ok) {
+			// The session reads the state directly from the borrowed range.
+			code = session.loadSessionState(state);
+		}
+		return code;
+	}
+	
+	std::vector<ErrorCode> SessionStateBundle::loadSessions(const std::vector<Session*> & sessions, Executor & executor) const
+	{
+		std::vector<ErrorCode> results(sessions.size(), EC_WrongParam);
+		ExecuteParallel(executor, sessions.size(), 0, [this, &sessions, &results](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				results[i] = loadSession(*sessions[i]);
+			}
+		});
+		return results;
+	}
+	
+} // io::getlime::powerAuth
+} // io::getlime
+} // io
@@ -0,0 +1,115 @@
+/*
+ * Copyright 2019 Wultra s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <PowerAuth/SessionStateMigrator.h>
+#include "protocol/PrivateTypes.h"
+#include "utils/DataReader.h"
+#include "utils/DataWriter.h"
+#include "utils/MappedFile.h"
+
+namespace io
+{
+namespace getlime
+{
+namespace powerAuth
+{
+	SessionStateMigrator::SessionStateMigrator(Executor & executor) :
+		_executor(executor)
+	{
+	}
+	
+	SessionStateFormat SessionStateMigrator::detectFormat(const cc7::ByteRange & state)
+	{
+		return protocol::PeekSessionStateFormat(state);
+	}
+	
+	SessionStateMigrationResult SessionStateMigrator::migrateState(const cc7::ByteRange & state)
+	{
+		SessionStateMigrationResult result;
+		result.sourceFormat = protocol::PeekSessionStateFormat(state);
+		
+		protocol::PersistentData pd;
+		bool has_data = false;
+		utils::DataReader reader(state);
+		if (!protocol::DeserializeSessionState(pd, has_data, reader)) {
+			return result;
+		}
+		result.code = EC_Ok;
+		result.protocolVersion = has_data ? pd.protocolVersion() : Version_NA;
+		
+		const protocol::PersistentData * pd_ptr = has_data ? &pd : nullptr;
+		utils::DataWriter measure(utils::DataWriter::MEASURE_ONLY);
+		protocol::SerializeSessionState(pd_ptr, measure);
+		result.state.reserve(measure.serializedSize());
+		utils::DataWriter writer(&result.state);
+		protocol::SerializeSessionState(pd_ptr, writer);
+		// The header doesn't identify the current format exactly (for example, older versions
+		// of the library stored V2 data without the recovery data), so compare the content.
+		result.migrated = result.state != state;
+		return result;
+	}
+	
+	std::vector<SessionStateMigrationResult> SessionStateMigrator::migrateStates(const std::vector<cc7::ByteRange> & states)
+	{
+		std::vector<SessionStateMigrationResult> results(states.size());
+		ExecuteParallel(_executor, states.size(), 0, [&states, &results](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++) {
+				results[i] = migrateState(states[i]);
+			}
+		});
+		return results;
+	}
+	
+	ErrorCode SessionStateMigrator::migrateArchive(const std::string & path, std::vector<SessionStateMigrationResult> & out_results)
+	{
+		out_results.clear();
+		utils::MappedFile file;
+		if (!file.open(path)) {
+			return EC_WrongParam;
+		}
+		// Collect ranges pointing to the mapped file. No state is copied here.
+		std::vector<cc7::ByteRange> states;
+		utils::DataReader reader(file.range());
+		while (reader.remainingSize() > 0) {
+			cc7::ByteRange state;
+			if (!reader.readRange(state)) {
+				CC7_LOG("SessionStateMigrator: Archive is corrupted at offset %d", (int)reader.currentOffset());
+				return EC_WrongParam;
+			}
+			states.push_back(state);
+		}
+		out_results = migrateStates(states);
+		return EC_Ok;
+	}
+	
+	cc7::ByteArray SessionStateMigrator::buildArchive(const std::vector<cc7::ByteRange> & states)
+	{
+		utils::DataWriter measure(utils::DataWriter::MEASURE_ONLY);
+		for (auto && state : states) {
+			measure.writeData(state);
+		}
+		cc7::ByteArray archive;
+		archive.reserve(measure.serializedSize());
+		utils::DataWriter writer(&archive);
+		for (auto && state : states) {
+			writer.writeData(state);
+		}
+		return archive;
+	}
+	
+} // io::getlime::powerAuth
+} // io::getlime
+} // io
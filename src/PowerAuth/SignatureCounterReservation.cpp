@@ -0,0 +1,116 @@
+/*
+ * Copyright 2019 Wultra s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <PowerAuth/SignatureCounterReservation.h>
+#include "protocol/ProtocolUtils.h"
+#include "protocol/Constants.h"
+#include "crypto/CryptoUtils.h"
+#include "utils/Base64.h"
+
+namespace io
+{
+namespace getlime
+{
+namespace powerAuth
+{
+	SignatureCounterReservation::SignatureCounterReservation() :
+		_keys(nullptr),
+		_factor(SF_Possession),
+		_offline_allowed(false)
+	{
+	}
+	
+	SignatureCounterReservation::~SignatureCounterReservation()
+	{
+		clear();
+	}
+	
+	bool SignatureCounterReservation::isValid() const
+	{
+		return _keys != nullptr && !_ctr_data.empty();
+	}
+	
+	size_t SignatureCounterReservation::count() const
+	{
+		return _ctr_data.size();
+	}
+	
+	SignatureFactor SignatureCounterReservation::signatureFactor() const
+	{
+		return _factor;
+	}
+	
+	void SignatureCounterReservation::clear()
+	{
+		if (_keys) {
+			_keys->possessionKey.secureClear();
+			_keys->knowledgeKey.secureClear();
+			_keys->biometryKey.secureClear();
+			_keys->transportKey.secureClear();
+			delete _keys;
+			_keys = nullptr;
+		}
+		_ctr_data.clear();
+		_version.clear();
+		_activation_id.clear();
+		_application_key.clear();
+		_application_secret.clear();
+		_offline_allowed = false;
+	}
+	
+	ErrorCode SignatureCounterReservation::signHTTPRequestData(size_t index, const HTTPRequestDataView & request, std::string & out_header_value) const
+	{
+		if (!isValid()) {
+			CC7_LOG("SignatureCounterReservation %p: Sign: The reservation is not valid.", this);
+			return EC_WrongState;
+		}
+		if (index >= _ctr_data.size() || !request.hasValidData()) {
+			CC7_LOG("SignatureCounterReservation %p: Sign: Wrong index or request data.", this);
+			return EC_WrongParam;
+		}
+		if (request.isOfflineRequest() && !_offline_allowed) {
+			CC7_LOG("SignatureCounterReservation %p: Sign: Offline signature is not available during the pending protocol upgrade.", this);
+			return EC_WrongState;
+		}
+		// Get NONCE from request structure, or generate a new one.
+		char nonce_buffer[32];
+		cc7::ByteRange nonce_b64;
+		if (!request.isOfflineRequest()) {
+			cc7::ByteArray nonce = crypto::GetRandomData(protocol::SIGNATURE_KEY_SIZE, true);
+			nonce_b64 = cc7::ByteRange(nonce_buffer, utils::Base64_EncodeToBuffer(nonce, nonce_buffer));
+		} else {
+			cc7::ByteArray nonce;
+			if (!utils::Base64_Decode(request.offlineNonce, nonce)) {
+				CC7_LOG("SignatureCounterReservation %p: Sign: request.offlineNonce is invalid.", this);
+				return EC_Encryption;
+			}
+			// Already in valid Base64 format
+			nonce_b64 = request.offlineNonce;
+		}
+		const std::string & app_key = request.isOfflineRequest() ? protocol::PA_OFFLINE_APP_SECRET : _application_key;
+		const std::string & app_secret = request.isOfflineRequest() ? protocol::PA_OFFLINE_APP_SECRET : _application_secret;
+		if (!protocol::CalculateAuthHeaderValue(out_header_value, *_keys, _factor, _ctr_data[index], _version, _activation_id,
+												app_key, app_secret, request, nonce_b64, nullptr)) {
+			CC7_LOG("SignatureCounterReservation %p: Sign: Signature calculation failed.", this);
+			return EC_Encryption;
+		}
+		return EC_Ok;
+	}
+	
+} // io::getlime::powerAuth
+} // io::getlime
+} // io
@@ -0,0 +1,129 @@
+/*
+ * Copyright 2019 Wultra s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <PowerAuth/VaultSession.h>
+#include <PowerAuth/Session.h>
+#include "protocol/ProtocolUtils.h"
+#include "crypto/CryptoUtils.h"
+#include "utils/SecureMemory.h"
+#include <algorithm>
+
+namespace io
+{
+namespace getlime
+{
+namespace powerAuth
+{
+	
+// Acquires lock of the session which opened this vault session. If the vault session
+// is not valid, then returns EC_WrongState from the calling function.
+#define VAULT_LOCK_GUARD()															\
+	Session * session = _session;													\
+	if (session == nullptr) {														\
+		return EC_WrongState;														\
+	}																				\
+	std::lock_guard<std::recursive_mutex> _lock_guard(session->_lock);				\
+	if (_session != session) {														\
+		return EC_WrongState;														\
+	}
+	
+	// MARK: Construction / Destruction -
+	
+	VaultSession::VaultSession() :
+		_session(nullptr),
+		_vault_key(nullptr),
+		_vault_key_allocated_size(0),
+		_device_private_key(nullptr)
+	{
+	}
+	
+	VaultSession::~VaultSession()
+	{
+		close();
+	}
+	
+	bool VaultSession::isValid() const
+	{
+		return _session != nullptr;
+	}
+	
+	void VaultSession::close()
+	{
+		Session * session = _session;
+		if (session == nullptr) {
+			return;
+		}
+		std::lock_guard<std::recursive_mutex> lock_guard(session->_lock);
+		if (_session == session) {
+			auto & list = session->_vault_sessions;
+			list.erase(std::remove(list.begin(), list.end(), this), list.end());
+			invalidate();
+		}
+	}
+	
+	void VaultSession::invalidate()
+	{
+		_session = nullptr;
+		utils::SecureMemory_Free(_vault_key, _vault_key_allocated_size);
+		_vault_key = nullptr;
+		_vault_key_allocated_size = 0;
+		EC_KEY_free(_device_private_key);
+		_device_private_key = nullptr;
+	}
+	
+	cc7::ByteRange VaultSession::vaultKey() const
+	{
+		return cc7::ByteRange(_vault_key, protocol::VAULT_KEY_SIZE);
+	}
+	
+	
+	// MARK: - Vault operations -
+	
+	ErrorCode VaultSession::deriveCryptographicKey(cc7::U64 key_index, cc7::ByteArray & out_key)
+	{
+		VAULT_LOCK_GUARD();
+		out_key = protocol::DeriveSecretKey(vaultKey(), key_index);
+		if (out_key.empty()) {
+			return EC_Encryption;
+		}
+		return EC_Ok;
+	}
+	
+	ErrorCode VaultSession::signDataWithDevicePrivateKey(const cc7::ByteRange & data, cc7::ByteArray & out_signature)
+	{
+		VAULT_LOCK_GUARD();
+		if (!crypto::ECDSA_ComputeSignature(data, _device_private_key, out_signature)) {
+			return EC_Encryption;
+		}
+		return EC_Ok;
+	}
+	
+	ErrorCode VaultSession::addBiometryFactor(const SignatureUnlockKeys & keys)
+	{
+		VAULT_LOCK_GUARD();
+		return session->addBiometryFactorImpl(vaultKey(), _device_private_key, keys);
+	}
+	
+	ErrorCode VaultSession::getActivationRecoveryData(RecoveryData & out_recovery_data)
+	{
+		VAULT_LOCK_GUARD();
+		return session->getActivationRecoveryDataImpl(vaultKey(), out_recovery_data);
+	}
+	
+} // io::getlime::powerAuth
+} // io::getlime
+} // io
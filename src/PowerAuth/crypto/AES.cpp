@@ -17,6 +17,8 @@
 #include "AES.h"
 #include "PKCS7Padding.h"
 #include <openssl/aes.h>
+#include <openssl/crypto.h>
+#include <string.h>
 
 
 namespace io
@@ -82,6 +84,61 @@ namespace crypto
 		return AES_CBC_Encrypt(key, iv, paddedData);
 	}
 	
+	
+	bool AES_CBC_Encrypt_Padding_InPlace(const cc7::ByteRange & key, const cc7::ByteRange & iv, cc7::ByteArray & inout_data)
+	{
+		PKCS7_Add(inout_data, AES_BLOCK_SIZE);
+		cc7::byte ivec[AES_BLOCK_SIZE];
+		AES_KEY aes_key;
+		
+		int res = iv.size() == AES_BLOCK_SIZE ? AES_set_encrypt_key(key.data(), (int)key.size() * 8, &aes_key) : -1;
+		if (res == 0) {
+			memcpy(ivec, iv.data(), AES_BLOCK_SIZE);
+			AES_cbc_encrypt(inout_data.data(), inout_data.data(), inout_data.size(), &aes_key, ivec, AES_ENCRYPT);
+		} else {
+			inout_data.clear();
+			CC7_LOG("AES_set_encrypt_key failed");
+		}
+		return res == 0;
+	}
+	
+	
+	struct AESDecryptionKey
+	{
+		AES_KEY aes_key;
+	};
+	
+	AESDecryptionKey * AES_CreateDecryptionKey(const cc7::ByteRange & key)
+	{
+		AESDecryptionKey * result = new AESDecryptionKey();
+		if (AES_set_decrypt_key(key.data(), (int)key.size() * 8, &result->aes_key) != 0) {
+			CC7_LOG("AES_set_decrypt_key failed");
+			AES_DestroyDecryptionKey(result);
+			return nullptr;
+		}
+		return result;
+	}
+	
+	void AES_DestroyDecryptionKey(AESDecryptionKey * key)
+	{
+		if (key) {
+			OPENSSL_cleanse(&key->aes_key, sizeof(key->aes_key));
+			delete key;
+		}
+	}
+	
+	bool AES_CBC_Decrypt_InPlace(const AESDecryptionKey * key, const cc7::ByteRange & iv, cc7::byte * inout_data, size_t size)
+	{
+		if (!key || iv.size() != AES_BLOCK_SIZE || (size % AES_BLOCK_SIZE) != 0) {
+			CC7_ASSERT(false, "Invalid parameters for AES_CBC_Decrypt_InPlace");
+			return false;
+		}
+		cc7::byte ivec[AES_BLOCK_SIZE];
+		memcpy(ivec, iv.data(), AES_BLOCK_SIZE);
+		AES_cbc_encrypt(inout_data, inout_data, size, &key->aes_key, ivec, AES_DECRYPT);
+		return true;
+	}
+	
 
 } // io::getlime::powerAuth::crypto
 } // io::getlime::powerAuth
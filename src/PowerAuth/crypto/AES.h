@@ -39,6 +39,25 @@ namespace crypto
 	// CBC + PKCS7 padding
 	cc7::ByteArray AES_CBC_Decrypt_Padding(const cc7::ByteRange & key, const cc7::ByteRange & iv, const cc7::ByteRange & data, bool * error = nullptr);
 	cc7::ByteArray AES_CBC_Encrypt_Padding(const cc7::ByteRange & key, const cc7::ByteRange & iv, const cc7::ByteRange & data);
+	
+	// Returns size of data encrypted with CBC + PKCS7 padding
+	inline size_t AES_CBC_PaddedSize(size_t data_size)
+	{
+		return (data_size & ~size_t(15)) + 16;
+	}
+	// CBC + PKCS7 padding, the content of |inout_data| is replaced with the encrypted data. If the array has
+	// enough capacity for the padding, then no memory is allocated. Returns false if the encryption fails.
+	bool AES_CBC_Encrypt_Padding_InPlace(const cc7::ByteRange & key, const cc7::ByteRange & iv, cc7::ByteArray & inout_data);
+	
+	// Prepared AES key schedule, which can be reused for multiple decryptions with the same key.
+	struct AESDecryptionKey;
+	// Creates a new key schedule for decryption with |key|. Returns nullptr if the key is invalid.
+	AESDecryptionKey * AES_CreateDecryptionKey(const cc7::ByteRange & key);
+	// Wipes and destroys the key schedule. It's safe to call this function with nullptr.
+	void AES_DestroyDecryptionKey(AESDecryptionKey * key);
+	// Simple CBC, decrypts |size| bytes at |inout_data| in place. The size must be a multiple of
+	// the AES block size and the |iv| must be exactly one block long.
+	bool AES_CBC_Decrypt_InPlace(const AESDecryptionKey * key, const cc7::ByteRange & iv, cc7::byte * inout_data, size_t size);
 
 	
 } // io::getlime::powerAuth::crypto
@@ -21,7 +21,7 @@
 #include <openssl/ecdh.h>
 #include <openssl/err.h>
 
-#include <cc7/Base64.h>
+#include "../utils/Base64.h"
 
 namespace io
 {
@@ -37,6 +37,43 @@ namespace crypto
 	//
 	const int ECC_CURVE = NID_X9_62_prime256v1;
 	
+	static EC_GROUP * _CreateSharedGroup()
+	{
+		EC_GROUP * group = EC_GROUP_new_by_curve_name(ECC_CURVE);
+		if (group && !EC_GROUP_have_precompute_mult(group)) {
+			// Precompute multiples of generator. If the curve implementation already has its own
+			// static table, then this is not required. The failure is not fatal, the group is still usable.
+			if (1 != EC_GROUP_precompute_mult(group, nullptr)) {
+				CC7_LOG("ECC: Failed to precompute multiples of generator.");
+				ERR_clear_error();
+			}
+		}
+		return group;
+	}
+	
+	const EC_GROUP * ECC_GetSharedGroup()
+	{
+		// Initialization of function-local static is thread safe. The group is intentionally never
+		// released, because it's shared by all keys created during the lifetime of the process.
+		static const EC_GROUP * s_group = _CreateSharedGroup();
+		return s_group;
+	}
+	
+	EC_KEY * ECC_CreateKey()
+	{
+		const EC_GROUP * group = ECC_GetSharedGroup();
+		if (!group) {
+			return nullptr;
+		}
+		// The key references a copy of the group, but the precomputed data is shared.
+		EC_KEY * key = EC_KEY_new();
+		if (key && 1 != EC_KEY_set_group(key, group)) {
+			EC_KEY_free(key);
+			key = nullptr;
+		}
+		return key;
+	}
+	
 	EC_KEY * ECC_ImportPublicKey(EC_KEY * key, const cc7::ByteRange & publicKey, BN_CTX * c)
 	{
 		bool result = false;
@@ -45,7 +82,7 @@ namespace crypto
 		
 		if (!key) {
 			// Create a new key if key object is null.
-			key = EC_KEY_new_by_curve_name(ECC_CURVE);
+			key = ECC_CreateKey();
 		}
 		const EC_GROUP * group = key ? EC_KEY_get0_group(key) : nullptr;
 		EC_POINT *       point = key ? EC_POINT_new(group)    : nullptr;
@@ -75,7 +112,7 @@ namespace crypto
 	
 	EC_KEY * ECC_ImportPublicKeyFromB64(EC_KEY * key, const std::string & publicKey, BN_CTX * c)
 	{
-		cc7::ByteArray keyData = cc7::FromBase64String(publicKey);
+		cc7::ByteArray keyData = utils::Base64_Decode(cc7::MakeRange(publicKey));
 		if (keyData.empty()) {
 			if (key) {
 				// we don't care if key was created outside.
@@ -89,6 +126,55 @@ namespace crypto
 	}
 	
 	
+	static size_t _FieldSize(const EC_GROUP * group)
+	{
+		return group ? (EC_GROUP_get_degree(group) + 7) / 8 : 0;
+	}
+	
+	EC_KEY * ECC_ImportPublicKeyFromCoordinates(EC_KEY * key, const cc7::ByteRange & coordinates, BN_CTX * c)
+	{
+		bool result = false;
+		
+		BNContext ctx(c);
+		
+		if (!key) {
+			// Create a new key if key object is null.
+			key = ECC_CreateKey();
+		}
+		const EC_GROUP * group = key ? EC_KEY_get0_group(key) : nullptr;
+		EC_POINT *       point = key ? EC_POINT_new(group)    : nullptr;
+		size_t      field_size = _FieldSize(group);
+		
+		if (point && field_size > 0 && coordinates.size() == 2 * field_size) {
+			BN_CTX_start(ctx);
+			BIGNUM * x = BN_CTX_get(ctx);
+			BIGNUM * y = BN_CTX_get(ctx);
+			if (y &&
+				BN_bin2bn(coordinates.data(), (int)field_size, x) &&
+				BN_bin2bn(coordinates.data() + field_size, (int)field_size, y)) {
+				// OpenSSL still checks whether the point is on the curve, but that's a cheap
+				// operation, compared to the square root calculated during the decompression.
+				if (1 == EC_POINT_set_affine_coordinates_GFp(group, point, x, y, ctx)) {
+					// Set makes copy of key and therefore we have to cleanup point later
+					result = (1 == EC_KEY_set_public_key(key, point));
+				}
+			}
+			BN_CTX_end(ctx);
+		}
+		
+		if (point) {
+			EC_POINT_free(point);
+		}
+		if (!result) {
+			if (key) {
+				EC_KEY_free(key);
+				key = nullptr;
+			}
+		}
+		return key;
+	}
+	
+	
 	cc7::ByteArray ECC_ExportPublicKey(EC_KEY * key, BN_CTX * c)
 	{
 		BNContext ctx(c);
@@ -113,7 +199,7 @@ namespace crypto
 	std::string ECC_ExportPublicKeyToB64(EC_KEY * key, BN_CTX * c)
 	{
 		auto keyData = ECC_ExportPublicKey(key, c);
-		return cc7::ToBase64String(keyData);
+		return utils::Base64_Encode(keyData);
 	}
 	
 	
@@ -147,15 +233,49 @@ namespace crypto
 	}
 	
 	
+	cc7::ByteArray ECC_ExportPublicKeyToCoordinates(EC_KEY * key, BN_CTX * c)
+	{
+		cc7::ByteArray out;
+		do {
+			if (!key) {
+				break;
+			}
+			const EC_POINT * point = EC_KEY_get0_public_key(key);
+			const EC_GROUP * group = EC_KEY_get0_group(key);
+			size_t field_size = _FieldSize(group);
+			if (!point || field_size == 0 || EC_POINT_is_at_infinity(group, point)) {
+				break;
+			}
+			BNContext ctx(c);
+			BN_CTX_start(ctx);
+			BIGNUM * x = BN_CTX_get(ctx);
+			BIGNUM * y = BN_CTX_get(ctx);
+			if (y && EC_POINT_get_affine_coordinates_GFp(group, point, x, y, ctx)) {
+				size_t x_size = BN_num_bytes(x);
+				size_t y_size = BN_num_bytes(y);
+				if (x_size <= field_size && y_size <= field_size) {
+					// Export both coordinates, with leading zeros
+					out = cc7::ByteArray(2 * field_size, 0);
+					BN_bn2bin(x, out.data() + field_size - x_size);
+					BN_bn2bin(y, out.data() + 2 * field_size - y_size);
+				}
+			}
+			BN_CTX_end(ctx);
+			
+		} while (false);
+		return out;
+	}
+	
+	
 	EC_KEY * ECC_ImportPrivateKey(EC_KEY * key, const cc7::ByteRange & privateKeyData, BN_CTX * c)
 	{
 		bool result = false;
 		BNContext ctx(c);
 		if (!key) {
-			key = EC_KEY_new_by_curve_name(ECC_CURVE);
+			key = ECC_CreateKey();
 		}
 		BIGNUM * s = BN_CTX_get(ctx);
-		if (s && nullptr != BN_bin2bn(privateKeyData.data(), (int)privateKeyData.size(), s)) {
+		if (key && s && nullptr != BN_bin2bn(privateKeyData.data(), (int)privateKeyData.size(), s)) {
 			result = (1 == EC_KEY_set_private_key(key, s));
 		}
 		if (!result) {
@@ -174,10 +294,28 @@ namespace crypto
 		return keyData;
 	}
 	
+	bool ECC_ValidateKeyPair(EC_KEY * private_key, EC_KEY * public_key, BN_CTX * c)
+	{
+		BNContext ctx(c);
+		const EC_GROUP * group = private_key ? EC_KEY_get0_group(private_key) : nullptr;
+		const BIGNUM * scalar = private_key ? EC_KEY_get0_private_key(private_key) : nullptr;
+		const EC_POINT * expected_point = public_key ? EC_KEY_get0_public_key(public_key) : nullptr;
+		if (!group || !scalar || !expected_point) {
+			return false;
+		}
+		bool result = false;
+		EC_POINT * point = EC_POINT_new(group);
+		if (point && 1 == EC_POINT_mul(group, point, scalar, nullptr, nullptr, ctx)) {
+			result = (0 == EC_POINT_cmp(group, point, expected_point, ctx));
+		}
+		EC_POINT_free(point);
+		return result;
+	}
+	
 	
 	EC_KEY * ECC_GenerateKeyPair()
 	{
-		EC_KEY * key = EC_KEY_new_by_curve_name(ECC_CURVE);
+		EC_KEY * key = ECC_CreateKey();
 		if (key) {
 			if (1 != EC_KEY_generate_key(key)) {
 				EC_KEY_free(key);
@@ -37,6 +37,17 @@ namespace crypto
 	// MARK: - ECC key routines -
 	//
 	
+	/**
+	 Returns process-wide P-256 group. The group is created on the first use, with precomputed
+	 multiples of the generator, if the curve implementation doesn't provide a static table.
+	 The returned group is immutable and can be used from multiple threads at the same time.
+	 Returns nullptr if the group cannot be created.
+	 */
+	const EC_GROUP *ECC_GetSharedGroup();
+	/**
+	 Creates a new empty EC_KEY structure, attached to the process-wide P-256 group.
+	 */
+	EC_KEY *		ECC_CreateKey();
 	/**
 	 Creates a new EC_KEY structure from given public key.
 	 If key parameter is null then creates a new key.
@@ -49,6 +60,14 @@ namespace crypto
 	 If key parameter is not null and import fails then deletes key automatically.
 	 */
 	EC_KEY *		ECC_ImportPublicKeyFromB64(EC_KEY * key, const std::string & publicKey, BN_CTX * c = nullptr);
+	/**
+	 Creates a new EC_KEY structure from uncompressed affine coordinates of public key, exported
+	 with ECC_ExportPublicKeyToCoordinates(). Unlike ECC_ImportPublicKey(), the point is set directly,
+	 so the costly decompression of point is not performed.
+	 If key parameter is null then creates a new key.
+	 If key parameter is not null and import fails then deletes key automatically.
+	 */
+	EC_KEY *		ECC_ImportPublicKeyFromCoordinates(EC_KEY * key, const cc7::ByteRange & coordinates, BN_CTX * c = nullptr);
 	/**
 	 Exports public key into compressed format.
 	 */
@@ -62,6 +81,12 @@ namespace crypto
 	 This is equivalent operation to Java's: eccPublicKey.getW().getAffineX().toByteArray();
 	 */
 	cc7::ByteArray	ECC_ExportPublicKeyToNormalizedForm(EC_KEY * key, BN_CTX * c = nullptr);
+	/**
+	 Exports public key into uncompressed affine coordinates. The result is a concatenation
+	 of X and Y coordinates, where each coordinate is padded to the size of the field.
+	 If the operation fails, then returns empty data.
+	 */
+	cc7::ByteArray	ECC_ExportPublicKeyToCoordinates(EC_KEY * key, BN_CTX * c = nullptr);
 	/**
 	 Imports private key from given data.
 	 If key parameter is null then creates a new key.
@@ -72,6 +97,11 @@ namespace crypto
 	 Exports private key into sequence of bytes.
 	 */
 	cc7::ByteArray	ECC_ExportPrivateKey(EC_KEY * key, BN_CTX * c = nullptr);
+	/**
+	 Returns true if public key calculated from the private key stored in |private_key|
+	 is equal to the point stored in |public_key|.
+	 */
+	bool			ECC_ValidateKeyPair(EC_KEY * private_key, EC_KEY * public_key, BN_CTX * c = nullptr);
 	/**
 	 Generates a new ECC key pair.
 	 */
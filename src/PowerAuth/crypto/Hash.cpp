@@ -35,14 +35,19 @@ namespace crypto
 	cc7::ByteArray SHA256(const cc7::ByteRange & data)
 	{
 		cc7::ByteArray hash(SHA256_DIGEST_LENGTH, 0);
+		SHA256_ToBuffer(data, hash.data());
+		return hash;
+	}
+	
+	void SHA256_ToBuffer(const cc7::ByteRange & data, cc7::byte * out_hash)
+	{
+		static_assert(SHA256_HASH_SIZE == SHA256_DIGEST_LENGTH, "Wrong SHA256_HASH_SIZE constant");
 		
 		SHA256_CTX sha256;
 		SHA256_Init(&sha256);
 		SHA256_Update(&sha256, data.data(), data.size());
-		SHA256_Final(hash.data(), &sha256);
+		SHA256_Final(out_hash, &sha256);
 		OPENSSL_cleanse(&sha256, sizeof(sha256));
-		
-		return hash;
 	}
 	
 } // io::getlime::powerAuth::crypto
@@ -32,7 +32,10 @@ namespace powerAuth
 namespace crypto
 {
 	// SHA256
+	const size_t SHA256_HASH_SIZE = 32;
 	cc7::ByteArray SHA256(const cc7::ByteRange & data);
+	// SHA256, the hash is stored to |out_hash| buffer, which must have capacity for SHA256_HASH_SIZE bytes.
+	void SHA256_ToBuffer(const cc7::ByteRange & data, cc7::byte * out_hash);
 
 	
 } // io::getlime::powerAuth::crypto
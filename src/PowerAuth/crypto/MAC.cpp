@@ -50,6 +50,94 @@ namespace crypto
 		return cc7::ByteArray();
 	}	
 	
+	// -------------------------------------------------------------------------------------------
+	// MARK: - HMAC, incremental
+	//
+	
+	HMAC_SHA256_Context::HMAC_SHA256_Context() :
+		_ctx(HMAC_CTX_new()),
+		_initialized(false)
+	{
+	}
+	
+	HMAC_SHA256_Context::~HMAC_SHA256_Context()
+	{
+		if (_ctx) {
+			// HMAC_CTX_free() also cleanses the internal state.
+			HMAC_CTX_free(_ctx);
+		}
+	}
+	
+	bool HMAC_SHA256_Context::init(const cc7::ByteRange & key)
+	{
+		_initialized = false;
+		if (!_ctx) {
+			CC7_LOG("HMAC_SHA256_Context: Context allocation failed.");
+			return false;
+		}
+		// OpenSSL treats NULL key as a request for reusing the previous key.
+		// We have to provide a valid pointer, even for an empty key.
+		static const unsigned char empty_key = 0;
+		const unsigned char * key_ptr = key.empty() ? &empty_key : key.data();
+		if (1 != HMAC_Init_ex(_ctx, key_ptr, (int)key.size(), EVP_sha256(), NULL)) {
+			CC7_LOG("HMAC_SHA256_Context: Init failed.");
+			return false;
+		}
+		_initialized = true;
+		return true;
+	}
+	
+	bool HMAC_SHA256_Context::init(const HMAC_SHA256_Context & prepared)
+	{
+		_initialized = false;
+		if (!_ctx || !prepared._initialized) {
+			CC7_ASSERT(false, "HMAC_SHA256_Context: Context is not allocated or prepared context is not initialized.");
+			return false;
+		}
+		if (1 != HMAC_CTX_copy(_ctx, prepared._ctx)) {
+			CC7_LOG("HMAC_SHA256_Context: Copy failed.");
+			return false;
+		}
+		_initialized = true;
+		return true;
+	}
+	
+	bool HMAC_SHA256_Context::update(const cc7::ByteRange & data)
+	{
+		if (!_initialized) {
+			CC7_ASSERT(false, "HMAC_SHA256_Context: Context is not initialized.");
+			return false;
+		}
+		if (data.empty()) {
+			return true;
+		}
+		if (1 != HMAC_Update(_ctx, data.data(), data.size())) {
+			CC7_LOG("HMAC_SHA256_Context: Update failed.");
+			_initialized = false;
+			return false;
+		}
+		return true;
+	}
+	
+	cc7::ByteArray HMAC_SHA256_Context::final(size_t outputBytes)
+	{
+		if (!_initialized) {
+			CC7_ASSERT(false, "HMAC_SHA256_Context: Context is not initialized.");
+			return cc7::ByteArray();
+		}
+		_initialized = false;
+		cc7::ByteArray digest(SHA256_DIGEST_LENGTH, 0);
+		unsigned int digest_length = SHA256_DIGEST_LENGTH;
+		if ((1 != HMAC_Final(_ctx, digest.data(), &digest_length)) || (digest_length != digest.size())) {
+			CC7_LOG("HMAC_SHA256_Context: Final failed.");
+			return cc7::ByteArray();
+		}
+		if (outputBytes > 0 && outputBytes < SHA256_DIGEST_LENGTH) {
+			digest.resize(outputBytes);
+		}
+		return digest;
+	}
+	
 } // io::getlime::powerAuth::crypto
 } // io::getlime::powerAuth
 } // io::getlime
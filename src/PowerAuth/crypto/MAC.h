@@ -17,6 +17,7 @@
 #pragma once
 
 #include <cc7/ByteArray.h>
+#include <openssl/hmac.h>
 
 /*
  Note that all functionality provided by this header will
@@ -34,6 +35,55 @@ namespace crypto
 	// HMAC with SHA256
 	cc7::ByteArray HMAC_SHA256(const cc7::ByteRange & data, const cc7::ByteRange & key, size_t outputBytes = 0);
 	
+	/**
+	 The HMAC_SHA256_Context class allows calculation of HMAC with SHA256 over data,
+	 which is provided in multiple chunks. The result is equal to HMAC_SHA256()
+	 function, calculated over concatenation of all chunks.
+	 
+	 The typical usage is: `init(key)`, one or more `update(chunk)` and then `final()`.
+	 The object can be reused for another calculation after the `init()` call.
+	 */
+	class HMAC_SHA256_Context
+	{
+	public:
+		HMAC_SHA256_Context();
+		~HMAC_SHA256_Context();
+		
+		/**
+		 Initializes context with given |key|. Returns false if the underlying
+		 cryptographic library fails.
+		 */
+		bool init(const cc7::ByteRange & key);
+		/**
+		 Initializes context with a keyed state copied from |prepared| context, which must be
+		 initialized and not updated yet. This is cheaper than init() with the same key, because
+		 the key is not processed again. Returns false if the |prepared| context is not initialized
+		 or if the underlying cryptographic library fails.
+		 */
+		bool init(const HMAC_SHA256_Context & prepared);
+		/**
+		 Adds |data| to the calculation. Returns false if context is not initialized
+		 or if the underlying cryptographic library fails.
+		 */
+		bool update(const cc7::ByteRange & data);
+		/**
+		 Finishes calculation and returns final MAC. If |outputBytes| is greater than 0
+		 and less than 32, then the result is truncated to the requested length.
+		 Returns an empty array in case of failure. The context must be initialized
+		 again before the next use.
+		 */
+		cc7::ByteArray final(size_t outputBytes = 0);
+		
+	private:
+		
+		// Not copyable
+		HMAC_SHA256_Context(const HMAC_SHA256_Context &) = delete;
+		HMAC_SHA256_Context & operator=(const HMAC_SHA256_Context &) = delete;
+		
+		HMAC_CTX * _ctx;
+		bool _initialized;
+	};
+	
 } // io::getlime::powerAuth::crypto
 } // io::getlime::powerAuth
 } // io::getlime
@@ -15,7 +15,7 @@
  */
 
 #include "ECIESEncryptorJNI.h"
-#include <cc7/Base64.h>
+#include "../utils/Base64.h"
 
 // Package: io.getlime.security.powerauth.core
 #define CC7_JNI_CLASS_PATH	    	"io/getlime/security/powerauth/core"
@@ -98,7 +98,7 @@ CC7_JNI_METHOD_PARAMS(void, destroy, jlong handle)
 //
 CC7_JNI_METHOD_PARAMS(jlong, init, jstring publicKey, jbyteArray sharedInfo1, jbyteArray sharedInfo2)
 {
-	auto cppPublicKey = cc7::FromBase64String(cc7::jni::CopyFromJavaString(env, publicKey));
+	auto cppPublicKey = utils::Base64_Decode(cc7::MakeRange(cc7::jni::CopyFromJavaString(env, publicKey)));
 	auto cppSharedInfo1 = cc7::jni::CopyFromJavaByteArray(env, sharedInfo1);
 	auto cppSharedInfo2 = cc7::jni::CopyFromJavaByteArray(env, sharedInfo2);
 	auto encryptor = new ECIESEncryptor(cppPublicKey, cppSharedInfo1, cppSharedInfo2);
@@ -138,7 +138,7 @@ CC7_JNI_METHOD(jstring, getPublicKey)
 		CC7_ASSERT(false, "Missing internal handle.");
 		return NULL;
 	}
-	auto publicKey = encryptor->publicKey().base64String();
+	auto publicKey = utils::Base64_Encode(encryptor->publicKey());
 	return cc7::jni::CopyToNullableJavaString(env, publicKey);
 }
 
@@ -245,4 +245,60 @@ CC7_JNI_METHOD_PARAMS(jbyteArray, decryptResponse, jobject cryptogram)
 	return cc7::jni::CopyToJavaByteArray(env, cppData);
 }
 
+//
+// public native byte[] encryptRequestToJson(byte[] requestData);
+//
+CC7_JNI_METHOD_PARAMS(jbyteArray, encryptRequestToJson, jbyteArray requestData)
+{
+	auto encryptor = CC7_THIS_OBJ();
+	if (!encryptor) {
+		CC7_ASSERT(false, "Missing internal handle.");
+		return NULL;
+	}
+	// Copy parameters to CPP objects
+	auto cppRequestData = cc7::jni::CopyFromJavaByteArray(env, requestData);
+	
+	// Encrypt request and serialize cryptogram to JSON
+	ECIESCryptogram cppCryptogram;
+	auto ec = encryptor->encryptRequest(cppRequestData, cppCryptogram);
+	if (ec != EC_Ok) {
+		CC7_ASSERT(false, "ECIESCryptogram.encryptRequestToJson: failed with error code %d", ec);
+		return NULL;
+	}
+	cc7::ByteArray cppJson;
+	ec = ECIESCryptogram_EncodeJSON(cppCryptogram, cppJson);
+	if (ec != EC_Ok) {
+		CC7_ASSERT(false, "ECIESCryptogram.encryptRequestToJson: JSON serialization failed with error code %d", ec);
+		return NULL;
+	}
+	return cc7::jni::CopyToJavaByteArray(env, cppJson);
+}
+
+//
+// public native byte[] decryptJsonResponse(byte[] responseJson);
+//
+CC7_JNI_METHOD_PARAMS(jbyteArray, decryptJsonResponse, jbyteArray responseJson)
+{
+	auto encryptor = CC7_THIS_OBJ();
+	if (!encryptor) {
+		CC7_ASSERT(false, "Missing internal handle.");
+		return NULL;
+	}
+	// Parse cryptogram from JSON
+	ECIESCryptogram cppCryptogram;
+	auto ec = ECIESCryptogram_DecodeJSON(cc7::jni::CopyFromJavaByteArray(env, responseJson), cppCryptogram);
+	if (ec != EC_Ok) {
+		CC7_LOG("ECIESCryptogram.decryptJsonResponse: Invalid JSON envelope.");
+		return NULL;
+	}
+	// Decrypt response
+	cc7::ByteArray cppData;
+	ec = encryptor->decryptResponse(cppCryptogram, cppData);
+	if (ec != EC_Ok) {
+		CC7_ASSERT(false, "ECIESCryptogram.decryptJsonResponse: failed with error code %d", ec);
+		return NULL;
+	}
+	return cc7::jni::CopyToJavaByteArray(env, cppData);
+}
+
 CC7_JNI_MODULE_CLASS_END()
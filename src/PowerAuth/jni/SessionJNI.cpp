@@ -51,7 +51,8 @@ static bool LoadSignatureUnlockKeys(SignatureUnlockKeys & out, JNIEnv * env, job
 		if (!cppPassword) {
 			return false;
 		}
-		out.userPassword = cppPassword->passwordData();
+		// The range points to the password's secure storage, which outlives the call.
+		out.userPasswordRange = cppPassword->passwordRange();
 	}
 	return true;
 }
@@ -389,22 +390,21 @@ CC7_JNI_METHOD_PARAMS(jbyteArray, prepareKeyValueDictionaryForDataSigning, jobje
 		CC7_ASSERT(false, "Missing param or internal handle.");
 		return NULL;
 	}
-	// Copy java keys and values into std::map<string,string>
+	// Copy java keys and values into vector of pairs
 	jsize keysCount = env->GetArrayLength(keys);
 	if (keysCount != env->GetArrayLength(values)) {
 		CC7_ASSERT(false, "Different number of keys and values.");
 		return NULL;
 	}
-	std::map<std::string, std::string> cppMap;
+	std::vector<std::pair<std::string, std::string>> cppPairs;
+	cppPairs.reserve(keysCount);
 	for (jsize index = 0; index < keysCount; index++) {
 		jstring javaKey      = (jstring) env->GetObjectArrayElement(keys, index);
 		jstring javaValue    = (jstring) env->GetObjectArrayElement(values, index);
-		std::string cppKey   = cc7::jni::CopyFromJavaString(env, javaKey);
-		std::string cppValue = cc7::jni::CopyFromJavaString(env, javaValue);
-		cppMap[cppKey] = cppValue;
+		cppPairs.push_back(std::make_pair(cc7::jni::CopyFromJavaString(env, javaKey), cc7::jni::CopyFromJavaString(env, javaValue)));
 	}
 	// Call C++ session and return byte[]
-	cc7::ByteArray cppResult = Session::prepareKeyValueMapForDataSigning(cppMap);
+	cc7::ByteArray cppResult = Session::prepareKeyValuePairsForDataSigning(cppPairs);
 	return cc7::jni::CopyToJavaByteArray(env, cppResult);
 }
 
@@ -418,21 +418,29 @@ CC7_JNI_METHOD_PARAMS(jobject, signHTTPRequest, jobject request, jobject unlockK
 		CC7_ASSERT(false, "Missing param or internal handle.");
 		return NULL;
 	}	
-	// Load parameters into C++ objects 
-	HTTPRequestData cppRequest;
+	// Load parameters into C++ objects.
 	jclass requestClazz		= CC7_JNI_MODULE_FIND_CLASS("SignatureRequest");
-	cppRequest.body			= cc7::jni::CopyFromJavaByteArray(env, CC7_JNI_GET_FIELD_BYTEARRAY(request, requestClazz, "body"));
-	cppRequest.method		= cc7::jni::CopyFromJavaString(env, CC7_JNI_GET_FIELD_STRING(request, requestClazz, "method"));
-	cppRequest.uri			= cc7::jni::CopyFromJavaString(env, CC7_JNI_GET_FIELD_STRING(request, requestClazz, "uriIdentifier"));
-	cppRequest.offlineNonce	= cc7::jni::CopyFromJavaString(env, CC7_JNI_GET_FIELD_STRING(request, requestClazz, "offlineNonce"));
+	std::string cppMethod	= cc7::jni::CopyFromJavaString(env, CC7_JNI_GET_FIELD_STRING(request, requestClazz, "method"));
+	std::string cppUri		= cc7::jni::CopyFromJavaString(env, CC7_JNI_GET_FIELD_STRING(request, requestClazz, "uriIdentifier"));
+	std::string cppNonce	= cc7::jni::CopyFromJavaString(env, CC7_JNI_GET_FIELD_STRING(request, requestClazz, "offlineNonce"));
 	SignatureFactor cppSignatureFactor = (SignatureFactor)signatureFactor;
 	SignatureUnlockKeys cppUnlockKeys;
 	if (false == LoadSignatureUnlockKeys(cppUnlockKeys, env, unlockKeys)) {
 		return NULL;
 	}
+	jbyteArray javaBody		= CC7_JNI_GET_FIELD_BYTEARRAY(request, requestClazz, "body");
+	// The view refers to the array elements provided by the VM. Note that the VM may still return a copy
+	// of the array. The critical access is not used, because the signing acquires the session's lock.
+	jbyte * javaBodyBytes	= javaBody ? env->GetByteArrayElements(javaBody, NULL) : NULL;
+	size_t javaBodySize		= javaBodyBytes ? (size_t) env->GetArrayLength(javaBody) : 0;
+	HTTPRequestDataView cppRequest(cc7::ByteRange(javaBodyBytes, javaBodySize), cc7::MakeRange(cppMethod), cc7::MakeRange(cppUri), cc7::MakeRange(cppNonce));
 	// Call C++ session
 	HTTPRequestDataSignature cppSignature;
 	ErrorCode code = session->signHTTPRequestData(cppRequest, cppUnlockKeys, cppSignatureFactor, cppSignature);
+	if (javaBodyBytes) {
+		// The body was only read, so there's nothing to copy back.
+		env->ReleaseByteArrayElements(javaBody, javaBodyBytes, JNI_ABORT);
+	}
 	// Copy result to java object
 	jclass  resultClazz  = CC7_JNI_MODULE_FIND_CLASS("SignatureResult");
 	jobject resultObject = cc7::jni::CreateJavaObject(env, CC7_JNI_MODULE_CLASS_PATH("SignatureResult"), "()V");
@@ -498,7 +506,7 @@ CC7_JNI_METHOD_PARAMS(jint, changeUserPassword, jobject oldPassword, jobject new
 		return EC_WrongParam;
 	}
 	// Call C++ session
-	return session->changeUserPassword(oldPasswordObj->passwordData(), newPasswordObj->passwordData());
+	return session->changeUserPassword(oldPasswordObj->passwordRange(), newPasswordObj->passwordRange());
 }
 
 //
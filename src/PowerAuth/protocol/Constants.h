@@ -71,12 +71,18 @@ namespace protocol
 	// Minimal password length
 	const size_t MINIMAL_PASSWORD_LENGTH = 4;
 	
+	// Length of server's public key, stored as uncompressed affine coordinates
+	const size_t SERVER_PUBLIC_KEY_COORDINATES_SIZE = 64;
+	
 	// Length of key produced by ECDH
 	const size_t SHARED_SECRET_KEY_SIZE = 32;
 	
 	// Length of decimalized signature, calculated from device public key
 	const size_t ACTIVATION_FINGERPRINT_SIZE = 8;
 	
+	// Length of decimalized signature, calculated for one signature factor
+	const size_t DECIMALIZED_SIGNATURE_SIZE = 8;
+	
 	// Length of status blob
 	const size_t STATUS_BLOB_SIZE = 32;
 	
@@ -84,6 +90,9 @@ namespace protocol
 	const size_t APPLICATION_KEY_SIZE = 16;
 	const size_t APPLICATION_SECRET_SIZE = 16;
 	
+	// Maximum number of signature counter values reserved at once
+	const size_t MAX_RESERVED_COUNTER_VALUES = 1024;
+	
 } // io::getlime::powerAuth::protocol
 } // io::getlime::powerAuth
 } // io::getlime
@@ -84,6 +84,55 @@ namespace protocol
 		return result;
 	}
 	
+	static bool _MatchesServerPublicKey(const cc7::ByteRange & key, const cc7::ByteRange & coordinates)
+	{
+		const size_t field_size = SERVER_PUBLIC_KEY_COORDINATES_SIZE / 2;
+		if (coordinates.size() != SERVER_PUBLIC_KEY_COORDINATES_SIZE) {
+			return false;
+		}
+		if (key.size() == 1 + field_size && (key[0] == 0x02 || key[0] == 0x03)) {
+			// Compressed key contains X and parity of Y
+			return (key[0] & 1) == (coordinates[SERVER_PUBLIC_KEY_COORDINATES_SIZE - 1] & 1) &&
+					key.subRangeFrom(1) == coordinates.subRangeTo(field_size);
+		}
+		if (key.size() == 1 + SERVER_PUBLIC_KEY_COORDINATES_SIZE && key[0] == 0x04) {
+			// Uncompressed key
+			return key.subRangeFrom(1) == coordinates;
+		}
+		return false;
+	}
+	
+	bool UpdateServerPublicKeyCoordinates(PersistentData & pd, BN_CTX * ctx)
+	{
+		if (_MatchesServerPublicKey(pd.serverPublicKey, pd.serverPublicKeyCoordinates)) {
+			return true;
+		}
+		pd.serverPublicKeyCoordinates.clear();
+		EC_KEY * key = crypto::ECC_ImportPublicKey(nullptr, pd.serverPublicKey, ctx);
+		if (key) {
+			pd.serverPublicKeyCoordinates = crypto::ECC_ExportPublicKeyToCoordinates(key, ctx);
+			EC_KEY_free(key);
+		}
+		if (pd.serverPublicKeyCoordinates.size() != SERVER_PUBLIC_KEY_COORDINATES_SIZE) {
+			CC7_LOG("UpdateServerPublicKeyCoordinates: Server's public key is invalid.");
+			pd.serverPublicKeyCoordinates.clear();
+			return false;
+		}
+		return true;
+	}
+	
+	EC_KEY * ImportServerPublicKey(const PersistentData & pd, BN_CTX * ctx)
+	{
+		if (!pd.serverPublicKeyCoordinates.empty()) {
+			EC_KEY * key = crypto::ECC_ImportPublicKeyFromCoordinates(nullptr, pd.serverPublicKeyCoordinates, ctx);
+			if (key) {
+				return key;
+			}
+			CC7_LOG("ImportServerPublicKey: Failed to import key from coordinates.");
+		}
+		return crypto::ECC_ImportPublicKey(nullptr, pd.serverPublicKey, ctx);
+	}
+	
 	bool ValidateSignatureFactor(SignatureFactor factor)
 	{
 		if ((factor & (SF_Possession_Knowledge_Biometry | SF_Transport)) == 0) {
@@ -121,7 +170,7 @@ namespace protocol
 			result = result && (unlock.possessionUnlockKey != ZERO_IV);
 		}
 		if (factor & SF_Knowledge) {
-			result = result && (unlock.userPassword.size() >= MINIMAL_PASSWORD_LENGTH);
+			result = result && (unlock.password().size() >= MINIMAL_PASSWORD_LENGTH);
 		}
 		if (factor & SF_Biometry) {
 			result = result && (unlock.biometryUnlockKey.size() == SIGNATURE_KEY_SIZE);
@@ -162,6 +211,7 @@ namespace protocol
 	const cc7::byte PD_VERSION_V2 = '3';	// data version is one step ahead
 	const cc7::byte PD_VERSION_V3 = '4';	// + protocol V3
 	const cc7::byte PD_VERSION_V4 = '5';	// + recovery codes
+	const cc7::byte PD_VERSION_V5 = '6';	// + server public key coordinates
 
 	// WARNING: If you update PD_VERSION, then please update also routine
 	//          located in PA2SessionStatusDataReader.m in iOS extensions project.
@@ -171,7 +221,7 @@ namespace protocol
 	{
 		CC7_ASSERT(ValidatePersistentData(pd), "Invalid persistent data");
 		
-		writer.openVersion(PD_TAG, pd.isV3() ? PD_VERSION_V4 : PD_VERSION_V2);
+		writer.openVersion(PD_TAG, pd.isV3() ? PD_VERSION_V5 : PD_VERSION_V2);
 		
 		// Serialize hash data or counter, depending on data version
 		if (pd.isV3()) {
@@ -197,6 +247,8 @@ namespace protocol
 
 		// encrypted recovery data (PD v4)
 		writer.writeData	(pd.cRecoveryData);
+		// server public key coordinates (PD v5)
+		writer.writeData	(pd.serverPublicKeyCoordinates);
 		
 		writer.closeVersion();
 		return true;
@@ -240,11 +292,22 @@ namespace protocol
 		} else {
 			pd.cRecoveryData.clear();
 		}
+		// server public key coordinates (PD v5)
+		if (reader.currentVersion() >= PD_VERSION_V5) {
+			result = result && reader.readData	(pd.serverPublicKeyCoordinates);
+		} else {
+			pd.serverPublicKeyCoordinates.clear();
+		}
 		
 		// close versioned section & validate data
 		result = result && reader.closeVersion();
 		result = result && ValidatePersistentData(pd);
 		
+		// Older data has no coordinates, so calculate them now. The failure is not fatal,
+		// the server's public key will be imported from its original encoding.
+		if (result) {
+			UpdateServerPublicKeyCoordinates(pd);
+		}
 		return result;
 	}
 	
@@ -274,16 +337,24 @@ namespace protocol
 			out_data.clear();
 			return true;
 		}
-		// Serialize structure to sequence of bytes
-		utils::DataWriter writer;
-		writer.openVersion(RD_TAG, RD_VERSION_V1);
-		writer.writeString(data.recoveryCode);
-		writer.writeString(data.puk);
-		writer.closeVersion();
+		// Serialize structure to sequence of bytes. The first pass only measures the size
+		// of data, so the output array can be allocated at once, including the padding.
+		auto serialize = [&data](utils::DataWriter & writer) {
+			writer.openVersion(RD_TAG, RD_VERSION_V1);
+			writer.writeString(data.recoveryCode);
+			writer.writeString(data.puk);
+			writer.closeVersion();
+		};
+		utils::DataWriter measure(utils::DataWriter::MEASURE_ONLY);
+		serialize(measure);
+		
+		out_data.clear();
+		out_data.reserve(crypto::AES_CBC_PaddedSize(measure.serializedSize()));
+		utils::DataWriter writer(&out_data);
+		serialize(writer);
 		
 		// Encrypt sequence of bytes
-		out_data = crypto::AES_CBC_Encrypt_Padding(vault_key, ZERO_IV, writer.serializedData());
-		return !out_data.empty();
+		return crypto::AES_CBC_Encrypt_Padding_InPlace(vault_key, ZERO_IV, out_data) && !out_data.empty();
 	}
 	
 	bool DeserializeRecoveryData(const cc7::ByteRange & serialized, const cc7::ByteRange vault_key, RecoveryData & out_data)
@@ -301,7 +372,7 @@ namespace protocol
 			return false;
 		}
 		
-		utils::DataReader reader(decrypted);
+		utils::DataReader reader(decrypted.byteRange());
 
 		// Open version with V1, which automatically allows deserialization of future variants.
 		bool result = reader.openVersion(RD_TAG, RD_VERSION_V1);
@@ -405,12 +476,82 @@ namespace protocol
 				result = result && _old_readString(reader, foo); // this value is no longer important
 			}
 			result = result && ValidatePersistentData(pd);
+			if (result) {
+				UpdateServerPublicKeyCoordinates(pd);
+			}
 		}
 		result = result && reader.readByte(end);
 		return   result && (end == H_END) && (reader.remainingSize() == 0);
 	}
 
 	
+	//
+	// MARK: - Session state -
+	//
+	
+	const cc7::byte HAS_PERSISTENT_DATA = 1 << 1;
+	const cc7::byte DATA_TAG = 'P';
+	const cc7::byte DATA_VER = 'A';
+	const cc7::byte DATA_MIGRATION_FLAG = 'M';
+	
+	void SerializeSessionState(const PersistentData * pd, utils::DataWriter & writer)
+	{
+		cc7::byte flags = pd ? HAS_PERSISTENT_DATA : 0;
+		writer.openVersion(DATA_TAG, DATA_VER);
+		writer.writeByte(flags);
+		if (pd) {
+			SerializePersistentData(*pd, writer);
+		}
+		writer.closeVersion();
+	}
+	
+	bool DeserializeSessionState(PersistentData & pd, bool & out_has_data, utils::DataReader & reader)
+	{
+		cc7::byte flags = 0;
+		bool result = reader.openVersion(DATA_TAG, DATA_VER) &&
+					  reader.readByte(flags);
+		out_has_data = false;
+		if (result && (flags != DATA_MIGRATION_FLAG)) {
+			if (flags & HAS_PERSISTENT_DATA) {
+				result = result && DeserializePersistentData(pd, reader);
+				out_has_data = result;
+			}
+		} else {
+			// DATA_MIGRATION_TAG
+			result = TryDeserializeOldPersistentData(pd, reader);
+			out_has_data = result && !pd.activationId.empty();
+		}
+		return result;
+	}
+	
+	SessionStateFormat PeekSessionStateFormat(const cc7::ByteRange & state)
+	{
+		// Current format:  | DATA_TAG | DATA_VER | flags | PD_TAG | PD_VERSION | ...
+		// Old format:      | 'P' | 'A' | 'M' | '1' or '2' | ...
+		if (state.size() < 3 || state[0] != DATA_TAG || state[1] != DATA_VER) {
+			return SSF_Unknown;
+		}
+		cc7::byte flags = state[2];
+		if (flags == DATA_MIGRATION_FLAG) {
+			return SSF_Legacy;
+		}
+		if (!(flags & HAS_PERSISTENT_DATA)) {
+			return SSF_Empty;
+		}
+		if (state.size() < 5 || state[3] != PD_TAG) {
+			return SSF_Unknown;
+		}
+		switch (state[4]) {
+			case PD_VERSION_V2: return SSF_PD_V2;
+			case PD_VERSION_V3: return SSF_PD_V3;
+			case PD_VERSION_V4: return SSF_PD_V4;
+			case PD_VERSION_V5: return SSF_PD_V5;
+			default:
+				return SSF_Unknown;
+		}
+	}
+
+	
 } // io::getlime::powerAuth::detail
 } // io::getlime::powerAuth
 } // io::getlime
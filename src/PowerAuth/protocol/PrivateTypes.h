@@ -17,6 +17,7 @@
 #pragma once
 
 #include <PowerAuth/PublicTypes.h>
+#include <PowerAuth/SessionStateMigrator.h>
 #include <openssl/ec.h>
 
 // Forward declarations
@@ -161,6 +162,12 @@ namespace protocol
 		 Server's public key
 		 */
 		cc7::ByteArray	serverPublicKey;
+		/**
+		 Server's public key as uncompressed affine coordinates X || Y. The coordinates
+		 are calculated from |serverPublicKey| once and allows import of the key without
+		 the point decompression. The array may be empty, if the key cannot be converted.
+		 */
+		cc7::ByteArray	serverPublicKeyCoordinates;
 		/**
 		 Device's public key
 		 */
@@ -264,6 +271,20 @@ namespace protocol
 	 */
 	bool ValidatePersistentData(const PersistentData & pd);
 	
+	/**
+	 Calculates |serverPublicKeyCoordinates| in |pd| from |serverPublicKey|, if the coordinates are
+	 missing or don't match the key. Returns false if the server's public key cannot be imported.
+	 In this case, the coordinates are cleared and the key must be imported from |serverPublicKey|.
+	 */
+	bool UpdateServerPublicKeyCoordinates(PersistentData & pd, BN_CTX * ctx = nullptr);
+	
+	/**
+	 Imports server's public key from |pd|. The key is imported from |serverPublicKeyCoordinates|
+	 if the coordinates are available, or from |serverPublicKey| otherwise. Returns nullptr if
+	 the key cannot be imported.
+	 */
+	EC_KEY * ImportServerPublicKey(const PersistentData & pd, BN_CTX * ctx = nullptr);
+	
 	/**
 	 Validates whether |factor| contains valid combination of factors.
 	 */
@@ -316,6 +337,25 @@ namespace protocol
 	 */
 	bool TryDeserializeOldPersistentData(PersistentData & pd, utils::DataReader & reader); // DATA_MIGRATION_TAG
 	
+	/**
+	 Serializes a whole session's state, in format produced by Session::saveSessionState(), into
+	 the provided |writer|. The |pd| pointer is nullptr if session has no activation.
+	 */
+	void SerializeSessionState(const PersistentData * pd, utils::DataWriter & writer);
+	
+	/**
+	 Deserializes a whole session's state from the |reader| into the |pd| reference. The old data
+	 format is also supported. The |out_has_data| is set to true if the state contains a valid
+	 activation. Returns false if the byte stream contains invalid data.
+	 */
+	bool DeserializeSessionState(PersistentData & pd, bool & out_has_data, utils::DataReader & reader);
+	
+	/**
+	 Detects format of serialized session's state, only by peeking into the data headers.
+	 The rest of the data is not validated.
+	 */
+	SessionStateFormat PeekSessionStateFormat(const cc7::ByteRange & state);
+	
 	
 	//
 	// MARK: - Recovery codes -
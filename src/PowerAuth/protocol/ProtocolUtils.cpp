@@ -17,8 +17,10 @@
 #include "ProtocolUtils.h"
 #include "Constants.h"
 #include "../crypto/CryptoUtils.h"
-#include <cc7/Base64.h>
+#include "../utils/Base64.h"
+#include <PowerAuth/Password.h>
 #include <cc7/Endian.h>
+#include <string.h>
 
 namespace io
 {
@@ -44,7 +46,7 @@ namespace protocol
 			return true;
 		}
 		cc7::ByteArray signature;
-		bool result = signature.readFromBase64String(sig);
+		bool result = utils::Base64_Decode(cc7::MakeRange(sig), signature);
 		if (!result || signature.empty()) {
 			return false;
 		}
@@ -150,6 +152,18 @@ namespace protocol
 		}
 	}
 	
+	static cc7::ByteArray _DeriveKnowledgeProtectionKey(const SignatureUnlockKeys & keys, const SignatureUnlockKeysReq & request)
+	{
+		// Use the speculatively derived key if it was created for the same password and PBKDF2 parameters.
+		if (keys.userPasswordKey) {
+			cc7::ByteArray derived_password;
+			if (keys.userPasswordKey->consumeDerivedKey(keys.password(), *request.pbkdf2_salt, request.pbkdf2_iter, derived_password)) {
+				return derived_password;
+			}
+		}
+		return DeriveSecretKeyFromPassword(keys.password(), *request.pbkdf2_salt, request.pbkdf2_iter);
+	}
+	
 	bool LockSignatureKeys(SignatureKeys & secret, const SignatureKeys & plain, const SignatureUnlockKeysReq & request)
 	{
 		if (request.keys == nullptr) {
@@ -213,7 +227,7 @@ namespace protocol
 				CC7_ASSERT(false, "salt is too small");
 				return false;
 			}
-			cc7::ByteArray derived_password = DeriveSecretKeyFromPassword(keys.userPassword, *request.pbkdf2_salt, request.pbkdf2_iter);
+			cc7::ByteArray derived_password = _DeriveKnowledgeProtectionKey(keys, request);
 			secret.knowledgeKey  = _EncryptSignatureKey(derived_password, request.ext_key, plain.knowledgeKey);
 		}
 		
@@ -295,7 +309,7 @@ namespace protocol
 				CC7_ASSERT(false, "salt is too small");
 				return false;
 			}
-			cc7::ByteArray derived_password = DeriveSecretKeyFromPassword(keys.userPassword, *request.pbkdf2_salt, request.pbkdf2_iter);
+			cc7::ByteArray derived_password = _DeriveKnowledgeProtectionKey(keys, request);
 			plain.knowledgeKey  = _DecryptSignatureKey(derived_password, request.ext_key, secret.knowledgeKey);
 			if (plain.knowledgeKey.empty()) {
 				return false;
@@ -368,8 +382,22 @@ namespace protocol
 		}
 	}
 	
+	void ReserveCounterValues(PersistentData & pd, size_t count, std::vector<cc7::ByteArray> & out_ctr_data)
+	{
+		out_ctr_data.resize(count);
+		for (size_t i = 0; i < count; i++) {
+			out_ctr_data[i] = pd.isV3() ? pd.signatureCounterData : SignatureCounterToData(pd.signatureCounter);
+			CalculateNextCounterValue(pd);
+		}
+	}
+	
 	
-	std::string CalculateSignature(const SignatureKeys & sk, SignatureFactor factor, const cc7::ByteRange & ctr_data, const cc7::ByteRange & data)
+	/**
+	 Derives keys for all factors involved in the signature calculation, from given signature
+	 keys |sk|, |factor| and |ctr_data|. The derived keys are stored to |out_keys| vector.
+	 Returns false if some HMAC calculation failed.
+	 */
+	static bool _DeriveFactorKeys(const SignatureKeys & sk, SignatureFactor factor, const cc7::ByteRange & ctr_data, std::vector<cc7::ByteArray> & out_keys)
 	{
 		// Prepare keys into one linear vector
 		std::vector<const cc7::ByteArray*> keys;
@@ -383,15 +411,15 @@ namespace protocol
 			keys.push_back(&sk.biometryKey);
 		}
 		
-		// Prepare data with counter; [ 0x0 * 8 + BigEndian(ctr) ]
-		std::string result;
+		out_keys.clear();
+		out_keys.reserve(keys.size());
 		for (size_t i = 0; i < keys.size(); i++) {
 			// Outer loop, for over key in the vector.
 			const cc7::ByteArray & signature_key = *keys[i];
 			auto derived_key = crypto::HMAC_SHA256(ctr_data, signature_key);
 			if (derived_key.size() == 0) {
 				CC7_ASSERT(false, "HMAC_SHA256() calculation failed.");
-				return std::string();
+				return false;
 			}
 			for (size_t j = 0; j < i; j++) {
 				const cc7::ByteArray & signature_key_inner = *keys[j + 1];
@@ -399,9 +427,23 @@ namespace protocol
 				derived_key = crypto::HMAC_SHA256(derived_key, derived_key_inner);
 				if (derived_key.size() == 0) {
 					CC7_ASSERT(false, "HMAC_SHA256() calculation failed.");
-					return std::string();
+					return false;
 				}
 			}
+			out_keys.push_back(derived_key);
+		}
+		return true;
+	}
+	
+	std::string CalculateSignature(const SignatureKeys & sk, SignatureFactor factor, const cc7::ByteRange & ctr_data, const cc7::ByteRange & data)
+	{
+		std::vector<cc7::ByteArray> derived_keys;
+		if (!_DeriveFactorKeys(sk, factor, ctr_data, derived_keys)) {
+			return std::string();
+		}
+		// Prepare data with counter; [ 0x0 * 8 + BigEndian(ctr) ]
+		SignatureWriter writer;
+		for (auto && derived_key : derived_keys) {
 			// Calculate HMAC for given data
 			auto signature_long = crypto::HMAC_SHA256(data, derived_key);
 			if (signature_long.size() == 0) {
@@ -409,14 +451,201 @@ namespace protocol
 				return std::string();
 			}
 			// Finally, calculate decimalized value from signature and append it to the
-			// output string.
-			auto signature = CalculateDecimalizedSignature(signature_long);
-			if (!result.empty()) {
-				result.append(DASH);
+			// output buffer.
+			writer.append(signature_long);
+		}
+		return writer.toString();
+	}
+	
+	
+	//
+	// MARK: - SignatureStream -
+	//
+	
+	/**
+	 Size of block processed at once by the Base64 encoder in SignatureStream.
+	 The value must be divisible by 3.
+	 */
+	static const size_t SIGNATURE_STREAM_BLOCK_SIZE = 3 * 1024;
+	
+	SignatureStream::SignatureStream() :
+		_hmac_count(0),
+		_pending_count(0),
+		_started(false)
+	{
+	}
+	
+	bool SignatureStream::begin(const SignatureKeys & sk,
+								SignatureFactor factor,
+								const cc7::ByteRange & ctr_data,
+								const std::string & method,
+								const std::string & uri,
+								const std::string & nonce_b64)
+	{
+		return begin(sk, factor, ctr_data, cc7::MakeRange(method), cc7::MakeRange(uri), cc7::MakeRange(nonce_b64));
+	}
+	
+	bool SignatureStream::begin(const SignatureKeys & sk,
+								SignatureFactor factor,
+								const cc7::ByteRange & ctr_data,
+								const cc7::ByteRange & method,
+								const cc7::ByteRange & uri,
+								const cc7::ByteRange & nonce_b64)
+	{
+		_started = false;
+		_hmac_count = 0;
+		_pending_count = 0;
+		
+		std::vector<cc7::ByteArray> derived_keys;
+		if (!_DeriveFactorKeys(sk, factor, ctr_data, derived_keys)) {
+			return false;
+		}
+		if (derived_keys.empty() || derived_keys.size() > MAX_FACTORS) {
+			CC7_ASSERT(false, "Unexpected number of signature factors.");
+			return false;
+		}
+		for (auto && derived_key : derived_keys) {
+			if (!_hmac[_hmac_count++].init(derived_key)) {
+				return false;
 			}
-			result.append(signature);
 		}
-		return result;
+		_started = true;
+		// ${method}&${B64(uri)}&${nonce_b64}&
+		return updateAll(method) &&
+			   updateAll(cc7::MakeRange(AMP)) &&
+			   updateAllBase64(uri, true) &&
+			   updateAll(cc7::MakeRange(AMP)) &&
+			   updateAll(nonce_b64) &&
+			   updateAll(cc7::MakeRange(AMP));
+	}
+	
+	bool SignatureStream::updateBody(const cc7::ByteRange & chunk)
+	{
+		return updateAllBase64(chunk, false);
+	}
+	
+	bool SignatureStream::updateBody(const HTTPRequestBodyStream & stream)
+	{
+		if (!stream) {
+			CC7_ASSERT(false, "Body stream is not set.");
+			_started = false;
+			return false;
+		}
+		cc7::byte buffer[SIGNATURE_STREAM_BLOCK_SIZE];
+		while (true) {
+			size_t size = 0;
+			if (!stream(buffer, sizeof(buffer), size) || size > sizeof(buffer)) {
+				CC7_LOG("SignatureStream: Body stream failed.");
+				_started = false;
+				return false;
+			}
+			if (size == 0) {
+				return _started;
+			}
+			if (!updateBody(cc7::ByteRange(buffer, size))) {
+				return false;
+			}
+		}
+	}
+	
+	std::string SignatureStream::finish(const std::string & app_secret)
+	{
+		std::string signature(_hmac_count * (DECIMALIZED_SIGNATURE_SIZE + 1) - 1, '0');
+		if (_hmac_count == 0 || !finish(app_secret, &signature[0])) {
+			return std::string();
+		}
+		return signature;
+	}
+	
+	bool SignatureStream::finish(const std::string & app_secret, char * out_signature)
+	{
+		// ...${B64(body)}&${app_secret}
+		bool result = updateAllBase64(cc7::ByteRange(), true) &&
+					  updateAll(cc7::MakeRange(AMP)) &&
+					  updateAll(cc7::MakeRange(app_secret));
+		_started = false;
+		if (!result) {
+			return false;
+		}
+		for (size_t i = 0; i < _hmac_count; i++) {
+			auto signature_long = _hmac[i].final();
+			if (signature_long.size() == 0) {
+				CC7_ASSERT(false, "HMAC_SHA256() calculation failed.");
+				return false;
+			}
+			if (i > 0) {
+				*out_signature++ = '-';
+			}
+			WriteDecimalizedSignature(signature_long, out_signature);
+			out_signature += DECIMALIZED_SIGNATURE_SIZE;
+		}
+		_hmac_count = 0;
+		return true;
+	}
+	
+	size_t SignatureStream::SignatureLength(SignatureFactor factor)
+	{
+		size_t count = ((factor & SF_Possession) != 0) + ((factor & SF_Knowledge) != 0) + ((factor & SF_Biometry) != 0);
+		return count > 0 ? count * (DECIMALIZED_SIGNATURE_SIZE + 1) - 1 : 0;
+	}
+	
+	bool SignatureStream::updateAll(const cc7::ByteRange & data)
+	{
+		if (!_started) {
+			return false;
+		}
+		for (size_t i = 0; i < _hmac_count; i++) {
+			if (!_hmac[i].update(data)) {
+				_started = false;
+				return false;
+			}
+		}
+		return true;
+	}
+	
+	bool SignatureStream::updateAllBase64(const cc7::ByteRange & data, bool final)
+	{
+		if (!_started) {
+			return false;
+		}
+		char encoded[SIGNATURE_STREAM_BLOCK_SIZE / 3 * 4];
+		const cc7::byte * in = data.data();
+		size_t in_size = data.size();
+		// Complete the triplet pending from the previous call.
+		if (_pending_count > 0) {
+			while (_pending_count < 3 && in_size > 0) {
+				_pending[_pending_count++] = *in++;
+				--in_size;
+			}
+			if (_pending_count < 3 && !final) {
+				return true;
+			}
+			size_t encoded_size = utils::Base64_EncodeToBuffer(cc7::ByteRange(_pending, _pending_count), encoded);
+			_pending_count = 0;
+			if (!updateAll(cc7::ByteRange(encoded, encoded_size))) {
+				return false;
+			}
+		}
+		// Encode all complete triplets, block by block.
+		while (in_size >= 3) {
+			size_t block_size = std::min(in_size - in_size % 3, SIGNATURE_STREAM_BLOCK_SIZE);
+			size_t encoded_size = utils::Base64_EncodeToBuffer(cc7::ByteRange(in, block_size), encoded);
+			if (!updateAll(cc7::ByteRange(encoded, encoded_size))) {
+				return false;
+			}
+			in += block_size;
+			in_size -= block_size;
+		}
+		// Process the rest of bytes.
+		if (in_size > 0) {
+			if (final) {
+				size_t encoded_size = utils::Base64_EncodeToBuffer(cc7::ByteRange(in, in_size), encoded);
+				return updateAll(cc7::ByteRange(encoded, encoded_size));
+			}
+			memcpy(_pending, in, in_size);
+			_pending_count = in_size;
+		}
+		return true;
 	}
 	
 	
@@ -426,65 +655,231 @@ namespace protocol
 											 const cc7::ByteRange & body,
 											 const std::string & app_secret)
 	{
-		std::string body_b64 = cc7::ToBase64String(body);
-		std::string uri_b64  = cc7::ToBase64String(cc7::MakeRange(uri));
-		
-		cc7::ByteArray data_for_signing;
-		data_for_signing.reserve(method.size() + uri_b64.size() + nonce_b64.size() + body_b64.size() + app_secret.size() + 5);
+		return NormalizeDataForSignature(cc7::MakeRange(method), cc7::MakeRange(uri), cc7::MakeRange(nonce_b64), body, cc7::MakeRange(app_secret));
+	}
+	
+	static inline cc7::byte * _AppendRange(cc7::byte * p, const cc7::ByteRange & range)
+	{
+		if (!range.empty()) {
+			memcpy(p, range.data(), range.size());
+		}
+		return p + range.size();
+	}
+	
+	static inline cc7::byte * _AppendRangeBase64(cc7::byte * p, const cc7::ByteRange & range)
+	{
+		return p + utils::Base64_EncodeToBuffer(range, reinterpret_cast<char*>(p));
+	}
+	
+	cc7::ByteArray NormalizeDataForSignature(const cc7::ByteRange & method,
+											 const cc7::ByteRange & uri,
+											 const cc7::ByteRange & nonce_b64,
+											 const cc7::ByteRange & body,
+											 const cc7::ByteRange & app_secret)
+	{
+		cc7::ByteArray data_for_signing(method.size() + utils::Base64_EncodedLength(uri.size()) + nonce_b64.size() +
+										utils::Base64_EncodedLength(body.size()) + app_secret.size() + 4, 0);
 		
 		// Construct data for signing
-		data_for_signing.assign(method.begin(), method.end());
-		data_for_signing.push_back('&');
-		data_for_signing.append(uri_b64.begin(), uri_b64.end());
-		data_for_signing.push_back('&');
-		data_for_signing.append(nonce_b64.begin(), nonce_b64.end());
-		data_for_signing.push_back('&');
-		data_for_signing.append(body_b64.begin(), body_b64.end());
-		data_for_signing.push_back('&');
-		data_for_signing.append(app_secret.begin(), app_secret.end());
+		cc7::byte * begin = data_for_signing.data();
+		cc7::byte * p = begin;
+		p = _AppendRange(p, method);
+		*p++ = '&';
+		p = _AppendRangeBase64(p, uri);
+		*p++ = '&';
+		p = _AppendRange(p, nonce_b64);
+		*p++ = '&';
+		p = _AppendRangeBase64(p, body);
+		*p++ = '&';
+		p = _AppendRange(p, app_secret);
+		CC7_ASSERT(p == begin + data_for_signing.size(), "Wrong size of normalized data");
 		
 		return data_for_signing;
 	}
 	
 	
-	std::string ConvertSignatureFactorToString(SignatureFactor factor)
+	static inline char * _AppendFragment(char * p, const std::string & fragment)
+	{
+		memcpy(p, fragment.data(), fragment.size());
+		return p + fragment.size();
+	}
+	
+	void PrepareAuthHeaderValue(std::string & out_value,
+								const std::string & version,
+								const std::string & activation_id,
+								const std::string & application_key,
+								size_t nonce_length,
+								const std::string & factor,
+								size_t signature_length,
+								size_t & out_nonce_offset,
+								size_t & out_signature_offset)
+	{
+		out_value.resize(version.size() + activation_id.size() + application_key.size() + nonce_length +
+						 factor.size() + signature_length + PA_AUTH_FRAGMENTS_LENGTH);
+		char * begin = &out_value[0];
+		char * p = begin;
+		p = _AppendFragment(p, PA_AUTH_FRAGMENT_BEGIN_VERSION);
+		p = _AppendFragment(p, version);
+		p = _AppendFragment(p, PA_AUTH_FRAGMENT_ACTIVATION_ID);
+		p = _AppendFragment(p, activation_id);
+		p = _AppendFragment(p, PA_AUTH_FRAGMENT_APPLICATION_KEY);
+		p = _AppendFragment(p, application_key);
+		p = _AppendFragment(p, PA_AUTH_FRAGMENT_NONCE);
+		out_nonce_offset = p - begin;
+		p += nonce_length;
+		p = _AppendFragment(p, PA_AUTH_FRAGMENT_SIGNATURE_TYPE);
+		p = _AppendFragment(p, factor);
+		p = _AppendFragment(p, PA_AUTH_FRAGMENT_SIGNATURE);
+		out_signature_offset = p - begin;
+		p += signature_length;
+		p = _AppendFragment(p, PA_AUTH_FRAGMENT_END);
+		CC7_ASSERT(p == begin + out_value.size(), "Wrong header size calculation");
+	}
+	
+	/**
+	 Calculates signature for |request| and writes it to |out_signature| buffer, which must have
+	 capacity for `SignatureStream::SignatureLength(factor)` characters.
+	 */
+	static bool _CalculateSignature(char * out_signature,
+									const SignatureKeys & sk,
+									SignatureFactor factor,
+									const cc7::ByteRange & ctr_data,
+									const std::string & application_secret,
+									const HTTPRequestDataView & request,
+									const cc7::ByteRange & nonce_b64,
+									const HTTPRequestBodyStream * body_stream)
 	{
+		// Calculate signature over the normalized data. The data is normalized on the fly, so
+		// the body is not copied, regardless of whether it's in the memory, or in the stream.
+		SignatureStream signature_stream;
+		bool result = signature_stream.begin(sk, factor, ctr_data, request.method, request.uri, nonce_b64);
+		if (body_stream) {
+			result = result && signature_stream.updateBody(*body_stream);
+		} else {
+			result = result && signature_stream.updateBody(request.body);
+		}
+		return result && signature_stream.finish(application_secret, out_signature);
+	}
+	
+	bool CalculateAuthHeaderValue(std::string & out_value,
+								  const SignatureKeys & sk,
+								  SignatureFactor factor,
+								  const cc7::ByteRange & ctr_data,
+								  const std::string & version,
+								  const std::string & activation_id,
+								  const std::string & application_key,
+								  const std::string & application_secret,
+								  const HTTPRequestDataView & request,
+								  const cc7::ByteRange & nonce_b64,
+								  const HTTPRequestBodyStream * body_stream)
+	{
+		// Prepare the header value with the space for nonce and signature, so both can be written in place.
+		size_t nonce_offset, signature_offset;
+		PrepareAuthHeaderValue(out_value, version, activation_id, application_key, nonce_b64.size(),
+							   ConvertSignatureFactorToString(factor), SignatureStream::SignatureLength(factor),
+							   nonce_offset, signature_offset);
+		memcpy(&out_value[nonce_offset], nonce_b64.data(), nonce_b64.size());
+		
+		bool result = _CalculateSignature(&out_value[signature_offset], sk, factor, ctr_data, application_secret,
+										  request, nonce_b64, body_stream);
+		if (!result) {
+			out_value.clear();
+		}
+		return result;
+	}
+	
+	bool CalculateRequestSignature(std::string & out_signature,
+								   const SignatureKeys & sk,
+								   SignatureFactor factor,
+								   const cc7::ByteRange & ctr_data,
+								   const std::string & application_secret,
+								   const HTTPRequestDataView & request,
+								   const cc7::ByteRange & nonce_b64,
+								   const HTTPRequestBodyStream * body_stream)
+	{
+		out_signature.resize(SignatureStream::SignatureLength(factor));
+		bool result = _CalculateSignature(&out_signature[0], sk, factor, ctr_data, application_secret,
+										  request, nonce_b64, body_stream);
+		if (!result) {
+			out_signature.clear();
+		}
+		return result;
+	}
+	
+	const std::string & ConvertSignatureFactorToString(SignatureFactor factor)
+	{
+		static const std::string s_possession("possession");
+		static const std::string s_knowledge("knowledge");
+		static const std::string s_biometry("biometry");
+		static const std::string s_possession_biometry("possession_biometry");
+		static const std::string s_possession_knowledge("possession_knowledge");
+		static const std::string s_possession_knowledge_biometry("possession_knowledge_biometry");
+		static const std::string s_empty;
 		switch (factor & 0x0fff) {
 			case SF_Possession:
-				return std::string("possession");
+				return s_possession;
 			case SF_Knowledge:
-				return std::string("knowledge");
+				return s_knowledge;
 			case SF_Biometry:
-				return std::string("biometry");
+				return s_biometry;
 			case SF_Possession_Biometry:
-				return std::string("possession_biometry");
+				return s_possession_biometry;
 			case SF_Possession_Knowledge:
-				return std::string("possession_knowledge");
+				return s_possession_knowledge;
 			case SF_Possession_Knowledge_Biometry:
-				return std::string("possession_knowledge_biometry");
+				return s_possession_knowledge_biometry;
 			default:
 				CC7_ASSERT(false, "Unknown factor %d", factor);
-				return std::string();
+				return s_empty;
 		}
 	}
 
 
+	//
+	// MARK: - Decimal formatting -
+	//
+	
 	/**
-	 Convers |val| to normalized string. Zero characters are used for the indentation padding
-	 when the string representation is shorter than 8 characters (e.g. 123 is converted to "00000123").
+	 Table with all two-digit decimal numbers, from "00" to "99".
 	 */
-	static std::string _ValToNormString(cc7::U32 val)
+	static const char s_two_digits[201] =
+		"00010203040506070809"
+		"10111213141516171819"
+		"20212223242526272829"
+		"30313233343536373839"
+		"40414243444546474849"
+		"50515253545556575859"
+		"60616263646566676869"
+		"70717273747576777879"
+		"80818283848586878889"
+		"90919293949596979899";
+	
+	void FormatDecimalDigits(cc7::U32 value, size_t digits, char * out)
 	{
-		std::string result = std::to_string(val);
-		static const std::string zero("00000000");
-		if (result.length() < protocol::ACTIVATION_FINGERPRINT_SIZE) {
-			result.insert(0, zero.substr(0, protocol::ACTIVATION_FINGERPRINT_SIZE - result.length()));
+		char * p = out + digits;
+		while (digits >= 2) {
+			const char * pair = &s_two_digits[(value % 100) * 2];
+			value /= 100;
+			*--p = pair[1];
+			*--p = pair[0];
+			digits -= 2;
+		}
+		if (digits > 0) {
+			*--p = '0' + (value % 10);
 		}
-		CC7_ASSERT(result.length() == protocol::ACTIVATION_FINGERPRINT_SIZE, "Wrong normalized size");
-		return result;
 	}
 	
-	
+	void WriteDecimalizedSignature(const cc7::ByteRange & signature, char * out)
+	{
+		CC7_ASSERT(signature.size() >= 4, "The signature is too short");
+		size_t offset = signature.size() - 4;
+		// "dynamic binary code" from HOTP draft
+		cc7::U32 dbc = (signature[offset + 0] & 0x7F) << 24 |
+						signature[offset + 1] << 16 |
+						signature[offset + 2] << 8  |
+						signature[offset + 3];
+		FormatDecimalDigits(dbc % 100000000, DECIMALIZED_SIGNATURE_SIZE, out);
+	}
 	
 	std::string CalculateDecimalizedSignature(const cc7::ByteRange & signature)
 	{
@@ -493,15 +888,42 @@ namespace protocol
 			CC7_ASSERT(false, "The signature is too short");
 			return std::string();
 		}
-		size_t offset = signature.size() - 4;
-		// "dynamic binary code" from HOTP draft
-		cc7::U32 dbc = (signature[offset + 0] & 0x7F) << 24 |
-						signature[offset + 1] << 16 |
-						signature[offset + 2] << 8  |
-						signature[offset + 3];
-		return _ValToNormString(dbc % 100000000);
+		char buffer[DECIMALIZED_SIGNATURE_SIZE];
+		WriteDecimalizedSignature(signature, buffer);
+		return std::string(buffer, DECIMALIZED_SIGNATURE_SIZE);
 	}
-
+	
+	
+	//
+	// MARK: - SignatureWriter -
+	//
+	
+	SignatureWriter::SignatureWriter() :
+		_length(0)
+	{
+	}
+	
+	bool SignatureWriter::append(const cc7::ByteRange & signature)
+	{
+		const size_t required = _length > 0 ? DECIMALIZED_SIGNATURE_SIZE + 1 : DECIMALIZED_SIGNATURE_SIZE;
+		if (signature.size() < 4 || _length + required > MAX_LENGTH) {
+			CC7_ASSERT(false, "The signature is too short, or too many factors are appended.");
+			return false;
+		}
+		if (_length > 0) {
+			_buffer[_length++] = '-';
+		}
+		WriteDecimalizedSignature(signature, _buffer + _length);
+		_length += DECIMALIZED_SIGNATURE_SIZE;
+		return true;
+	}
+	
+	std::string SignatureWriter::toString() const
+	{
+		return std::string(_buffer, _length);
+	}
+	
+	
 	std::string CalculateActivationFingerprint(const cc7::ByteRange & device_pub_key, const cc7::ByteRange & server_pub_key, const std::string activation_id, Version v)
 	{
 		std::string result;
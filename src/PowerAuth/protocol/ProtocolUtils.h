@@ -17,6 +17,8 @@
 #pragma once
 
 #include "PrivateTypes.h"
+#include "Constants.h"
+#include "../crypto/MAC.h"
 
 namespace io
 {
@@ -98,6 +100,13 @@ namespace protocol
 	 */
 	void CalculateNextCounterValue(PersistentData & pd);
 	
+	/**
+	 Reserves |count| consecutive signature counter values in |pd|. The counter data for each reserved
+	 value is stored to |out_ctr_data| and |pd| is moved forward behind the last reserved value. For V3,
+	 the hash chain is precomputed, so the result is equal to |count| calls to CalculateNextCounterValue().
+	 */
+	void ReserveCounterValues(PersistentData & pd, size_t count, std::vector<cc7::ByteArray> & out_ctr_data);
+	
 	/**
 	 Calculates multi-factor signature from given |data|, for using |ctr_data| and |keys|.
 	 */
@@ -117,9 +126,168 @@ namespace protocol
 											 const std::string & app_secret);
 	
 	/**
-	 Returns string representing given signature factor.
+	 Prepares exact data for signature calculation, like the previous function, but all
+	 components are provided as ranges of characters. The body is encoded to Base64 directly
+	 into the result, so no intermediate copy is created.
+	 */
+	cc7::ByteArray NormalizeDataForSignature(const cc7::ByteRange & method,
+											 const cc7::ByteRange & uri,
+											 const cc7::ByteRange & nonce_b64,
+											 const cc7::ByteRange & body,
+											 const cc7::ByteRange & app_secret);
+	
+	/**
+	 The SignatureStream class calculates multi-factor signature over normalized data, without
+	 constructing the whole normalized data in the memory. The body is encoded to Base64 on the fly
+	 and all components of the normalized data are fed directly into the HMAC states. So, the memory
+	 consumption of the calculation doesn't depend on the size of the body.
+	 
+	 The result is equal to the following calculation:
+	    CalculateSignature(sk, factor, ctr_data, NormalizeDataForSignature(method, uri, nonce_b64, body, app_secret))
+	 
+	 The typical usage is: `begin()`, zero or more `updateBody()` and then `finish()`.
+	 */
+	class SignatureStream
+	{
+	public:
+		SignatureStream();
+		
+		/**
+		 Starts a new signature calculation. The function derives keys for all factors from |sk|, |factor|
+		 and |ctr_data| and then processes "${method}&${B64(uri)}&${nonce_b64}&" part of normalized data.
+		 Returns false if some cryptographic operation failed.
+		 */
+		bool begin(const SignatureKeys & sk,
+				   SignatureFactor factor,
+				   const cc7::ByteRange & ctr_data,
+				   const std::string & method,
+				   const std::string & uri,
+				   const std::string & nonce_b64);
+		
+		/**
+		 Starts a new signature calculation, like the previous method, but |method|, |uri|
+		 and |nonce_b64| are provided as ranges of characters, so no copy of them is required.
+		 */
+		bool begin(const SignatureKeys & sk,
+				   SignatureFactor factor,
+				   const cc7::ByteRange & ctr_data,
+				   const cc7::ByteRange & method,
+				   const cc7::ByteRange & uri,
+				   const cc7::ByteRange & nonce_b64);
+		
+		/**
+		 Processes next |chunk| of the body. Returns false if the calculation is not started,
+		 or if some cryptographic operation failed.
+		 */
+		bool updateBody(const cc7::ByteRange & chunk);
+		
+		/**
+		 Reads all data from |stream| and processes them as a body. Returns false if the calculation is
+		 not started, if the stream reports failure, or if some cryptographic operation failed.
+		 */
+		bool updateBody(const HTTPRequestBodyStream & stream);
+		
+		/**
+		 Processes "&${app_secret}" suffix of normalized data and returns the final signature. Returns
+		 an empty string if some previous operation failed.
+		 */
+		std::string finish(const std::string & app_secret);
+		
+		/**
+		 Processes "&${app_secret}" suffix of normalized data and writes the final signature into
+		 |out_signature| buffer, which must have capacity for `SignatureLength(factor)` characters.
+		 The null terminator is not appended. Returns false if some previous operation failed.
+		 */
+		bool finish(const std::string & app_secret, char * out_signature);
+		
+		/**
+		 Returns length of signature calculated for |factor|, or 0 if the factor is not valid.
+		 */
+		static size_t SignatureLength(SignatureFactor factor);
+		
+	private:
+		
+		// Not copyable
+		SignatureStream(const SignatureStream &) = delete;
+		SignatureStream & operator=(const SignatureStream &) = delete;
+		
+		bool updateAll(const cc7::ByteRange & data);
+		bool updateAllBase64(const cc7::ByteRange & data, bool final);
+		
+		static const size_t MAX_FACTORS = 3;
+		crypto::HMAC_SHA256_Context _hmac[MAX_FACTORS];
+		size_t _hmac_count;
+		cc7::byte _pending[3];
+		size_t _pending_count;
+		bool _started;
+	};
+	
+	/**
+	 Prepares value for "X-PowerAuth-Authorization" header into |out_value|. The nonce and the signature
+	 are not written, but the space for |nonce_length| and |signature_length| characters is left at
+	 |out_nonce_offset| and |out_signature_offset|, so the caller can write them in place. The string is
+	 resized only once, so there's no allocation if it already has enough capacity.
+	 */
+	void PrepareAuthHeaderValue(std::string & out_value,
+								const std::string & version,
+								const std::string & activation_id,
+								const std::string & application_key,
+								size_t nonce_length,
+								const std::string & factor,
+								size_t signature_length,
+								size_t & out_nonce_offset,
+								size_t & out_signature_offset);
+	
+	/**
+	 Calculates signature for |request| and stores the whole value for "X-PowerAuth-Authorization" header
+	 into |out_value|. The signature is calculated from keys |sk|, |factor| and |ctr_data| and the |nonce_b64|
+	 is written to the header as it is. If |body_stream| is not nullptr, then the body is read from the stream,
+	 otherwise the |request.body| is signed. Returns false if some cryptographic operation failed.
+	 */
+	bool CalculateAuthHeaderValue(std::string & out_value,
+								  const SignatureKeys & sk,
+								  SignatureFactor factor,
+								  const cc7::ByteRange & ctr_data,
+								  const std::string & version,
+								  const std::string & activation_id,
+								  const std::string & application_key,
+								  const std::string & application_secret,
+								  const HTTPRequestDataView & request,
+								  const cc7::ByteRange & nonce_b64,
+								  const HTTPRequestBodyStream * body_stream);
+	
+	/**
+	 Calculates signature for |request| and stores only the signature into |out_signature|. The parameters
+	 have the same meaning as in CalculateAuthHeaderValue(). Returns false if some cryptographic operation failed.
+	 */
+	bool CalculateRequestSignature(std::string & out_signature,
+								   const SignatureKeys & sk,
+								   SignatureFactor factor,
+								   const cc7::ByteRange & ctr_data,
+								   const std::string & application_secret,
+								   const HTTPRequestDataView & request,
+								   const cc7::ByteRange & nonce_b64,
+								   const HTTPRequestBodyStream * body_stream);
+	
+	/**
+	 Returns string representing given signature factor. Returns an empty string if the factor
+	 is not valid.
 	 */
-	std::string ConvertSignatureFactorToString(SignatureFactor factor);
+	const std::string & ConvertSignatureFactorToString(SignatureFactor factor);
+	
+	/**
+	 Writes |value| as exactly |digits| decimal digits into |out| buffer. The value is padded
+	 with zeros from the left, and the higher digits are truncated, if the value doesn't fit.
+	 Two digits are produced by one table lookup and no memory is allocated.
+	 */
+	void FormatDecimalDigits(cc7::U32 value, size_t digits, char * out);
+	
+	/**
+	 Writes decimalized signature calculated from |signature| into |out| buffer, which must
+	 have capacity for DECIMALIZED_SIGNATURE_SIZE characters. The size of provided data
+	 object must be greater or equal 4.
+	 */
+	void WriteDecimalizedSignature(const cc7::ByteRange & signature, char * out);
 	
 	/**
 	 Calculates decimalized signature from given data. The size of provided data object
@@ -127,6 +295,47 @@ namespace protocol
 	 */
 	std::string CalculateDecimalizedSignature(const cc7::ByteRange & signature);
 	
+	/**
+	 The SignatureWriter class composes multi-factor signature in "NNNNNNNN-NNNNNNNN-NNNNNNNN"
+	 format in its own fixed buffer, so it can be allocated on the stack.
+	 */
+	class SignatureWriter
+	{
+	public:
+		SignatureWriter();
+		
+		/**
+		 Appends decimalized |signature|, calculated for the next factor. The DASH character is
+		 used as a separator between factors. Returns false if the signature is too short, or if
+		 there's no space for another factor.
+		 */
+		bool append(const cc7::ByteRange & signature);
+		
+		/**
+		 Returns pointer to composed signature. The string is not null terminated.
+		 */
+		const char * data() const { return _buffer; }
+		
+		/**
+		 Returns length of composed signature.
+		 */
+		size_t length() const { return _length; }
+		
+		/**
+		 Returns composed signature as a string.
+		 */
+		std::string toString() const;
+		
+		/**
+		 Maximum length of signature, for three factors.
+		 */
+		static const size_t MAX_LENGTH = 3 * DECIMALIZED_SIGNATURE_SIZE + 2;
+		
+	private:
+		char _buffer[MAX_LENGTH];
+		size_t _length;
+	};
+	
 	/**
 	 Calculates activation fingerprint from given data. The algorithm depends
 	 on the activation version. For V2, only "device_pub_key" is used. For V3 and
@@ -0,0 +1,525 @@
+/*
+ * Copyright 2019 Wultra s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Base64.h"
+#include "KernelSelector.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+	#define PA_BASE64_X86
+	#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#define PA_BASE64_NEON
+	#include <arm_neon.h>
+#endif
+
+namespace io
+{
+namespace getlime
+{
+namespace powerAuth
+{
+namespace utils
+{
+	// -------------------------------------------------------------------------------------------
+	// MARK: - Scalar implementation -
+	//
+
+	static const char s_encode_table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	static const cc7::byte s_decode_table[256] =
+	{
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF, 0xFF, 0x3F,
+		0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+		0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+		0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	};
+
+	/**
+	 Encodes |size| bytes from |in| to |out|. The |size| must be divisible by 3.
+	 */
+	static void _EncodeScalar(const cc7::byte * in, size_t size, char * out)
+	{
+		const cc7::byte * end = in + size;
+		while (in < end) {
+			cc7::U32 v = (cc7::U32)in[0] << 16 | (cc7::U32)in[1] << 8 | in[2];
+			out[0] = s_encode_table[(v >> 18) & 0x3F];
+			out[1] = s_encode_table[(v >> 12) & 0x3F];
+			out[2] = s_encode_table[(v >> 6 ) & 0x3F];
+			out[3] = s_encode_table[(v      ) & 0x3F];
+			in  += 3;
+			out += 4;
+		}
+	}
+
+	/**
+	 Decodes |length| characters from |in| to |out|. The |length| must be divisible by 4 and the input
+	 must not contain padding characters. Returns false if input contains an invalid character.
+	 */
+	static bool _DecodeScalar(const cc7::byte * in, size_t length, cc7::byte * out)
+	{
+		const cc7::byte * end = in + length;
+		cc7::U32 invalid = 0;
+		while (in < end) {
+			cc7::U32 a = s_decode_table[in[0]];
+			cc7::U32 b = s_decode_table[in[1]];
+			cc7::U32 c = s_decode_table[in[2]];
+			cc7::U32 d = s_decode_table[in[3]];
+			invalid |= a | b | c | d;
+			cc7::U32 v = a << 18 | b << 12 | c << 6 | d;
+			out[0] = (cc7::byte)(v >> 16);
+			out[1] = (cc7::byte)(v >> 8);
+			out[2] = (cc7::byte)(v);
+			in  += 4;
+			out += 3;
+		}
+		// All valid values are lesser than 64, the invalid marker is 0xFF.
+		return (invalid & 0x80) == 0;
+	}
+
+
+	// -------------------------------------------------------------------------------------------
+	// MARK: - SIMD implementation -
+	//
+	// Each kernel processes as many complete blocks from the input as possible and returns the number
+	// of consumed input bytes. The rest of the input is then processed with the scalar implementation.
+	// The kernels never read or write beyond the provided buffers.
+	//
+
+	typedef size_t (*EncodeKernel)(const cc7::byte * in, size_t size, char * out);
+	typedef size_t (*DecodeKernel)(const cc7::byte * in, size_t length, cc7::byte * out, bool & invalid);
+
+#if defined(PA_BASE64_X86)
+
+	// The x86 kernels are based on the well-known algorithms published by Wojciech Mula and Daniel Lemire.
+	// The AVX2 kernels are doing the same work as SSSE3 kernels, but in two 128-bit lanes at once.
+
+	#define PA_TARGET_SSSE3	__attribute__((target("ssse3")))
+	#define PA_TARGET_AVX2	__attribute__((target("avx2")))
+
+	PA_TARGET_SSSE3
+	static inline __m128i _EncodeLane_SSSE3(__m128i in)
+	{
+		// Split 12 input bytes into 16 6-bit indexes
+		in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+		const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+		const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+		const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+		const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+		const __m128i indexes = _mm_or_si128(t1, t3);
+		// Translate indexes to ASCII characters
+		const __m128i shift_lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+												'0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+		__m128i reduced = _mm_subs_epu8(indexes, _mm_set1_epi8(51));
+		const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indexes);
+		reduced = _mm_or_si128(reduced, _mm_and_si128(less, _mm_set1_epi8(13)));
+		return _mm_add_epi8(_mm_shuffle_epi8(shift_lut, reduced), indexes);
+	}
+
+	PA_TARGET_SSSE3
+	static inline __m128i _DecodeLane_SSSE3(__m128i in, __m128i & invalid)
+	{
+		// Translate ASCII characters to 6-bit values and validate the input
+		const __m128i shift_lut  = _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+		const __m128i mask_lut   = _mm_setr_epi8((char)0xA8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8,
+												 (char)0xF8, (char)0xF8, (char)0xF0, (char)0x54, (char)0x50, (char)0x50, (char)0x50, (char)0x54);
+		const __m128i bitpos_lut = _mm_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80, 0, 0, 0, 0, 0, 0, 0, 0);
+		const __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0F));
+		const __m128i lo_nibbles = _mm_and_si128(in, _mm_set1_epi8(0x0F));
+		const __m128i eq_slash   = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+		const __m128i shift      = _mm_or_si128(_mm_andnot_si128(eq_slash, _mm_shuffle_epi8(shift_lut, hi_nibbles)),
+												_mm_and_si128(eq_slash, _mm_set1_epi8(16)));
+		const __m128i mask       = _mm_shuffle_epi8(mask_lut, lo_nibbles);
+		const __m128i bit        = _mm_shuffle_epi8(bitpos_lut, hi_nibbles);
+		invalid = _mm_or_si128(invalid, _mm_cmpeq_epi8(_mm_and_si128(mask, bit), _mm_setzero_si128()));
+		const __m128i values     = _mm_add_epi8(in, shift);
+		// Pack 16 6-bit values into 12 bytes
+		const __m128i merged_ab  = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+		const __m128i merged     = _mm_madd_epi16(merged_ab, _mm_set1_epi32(0x00011000));
+		return _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+	}
+
+	/**
+	 Stores first 12 bytes from |v| to |out|.
+	 */
+	PA_TARGET_SSSE3
+	static inline void _Store12(cc7::byte * out, __m128i v)
+	{
+		_mm_storel_epi64((__m128i*)out, v);
+		cc7::U32 tail = (cc7::U32)_mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+		memcpy(out + 8, &tail, 4);
+	}
+
+	PA_TARGET_SSSE3
+	static size_t _EncodeKernel_SSSE3(const cc7::byte * in, size_t size, char * out)
+	{
+		// 12 bytes are encoded in one step, but 16 bytes are loaded.
+		size_t processed = 0;
+		while (size - processed >= 16) {
+			__m128i v = _EncodeLane_SSSE3(_mm_loadu_si128((const __m128i*)(in + processed)));
+			_mm_storeu_si128((__m128i*)out, v);
+			processed += 12;
+			out += 16;
+		}
+		return processed;
+	}
+
+	PA_TARGET_SSSE3
+	static size_t _DecodeKernel_SSSE3(const cc7::byte * in, size_t length, cc7::byte * out, bool & invalid)
+	{
+		__m128i invalid_mask = _mm_setzero_si128();
+		size_t processed = 0;
+		while (length - processed >= 16) {
+			__m128i v = _DecodeLane_SSSE3(_mm_loadu_si128((const __m128i*)(in + processed)), invalid_mask);
+			_Store12(out, v);
+			processed += 16;
+			out += 12;
+		}
+		invalid = _mm_movemask_epi8(invalid_mask) != 0;
+		return processed;
+	}
+
+	PA_TARGET_AVX2
+	static size_t _EncodeKernel_AVX2(const cc7::byte * in, size_t size, char * out)
+	{
+		const __m256i shuffle = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+												 1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+		const __m256i shift_lut = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+												   '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+												   'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+												   '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+		// 24 bytes are encoded in one step. Each lane is loaded separately, so 28 bytes must be available.
+		size_t processed = 0;
+		while (size - processed >= 28) {
+			const cc7::byte * p = in + processed;
+			__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)p)),
+												_mm_loadu_si128((const __m128i*)(p + 12)), 1);
+			v = _mm256_shuffle_epi8(v, shuffle);
+			const __m256i t0 = _mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00));
+			const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+			const __m256i t2 = _mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0));
+			const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+			const __m256i indexes = _mm256_or_si256(t1, t3);
+			__m256i reduced = _mm256_subs_epu8(indexes, _mm256_set1_epi8(51));
+			const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indexes);
+			reduced = _mm256_or_si256(reduced, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+			v = _mm256_add_epi8(_mm256_shuffle_epi8(shift_lut, reduced), indexes);
+			_mm256_storeu_si256((__m256i*)out, v);
+			processed += 24;
+			out += 32;
+		}
+		return processed;
+	}
+
+	PA_TARGET_AVX2
+	static size_t _DecodeKernel_AVX2(const cc7::byte * in, size_t length, cc7::byte * out, bool & invalid)
+	{
+		const __m256i shift_lut  = _mm256_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+													0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+		const __m256i mask_lut   = _mm256_setr_epi8((char)0xA8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8,
+													(char)0xF8, (char)0xF8, (char)0xF0, (char)0x54, (char)0x50, (char)0x50, (char)0x50, (char)0x54,
+													(char)0xA8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8,
+													(char)0xF8, (char)0xF8, (char)0xF0, (char)0x54, (char)0x50, (char)0x50, (char)0x50, (char)0x54);
+		const __m256i bitpos_lut = _mm256_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80, 0, 0, 0, 0, 0, 0, 0, 0,
+													0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80, 0, 0, 0, 0, 0, 0, 0, 0);
+		const __m256i pack       = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+													2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+		__m256i invalid_mask = _mm256_setzero_si256();
+		size_t processed = 0;
+		while (length - processed >= 32) {
+			const __m256i v          = _mm256_loadu_si256((const __m256i*)(in + processed));
+			const __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(v, 4), _mm256_set1_epi8(0x0F));
+			const __m256i lo_nibbles = _mm256_and_si256(v, _mm256_set1_epi8(0x0F));
+			const __m256i eq_slash   = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('/'));
+			const __m256i shift      = _mm256_blendv_epi8(_mm256_shuffle_epi8(shift_lut, hi_nibbles), _mm256_set1_epi8(16), eq_slash);
+			const __m256i mask       = _mm256_shuffle_epi8(mask_lut, lo_nibbles);
+			const __m256i bit        = _mm256_shuffle_epi8(bitpos_lut, hi_nibbles);
+			invalid_mask = _mm256_or_si256(invalid_mask, _mm256_cmpeq_epi8(_mm256_and_si256(mask, bit), _mm256_setzero_si256()));
+			const __m256i values     = _mm256_add_epi8(v, shift);
+			const __m256i merged_ab  = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+			const __m256i merged     = _mm256_madd_epi16(merged_ab, _mm256_set1_epi32(0x00011000));
+			const __m256i packed     = _mm256_shuffle_epi8(merged, pack);
+			_Store12(out,      _mm256_castsi256_si128(packed));
+			_Store12(out + 12, _mm256_extracti128_si256(packed, 1));
+			processed += 32;
+			out += 24;
+		}
+		invalid = _mm256_movemask_epi8(invalid_mask) != 0;
+		return processed;
+	}
+
+	/**
+	 Selects the best available kernels for the current CPU.
+	 */
+	static void _SelectKernels(EncodeKernel & encode, DecodeKernel & decode)
+	{
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) {
+			encode = _EncodeKernel_AVX2;
+			decode = _DecodeKernel_AVX2;
+		} else if (__builtin_cpu_supports("ssse3")) {
+			encode = _EncodeKernel_SSSE3;
+			decode = _DecodeKernel_SSSE3;
+		} else {
+			encode = nullptr;
+			decode = nullptr;
+		}
+	}
+
+#elif defined(PA_BASE64_NEON)
+
+	// The NEON kernels are using interleaved loads and stores, so 48 bytes are
+	// converted to 64 characters in one step, and vice versa.
+
+	static inline uint8x16_t _EncodeLookup_NEON(uint8x16_t idx)
+	{
+		// Start with 'A' + idx and then apply corrections for other ranges.
+		uint8x16_t res = vaddq_u8(idx, vdupq_n_u8('A'));
+		res = vaddq_u8(res, vandq_u8(vcgeq_u8(idx, vdupq_n_u8(26)), vdupq_n_u8(6)));				// 'a' - 26 - 'A'
+		res = vaddq_u8(res, vandq_u8(vcgeq_u8(idx, vdupq_n_u8(52)), vdupq_n_u8((cc7::byte)-75)));	// '0' - 52 - ('a' - 26)
+		res = vaddq_u8(res, vandq_u8(vceqq_u8(idx, vdupq_n_u8(62)), vdupq_n_u8((cc7::byte)-15)));	// '+' - 62 - ('0' - 52)
+		res = vaddq_u8(res, vandq_u8(vceqq_u8(idx, vdupq_n_u8(63)), vdupq_n_u8((cc7::byte)-12)));	// '/' - 63 - ('0' - 52)
+		return res;
+	}
+
+	static inline uint8x16_t _DecodeLookup_NEON(uint8x16_t c, uint8x16_t & valid)
+	{
+		const uint8x16_t upper = vcleq_u8(vsubq_u8(c, vdupq_n_u8('A')), vdupq_n_u8(25));
+		const uint8x16_t lower = vcleq_u8(vsubq_u8(c, vdupq_n_u8('a')), vdupq_n_u8(25));
+		const uint8x16_t digit = vcleq_u8(vsubq_u8(c, vdupq_n_u8('0')), vdupq_n_u8(9));
+		const uint8x16_t plus  = vceqq_u8(c, vdupq_n_u8('+'));
+		const uint8x16_t slash = vceqq_u8(c, vdupq_n_u8('/'));
+		uint8x16_t v = vandq_u8(upper, vsubq_u8(c, vdupq_n_u8('A')));
+		v = vorrq_u8(v, vandq_u8(lower, vsubq_u8(c, vdupq_n_u8('a' - 26))));
+		v = vorrq_u8(v, vandq_u8(digit, vaddq_u8(c, vdupq_n_u8(52 - '0'))));
+		v = vorrq_u8(v, vandq_u8(plus,  vdupq_n_u8(62)));
+		v = vorrq_u8(v, vandq_u8(slash, vdupq_n_u8(63)));
+		valid = vandq_u8(valid, vorrq_u8(vorrq_u8(upper, lower), vorrq_u8(digit, vorrq_u8(plus, slash))));
+		return v;
+	}
+
+	static size_t _EncodeKernel_NEON(const cc7::byte * in, size_t size, char * out)
+	{
+		size_t processed = 0;
+		while (size - processed >= 48) {
+			const uint8x16x3_t src = vld3q_u8(in + processed);
+			uint8x16x4_t dst;
+			dst.val[0] = vshrq_n_u8(src.val[0], 2);
+			dst.val[1] = vorrq_u8(vshlq_n_u8(vandq_u8(src.val[0], vdupq_n_u8(0x03)), 4), vshrq_n_u8(src.val[1], 4));
+			dst.val[2] = vorrq_u8(vshlq_n_u8(vandq_u8(src.val[1], vdupq_n_u8(0x0F)), 2), vshrq_n_u8(src.val[2], 6));
+			dst.val[3] = vandq_u8(src.val[2], vdupq_n_u8(0x3F));
+			dst.val[0] = _EncodeLookup_NEON(dst.val[0]);
+			dst.val[1] = _EncodeLookup_NEON(dst.val[1]);
+			dst.val[2] = _EncodeLookup_NEON(dst.val[2]);
+			dst.val[3] = _EncodeLookup_NEON(dst.val[3]);
+			vst4q_u8((cc7::byte*)out, dst);
+			processed += 48;
+			out += 64;
+		}
+		return processed;
+	}
+
+	static size_t _DecodeKernel_NEON(const cc7::byte * in, size_t length, cc7::byte * out, bool & invalid)
+	{
+		uint8x16_t valid = vdupq_n_u8(0xFF);
+		size_t processed = 0;
+		while (length - processed >= 64) {
+			const uint8x16x4_t src = vld4q_u8(in + processed);
+			const uint8x16_t a = _DecodeLookup_NEON(src.val[0], valid);
+			const uint8x16_t b = _DecodeLookup_NEON(src.val[1], valid);
+			const uint8x16_t c = _DecodeLookup_NEON(src.val[2], valid);
+			const uint8x16_t d = _DecodeLookup_NEON(src.val[3], valid);
+			uint8x16x3_t dst;
+			dst.val[0] = vorrq_u8(vshlq_n_u8(a, 2), vshrq_n_u8(b, 4));
+			dst.val[1] = vorrq_u8(vshlq_n_u8(b, 4), vshrq_n_u8(c, 2));
+			dst.val[2] = vorrq_u8(vshlq_n_u8(c, 6), d);
+			vst3q_u8(out, dst);
+			processed += 64;
+			out += 48;
+		}
+		const uint64x2_t valid64 = vreinterpretq_u64_u8(valid);
+		invalid = (vgetq_lane_u64(valid64, 0) & vgetq_lane_u64(valid64, 1)) != 0xFFFFFFFFFFFFFFFFULL;
+		return processed;
+	}
+
+	static void _SelectKernels(EncodeKernel & encode, DecodeKernel & decode)
+	{
+		encode = _EncodeKernel_NEON;
+		decode = _DecodeKernel_NEON;
+	}
+
+#else
+
+	static void _SelectKernels(EncodeKernel & encode, DecodeKernel & decode)
+	{
+		encode = nullptr;
+		decode = nullptr;
+	}
+
+#endif // PA_BASE64_X86 / PA_BASE64_NEON
+
+	/**
+	 Structure keeping kernels selected for the current CPU.
+	 */
+	struct Base64Kernels
+	{
+		EncodeKernel encode;
+		DecodeKernel decode;
+
+		Base64Kernels()
+		{
+			_SelectKernels(encode, decode);
+		}
+	};
+
+
+	// -------------------------------------------------------------------------------------------
+	// MARK: - Public interface -
+	//
+
+	size_t Base64_EncodeToBuffer(const cc7::ByteRange & data, char * out)
+	{
+		const cc7::byte * in = data.data();
+		const size_t size = data.size();
+		size_t processed = 0;
+		char * p = out;
+		// Vectorized part
+		const Base64Kernels & kernels = GetSelectedKernels<Base64Kernels>();
+		if (kernels.encode) {
+			processed = kernels.encode(in, size, p);
+			p += processed / 3 * 4;
+		}
+		// Scalar part, for all remaining complete triplets
+		const size_t rest = (size - processed) / 3 * 3;
+		_EncodeScalar(in + processed, rest, p);
+		processed += rest;
+		p += rest / 3 * 4;
+		// Tail with padding
+		const size_t tail = size - processed;
+		if (tail > 0) {
+			cc7::U32 v = (cc7::U32)in[processed] << 16;
+			if (tail > 1) {
+				v |= (cc7::U32)in[processed + 1] << 8;
+			}
+			p[0] = s_encode_table[(v >> 18) & 0x3F];
+			p[1] = s_encode_table[(v >> 12) & 0x3F];
+			p[2] = tail > 1 ? s_encode_table[(v >> 6) & 0x3F] : '=';
+			p[3] = '=';
+			p += 4;
+		}
+		return p - out;
+	}
+
+	std::string Base64_Encode(const cc7::ByteRange & data)
+	{
+		std::string result(Base64_EncodedLength(data.size()), 0);
+		if (!result.empty()) {
+			size_t length = Base64_EncodeToBuffer(data, &result[0]);
+			CC7_ASSERT(length == result.size(), "Unexpected Base64 length");
+			(void)length;
+		}
+		return result;
+	}
+
+	bool Base64_DecodeToBuffer(const cc7::ByteRange & input, cc7::byte * out, size_t & out_size)
+	{
+		out_size = 0;
+		const cc7::byte * in = input.data();
+		const size_t length = input.size();
+		if (length == 0) {
+			return true;
+		}
+		if ((length & 3) != 0) {
+			return false;
+		}
+		// Determine padding. The last quartet is always processed separately.
+		size_t padding = 0;
+		if (in[length - 1] == '=') {
+			padding = in[length - 2] == '=' ? 2 : 1;
+		}
+		const size_t body_length = length - 4;
+		// Vectorized part
+		size_t processed = 0;
+		cc7::byte * p = out;
+		const Base64Kernels & kernels = GetSelectedKernels<Base64Kernels>();
+		if (kernels.decode) {
+			bool invalid = false;
+			processed = kernels.decode(in, body_length, p, invalid);
+			if (invalid) {
+				return false;
+			}
+			p += processed / 4 * 3;
+		}
+		// Scalar part, for all remaining complete quartets
+		if (!_DecodeScalar(in + processed, body_length - processed, p)) {
+			return false;
+		}
+		p += (body_length - processed) / 4 * 3;
+		// Last quartet, with optional padding
+		const cc7::byte * q = in + body_length;
+		cc7::U32 a = s_decode_table[q[0]];
+		cc7::U32 b = s_decode_table[q[1]];
+		cc7::U32 c = padding < 2 ? s_decode_table[q[2]] : 0;
+		cc7::U32 d = padding < 1 ? s_decode_table[q[3]] : 0;
+		if (((a | b | c | d) & 0x80) != 0) {
+			return false;
+		}
+		cc7::U32 v = a << 18 | b << 12 | c << 6 | d;
+		*p++ = (cc7::byte)(v >> 16);
+		if (padding < 2) {
+			*p++ = (cc7::byte)(v >> 8);
+		}
+		if (padding < 1) {
+			*p++ = (cc7::byte)(v);
+		}
+		out_size = p - out;
+		return true;
+	}
+
+	bool Base64_Decode(const cc7::ByteRange & input, cc7::ByteArray & out)
+	{
+		out.resize(Base64_MaxDecodedSize(input.size()));
+		size_t out_size = 0;
+		if (!Base64_DecodeToBuffer(input, out.data(), out_size)) {
+			out.clear();
+			return false;
+		}
+		out.resize(out_size);
+		return true;
+	}
+
+	cc7::ByteArray Base64_Decode(const cc7::ByteRange & input)
+	{
+		cc7::ByteArray result;
+		Base64_Decode(input, result);
+		return result;
+	}
+
+} // io::getlime::powerAuth::utils
+} // io::getlime::powerAuth
+} // io::getlime
+} // io
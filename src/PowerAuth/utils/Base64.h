@@ -0,0 +1,93 @@
+/*
+ * Copyright 2019 Wultra s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cc7/ByteArray.h>
+
+/*
+ The Base64 codec implemented in this header produces and accepts exactly the same
+ data as cc7::Base64 functions with no line wrapping (e.g. wrap_size == 0):
+
+  - Standard RFC 4648 alphabet with '+' and '/' characters is used.
+  - The encoded string is always padded with '=' to a multiple of 4 characters.
+  - The decoder requires padding and rejects whitespace or any other character.
+
+ The implementation uses SIMD instructions when they're available on the target CPU
+ (AVX2 or SSSE3 on Intel, NEON on ARM) and falls back to a table based scalar code.
+ */
+
+namespace io
+{
+namespace getlime
+{
+namespace powerAuth
+{
+namespace utils
+{
+	/**
+	 Returns number of characters required for Base64 representation of |data_size| bytes.
+	 */
+	inline size_t Base64_EncodedLength(size_t data_size)
+	{
+		return ((data_size + 2) / 3) * 4;
+	}
+
+	/**
+	 Returns maximum number of bytes, which can be produced by decoding |length| characters
+	 long Base64 string.
+	 */
+	inline size_t Base64_MaxDecodedSize(size_t length)
+	{
+		return (length / 4) * 3;
+	}
+
+	/**
+	 Encodes |data| into Base64 and stores the result into |out| buffer. The buffer must have capacity for
+	 at least `Base64_EncodedLength(data.size())` characters. The null terminator is not appended.
+	 Returns number of characters written to the buffer.
+	 */
+	size_t Base64_EncodeToBuffer(const cc7::ByteRange & data, char * out);
+
+	/**
+	 Returns Base64 representation of |data|.
+	 */
+	std::string Base64_Encode(const cc7::ByteRange & data);
+
+	/**
+	 Decodes Base64 string from |input| and stores the result into |out| buffer. The buffer must have capacity for
+	 at least `Base64_MaxDecodedSize(input.size())` bytes. The number of decoded bytes is stored to |out_size|.
+	 Returns false if the input is not a valid Base64 string. In this case, the content of |out| buffer
+	 is undefined.
+	 */
+	bool Base64_DecodeToBuffer(const cc7::ByteRange & input, cc7::byte * out, size_t & out_size);
+
+	/**
+	 Decodes Base64 string |input| and stores the result into |out| byte array. Returns false if
+	 the input is not a valid Base64 string. In this case, the |out| array is cleared.
+	 */
+	bool Base64_Decode(const cc7::ByteRange & input, cc7::ByteArray & out);
+
+	/**
+	 Returns bytes decoded from Base64 string |input|. Returns an empty array if the input is
+	 not a valid Base64 string.
+	 */
+	cc7::ByteArray Base64_Decode(const cc7::ByteRange & input);
+
+} // io::getlime::powerAuth::utils
+} // io::getlime::powerAuth
+} // io::getlime
+} // io
@@ -15,6 +15,12 @@
  */
 
 #include "CRC16.h"
+#include "KernelSelector.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+	#define PA_CRC16_X86
+	#include <immintrin.h>
+#endif
 
 namespace io
 {
@@ -24,51 +30,291 @@ namespace powerAuth
 {
 namespace utils
 {
-	static const cc7::U16 s_crc_table[256] =
-	{
-		0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
-		0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
-		0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
-		0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
-		0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
-		0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
-		0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
-		0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
-		0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
-		0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
-		0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
-		0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
-		0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
-		0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
-		0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
-		0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
-		0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
-		0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
-		0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
-		0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
-		0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
-		0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
-		0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
-		0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
-		0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
-		0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
-		0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
-		0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
-		0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
-		0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
-		0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
-		0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040,
+	// -------------------------------------------------------------------------------------------
+	// MARK: - Compile time tables -
+	//
+	
+	// CRC-16/ARC is using 0x8005 polynomial (x^16 + x^15 + x^2 + 1) with reflected
+	// input and output, so the table driven implementation uses reflected 0xA001 value.
+	
+	static constexpr cc7::U16 CRC16_POLY = 0x8005;
+	static constexpr cc7::U16 CRC16_POLY_REFLECTED = 0xA001;
+	
+	/**
+	 Returns |crc| after processing |bits| zero bits, bit by bit.
+	 */
+	static constexpr cc7::U16 _BitwiseCRC(cc7::U16 crc, int bits)
+	{
+		return bits == 0 ? crc : _BitwiseCRC((crc & 1) ? (crc >> 1) ^ CRC16_POLY_REFLECTED : (crc >> 1), bits - 1);
+	}
+	
+	/**
+	 Returns |crc| after processing one zero byte.
+	 */
+	static constexpr cc7::U16 _ShiftZeroByte(cc7::U16 crc)
+	{
+		return (crc >> 8) ^ _BitwiseCRC(crc & 0xFF, 8);
+	}
+	
+	/**
+	 Returns entry at |index| in slicing table number |table|. The table N contains CRC of
+	 byte |index| followed by N zero bytes.
+	 */
+	static constexpr cc7::U16 _TableEntry(size_t table, size_t index)
+	{
+		return table == 0 ? _BitwiseCRC((cc7::U16)index, 8) : _ShiftZeroByte(_TableEntry(table - 1, index));
+	}
+	
+	// C++11 compatible replacement for std::index_sequence
+	template <size_t... I> struct _IndexSequence {};
+	template <size_t N, size_t... I> struct _MakeIndexSequence : _MakeIndexSequence<N - 1, N - 1, I...> {};
+	template <size_t... I> struct _MakeIndexSequence<0, I...> : _IndexSequence<I...> {};
+	
+	struct CRC16Table
+	{
+		cc7::U16 entries[256];
 	};
 	
-	cc7::U16 CRC16_Calculate(const cc7::ByteRange & bytes)
+	template <size_t... I>
+	static constexpr CRC16Table _MakeTable(size_t table, _IndexSequence<I...>)
 	{
-		cc7::U16 crc = 0;
-		for (size_t i = 0; i < bytes.size(); ++i) {
-			crc = (crc >> 8) ^ s_crc_table[(crc ^ bytes[i]) & 0xFF];
+		return CRC16Table { { _TableEntry(table, I)... } };
+	}
+	
+	/**
+	 Tables for slicing-by-8 algorithm, generated at compile time.
+	 */
+	static constexpr CRC16Table s_crc_tables[8] =
+	{
+		_MakeTable(0, _MakeIndexSequence<256>()),
+		_MakeTable(1, _MakeIndexSequence<256>()),
+		_MakeTable(2, _MakeIndexSequence<256>()),
+		_MakeTable(3, _MakeIndexSequence<256>()),
+		_MakeTable(4, _MakeIndexSequence<256>()),
+		_MakeTable(5, _MakeIndexSequence<256>()),
+		_MakeTable(6, _MakeIndexSequence<256>()),
+		_MakeTable(7, _MakeIndexSequence<256>()),
+	};
+	
+	static_assert(s_crc_tables[0].entries[1] == 0xC0C1 && s_crc_tables[0].entries[255] == 0x4040, "Invalid CRC16 table");
+	
+	
+	// -------------------------------------------------------------------------------------------
+	// MARK: - Polynomial arithmetic -
+	//
+	
+	// Following functions are working with polynomials modulo P, in the normal (not reflected)
+	// bit order, where bit N is coefficient of x^N.
+	
+	/**
+	 Returns a * x mod P
+	 */
+	static constexpr cc7::U16 _MulX(cc7::U16 a)
+	{
+		return (cc7::U16)((a << 1) ^ ((a & 0x8000) ? CRC16_POLY : 0));
+	}
+	
+	/**
+	 Returns (acc + a * b) mod P
+	 */
+	static constexpr cc7::U16 _MulMod(cc7::U16 a, cc7::U16 b, cc7::U16 acc = 0)
+	{
+		return b == 0 ? acc : _MulMod(_MulX(a), b >> 1, (b & 1) ? acc ^ a : acc);
+	}
+	
+	/**
+	 Returns a^2 mod P, or a^2 * x mod P if |mul_x| is true.
+	 */
+	static constexpr cc7::U16 _SquareMod(cc7::U16 a, bool mul_x)
+	{
+		return mul_x ? _MulX(_MulMod(a, a)) : _MulMod(a, a);
+	}
+	
+	/**
+	 Returns x^n mod P
+	 */
+	static constexpr cc7::U16 _XPowMod(cc7::U64 n)
+	{
+		return n == 0 ? 1 : _SquareMod(_XPowMod(n >> 1), (n & 1) != 0);
+	}
+	
+	/**
+	 Returns 16 bit |value| with reversed order of bits.
+	 */
+	static constexpr cc7::U16 _Reflect16(cc7::U16 value, int bit = 0)
+	{
+		return bit == 16 ? 0 : (cc7::U16)((((value >> bit) & 1) << (15 - bit)) | _Reflect16(value, bit + 1));
+	}
+	
+	
+	// -------------------------------------------------------------------------------------------
+	// MARK: - Slicing-by-8 -
+	//
+	
+	static cc7::U16 _CalculateSlice8(cc7::U16 crc, const cc7::byte * in, size_t size)
+	{
+		const cc7::U16 * t0 = s_crc_tables[0].entries;
+		const cc7::U16 * t1 = s_crc_tables[1].entries;
+		const cc7::U16 * t2 = s_crc_tables[2].entries;
+		const cc7::U16 * t3 = s_crc_tables[3].entries;
+		const cc7::U16 * t4 = s_crc_tables[4].entries;
+		const cc7::U16 * t5 = s_crc_tables[5].entries;
+		const cc7::U16 * t6 = s_crc_tables[6].entries;
+		const cc7::U16 * t7 = s_crc_tables[7].entries;
+		while (size >= 8) {
+			const cc7::U32 head = (in[0] | ((cc7::U32)in[1] << 8)) ^ crc;
+			crc = t7[head & 0xFF] ^ t6[head >> 8] ^ t5[in[2]] ^ t4[in[3]] ^
+				  t3[in[4]] ^ t2[in[5]] ^ t1[in[6]] ^ t0[in[7]];
+			in   += 8;
+			size -= 8;
+		}
+		while (size > 0) {
+			crc = (crc >> 8) ^ t0[(crc ^ *in++) & 0xFF];
+			--size;
 		}
 		return crc;
 	}
 	
+	
+	// -------------------------------------------------------------------------------------------
+	// MARK: - Carry-less multiplication -
+	//
+	
+	typedef cc7::U16 (*CRC16Kernel)(cc7::U16 crc, const cc7::byte * in, size_t size);
+	
+	/**
+	 Minimum number of bytes processed by the kernel.
+	 */
+	static const size_t KERNEL_MIN_SIZE = 128;
+	
+#if defined(PA_CRC16_X86)
+	
+	// The kernel is folding 128-bit blocks of data with carry-less multiplication, until only one block
+	// remains. In the reflected bit order, the block is A = Ah * x^64 + Al, where Ah is in the low 64 bits.
+	// Moving the block by D bits forward is then equal to Ah * x^(D+64) + Al * x^D, which is congruent with
+	// Ah * (x^(D+64) mod P) + Al * (x^D mod P). Both products have less than 128 bits, so their sum can be
+	// xored to the block placed D bits after the original one. The constants are stored as reflected
+	// x^(D+63) and x^(D-1), because the product of reflected values is shifted by one bit.
+	// The last block is then processed with the table based algorithm.
+	
+	#define PA_TARGET_PCLMUL	__attribute__((target("pclmul,sse2")))
+	
+	static constexpr cc7::U64 _ReflectedConstant(size_t n)
+	{
+		return (cc7::U64)_Reflect16(_XPowMod(n)) << 48;
+	}
+	
+	// Fold by 4 blocks (512 bits) and by one block (128 bits)
+	static constexpr cc7::U64 K_FOLD_512_LO = _ReflectedConstant(512 + 63);
+	static constexpr cc7::U64 K_FOLD_512_HI = _ReflectedConstant(512 - 1);
+	static constexpr cc7::U64 K_FOLD_128_LO = _ReflectedConstant(128 + 63);
+	static constexpr cc7::U64 K_FOLD_128_HI = _ReflectedConstant(128 - 1);
+	
+	PA_TARGET_PCLMUL
+	static inline __m128i _Fold_PCLMUL(__m128i x, __m128i k, __m128i next)
+	{
+		const __m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+		const __m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+		return _mm_xor_si128(_mm_xor_si128(lo, hi), next);
+	}
+	
+	PA_TARGET_PCLMUL
+	static cc7::U16 _Calculate_PCLMUL(cc7::U16 crc, const cc7::byte * in, size_t size)
+	{
+		const __m128i k512 = _mm_set_epi64x((long long)K_FOLD_512_HI, (long long)K_FOLD_512_LO);
+		const __m128i k128 = _mm_set_epi64x((long long)K_FOLD_128_HI, (long long)K_FOLD_128_LO);
+		const __m128i * p = (const __m128i*)in;
+		// Initial CRC value is equal to xor with the first bytes of data
+		__m128i x0 = _mm_xor_si128(_mm_loadu_si128(p), _mm_cvtsi32_si128(crc));
+		__m128i x1 = _mm_loadu_si128(p + 1);
+		__m128i x2 = _mm_loadu_si128(p + 2);
+		__m128i x3 = _mm_loadu_si128(p + 3);
+		p    += 4;
+		size -= 64;
+		// Fold 4 independent lanes
+		while (size >= 64) {
+			x0 = _Fold_PCLMUL(x0, k512, _mm_loadu_si128(p));
+			x1 = _Fold_PCLMUL(x1, k512, _mm_loadu_si128(p + 1));
+			x2 = _Fold_PCLMUL(x2, k512, _mm_loadu_si128(p + 2));
+			x3 = _Fold_PCLMUL(x3, k512, _mm_loadu_si128(p + 3));
+			p    += 4;
+			size -= 64;
+		}
+		// Fold lanes into one block, then fold remaining blocks
+		__m128i x = _Fold_PCLMUL(x0, k128, x1);
+		x = _Fold_PCLMUL(x, k128, x2);
+		x = _Fold_PCLMUL(x, k128, x3);
+		while (size >= 16) {
+			x = _Fold_PCLMUL(x, k128, _mm_loadu_si128(p));
+			p    += 1;
+			size -= 16;
+		}
+		// Calculate CRC from the last block and the rest of data
+		cc7::byte last_block[16];
+		_mm_storeu_si128((__m128i*)last_block, x);
+		crc = _CalculateSlice8(0, last_block, 16);
+		return _CalculateSlice8(crc, (const cc7::byte*)p, size);
+	}
+	
+	static CRC16Kernel _SelectKernel()
+	{
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("pclmul")) {
+			return _Calculate_PCLMUL;
+		}
+		return nullptr;
+	}
+	
+#else
+	
+	static CRC16Kernel _SelectKernel()
+	{
+		return nullptr;
+	}
+	
+#endif // PA_CRC16_X86
+	
+	/**
+	 Structure keeping kernel selected for the current CPU.
+	 */
+	struct CRC16Kernels
+	{
+		CRC16Kernel calculate;
+		
+		CRC16Kernels() : calculate(_SelectKernel())
+		{
+		}
+	};
+	
+	
+	// -------------------------------------------------------------------------------------------
+	// MARK: - Public interface -
+	//
+	
+	cc7::U16 CRC16_Calculate(const cc7::ByteRange & bytes)
+	{
+		return CRC16_Update(0, bytes);
+	}
+	
+	cc7::U16 CRC16_Update(cc7::U16 crc, const cc7::ByteRange & bytes)
+	{
+		if (bytes.size() >= KERNEL_MIN_SIZE) {
+			CRC16Kernel kernel = GetSelectedKernels<CRC16Kernels>().calculate;
+			if (kernel) {
+				return kernel(crc, bytes.data(), bytes.size());
+			}
+		}
+		return _CalculateSlice8(crc, bytes.data(), bytes.size());
+	}
+	
+	cc7::U16 CRC16_Combine(cc7::U16 crc1, cc7::U16 crc2, size_t length2)
+	{
+		// Processing |length2| zero bytes is equal to multiplication by x^(8 * length2) mod P.
+		// The CRC value is reflected, so it has to be converted to normal bit order first.
+		const cc7::U16 shifted = _MulMod(_Reflect16(crc1), _XPowMod((cc7::U64)length2 * 8));
+		return _Reflect16(shifted) ^ crc2;
+	}
+	
 	bool CRC16_Validate(const cc7::ByteRange & bytes)
 	{
 		const size_t count = bytes.size();
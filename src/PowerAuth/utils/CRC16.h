@@ -31,6 +31,19 @@ namespace utils
 	 */
 	cc7::U16 CRC16_Calculate(const cc7::ByteRange & bytes);
 	
+	/**
+	 Updates CRC-16/ARC checksum |crc|, calculated from previous data, with next |bytes|.
+	 The initial value of |crc| must be 0.
+	 */
+	cc7::U16 CRC16_Update(cc7::U16 crc, const cc7::ByteRange & bytes);
+	
+	/**
+	 Combines two CRC-16/ARC checksums calculated from independent chunks of data. The |crc1| is checksum
+	 of the first chunk and |crc2| is checksum of the second chunk with |length2| bytes. The function
+	 returns checksum of both chunks concatenated together.
+	 */
+	cc7::U16 CRC16_Combine(cc7::U16 crc1, cc7::U16 crc2, size_t length2);
+	
 	/**
 	 Validates CRC-16/ARC checksum from given |bytes|. The function is expecting
 	 that the last two bytes, contains the checksum in big endian order, calculated
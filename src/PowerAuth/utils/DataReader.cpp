@@ -46,6 +46,13 @@ namespace utils
 		_data.assign(_data_copy.byteRange());
 	}
 	
+	DataReader::DataReader(ByteArray && data) :
+		_data_copy(std::move(data)),
+		_offset(0)
+	{
+		_data.assign(_data_copy.byteRange());
+	}
+	
 	void DataReader::reset()
 	{
 		_offset = 0;
@@ -65,6 +72,13 @@ namespace utils
 		_data.assign(_data_copy.byteRange());
 	}
 	
+	void DataReader::resetWithNewByteArray(cc7::ByteArray && data)
+	{
+		_offset = 0;
+		_data_copy = std::move(data);
+		_data.assign(_data_copy.byteRange());
+	}
+	
 	size_t DataReader::remainingSize() const
 	{
 		return _data.size() - _offset;
@@ -91,18 +105,11 @@ namespace utils
 	
 	bool DataReader::readData(ByteArray & out_data, size_t expected_size)
 	{
-		size_t size;
-		if (!readCount(size)) {
-			return false;
-		}
-		if (!canReadSize(size)) {
+		ByteRange range;
+		if (!readRange(range, expected_size)) {
 			return false;
 		}
-		if (expected_size > 0 && expected_size != size) {
-			return false;
-		}
-		out_data.assign(_data.subRange(_offset, size));
-		_offset += size;
+		out_data.assign(range);
 		return true;
 	}
 	
@@ -145,18 +152,19 @@ namespace utils
 	
 	bool DataReader::readString(string & out_string)
 	{
-		size_t size;
-		if (!readCount(size)) {
+		ByteRange range;
+		if (!readRange(range)) {
 			return false;
 		}
-		if (!canReadSize(size)) {
-			return false;
-		}
-		out_string.assign(reinterpret_cast<const char*>(_data.data()) + _offset, size);
-		_offset += size;
+		out_string.assign(reinterpret_cast<const char*>(range.data()), range.size());
 		return true;
 	}
 	
+	bool DataReader::readStringRange(cc7::ByteRange & out_range)
+	{
+		return readRange(out_range);
+	}
+	
 	bool DataReader::readByte(uint8_t & out_value)
 	{
 		if (!canReadSize(1)) {
@@ -209,35 +217,32 @@ namespace utils
 	
 	bool DataReader::readCount(size_t & out_value)
 	{
-		byte tmp[4];
-		if (!readByte(tmp[0])) {
+		if (_offset >= _data.size()) {
 			return false;
 		}
-		const byte marker = tmp[0] & 0xC0;
-		if (marker == 0x00 || marker == 0x40) {
-			// just one byte
-			out_value = tmp[0];
-			//
+		const byte * p = _data.data() + _offset;
+		const size_t b0 = p[0];
+		if (b0 < 0x80) {
+			// Just one byte, the most common case
+			out_value = b0;
+			_offset++;
+			return true;
+		}
+		// Marker is 2 or 3, that means that the count is stored in 2 or 4 bytes.
+		const size_t size = b0 < 0xC0 ? 2 : 4;
+		if (!canReadSize(size)) {
+			return false;
+		}
+		if (size == 4) {
+			out_value = ((b0 & 0x3F) << 24) |
+						(size_t(p[1]) << 16) |
+						(size_t(p[2]) << 8 ) |
+						 size_t(p[3]);
 		} else {
-			// marker is 2 or 3, that means that we need 1 or 3 more bytes
-			size_t additional_bytes = marker == 0xC0 ? 3 : 1;
-			if (!readRawMemory(tmp + 1, additional_bytes)) {
-				return false;
-			}
-			if (marker == 0xC0) {
-				// 4 bytes
-				out_value = (size_t(tmp[0] & 0x3F) << 24) |
-							(size_t(tmp[1]       ) << 16) |
-							(size_t(tmp[2]	     ) << 8 ) |
-							 size_t(tmp[3]);
-				//
-			} else {
-				// 2 bytes
-				out_value = (size_t(tmp[0] & 0x3F) << 8 ) |
-							 size_t(tmp[1]);
-				//
-			}
+			out_value = ((b0 & 0x3F) << 8 ) |
+						 size_t(p[1]);
 		}
+		_offset += size;
 		return true;
 	}
 	
@@ -55,6 +55,13 @@ namespace utils
 		 */
 		explicit DataReader(const cc7::ByteArray & data);
 		
+		/**
+		 Initializes DataReader object with a ByteArray object. The reader takes
+		 ownership of provided data, so no copy is made. Use this constructor
+		 for temporary arrays, for example for just decrypted data.
+		 */
+		explicit DataReader(cc7::ByteArray && data);
+		
 		/**
 		 Resets data reader to its initial state.
 		 */
@@ -73,6 +80,12 @@ namespace utils
 		 */
 		void resetWithNewByteArray(const cc7::ByteArray & data);
 		
+		/**
+		 Resets data reader and assigns a new data. Unlike the variant
+		 with const reference, the reader takes ownership of provided data.
+		 */
+		void resetWithNewByteArray(cc7::ByteArray && data);
+		
 		/**
 		 Returns remaining size available in the stream.
 		 */
@@ -109,6 +122,8 @@ namespace utils
 		
 		/**
 		 Similar to readData(), but returns sub-range to internal data object.
+		 The returned range is valid as long as the data provided to the reader.
+		 Prefer this method if you don't need to keep a copy of data.
 		 */
 		bool readRange(cc7::ByteRange & out_range, size_t expected_size = 0);
 
@@ -122,6 +137,11 @@ namespace utils
 		 Reads string object into |out_string|
 		 */
 		bool readString(std::string & out_string);
+		/**
+		 Similar to readString(), but returns sub-range to internal data object,
+		 containing characters of the string.
+		 */
+		bool readStringRange(cc7::ByteRange & out_range);
 		/**
 		 Reads one byte into |out_value|
 		 */
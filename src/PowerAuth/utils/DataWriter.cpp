@@ -16,6 +16,7 @@
 
 #include "DataWriter.h"
 #include <cc7/Endian.h>
+#include <string.h>
 
 using namespace cc7;
 using namespace std;
@@ -31,7 +32,10 @@ namespace utils
 
 	const size_t kResetToFitThreshold = 2048;
 
-	DataWriter::DataWriter(ByteArray * buffer)
+	DataWriter::DataWriter(ByteArray * buffer) :
+		_buffer(nullptr),
+		_capacity(0),
+		_size(0)
 	{
 		if (buffer) {
 			_data = buffer;
@@ -42,6 +46,25 @@ namespace utils
 		}
 	}
 	
+	DataWriter::DataWriter(Mode) :
+		_data(nullptr),
+		_buffer(nullptr),
+		_capacity((size_t)-1),	// measuring writer never overflows
+		_size(0),
+		_destroy_data(false)
+	{
+	}
+	
+	DataWriter::DataWriter(cc7::byte * buffer, size_t capacity) :
+		_data(nullptr),
+		_buffer(buffer),
+		_capacity(capacity),
+		_size(0),
+		_destroy_data(false)
+	{
+		CC7_ASSERT(buffer != nullptr || capacity == 0, "Invalid buffer");
+	}
+	
 	DataWriter::~DataWriter()
 	{
 		if (_destroy_data) {
@@ -52,15 +75,40 @@ namespace utils
 	
 	void DataWriter::reset()
 	{
-		_data->clear();
-		if (_data->capacity() > kResetToFitThreshold) {
-			_data->shrink_to_fit();
+		if (_data) {
+			_data->clear();
+			if (_data->capacity() > kResetToFitThreshold) {
+				_data->shrink_to_fit();
+			}
+		}
+		_size = 0;
+	}
+	
+	void DataWriter::reserve(size_t size)
+	{
+		if (_data) {
+			_data->reserve(_data->size() + size);
 		}
 	}
 	
 	const ByteArray & DataWriter::serializedData() const
 	{
-		return *_data;
+		if (_data) {
+			return *_data;
+		}
+		// Measuring mode, or external buffer.
+		static const ByteArray s_empty;
+		return s_empty;
+	}
+	
+	size_t DataWriter::serializedSize() const
+	{
+		return _data ? _data->size() : _size;
+	}
+	
+	bool DataWriter::hasOverflow() const
+	{
+		return _size > _capacity;
 	}
 	
 	void DataWriter::writeData(const ByteRange & data)
@@ -68,7 +116,7 @@ namespace utils
 		if (!writeCount(data.size())) {
 			return;
 		}
-		_data->append(data);
+		writeRawMemory(data.data(), data.size());
 	}
 	
 	void DataWriter::writeString(const string & str)
@@ -76,12 +124,16 @@ namespace utils
 		if (!writeCount(str.size())) {
 			return;
 		}
-		_data->append(cc7::MakeRange(str));
+		writeRawMemory(str.data(), str.size());
 	}
 	
 	void DataWriter::writeByte(cc7::byte byte)
 	{
-		_data->push_back(byte);
+		if (_data) {
+			_data->push_back(byte);
+		} else {
+			writeRawMemory(&byte, 1);
+		}
 	}
 	
 	void DataWriter::writeU16(cc7::U16 value)
@@ -104,7 +156,7 @@ namespace utils
 	
 	void DataWriter::writeMemory(const ByteRange &range)
 	{
-		_data->append(range);
+		writeRawMemory(range.data(), range.size());
 	}
 	
 	//   00h ..       7Fh (as             value, one byte)
@@ -113,26 +165,29 @@ namespace utils
 	
 	bool DataWriter::writeCount(size_t n)
 	{
-		if (n <= 0x7F) {
+		cc7::byte tmp[4];
+		size_t size = countSize(n);
+		if (size == 1) {
 			//
-			writeByte(n);
+			tmp[0] = n;
 			//
-		} else if (n <= 0x3FFF) {
+		} else if (size == 2) {
 			//
-			writeByte(((n >> 8 ) & 0x3F) | 0x80);
-			writeByte(  n        & 0xFF);
+			tmp[0] = ((n >> 8 ) & 0x3F) | 0x80;
+			tmp[1] =   n        & 0xFF;
 			//
-		} else if (n <= 0x3FFFFFFF) {
+		} else if (size == 4) {
 			//
-			writeByte(((n >> 24) & 0x3F) | 0xC0);
-			writeByte( (n >> 16) & 0xFF);
-			writeByte( (n >> 8 ) & 0xFF);
-			writeByte(  n        & 0xFF);
+			tmp[0] = ((n >> 24) & 0x3F) | 0xC0;
+			tmp[1] =  (n >> 16) & 0xFF;
+			tmp[2] =  (n >> 8 ) & 0xFF;
+			tmp[3] =   n        & 0xFF;
 			//
 		} else {
 			CC7_ASSERT(false, "Count is too big.");
 			return false;
 		}
+		writeRawMemory(tmp, size);
 		return true;
 	}
 	
@@ -141,20 +196,40 @@ namespace utils
 		return 0x3FFFFFFF;
 	}
 	
+	size_t DataWriter::countSize(size_t n)
+	{
+		if (n <= 0x7F) {
+			return 1;
+		} else if (n <= 0x3FFF) {
+			return 2;
+		} else if (n <= 0x3FFFFFFF) {
+			return 4;
+		}
+		return 0;
+	}
+	
 	// Private impl.
 	
 	void DataWriter::writeRawMemory(const void *ptr, size_t size)
 	{
 		const uint8_t * p = reinterpret_cast<const uint8_t *>(ptr);
-		_data->append(p, p + size);
+		if (_data) {
+			_data->append(p, p + size);
+			return;
+		}
+		if (_buffer && _size <= _capacity && size <= _capacity - _size) {
+			memcpy(_buffer + _size, p, size);
+		}
+		// In measuring mode, or if the external buffer overflows, only the size is updated.
+		_size += size;
 	}
 	
 	// versions
 	
 	void DataWriter::openVersion(cc7::byte tag, cc7::byte v)
 	{
-		writeByte(tag);
-		writeByte(v);
+		cc7::byte tmp[2] = { tag, v };
+		writeRawMemory(tmp, sizeof(tmp));
 		_version_stack.push_back((cc7::U16(tag) << 8) | v);
 	}
 	
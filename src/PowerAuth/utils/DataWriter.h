@@ -31,16 +31,56 @@ namespace utils
 	 data serialization.
 	 
 	 You can use DataReader as a complementary class.
+	 
+	 The writer can also work in the measuring mode, where nothing is written
+	 and only the exact number of serialized bytes is calculated. This allows
+	 you to serialize the same sequence of data twice, first to measure its size
+	 and then to write it into a buffer with exactly preallocated capacity:
+	 
+		DataWriter measure(DataWriter::MEASURE_ONLY);
+		serialize(measure);
+		cc7::ByteArray result;
+		result.reserve(measure.serializedSize());
+		DataWriter writer(&result);
+		serialize(writer);
 	 */
 	class DataWriter
 	{
 	public:
+		
+		/**
+		 The Mode enumeration allows you to create writer which doesn't
+		 write data to any buffer.
+		 */
+		enum Mode
+		{
+			/**
+			 The writer only calculates number of bytes required for
+			 the serialization.
+			 */
+			MEASURE_ONLY
+		};
+		
 		/**
 		 Initializes empty data writer. If you don't specify
 		 out_buffer, then the internal buffer will be used.
 		 */
 		DataWriter(cc7::ByteArray * out_buffer = nullptr);
 		
+		/**
+		 Initializes data writer in measuring mode. Such writer never writes
+		 data and only counts number of bytes, available in serializedSize().
+		 */
+		explicit DataWriter(Mode mode);
+		
+		/**
+		 Initializes data writer with an external preallocated |buffer| with
+		 |capacity| bytes. The writer never writes behind the capacity of buffer.
+		 If there's not enough space for data, then the writer stops writing
+		 and hasOverflow() returns true.
+		 */
+		DataWriter(cc7::byte * buffer, size_t capacity);
+		
 		/**
 		 Destruction.
 		 */
@@ -51,6 +91,13 @@ namespace utils
 		 */
 		void reset();
 		
+		/**
+		 Reserves capacity for additional |size| bytes in the output byte array.
+		 The method has no effect if writer is in measuring mode, or writes to
+		 an external buffer.
+		 */
+		void reserve(size_t size);
+		
 		/**
 		 Writes number of bytes in byte range and actual
 		 data to the stream. The size of range must not exceed
@@ -89,10 +136,24 @@ namespace utils
 		void writeMemory(const cc7::ByteRange & range);
 		
 		/**
-		 Returns serialized data.
+		 Returns serialized data. The method returns an empty byte array if writer
+		 is in measuring mode, or writes to an external buffer.
 		 */
 		const cc7::ByteArray & serializedData() const;
 		
+		/**
+		 Returns number of serialized bytes. In measuring mode, returns number of bytes
+		 which would be written to the stream. If writer writes to an external buffer
+		 and the buffer overflows, then returns number of bytes required for all data.
+		 */
+		size_t serializedSize() const;
+		
+		/**
+		 Returns true if writer writes to an external buffer and the buffer has no
+		 capacity for all data.
+		 */
+		bool hasOverflow() const;
+		
 		/**
 		 Writes a count to the stream in optimized binary format. The count
 		 parameter must be less or equal than value returned from
@@ -111,6 +172,12 @@ namespace utils
 		 platforms and CPU architectures.
 		 */
 		static size_t maxCount();
+		
+		/**
+		 Returns number of bytes produced by writeCount() for given |count|,
+		 or 0 if count is greater than value returned from DataWriter::maxCount().
+		 */
+		static size_t countSize(size_t count);
 
 		
 		// Data versioning
@@ -147,6 +214,9 @@ namespace utils
 		void writeRawMemory(const void * ptr, size_t size);
 
 		cc7::ByteArray *	_data;
+		cc7::byte *			_buffer;
+		size_t				_capacity;
+		size_t				_size;
 		VersionStack		_version_stack;
 		bool				_destroy_data;
 	};
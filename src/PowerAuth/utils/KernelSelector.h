@@ -0,0 +1,42 @@
+/*
+ * Copyright 2019 Wultra s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+namespace io
+{
+namespace getlime
+{
+namespace powerAuth
+{
+namespace utils
+{
+	/**
+	 Returns structure with accelerated kernels, selected for the current CPU. The |Kernels|
+	 type has to select its kernels in its default constructor. The structure is constructed
+	 only once, on the first call. Thread safe initialization is guaranteed since C++11.
+	 */
+	template <typename Kernels>
+	const Kernels & GetSelectedKernels()
+	{
+		static const Kernels s_kernels;
+		return s_kernels;
+	}
+	
+} // io::getlime::powerAuth::utils
+} // io::getlime::powerAuth
+} // io::getlime
+} // io
@@ -0,0 +1,93 @@
+/*
+ * Copyright 2019 Wultra s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MappedFile.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace io
+{
+namespace getlime
+{
+namespace powerAuth
+{
+namespace utils
+{
+	MappedFile::MappedFile() :
+		_ptr(nullptr),
+		_size(0),
+		_is_open(false)
+	{
+	}
+	
+	MappedFile::~MappedFile()
+	{
+		close();
+	}
+	
+	bool MappedFile::open(const std::string & path)
+	{
+		close();
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			CC7_LOG("MappedFile: Failed to open file: %s", path.c_str());
+			return false;
+		}
+		struct stat st;
+		bool result = fstat(fd, &st) == 0;
+		if (result && st.st_size > 0) {
+			void * ptr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (ptr != MAP_FAILED) {
+				// The content is typically processed sequentially.
+				madvise(ptr, (size_t)st.st_size, MADV_SEQUENTIAL);
+				_ptr = ptr;
+				_size = (size_t)st.st_size;
+			} else {
+				CC7_LOG("MappedFile: Failed to map file: %s", path.c_str());
+				result = false;
+			}
+		}
+		::close(fd);
+		_is_open = result;
+		return result;
+	}
+	
+	void MappedFile::close()
+	{
+		if (_ptr) {
+			munmap(_ptr, _size);
+		}
+		_ptr = nullptr;
+		_size = 0;
+		_is_open = false;
+	}
+	
+	bool MappedFile::isOpen() const
+	{
+		return _is_open;
+	}
+	
+	cc7::ByteRange MappedFile::range() const
+	{
+		return cc7::ByteRange(static_cast<const cc7::byte*>(_ptr), _size);
+	}
+	
+} // io::getlime::powerAuth::utils
+} // io::getlime::powerAuth
+} // io::getlime
+} // io
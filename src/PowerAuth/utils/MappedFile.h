@@ -0,0 +1,82 @@
+/*
+ * Copyright 2019 Wultra s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cc7/ByteArray.h>
+
+namespace io
+{
+namespace getlime
+{
+namespace powerAuth
+{
+namespace utils
+{
+	/**
+	 The MappedFile class provides a read-only, memory mapped view to the content
+	 of file. The mapping is released when the object is destroyed.
+	 */
+	class MappedFile
+	{
+	public:
+		
+		/**
+		 Constructs an empty object.
+		 */
+		MappedFile();
+		
+		/**
+		 Unmaps the file.
+		 */
+		~MappedFile();
+		
+		MappedFile(const MappedFile &) = delete;
+		MappedFile & operator=(const MappedFile &) = delete;
+		
+		/**
+		 Maps file at |path| into the memory. The previously mapped file is released.
+		 Returns false if file cannot be opened or mapped.
+		 */
+		bool open(const std::string & path);
+		
+		/**
+		 Unmaps the file.
+		 */
+		void close();
+		
+		/**
+		 Returns true if file is mapped.
+		 */
+		bool isOpen() const;
+		
+		/**
+		 Returns range with the content of the file. The range is valid until
+		 the file is closed.
+		 */
+		cc7::ByteRange range() const;
+		
+	private:
+		
+		void *	_ptr;
+		size_t	_size;
+		bool	_is_open;
+	};
+	
+} // io::getlime::powerAuth::utils
+} // io::getlime::powerAuth
+} // io::getlime
+} // io
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2019 Wultra s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SecureMemory.h"
+#include <openssl/crypto.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <mutex>
+#include <vector>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+namespace io
+{
+namespace getlime
+{
+namespace powerAuth
+{
+namespace utils
+{
+	static size_t _PageSize()
+	{
+		static const size_t s_page_size = []() -> size_t {
+			long size = sysconf(_SC_PAGESIZE);
+			return size > 0 ? (size_t)size : 4096;
+		}();
+		return s_page_size;
+	}
+	
+	/**
+	 Allocates |allocated_size| bytes of locked pages. The size must be a multiple of page size.
+	 */
+	static cc7::byte * _AllocPages(size_t allocated_size)
+	{
+		void * ptr = mmap(nullptr, allocated_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (ptr == MAP_FAILED) {
+			CC7_LOG("SecureMemory: Failed to allocate %d bytes.", (int)allocated_size);
+			return nullptr;
+		}
+		if (mlock(ptr, allocated_size) != 0) {
+			CC7_LOG("SecureMemory: Failed to lock %d bytes.", (int)allocated_size);
+		}
+#if defined(MADV_DONTDUMP)
+		madvise(ptr, allocated_size, MADV_DONTDUMP);
+#endif
+		return reinterpret_cast<cc7::byte*>(ptr);
+	}
+	
+	// MARK: - Pool of small blocks -
+	
+	/**
+	 Size of the smallest block in the pool. Other blocks are 2x, 4x, ... larger.
+	 */
+	const size_t kPoolMinBlockSize = 32;
+	/**
+	 Number of block sizes in the pool. The largest block has 1024 bytes.
+	 */
+	const size_t kPoolBlockSizesCount = 6;
+	
+	/**
+	 The SmallBlockPool keeps lists of free blocks for each block size. The pages
+	 are split into blocks of one size and are never returned to the system.
+	 */
+	struct SmallBlockPool
+	{
+		std::mutex lock;
+		std::vector<cc7::byte*> free_blocks[kPoolBlockSizesCount];
+	};
+	
+	static SmallBlockPool & _Pool()
+	{
+		// The pool is intentionally never destroyed, so it's safe to release
+		// blocks from destructors of other static objects.
+		static SmallBlockPool * s_pool = new SmallBlockPool();
+		return *s_pool;
+	}
+	
+	/**
+	 Returns index of the smallest block size for |size| bytes, or kPoolBlockSizesCount
+	 if the size doesn't fit into the pool's blocks. The largest block must be smaller
+	 than the page.
+	 */
+	static size_t _PoolSizeIndex(size_t size)
+	{
+		size_t block_size = kPoolMinBlockSize;
+		for (size_t index = 0; index < kPoolBlockSizesCount; index++, block_size <<= 1) {
+			if (size <= block_size) {
+				return block_size < _PageSize() ? index : kPoolBlockSizesCount;
+			}
+		}
+		return kPoolBlockSizesCount;
+	}
+	
+	static cc7::byte * _PoolAlloc(size_t index)
+	{
+		const size_t block_size = kPoolMinBlockSize << index;
+		auto & pool = _Pool();
+		std::lock_guard<std::mutex> guard(pool.lock);
+		auto & free_blocks = pool.free_blocks[index];
+		if (free_blocks.empty()) {
+			// Split a new page into blocks. The page is zero filled.
+			const size_t page_size = _PageSize();
+			cc7::byte * page = _AllocPages(page_size);
+			if (!page) {
+				return nullptr;
+			}
+			for (size_t offset = page_size; offset >= block_size; offset -= block_size) {
+				free_blocks.push_back(page + offset - block_size);
+			}
+		}
+		cc7::byte * block = free_blocks.back();
+		free_blocks.pop_back();
+		return block;
+	}
+	
+	static void _PoolFree(cc7::byte * block, size_t index)
+	{
+		// The block is already wiped, so it's zero filled for the next allocation.
+		auto & pool = _Pool();
+		std::lock_guard<std::mutex> guard(pool.lock);
+		pool.free_blocks[index].push_back(block);
+	}
+	
+	// MARK: - Public interface -
+	
+	cc7::byte * SecureMemory_Alloc(size_t size, size_t & out_allocated_size)
+	{
+		const size_t pool_index = _PoolSizeIndex(size);
+		if (pool_index < kPoolBlockSizesCount) {
+			cc7::byte * block = _PoolAlloc(pool_index);
+			out_allocated_size = block ? kPoolMinBlockSize << pool_index : 0;
+			return block;
+		}
+		const size_t page_size = _PageSize();
+		const size_t allocated_size = ((size + page_size - 1) / page_size) * page_size;
+		cc7::byte * ptr = _AllocPages(allocated_size);
+		out_allocated_size = ptr ? allocated_size : 0;
+		return ptr;
+	}
+	
+	void SecureMemory_Free(cc7::byte * ptr, size_t allocated_size)
+	{
+		if (ptr) {
+			OPENSSL_cleanse(ptr, allocated_size);
+			const size_t pool_index = _PoolSizeIndex(allocated_size);
+			if (pool_index < kPoolBlockSizesCount) {
+				_PoolFree(ptr, pool_index);
+				return;
+			}
+			munlock(ptr, allocated_size);
+			munmap(ptr, allocated_size);
+		}
+	}
+	
+	void SecureMemory_Wipe(void * ptr, size_t size)
+	{
+		if (size > 0) {
+			OPENSSL_cleanse(ptr, size);
+		}
+	}
+	
+} // io::getlime::powerAuth::utils
+} // io::getlime::powerAuth
+} // io::getlime
+} // io
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2019 Wultra s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cc7/Platform.h>
+
+/*
+ The SecureMemory functions provide memory for sensitive data, like passwords
+ or keys. The memory is always allocated in whole pages, so it's never shared with
+ other objects allocated on the heap. The pages are locked in RAM when possible,
+ so the content is never swapped to the disk, and excluded from core dumps on
+ platforms that support it. The content of memory is wiped before it's released.
+ 
+ Small blocks are carved from shared secure pages, so short keys or passwords
+ don't lock a whole page each. Such pages are kept for the reuse and never
+ contain anything else than other secure memory blocks.
+ */
+
+namespace io
+{
+namespace getlime
+{
+namespace powerAuth
+{
+namespace utils
+{
+	/**
+	 Allocates zero filled secure memory with at least |size| bytes. The real size of
+	 allocated block is stored to |out_allocated_size| and must be later provided to
+	 SecureMemory_Free() function. Returns nullptr if memory cannot be allocated.
+	 
+	 Note that locking of memory is best effort only. If the process exceeds its limit
+	 for locked memory, then the memory is still allocated, but not locked.
+	 */
+	cc7::byte * SecureMemory_Alloc(size_t size, size_t & out_allocated_size);
+	
+	/**
+	 Wipes and releases memory block previously allocated with SecureMemory_Alloc().
+	 The |allocated_size| must be equal to value returned from SecureMemory_Alloc().
+	 It's safe to call this function with nullptr.
+	 */
+	void SecureMemory_Free(cc7::byte * ptr, size_t allocated_size);
+	
+	/**
+	 Wipes |size| bytes at |ptr|. Unlike memset(), the call is never optimized out
+	 by the compiler.
+	 */
+	void SecureMemory_Wipe(void * ptr, size_t size);
+	
+} // io::getlime::powerAuth::utils
+} // io::getlime::powerAuth
+} // io::getlime
+} // io
@@ -15,6 +15,16 @@
  */
 
 #include "URLEncoding.h"
+#include "KernelSelector.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+	#define PA_URLENC_X86
+	#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#define PA_URLENC_NEON
+	#include <arm_neon.h>
+#endif
 
 namespace io
 {
@@ -24,89 +34,400 @@ namespace powerAuth
 {
 namespace utils
 {
-	static size_t _URLEncodingEstimateResultLength(std::string::const_iterator begin, std::string::const_iterator end)
-	{
-		size_t result = 0;
-		bool escape = false;
-		while (begin != end) {
-			cc7::byte c = (cc7::byte)*begin++;
-			if ((c >= '0' && c <= '9') ||
-				(c >= 'A' && c <= 'Z') ||
-				(c >= 'a' && c <= 'z') ||
-				(c == '-' || c == '_' || c == '.' || c == '*')
-				)
-			{
-				result++;
+	// -------------------------------------------------------------------------------------------
+	// MARK: - Scalar implementation -
+	//
+
+	/**
+	 Table contains 1 for all characters which don't need to be escaped, e.g. [0-9A-Za-z] and "-_.*"
+	 */
+	static const cc7::byte s_unreserved_table[256] =
+	{
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 1, 0,
+		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+		0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 1,
+		0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+		1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	};
+
+	static const char s_hex_table[] = "0123456789ABCDEF";
+
+	/**
+	 Writes escaped character |c| to |out| and returns pointer behind the written sequence.
+	 */
+	static inline cc7::byte * _EscapeChar(cc7::byte c, cc7::byte * out)
+	{
+		if (c == ' ') {
+			// space is escaped with '+'
+			*out++ = '+';
+		} else {
+			// escaped characters, %XX
+			out[0] = '%';
+			out[1] = s_hex_table[c >> 4];
+			out[2] = s_hex_table[c & 0xF];
+			out += 3;
+		}
+		return out;
+	}
+
+	/**
+	 Returns number of bytes produced by encoding |size| bytes from |in|.
+	 */
+	static size_t _EncodedLengthScalar(const cc7::byte * in, size_t size)
+	{
+		size_t length = 0;
+		const cc7::byte * end = in + size;
+		while (in < end) {
+			cc7::byte c = *in++;
+			length += (s_unreserved_table[c] || c == ' ') ? 1 : 3;
+		}
+		return length;
+	}
+
+	/**
+	 Encodes |size| bytes from |in| to |out| and returns pointer behind the written sequence.
+	 */
+	static cc7::byte * _EncodeScalar(const cc7::byte * in, size_t size, cc7::byte * out)
+	{
+		const cc7::byte * end = in + size;
+		while (in < end) {
+			cc7::byte c = *in++;
+			if (s_unreserved_table[c]) {
+				*out++ = c;
+			} else {
+				out = _EscapeChar(c, out);
 			}
-			else if (c == ' ')
-			{
-				result++;
-				escape = true;
+		}
+		return out;
+	}
+
+	/**
+	 Finishes encoding of |width| bytes long block from |in|. The |unreserved| contains one bit per
+	 each character which doesn't need to be escaped and at least one bit must be cleared. The caller
+	 already stored the whole block to |out|, so the leading run of unreserved characters is already
+	 in place. Returns pointer behind the written sequence.
+	 */
+	static inline cc7::byte * _EncodeMaskedBlock(const cc7::byte * in, size_t width, cc7::U64 unreserved, cc7::byte * out)
+	{
+		// Bits of characters to escape, with the sentinel bit behind the end of block.
+		const cc7::U64 end_bit = 1ULL << width;
+		cc7::U64 escaped = (~unreserved & (end_bit - 1)) | end_bit;
+		size_t pos = __builtin_ctzll(escaped);
+		out += pos;
+		while (pos < width) {
+			out = _EscapeChar(in[pos], out);
+			escaped &= escaped - 1;
+			const size_t next = __builtin_ctzll(escaped);
+			const size_t run = next - pos - 1;
+			if (run > 0) {
+				memcpy(out, in + pos + 1, run);
+				out += run;
 			}
-			else
-			{
-				result += 3;	// %xx
-				escape = true;
+			pos = next;
+		}
+		return out;
+	}
+
+
+	// -------------------------------------------------------------------------------------------
+	// MARK: - SIMD implementation -
+	//
+
+	// Each kernel classifies whole block of characters at once. If there's no character to escape,
+	// then the block is stored to the output as it is. Otherwise the block is still stored, but
+	// the output pointer is moved only behind the leading run of unreserved characters and the rest
+	// of the block is finished in _EncodeMaskedBlock(). The speculative store is always safe, because
+	// each input character produces at least one output character, so the encoded block is never
+	// shorter than the block itself.
+	//
+	// The length kernels are counting characters to escape in the same blocks, so the exact length
+	// of encoded string can be determined cheaply, before the output buffer is allocated.
+
+	typedef size_t (*EncodeKernel)(const cc7::byte * in, size_t size, cc7::byte * & out);
+	typedef size_t (*LengthKernel)(const cc7::byte * in, size_t size, size_t & length);
+
+#if defined(PA_URLENC_X86)
+
+	#define PA_TARGET_SSE2	__attribute__((target("sse2")))
+	#define PA_TARGET_AVX2	__attribute__((target("avx2")))
+
+	PA_TARGET_SSE2
+	static inline __m128i _InRange_SSE2(__m128i c, char lo, char hi)
+	{
+		const __m128i t = _mm_sub_epi8(c, _mm_set1_epi8(lo));
+		return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(hi - lo)), t);
+	}
+
+	PA_TARGET_SSE2
+	static inline __m128i _Unreserved_SSE2(__m128i c)
+	{
+		// ASCII letters are folded to lowercase, so one range check is enough
+		__m128i r = _InRange_SSE2(_mm_or_si128(c, _mm_set1_epi8(0x20)), 'a', 'z');
+		r = _mm_or_si128(r, _InRange_SSE2(c, '0', '9'));
+		r = _mm_or_si128(r, _mm_cmpeq_epi8(c, _mm_set1_epi8('-')));
+		r = _mm_or_si128(r, _mm_cmpeq_epi8(c, _mm_set1_epi8('_')));
+		r = _mm_or_si128(r, _mm_cmpeq_epi8(c, _mm_set1_epi8('.')));
+		r = _mm_or_si128(r, _mm_cmpeq_epi8(c, _mm_set1_epi8('*')));
+		return r;
+	}
+
+	PA_TARGET_SSE2
+	static size_t _EncodeKernel_SSE2(const cc7::byte * in, size_t size, cc7::byte * & out)
+	{
+		size_t processed = 0;
+		while (size - processed >= 16) {
+			const __m128i c = _mm_loadu_si128((const __m128i*)(in + processed));
+			const cc7::U32 mask = (cc7::U32)_mm_movemask_epi8(_Unreserved_SSE2(c));
+			_mm_storeu_si128((__m128i*)out, c);
+			if (mask == 0xFFFF) {
+				out += 16;
+			} else {
+				out = _EncodeMaskedBlock(in + processed, 16, mask, out);
 			}
+			processed += 16;
 		}
-		return !escape ? 0 : result;
+		return processed;
 	}
-	
-	static inline cc7::byte _HexadecimalChar(cc7::byte c)
+
+	PA_TARGET_SSE2
+	static size_t _LengthKernel_SSE2(const cc7::byte * in, size_t size, size_t & length)
 	{
-		if (c < 10) {
-			return c + '0';
+		size_t processed = 0;
+		while (size - processed >= 16) {
+			const __m128i c = _mm_loadu_si128((const __m128i*)(in + processed));
+			const cc7::U32 escaped = ~(cc7::U32)_mm_movemask_epi8(_Unreserved_SSE2(c)) & 0xFFFF;
+			const cc7::U32 spaces  = (cc7::U32)_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8(' ')));
+			length += 16 + 2 * (__builtin_popcount(escaped) - __builtin_popcount(spaces));
+			processed += 16;
 		}
-		return 'A' - 10 + c;
+		return processed;
 	}
-	
-	cc7::ByteArray ConvertStringToUrlEncodedData(const std::string & str)
+
+	PA_TARGET_AVX2
+	static inline __m256i _InRange_AVX2(__m256i c, char lo, char hi)
 	{
-		if (str.size() == 0) {
-			return cc7::ByteArray();
+		const __m256i t = _mm256_sub_epi8(c, _mm256_set1_epi8(lo));
+		return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(hi - lo)), t);
+	}
+
+	PA_TARGET_AVX2
+	static inline __m256i _Unreserved_AVX2(__m256i c)
+	{
+		__m256i r = _InRange_AVX2(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), 'a', 'z');
+		r = _mm256_or_si256(r, _InRange_AVX2(c, '0', '9'));
+		r = _mm256_or_si256(r, _mm256_cmpeq_epi8(c, _mm256_set1_epi8('-')));
+		r = _mm256_or_si256(r, _mm256_cmpeq_epi8(c, _mm256_set1_epi8('_')));
+		r = _mm256_or_si256(r, _mm256_cmpeq_epi8(c, _mm256_set1_epi8('.')));
+		r = _mm256_or_si256(r, _mm256_cmpeq_epi8(c, _mm256_set1_epi8('*')));
+		return r;
+	}
+
+	PA_TARGET_AVX2
+	static size_t _EncodeKernel_AVX2(const cc7::byte * in, size_t size, cc7::byte * & out)
+	{
+		size_t processed = 0;
+		while (size - processed >= 32) {
+			const __m256i c = _mm256_loadu_si256((const __m256i*)(in + processed));
+			const cc7::U32 mask = (cc7::U32)_mm256_movemask_epi8(_Unreserved_AVX2(c));
+			_mm256_storeu_si256((__m256i*)out, c);
+			if (mask == 0xFFFFFFFF) {
+				out += 32;
+			} else {
+				out = _EncodeMaskedBlock(in + processed, 32, mask, out);
+			}
+			processed += 32;
 		}
-		
-		// Calculate expected length
-		size_t buffer_length = _URLEncodingEstimateResultLength(str.cbegin(), str.cend());
-		if (buffer_length == 0) {
-			// There's no escaping, we can return input string directly.
-			return cc7::ByteArray(str.cbegin(), str.cend());
+		return processed;
+	}
+
+	PA_TARGET_AVX2
+	static size_t _LengthKernel_AVX2(const cc7::byte * in, size_t size, size_t & length)
+	{
+		size_t processed = 0;
+		while (size - processed >= 32) {
+			const __m256i c = _mm256_loadu_si256((const __m256i*)(in + processed));
+			const cc7::U32 escaped = ~(cc7::U32)_mm256_movemask_epi8(_Unreserved_AVX2(c));
+			const cc7::U32 spaces  = (cc7::U32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(' ')));
+			length += 32 + 2 * (__builtin_popcount(escaped) - __builtin_popcount(spaces));
+			processed += 32;
 		}
-		
-		// Prepare buffer with expected length
-		cc7::ByteArray buffer;
-		buffer.reserve(buffer_length);
-		
-		// Convert to encoded string
-		auto it  = str.cbegin();
-		auto end = str.cend();
-		while (it != end) {
-			cc7::byte c = (cc7::byte)*it++;
-			if ((c >= '0' && c <= '9') ||
-				(c >= 'A' && c <= 'Z') ||
-				(c >= 'a' && c <= 'z') ||
-				(c == '-' || c == '_' || c == '.' || c == '*')
-				)
-			{
-				// no escape
-				buffer.push_back(c);
-			}
-			else if (c == ' ')
-			{
-				// space is escaped with '+'
-				buffer.push_back('+');
-			}
-			else
-			{
-				// escaped characters, %XX
-				buffer.push_back('%');
-				buffer.push_back(_HexadecimalChar((c >> 4) & 0xf));
-				buffer.push_back(_HexadecimalChar(c & 0xf));
+		return processed;
+	}
+
+	/**
+	 Selects the best available kernels for the current CPU.
+	 */
+	static void _SelectKernels(EncodeKernel & encode, LengthKernel & length)
+	{
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) {
+			encode = _EncodeKernel_AVX2;
+			length = _LengthKernel_AVX2;
+		} else if (__builtin_cpu_supports("sse2")) {
+			encode = _EncodeKernel_SSE2;
+			length = _LengthKernel_SSE2;
+		} else {
+			encode = nullptr;
+			length = nullptr;
+		}
+	}
+
+#elif defined(PA_URLENC_NEON)
+
+	static inline uint8x16_t _InRange_NEON(uint8x16_t c, cc7::byte lo, cc7::byte hi)
+	{
+		return vcleq_u8(vsubq_u8(c, vdupq_n_u8(lo)), vdupq_n_u8(hi - lo));
+	}
+
+	static inline cc7::U32 _MoveMask_NEON(uint8x16_t v)
+	{
+		// NEON has no movemask instruction, so keep one weighted bit per lane
+		// and then sum each half of the vector with pairwise additions.
+		static const cc7::byte weights[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+		const uint8x16_t bits = vandq_u8(v, vld1q_u8(weights));
+		uint8x8_t t = vpadd_u8(vget_low_u8(bits), vget_high_u8(bits));
+		t = vpadd_u8(t, t);
+		t = vpadd_u8(t, t);
+		return (cc7::U32)vget_lane_u8(t, 0) | ((cc7::U32)vget_lane_u8(t, 1) << 8);
+	}
+
+	static inline uint8x16_t _Unreserved_NEON(uint8x16_t c)
+	{
+		uint8x16_t r = _InRange_NEON(vorrq_u8(c, vdupq_n_u8(0x20)), 'a', 'z');
+		r = vorrq_u8(r, _InRange_NEON(c, '0', '9'));
+		r = vorrq_u8(r, vceqq_u8(c, vdupq_n_u8('-')));
+		r = vorrq_u8(r, vceqq_u8(c, vdupq_n_u8('_')));
+		r = vorrq_u8(r, vceqq_u8(c, vdupq_n_u8('.')));
+		r = vorrq_u8(r, vceqq_u8(c, vdupq_n_u8('*')));
+		return r;
+	}
+
+	static size_t _EncodeKernel_NEON(const cc7::byte * in, size_t size, cc7::byte * & out)
+	{
+		size_t processed = 0;
+		while (size - processed >= 16) {
+			const uint8x16_t c = vld1q_u8(in + processed);
+			vst1q_u8(out, c);
+			const cc7::U32 mask = _MoveMask_NEON(_Unreserved_NEON(c));
+			if (mask == 0xFFFF) {
+				out += 16;
+			} else {
+				out = _EncodeMaskedBlock(in + processed, 16, mask, out);
 			}
+			processed += 16;
+		}
+		return processed;
+	}
+
+	static size_t _LengthKernel_NEON(const cc7::byte * in, size_t size, size_t & length)
+	{
+		size_t processed = 0;
+		while (size - processed >= 16) {
+			const uint8x16_t c = vld1q_u8(in + processed);
+			const cc7::U32 escaped = ~_MoveMask_NEON(_Unreserved_NEON(c)) & 0xFFFF;
+			const cc7::U32 spaces  = _MoveMask_NEON(vceqq_u8(c, vdupq_n_u8(' ')));
+			length += 16 + 2 * (__builtin_popcount(escaped) - __builtin_popcount(spaces));
+			processed += 16;
+		}
+		return processed;
+	}
+
+	static void _SelectKernels(EncodeKernel & encode, LengthKernel & length)
+	{
+		encode = _EncodeKernel_NEON;
+		length = _LengthKernel_NEON;
+	}
+
+#else
+
+	static void _SelectKernels(EncodeKernel & encode, LengthKernel & length)
+	{
+		encode = nullptr;
+		length = nullptr;
+	}
+
+#endif // PA_URLENC_X86 / PA_URLENC_NEON
+
+	/**
+	 Structure keeping kernels selected for the current CPU.
+	 */
+	struct URLEncodingKernels
+	{
+		EncodeKernel encode;
+		LengthKernel length;
+
+		URLEncodingKernels()
+		{
+			_SelectKernels(encode, length);
 		}
-		return buffer;
+	};
+
+
+	// -------------------------------------------------------------------------------------------
+	// MARK: - Public interface -
+	//
+
+	size_t URLEncoding_EncodedLength(const cc7::ByteRange & str)
+	{
+		const cc7::byte * in = str.data();
+		const size_t size = str.size();
+		size_t processed = 0;
+		size_t length = 0;
+		// Vectorized part
+		const URLEncodingKernels & kernels = GetSelectedKernels<URLEncodingKernels>();
+		if (kernels.length) {
+			processed = kernels.length(in, size, length);
+		}
+		// Scalar tail
+		return length + _EncodedLengthScalar(in + processed, size - processed);
 	}
-	
+
+	size_t ConvertStringToUrlEncodedBuffer(const cc7::ByteRange & str, cc7::byte * out)
+	{
+		const cc7::byte * in = str.data();
+		const size_t size = str.size();
+		size_t processed = 0;
+		cc7::byte * p = out;
+		// Vectorized part
+		const URLEncodingKernels & kernels = GetSelectedKernels<URLEncodingKernels>();
+		if (kernels.encode) {
+			processed = kernels.encode(in, size, p);
+		}
+		// Scalar tail
+		p = _EncodeScalar(in + processed, size - processed, p);
+		return p - out;
+	}
+
+	void AppendUrlEncodedString(const std::string & str, cc7::ByteArray & out)
+	{
+		if (str.empty()) {
+			return;
+		}
+		// Count the bytes first, so only the exact size of output is allocated and zero filled.
+		const cc7::ByteRange range = cc7::MakeRange(str);
+		const size_t offset = out.size();
+		out.resize(offset + URLEncoding_EncodedLength(range));
+		ConvertStringToUrlEncodedBuffer(range, out.data() + offset);
+	}
+
+	cc7::ByteArray ConvertStringToUrlEncodedData(const std::string & str)
+	{
+		cc7::ByteArray result;
+		AppendUrlEncodedString(str, result);
+		return result;
+	}
+
 } // io::getlime::powerAuth::utils
 } // io::getlime::powerAuth
 } // io::getlime
@@ -26,6 +26,34 @@ namespace powerAuth
 {
 namespace utils
 {
+	/**
+	 Returns maximum number of bytes, which can be produced by URL encoding of |length| bytes long string.
+	 */
+	inline size_t URLEncoding_MaxEncodedLength(size_t length)
+	{
+		return length * 3;
+	}
+	
+	/**
+	 Returns exact number of bytes, which will be produced by URL encoding of |str|.
+	 */
+	size_t URLEncoding_EncodedLength(const cc7::ByteRange & str);
+	
+	/**
+	 Encodes |str| and stores the result into |out| buffer. The buffer must have capacity for at least
+	 `URLEncoding_EncodedLength(str)` bytes. If you don't want to calculate the exact length, then you can use
+	 `URLEncoding_MaxEncodedLength(str.size())` instead. Returns number of bytes written to the buffer.
+	 
+	 The input is processed in one pass and runs of characters which don't need to be escaped
+	 are copied to the output in blocks. The implementation uses SIMD instructions when they're
+	 available on the target CPU (AVX2 or SSE2 on Intel, NEON on ARM).
+	 */
+	size_t ConvertStringToUrlEncodedBuffer(const cc7::ByteRange & str, cc7::byte * out);
+	
+	/**
+	 Appends URL encoded |str| at the end of |out| byte array.
+	 */
+	void AppendUrlEncodedString(const std::string & str, cc7::ByteArray & out);
 
 	/**
 	 Converts UTF8 string into URL encoded data.
@@ -31,6 +31,9 @@ namespace powerAuthTests
 		// High level objects
 		CC7_ADD_UNIT_TEST(pa2DataWriterReaderTests, list);
 		CC7_ADD_UNIT_TEST(pa2SessionTests, list);
+		CC7_ADD_UNIT_TEST(pa2AsyncSessionTests, list);
+		CC7_ADD_UNIT_TEST(pa2SessionStateMigratorTests, list);
+		CC7_ADD_UNIT_TEST(pa2SessionStateBundleTests, list);
 		CC7_ADD_UNIT_TEST(pa2PasswordTests, list);
 		CC7_ADD_UNIT_TEST(pa2OtpUtilTests, list);
 		CC7_ADD_UNIT_TEST(pa2ECIESTests, list);
@@ -40,6 +43,7 @@ namespace powerAuthTests
 		CC7_ADD_UNIT_TEST(pa2CryptoAESTests, list);
 		CC7_ADD_UNIT_TEST(pa2CryptoHMACTests, list);
 		CC7_ADD_UNIT_TEST(pa2CryptoECDHKDFTests, list);
+		CC7_ADD_UNIT_TEST(pa2CryptoECCTests, list);
 		
 		// Protocol tests
 		CC7_ADD_UNIT_TEST(pa2ProtocolUtilsTests, list);
@@ -52,6 +56,7 @@ namespace powerAuthTests
 		
 		// Misc
 		CC7_ADD_UNIT_TEST(pa2CRC16Tests, list);
+		CC7_ADD_UNIT_TEST(pa2Base64Tests, list);
 
 		return list;
 	}
@@ -0,0 +1,259 @@
+/*
+ * Copyright 2019 Wultra s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cc7tests/CC7Tests.h>
+#include "crypto/CryptoUtils.h"
+#include <PowerAuth/AsyncSession.h>
+#include <PowerAuth/Password.h>
+
+using namespace cc7;
+using namespace cc7::tests;
+using namespace io::getlime::powerAuth;
+
+namespace io
+{
+namespace getlime
+{
+namespace powerAuthTests
+{
+	class pa2AsyncSessionTests : public UnitTest
+	{
+	public:
+
+		pa2AsyncSessionTests()
+		{
+			CC7_REGISTER_TEST_METHOD(testWorkerPoolExecutor)
+			CC7_REGISTER_TEST_METHOD(testEciesEncryption)
+			CC7_REGISTER_TEST_METHOD(testWrongState)
+			CC7_REGISTER_TEST_METHOD(testCancellation)
+			CC7_REGISTER_TEST_METHOD(testKeysCopyRelease)
+		}
+
+		EC_KEY *		_masterServerPrivateKey;
+		std::string		_masterServerPublicKeyStr;
+		SessionSetup	_setup;
+
+		void setUp() override
+		{
+			_masterServerPrivateKey = crypto::ECC_GenerateKeyPair();
+			ccstAssertNotNull(_masterServerPrivateKey);
+			_masterServerPublicKeyStr = crypto::ECC_ExportPublicKeyToB64(_masterServerPrivateKey);
+
+			_setup.applicationKey			= "MDEyMzQ1Njc4OUFCQ0RFRg==";
+			_setup.applicationSecret		= "QUJDREVGMDEyMzQ1Njc4OQ==";
+			_setup.masterServerPublicKey	= _masterServerPublicKeyStr;
+			_setup.sessionIdentifier		= 77;
+		}
+
+		void tearDown() override
+		{
+			EC_KEY_free(_masterServerPrivateKey);
+			_masterServerPrivateKey = nullptr;
+		}
+
+		/**
+		 Executor which keeps tasks until runAll() is called. Unlike the usual executor,
+		 the tasks are never released.
+		 */
+		struct RetainingExecutor : public Executor
+		{
+			std::vector<std::function<void()>> tasks;
+			
+			void execute(std::function<void()> task) override
+			{
+				tasks.push_back(task);
+			}
+			
+			void runAll()
+			{
+				for (auto & task : tasks) {
+					task();
+				}
+			}
+		};
+
+		// unit tests
+
+		void testWorkerPoolExecutor()
+		{
+			std::atomic<int> counter(0);
+			{
+				WorkerPoolExecutor executor(3);
+				ccstAssertEqual(executor.maxThreads(), (size_t)3);
+				for (int i = 0; i < 100; i++) {
+					executor.execute([&counter] { counter++; });
+				}
+				executor.waitUntilIdle();
+				ccstAssertEqual(counter.load(), 100);
+				// Schedule more tasks, destructor must wait for them
+				for (int i = 0; i < 100; i++) {
+					executor.execute([&counter] { counter++; });
+				}
+			}
+			ccstAssertEqual(counter.load(), 200);
+
+			WorkerPoolExecutor default_executor;
+			ccstAssertTrue(default_executor.maxThreads() >= 1);
+		}
+
+		void testEciesEncryption()
+		{
+			WorkerPoolExecutor executor(2);
+			Session session(_setup);
+			AsyncSession async_session(session, executor);
+
+			std::future<AsyncResult<ECIESEncryptedRequest>> request_future;
+			async_session.eciesEncryptRequest(ECIES_ApplicationScope, SignatureUnlockKeys(),
+											  cc7::MakeRange("/pa/test"), cc7::MakeRange("Hello async!"),
+											  MakeAsyncFutureCompletion(request_future));
+			auto request = request_future.get();
+			ccstAssertEqual(request.code, EC_Ok);
+			ccstAssertFalse(request.cancelled);
+			ccstAssertEqual(request.value.encryptor.sharedInfo1(), cc7::MakeRange("/pa/test"));
+
+			// Decrypt on "server" side and encrypt response
+			ECIESDecryptor decryptor(crypto::ECC_ExportPrivateKey(_masterServerPrivateKey),
+									 cc7::MakeRange("/pa/test"),
+									 crypto::SHA256(cc7::MakeRange(_setup.applicationSecret)));
+			cc7::ByteArray request_data;
+			ccstAssertEqual(decryptor.decryptRequest(request.value.cryptogram, request_data), EC_Ok);
+			ccstAssertEqual(request_data, cc7::MakeRange("Hello async!"));
+			ECIESCryptogram response;
+			ccstAssertEqual(decryptor.encryptResponse(cc7::MakeRange("Response"), response), EC_Ok);
+
+			// Decrypt response with callback
+			std::mutex lock;
+			std::condition_variable cond;
+			bool finished = false;
+			AsyncResult<cc7::ByteArray> response_result;
+			async_session.eciesDecryptResponse(request.value.encryptor, response, [&](AsyncResult<cc7::ByteArray> && result) {
+				std::lock_guard<std::mutex> guard(lock);
+				response_result = std::move(result);
+				finished = true;
+				cond.notify_one();
+			});
+			std::unique_lock<std::mutex> wait_lock(lock);
+			cond.wait(wait_lock, [&] { return finished; });
+			ccstAssertEqual(response_result.code, EC_Ok);
+			ccstAssertEqual(response_result.value, cc7::MakeRange("Response"));
+		}
+
+		void testWrongState()
+		{
+			WorkerPoolExecutor executor(1);
+			Session session(_setup);
+			AsyncSession async_session(session, executor);
+
+			std::future<AsyncResult<HTTPRequestDataSignature>> sign_future;
+			HTTPRequestData request(cc7::MakeRange("body"), "POST", "/hello/world");
+			async_session.signHTTPRequestData(request, SignatureUnlockKeys(), SF_Possession, MakeAsyncFutureCompletion(sign_future));
+			auto sign_result = sign_future.get();
+			ccstAssertEqual(sign_result.code, EC_WrongState);
+			ccstAssertFalse(sign_result.cancelled);
+
+			std::future<AsyncResult<ECIESEncryptedRequest>> ecies_future;
+			async_session.eciesEncryptRequest(ECIES_ActivationScope, SignatureUnlockKeys(), cc7::ByteRange(), cc7::MakeRange("data"),
+											  MakeAsyncFutureCompletion(ecies_future));
+			auto ecies_result = ecies_future.get();
+			ccstAssertEqual(ecies_result.code, EC_WrongState);
+			ccstAssertFalse(ecies_result.cancelled);
+		}
+
+		void testCancellation()
+		{
+			WorkerPoolExecutor executor(1);
+			Session session(_setup);
+			AsyncSession async_session(session, executor);
+
+			// Block the only worker until the operation is cancelled.
+			std::promise<void> gate;
+			std::shared_future<void> gate_future = gate.get_future().share();
+			executor.execute([gate_future] { gate_future.wait(); });
+
+			std::future<AsyncResult<ECIESEncryptedRequest>> cancelled_future;
+			auto operation = async_session.eciesEncryptRequest(ECIES_ApplicationScope, SignatureUnlockKeys(), cc7::ByteRange(), cc7::MakeRange("data"),
+															   MakeAsyncFutureCompletion(cancelled_future));
+			std::future<AsyncResult<ECIESEncryptedRequest>> normal_future;
+			async_session.eciesEncryptRequest(ECIES_ApplicationScope, SignatureUnlockKeys(), cc7::ByteRange(), cc7::MakeRange("data"),
+											  MakeAsyncFutureCompletion(normal_future));
+			// Operation with a single phase
+			std::future<AsyncResult<HTTPRequestDataSignature>> sign_future;
+			HTTPRequestData request(cc7::MakeRange("body"), "POST", "/hello/world");
+			auto sign_operation = async_session.signHTTPRequestData(request, SignatureUnlockKeys(), SF_Possession,
+																	MakeAsyncFutureCompletion(sign_future));
+			ccstAssertFalse(operation.isCancelled());
+			operation.cancel();
+			ccstAssertTrue(operation.isCancelled());
+			sign_operation.cancel();
+			gate.set_value();
+
+			auto cancelled_result = cancelled_future.get();
+			ccstAssertTrue(cancelled_result.cancelled);
+			ccstAssertEqual(cancelled_result.code, EC_WrongState);
+			ccstAssertTrue(cancelled_result.value.cryptogram.body.empty());
+
+			auto sign_result = sign_future.get();
+			ccstAssertTrue(sign_result.cancelled);
+			ccstAssertEqual(sign_result.code, EC_WrongState);
+			ccstAssertTrue(sign_result.value.signature.empty());
+
+			auto normal_result = normal_future.get();
+			ccstAssertFalse(normal_result.cancelled);
+			ccstAssertEqual(normal_result.code, EC_Ok);
+			ccstAssertFalse(normal_result.value.cryptogram.body.empty());
+		}
+
+		void testKeysCopyRelease()
+		{
+			RetainingExecutor executor;
+			Session session(_setup);
+			AsyncSession async_session(session, executor);
+
+			Password password;
+			password.initAsImmutable(cc7::MakeRange("correct horse battery staple"));
+			SignatureUnlockKeys keys;
+			keys.possessionUnlockKey = crypto::GetRandomData(16);
+			keys.userPasswordRange = password.passwordRange();
+			// The derivation handle is shared with the copy of keys, so it tells
+			// whether the copy still exists.
+			keys.userPasswordKey = password.startKeyDerivation(cc7::MakeRange("salt"), 1, executor);
+			ccstAssertNotNull(keys.userPasswordKey);
+			long use_count = keys.userPasswordKey.use_count();
+
+			std::future<AsyncResult<AsyncNoValue>> completed_future;
+			async_session.completeActivation(keys, MakeAsyncFutureCompletion(completed_future));
+			std::future<AsyncResult<ActivationStatus>> cancelled_future;
+			auto operation = async_session.decodeActivationStatus("", keys, MakeAsyncFutureCompletion(cancelled_future));
+			ccstAssertEqual(keys.userPasswordKey.use_count(), use_count + 2);
+			operation.cancel();
+			executor.runAll();
+
+			auto completed_result = completed_future.get();
+			ccstAssertEqual(completed_result.code, EC_WrongState);
+			ccstAssertFalse(completed_result.cancelled);
+			auto cancelled_result = cancelled_future.get();
+			ccstAssertEqual(cancelled_result.code, EC_WrongState);
+			ccstAssertTrue(cancelled_result.cancelled);
+			// Both copies are released and wiped, even if the executor keeps the tasks.
+			ccstAssertEqual(keys.userPasswordKey.use_count(), use_count);
+		}
+	};
+
+	CC7_CREATE_UNIT_TEST(pa2AsyncSessionTests, "pa2")
+
+} // io::getlime::powerAuthTests
+} // io::getlime
+} // io
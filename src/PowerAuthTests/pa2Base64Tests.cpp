@@ -0,0 +1,130 @@
+/*
+ * Copyright 2019 Wultra s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cc7tests/CC7Tests.h>
+#include <cc7/Base64.h>
+#include "../PowerAuth/utils/Base64.h"
+#include "../PowerAuth/crypto/CryptoUtils.h"
+
+using namespace cc7;
+using namespace cc7::tests;
+using namespace io::getlime::powerAuth;
+
+namespace io
+{
+namespace getlime
+{
+namespace powerAuthTests
+{
+	class pa2Base64Tests : public UnitTest
+	{
+	public:
+
+		pa2Base64Tests()
+		{
+			CC7_REGISTER_TEST_METHOD(testKnownVectors)
+			CC7_REGISTER_TEST_METHOD(testCompatibilityWithCC7)
+			CC7_REGISTER_TEST_METHOD(testInvalidInput)
+		}
+
+		// unit tests
+
+		void testKnownVectors()
+		{
+			// Test vectors from RFC 4648
+			static const char * vectors[] = {
+				"",       "",
+				"f",      "Zg==",
+				"fo",     "Zm8=",
+				"foo",    "Zm9v",
+				"foob",   "Zm9vYg==",
+				"fooba",  "Zm9vYmE=",
+				"foobar", "Zm9vYmFy",
+				nullptr,  nullptr
+			};
+			for (size_t i = 0; vectors[i] != nullptr; i += 2) {
+				std::string plain(vectors[i]);
+				std::string expected(vectors[i + 1]);
+				ccstAssertEqual(utils::Base64_Encode(cc7::MakeRange(plain)), expected);
+				cc7::ByteArray decoded;
+				ccstAssertTrue(utils::Base64_Decode(cc7::MakeRange(expected), decoded));
+				ccstAssertEqual(decoded, cc7::ByteArray(cc7::MakeRange(plain)));
+			}
+			// Whole alphabet
+			std::string alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+			cc7::ByteArray decoded = utils::Base64_Decode(cc7::MakeRange(alphabet));
+			ccstAssertEqual(decoded.size(), 48);
+			ccstAssertEqual(utils::Base64_Encode(decoded), alphabet);
+		}
+
+		void testCompatibilityWithCC7()
+		{
+			// Sizes are covering scalar tails and all SIMD block sizes
+			for (size_t size = 0; size < 600; size++) {
+				cc7::ByteArray data = crypto::GetRandomData(size);
+				std::string expected = cc7::ToBase64String(data);
+				std::string encoded = utils::Base64_Encode(data);
+				ccstAssertEqual(encoded, expected);
+				ccstAssertEqual(encoded.size(), utils::Base64_EncodedLength(size));
+				cc7::ByteArray decoded;
+				ccstAssertTrue(utils::Base64_Decode(cc7::MakeRange(encoded), decoded));
+				ccstAssertEqual(decoded, data);
+			}
+			// Large data
+			cc7::ByteArray data = crypto::GetRandomData(100000 + arc4random_uniform(100));
+			std::string encoded = utils::Base64_Encode(data);
+			ccstAssertEqual(encoded, cc7::ToBase64String(data));
+			ccstAssertEqual(utils::Base64_Decode(cc7::MakeRange(encoded)), data);
+		}
+
+		void testInvalidInput()
+		{
+			cc7::ByteArray out;
+			// Wrong length or wrong padding
+			static const char * wrong[] = {
+				"A", "AB", "ABC", "ABCDE", "====", "A===", "AB=C", "=ABC", "AB==CDEF", "ABC=DEFG", "Zm9vYmFy=", nullptr
+			};
+			for (size_t i = 0; wrong[i] != nullptr; i++) {
+				ccstAssertFalse(utils::Base64_Decode(cc7::MakeRange(wrong[i]), out), "Should fail for '%s'", wrong[i]);
+				ccstAssertTrue(out.empty());
+			}
+			// Each invalid character at each position must be detected. Test positions in both
+			// vectorized and scalar parts of the input.
+			std::string valid = utils::Base64_Encode(crypto::GetRandomData(150));
+			for (int c = 0; c < 256; c++) {
+				cc7::ByteArray reference;
+				std::string one_char(1, (char)c);
+				bool is_valid_char = utils::Base64_Decode(cc7::MakeRange(one_char + "AAA"), reference);
+				for (size_t pos = 0; pos < valid.size() - 4; pos += 1 + arc4random_uniform(5)) {
+					std::string modified = valid;
+					modified[pos] = (char)c;
+					bool cc7_result = cc7::Base64_Decode(modified, 0, reference);
+					bool result = utils::Base64_Decode(cc7::MakeRange(modified), out);
+					ccstAssertEqual(result, cc7_result, "Char 0x%02x at %d", c, (int)pos);
+					ccstAssertEqual(result, is_valid_char, "Char 0x%02x at %d", c, (int)pos);
+					if (result) {
+						ccstAssertEqual(out, reference);
+					}
+				}
+			}
+		}
+	};
+
+	CC7_CREATE_UNIT_TEST(pa2Base64Tests, "pa2")
+
+} // io::getlime::powerAuthTests
+} // io::getlime
+} // io
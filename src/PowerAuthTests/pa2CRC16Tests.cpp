@@ -38,6 +38,8 @@ namespace powerAuthTests
 		{
 			CC7_REGISTER_TEST_METHOD(testCalculate)
 			CC7_REGISTER_TEST_METHOD(testValidate)
+			CC7_REGISTER_TEST_METHOD(testLargeData)
+			CC7_REGISTER_TEST_METHOD(testCombine)
 		}
 		
 		// unit tests
@@ -73,6 +75,58 @@ namespace powerAuthTests
 			}
 		}
 		
+		// Simple, byte by byte implementation used as a reference
+		
+		static cc7::U16 referenceCRC16(const cc7::ByteRange & bytes)
+		{
+			cc7::U16 crc = 0;
+			for (cc7::byte b : bytes) {
+				crc ^= b;
+				for (int bit = 0; bit < 8; bit++) {
+					crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+				}
+			}
+			return crc;
+		}
+		
+		void testLargeData()
+		{
+			ccstAssertEqual(utils::CRC16_Calculate(cc7::MakeRange("123456789")), 0xBB3D);
+			// Sizes are covering all kernels and their tails
+			for (size_t size = 0; size < 1100; size += 1 + arc4random_uniform(3)) {
+				cc7::ByteArray data = crypto::GetRandomData(size);
+				const cc7::U16 expected = referenceCRC16(data);
+				ccstAssertEqual(utils::CRC16_Calculate(data), expected, "Size %d", (int)size);
+				// Incremental update
+				const size_t split = arc4random_uniform((cc7::U32)size + 1);
+				cc7::U16 crc = utils::CRC16_Update(0, data.byteRange().subRangeTo(split));
+				crc = utils::CRC16_Update(crc, data.byteRange().subRangeFrom(split));
+				ccstAssertEqual(crc, expected, "Size %d, split at %d", (int)size, (int)split);
+			}
+			cc7::ByteArray data = crypto::GetRandomData(1024 * 1024 + arc4random_uniform(100));
+			ccstAssertEqual(utils::CRC16_Calculate(data), referenceCRC16(data));
+		}
+		
+		void testCombine()
+		{
+			for (int i = 0; i < 200; i++) {
+				cc7::ByteArray data = crypto::GetRandomData(arc4random_uniform(1000));
+				const size_t split = arc4random_uniform((cc7::U32)data.size() + 1);
+				const cc7::U16 crc1 = utils::CRC16_Calculate(data.byteRange().subRangeTo(split));
+				const cc7::U16 crc2 = utils::CRC16_Calculate(data.byteRange().subRangeFrom(split));
+				ccstAssertEqual(utils::CRC16_Combine(crc1, crc2, data.size() - split), utils::CRC16_Calculate(data));
+			}
+			// Combine chunks processed independently
+			cc7::ByteArray data = crypto::GetRandomData(100000);
+			const size_t chunk_size = 4096;
+			cc7::U16 crc = 0;
+			for (size_t offset = 0; offset < data.size(); offset += chunk_size) {
+				auto chunk = data.byteRange().subRange(offset, std::min(chunk_size, data.size() - offset));
+				crc = utils::CRC16_Combine(crc, utils::CRC16_Calculate(chunk), chunk.size());
+			}
+			ccstAssertEqual(crc, utils::CRC16_Calculate(data));
+		}
+		
 	};
 	
 	CC7_CREATE_UNIT_TEST(pa2CRC16Tests, "pa2")
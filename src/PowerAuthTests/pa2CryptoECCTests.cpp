@@ -0,0 +1,195 @@
+/*
+ * Copyright 2019 Wultra s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <cc7tests/CC7Tests.h>
+#include "crypto/CryptoUtils.h"
+#include <thread>
+#include <atomic>
+
+using namespace cc7;
+using namespace cc7::tests;
+using namespace io::getlime::powerAuth;
+
+namespace io
+{
+namespace getlime
+{
+namespace powerAuthTests
+{
+	class pa2CryptoECCTests : public UnitTest
+	{
+	public:
+		
+		pa2CryptoECCTests()
+		{
+			CC7_REGISTER_TEST_METHOD(testSharedGroup)
+			CC7_REGISTER_TEST_METHOD(testConcurrentUse)
+			CC7_REGISTER_TEST_METHOD(testImportFromCoordinates)
+			CC7_REGISTER_TEST_METHOD(testValidateKeyPair)
+		}
+		
+		// unit tests
+		
+		void testSharedGroup()
+		{
+			const EC_GROUP * group = crypto::ECC_GetSharedGroup();
+			ccstAssertNotNull(group);
+			ccstAssertTrue(group == crypto::ECC_GetSharedGroup());
+			ccstAssertEqual(EC_GROUP_get_curve_name(group), NID_X9_62_prime256v1);
+			ccstAssertTrue(EC_GROUP_have_precompute_mult(group) == 1);
+			
+			// Keys created by all routines must use P-256
+			EC_KEY * key1 = crypto::ECC_GenerateKeyPair();
+			EC_KEY * key2 = crypto::ECC_GenerateKeyPair();
+			ccstAssertNotNull(key1);
+			ccstAssertNotNull(key2);
+			ccstAssertEqual(EC_GROUP_get_curve_name(EC_KEY_get0_group(key1)), NID_X9_62_prime256v1);
+			
+			// Export & import
+			ByteArray pub1 = crypto::ECC_ExportPublicKey(key1);
+			ByteArray pri2 = crypto::ECC_ExportPrivateKey(key2);
+			EC_KEY * pub_key1 = crypto::ECC_ImportPublicKey(nullptr, pub1);
+			EC_KEY * pri_key2 = crypto::ECC_ImportPrivateKey(nullptr, pri2);
+			ccstAssertNotNull(pub_key1);
+			ccstAssertNotNull(pri_key2);
+			ccstAssertEqual(crypto::ECC_ExportPublicKey(pub_key1), pub1);
+			ccstAssertEqual(EC_GROUP_get_curve_name(EC_KEY_get0_group(pri_key2)), NID_X9_62_prime256v1);
+			
+			// ECDH with imported keys must match ECDH with original keys
+			ByteArray secret1 = crypto::ECDH_SharedSecret(key1, key2);
+			ByteArray secret2 = crypto::ECDH_SharedSecret(pub_key1, pri_key2);
+			ccstAssertFalse(secret1.empty());
+			ccstAssertEqual(secret1, secret2);
+			
+			// Invalid public key
+			ByteArray wrong_pub = pub1;
+			wrong_pub[0] = 0x05;
+			ccstAssertNull(crypto::ECC_ImportPublicKey(nullptr, wrong_pub));
+			
+			EC_KEY_free(key1);
+			EC_KEY_free(key2);
+			EC_KEY_free(pub_key1);
+			EC_KEY_free(pri_key2);
+		}
+		
+		void testConcurrentUse()
+		{
+			const size_t threads_count = 8;
+			const size_t iterations = 50;
+			std::atomic<int> failures(0);
+			std::vector<std::thread> threads;
+			for (size_t t = 0; t < threads_count; t++) {
+				threads.push_back(std::thread([&]() {
+					for (size_t i = 0; i < iterations; i++) {
+						EC_KEY * key = crypto::ECC_GenerateKeyPair();
+						EC_KEY * pub_key = crypto::ECC_ImportPublicKey(nullptr, crypto::ECC_ExportPublicKey(key));
+						EC_KEY * pri_key = crypto::ECC_ImportPrivateKey(nullptr, crypto::ECC_ExportPrivateKey(key));
+						ByteArray signature;
+						bool result = key && pub_key && pri_key;
+						result = result && crypto::ECDSA_ComputeSignature(cc7::MakeRange("data"), key, signature);
+						result = result && crypto::ECDSA_ValidateSignature(cc7::MakeRange("data"), signature, pub_key);
+						result = result && crypto::ECDH_SharedSecret(pub_key, pri_key) == crypto::ECDH_SharedSecret(pub_key, key);
+						if (!result) {
+							failures++;
+						}
+						EC_KEY_free(key);
+						EC_KEY_free(pub_key);
+						EC_KEY_free(pri_key);
+					}
+				}));
+			}
+			for (auto && thread : threads) {
+				thread.join();
+			}
+			ccstAssertEqual(failures.load(), 0);
+		}
+		
+		void testImportFromCoordinates()
+		{
+			for (int i = 0; i < 32; i++) {
+				EC_KEY * key = crypto::ECC_GenerateKeyPair();
+				ccstAssertNotNull(key);
+				ByteArray public_key  = crypto::ECC_ExportPublicKey(key);
+				ByteArray coordinates = crypto::ECC_ExportPublicKeyToCoordinates(key);
+				ccstAssertEqual(coordinates.size(), 64);
+				// X coordinate is also in compressed key
+				ccstAssertEqual(coordinates.byteRange().subRangeTo(32), public_key.byteRange().subRangeFrom(1));
+				
+				EC_KEY * imported = crypto::ECC_ImportPublicKeyFromCoordinates(nullptr, coordinates);
+				ccstAssertNotNull(imported);
+				ccstAssertEqual(crypto::ECC_ExportPublicKey(imported), public_key);
+				ccstAssertEqual(crypto::ECC_ExportPublicKeyToCoordinates(imported), coordinates);
+				EC_KEY_free(imported);
+				// Import with the provided BN context
+				crypto::BNContext ctx;
+				imported = crypto::ECC_ImportPublicKeyFromCoordinates(nullptr, coordinates, ctx);
+				ccstAssertNotNull(imported);
+				ccstAssertEqual(crypto::ECC_ExportPublicKey(imported), public_key);
+				EC_KEY_free(imported);
+				
+				// Wrong length
+				ccstAssertNull(crypto::ECC_ImportPublicKeyFromCoordinates(nullptr, coordinates.byteRange().subRangeTo(63)));
+				ccstAssertNull(crypto::ECC_ImportPublicKeyFromCoordinates(nullptr, public_key));
+				// Point is not on the curve
+				ByteArray wrong_coordinates = coordinates;
+				wrong_coordinates[63] ^= 0x01;
+				ccstAssertNull(crypto::ECC_ImportPublicKeyFromCoordinates(nullptr, wrong_coordinates));
+				
+				EC_KEY_free(key);
+			}
+			ccstAssertTrue(crypto::ECC_ExportPublicKeyToCoordinates(nullptr).empty());
+		}
+		
+		void testValidateKeyPair()
+		{
+			for (int i = 0; i < 16; i++) {
+				EC_KEY * key = crypto::ECC_GenerateKeyPair();
+				ccstAssertNotNull(key);
+				EC_KEY * public_key = crypto::ECC_ImportPublicKey(nullptr, crypto::ECC_ExportPublicKey(key));
+				ccstAssertNotNull(public_key);
+				// Public key in uncompressed format
+				ByteArray uncompressed_public_key_data = { 0x04 };
+				uncompressed_public_key_data.append(crypto::ECC_ExportPublicKeyToCoordinates(key));
+				EC_KEY * uncompressed_public_key = crypto::ECC_ImportPublicKey(nullptr, uncompressed_public_key_data);
+				ccstAssertNotNull(uncompressed_public_key);
+				EC_KEY * private_key = crypto::ECC_ImportPrivateKey(nullptr, crypto::ECC_ExportPrivateKey(key));
+				ccstAssertNotNull(private_key);
+				ccstAssertTrue(crypto::ECC_ValidateKeyPair(private_key, public_key));
+				ccstAssertTrue(crypto::ECC_ValidateKeyPair(private_key, uncompressed_public_key));
+				EC_KEY_free(private_key);
+				
+				// Different scalar produces a different public key
+				ByteArray wrong_scalar = crypto::ECC_ExportPrivateKey(key);
+				wrong_scalar[wrong_scalar.size() - 1] ^= 0x01;
+				private_key = crypto::ECC_ImportPrivateKey(nullptr, wrong_scalar);
+				ccstAssertNotNull(private_key);
+				ccstAssertFalse(crypto::ECC_ValidateKeyPair(private_key, public_key));
+				ccstAssertFalse(crypto::ECC_ValidateKeyPair(private_key, nullptr));
+				ccstAssertFalse(crypto::ECC_ValidateKeyPair(nullptr, public_key));
+				EC_KEY_free(private_key);
+				EC_KEY_free(uncompressed_public_key);
+				EC_KEY_free(public_key);
+				EC_KEY_free(key);
+			}
+		}
+	};
+	
+	CC7_CREATE_UNIT_TEST(pa2CryptoECCTests, "pa2")
+	
+} // io::getlime::powerAuthTests
+} // io::getlime
+} // io
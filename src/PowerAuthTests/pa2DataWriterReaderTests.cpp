@@ -39,6 +39,9 @@ namespace powerAuthTests
 			CC7_REGISTER_TEST_METHOD(testReadWriteMethods)
 			CC7_REGISTER_TEST_METHOD(testNotEnoughData)
 			CC7_REGISTER_TEST_METHOD(testVersions)
+			CC7_REGISTER_TEST_METHOD(testMeasuringMode)
+			CC7_REGISTER_TEST_METHOD(testExternalBuffer)
+			CC7_REGISTER_TEST_METHOD(testReaderOwnership)
 		}
 		
 		// unit tests
@@ -342,6 +345,150 @@ namespace powerAuthTests
 			writer.reset();
 		}
 		
+		
+		// Measuring mode & external buffer
+		
+		void writeMixedSequence(DataWriter & writer, const ByteArray & data)
+		{
+			writer.openVersion('M', 1);
+			writer.writeCount(0x7F);
+			writer.writeCount(0x80);
+			writer.writeCount(0x3FFF);
+			writer.writeCount(0x4000);
+			writer.writeData(data);
+			writer.writeString(std::string(200, 'x'));
+			writer.openVersion('N', 2);
+			writer.writeByte(0xEE);
+			writer.writeU16(0xCCDD);
+			writer.writeU32(0x12345678);
+			writer.writeU64(0x12345678ccddeeffLL);
+			writer.writeMemory(data.byteRange().subRangeTo(data.size() / 2));
+			writer.closeVersion();
+			writer.closeVersion();
+		}
+		
+		void testMeasuringMode()
+		{
+			ccstAssertEqual(DataWriter::countSize(0), 1);
+			ccstAssertEqual(DataWriter::countSize(0x7F), 1);
+			ccstAssertEqual(DataWriter::countSize(0x80), 2);
+			ccstAssertEqual(DataWriter::countSize(0x3FFF), 2);
+			ccstAssertEqual(DataWriter::countSize(0x4000), 4);
+			ccstAssertEqual(DataWriter::countSize(DataWriter::maxCount()), 4);
+			ccstAssertEqual(DataWriter::countSize(DataWriter::maxCount() + 1), 0);
+			
+			const size_t sizes[] = { 0, 1, 0x7F, 0x80, 0x3FFF, 0x4000, 70000 };
+			for (size_t size : sizes) {
+				ByteArray data = getTestRandomData(size);
+				
+				DataWriter measure(DataWriter::MEASURE_ONLY);
+				writeMixedSequence(measure, data);
+				ccstAssertFalse(measure.hasOverflow());
+				ccstAssertTrue(measure.serializedData().empty());
+				
+				ByteArray reference;
+				DataWriter reference_writer(&reference);
+				writeMixedSequence(reference_writer, data);
+				ccstAssertEqual(measure.serializedSize(), reference.size());
+				ccstAssertEqual(reference_writer.serializedSize(), reference.size());
+				
+				// Reserved capacity must be enough for all data.
+				ByteArray exact;
+				DataWriter exact_writer(&exact);
+				exact_writer.reserve(measure.serializedSize());
+				const byte * ptr = exact.data();
+				writeMixedSequence(exact_writer, data);
+				ccstAssertEqual(exact, reference);
+				ccstAssertTrue(exact.data() == ptr);
+				
+				measure.reset();
+				ccstAssertEqual(measure.serializedSize(), 0);
+			}
+		}
+		
+		void testExternalBuffer()
+		{
+			ByteArray data = getTestRandomData(300);
+			ByteArray reference;
+			DataWriter reference_writer(&reference);
+			writeMixedSequence(reference_writer, data);
+			
+			// Exact capacity
+			ByteArray buffer(reference.size() + 16, 0xAA);
+			DataWriter writer(buffer.data(), reference.size());
+			writeMixedSequence(writer, data);
+			ccstAssertFalse(writer.hasOverflow());
+			ccstAssertEqual(writer.serializedSize(), reference.size());
+			ccstAssertTrue(writer.serializedData().empty());
+			ccstAssertEqual(buffer.byteRange().subRangeTo(reference.size()), reference.byteRange());
+			ccstAssertEqual(buffer.byteRange().subRangeFrom(reference.size()), ByteArray(16, 0xAA).byteRange());
+			
+			// Data is readable from the buffer
+			DataReader reader(buffer.byteRange().subRangeTo(writer.serializedSize()));
+			ccstAssertTrue(reader.openVersion('M', 1));
+			
+			// Not enough capacity
+			for (size_t capacity : { (size_t)0, (size_t)1, reference.size() / 2, reference.size() - 1 }) {
+				ByteArray small_buffer(reference.size(), 0xAA);
+				DataWriter small_writer(small_buffer.data(), capacity);
+				writeMixedSequence(small_writer, data);
+				ccstAssertTrue(small_writer.hasOverflow());
+				// Size of whole sequence is still reported
+				ccstAssertEqual(small_writer.serializedSize(), reference.size());
+				// Nothing is written behind the capacity
+				for (size_t i = capacity; i < small_buffer.size(); i++) {
+					ccstAssertEqual(small_buffer[i], 0xAA);
+				}
+				small_writer.reset();
+				ccstAssertFalse(small_writer.hasOverflow());
+			}
+		}
+		
+		void testReaderOwnership()
+		{
+			ByteArray data = getTestRandomData(0x4000);
+			ByteArray serialized;
+			DataWriter writer(&serialized);
+			writeMixedSequence(writer, data);
+			
+			// Moved array must not be copied
+			ByteArray moved = serialized;
+			const byte * moved_ptr = moved.data();
+			DataReader reader(std::move(moved));
+			ByteRange range;
+			ccstAssertTrue(reader.readMemoryRange(range, 2));
+			ccstAssertTrue(range.data() == moved_ptr);
+			
+			ByteArray moved_again = serialized;
+			moved_ptr = moved_again.data();
+			reader.resetWithNewByteArray(std::move(moved_again));
+			ccstAssertTrue(reader.readMemoryRange(range, 2));
+			ccstAssertTrue(range.data() == moved_ptr);
+			
+			// Views to the borrowed data
+			reader.resetWithNewByteRange(serialized.byteRange());
+			size_t count;
+			ccstAssertTrue(reader.openVersion('M', 1));
+			ccstAssertTrue(reader.readCount(count));
+			ccstAssertEqual(count, 0x7F);
+			ccstAssertTrue(reader.readCount(count));
+			ccstAssertEqual(count, 0x80);
+			ccstAssertTrue(reader.readCount(count));
+			ccstAssertEqual(count, 0x3FFF);
+			ccstAssertTrue(reader.readCount(count));
+			ccstAssertEqual(count, 0x4000);
+			ccstAssertTrue(reader.readRange(range, data.size()));
+			ccstAssertEqual(range, data.byteRange());
+			ccstAssertTrue(range.data() >= serialized.data() && range.data() < serialized.data() + serialized.size());
+			ccstAssertTrue(reader.readStringRange(range));
+			ccstAssertEqual(range, ByteRange(std::string(200, 'x').data(), 200));
+			
+			// Truncated count must not move the reading offset
+			reader.resetWithNewByteRange(serialized.byteRange().subRange(4, 1));
+			ccstAssertFalse(reader.readCount(count));
+			ccstAssertEqual(reader.currentOffset(), 0);
+		}
+		
 	};
 	
 	CC7_CREATE_UNIT_TEST(pa2DataWriterReaderTests, "pa2")
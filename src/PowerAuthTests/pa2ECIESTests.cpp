@@ -47,6 +47,8 @@ namespace powerAuthTests
 		{
 			CC7_REGISTER_TEST_METHOD(testEncryptorDecryptor)
 			CC7_REGISTER_TEST_METHOD(testInvalidCurve)
+			CC7_REGISTER_TEST_METHOD(testRetryContext)
+			CC7_REGISTER_TEST_METHOD(testJSONCodec)
 		}
 		
 		void testEncryptorDecryptor()
@@ -182,6 +184,160 @@ namespace powerAuthTests
 			auto code = encryptor.encryptRequest(cc7::MakeRange("should not be encrypted"), cryptogram);
 			ccstAssertTrue(code == EC_Encryption);
 		}
+		
+		void testRetryContext()
+		{
+			EC_KEY * master_keypair = crypto::ECC_GenerateKeyPair();
+			cc7::ByteArray master_public_key = crypto::ECC_ExportPublicKey(master_keypair);
+			cc7::ByteArray master_private_key = crypto::ECC_ExportPrivateKey(master_keypair);
+			EC_KEY_free(master_keypair);
+			
+			auto shared_info1 = cc7::MakeRange("/pa/retry");
+			auto shared_info2 = cc7::MakeRange("retry-sh2");
+			auto client_encryptor = ECIESEncryptor(master_public_key, shared_info1, shared_info2);
+			auto server_decryptor = ECIESDecryptor(master_private_key, shared_info1, shared_info2);
+			
+			ECIESCryptogram request;
+			ccstAssertEqual(client_encryptor.encryptRequest(cc7::MakeRange("idempotent request"), request), EC_Ok);
+			ECIESRetryContext context(client_encryptor, request, 3, std::chrono::seconds(60));
+			ccstAssertTrue(context.isValid());
+			ccstAssertTrue(context.hasKeys());
+			ccstAssertEqual(context.remainingAttempts(), 3);
+			
+			// Re-send the same cryptogram
+			ECIESCryptogram resent;
+			ccstAssertEqual(context.requestCryptogram(resent), EC_Ok);
+			ccstAssertEqual(resent.key, request.key);
+			ccstAssertEqual(resent.body, request.body);
+			ccstAssertEqual(resent.mac, request.mac);
+			ccstAssertEqual(context.remainingRequests(), 2);
+			ccstAssertEqual(context.remainingAttempts(), 3);
+			
+			cc7::ByteArray server_data;
+			ccstAssertEqual(server_decryptor.decryptRequest(resent, server_data), EC_Ok);
+			ccstAssertEqual(server_data, cc7::MakeRange("idempotent request"));
+			ECIESCryptogram response;
+			ccstAssertEqual(server_decryptor.encryptResponse(cc7::MakeRange("Response data"), response), EC_Ok);
+			
+			// Damaged response, transport problem
+			ECIESCryptogram damaged = response;
+			damaged.body[0] ^= 0x11;
+			cc7::ByteArray client_data;
+			ccstAssertEqual(context.decryptResponse(damaged, client_data), EC_Encryption);
+			ccstAssertEqual(context.remainingAttempts(), 2);
+			ccstAssertTrue(context.hasKeys());
+			// Re-fetched response
+			ccstAssertEqual(context.decryptResponse(response, client_data), EC_Ok);
+			ccstAssertEqual(client_data, cc7::MakeRange("Response data"));
+			// Context is invalidated after the successful decryption
+			ccstAssertFalse(context.isValid());
+			ccstAssertFalse(context.hasKeys());
+			ccstAssertEqual(context.decryptResponse(response, client_data), EC_WrongState);
+			ccstAssertEqual(context.requestCryptogram(resent), EC_WrongState);
+			
+			// Attempts exhausted
+			ECIESRetryContext context2(client_encryptor, request, 1, std::chrono::seconds(60));
+			ccstAssertEqual(context2.decryptResponse(damaged, client_data), EC_Encryption);
+			ccstAssertFalse(context2.isValid());
+			ccstAssertFalse(context2.hasKeys());
+			ccstAssertEqual(context2.decryptResponse(response, client_data), EC_WrongState);
+			// Response to the re-sent request is decrypted even with a single attempt
+			ECIESRetryContext context6(client_encryptor, request, 1, std::chrono::seconds(60));
+			ccstAssertEqual(context6.requestCryptogram(resent), EC_Ok);
+			ccstAssertEqual(resent.body, request.body);
+			ccstAssertEqual(context6.requestCryptogram(resent), EC_WrongState);
+			ccstAssertTrue(context6.isValid());
+			ccstAssertTrue(context6.hasKeys());
+			ccstAssertEqual(context6.decryptResponse(response, client_data), EC_Ok);
+			ccstAssertEqual(client_data, cc7::MakeRange("Response data"));
+			ccstAssertFalse(context6.hasKeys());
+			
+			// Expired context
+			ECIESRetryContext context3(client_encryptor, request, 10, std::chrono::milliseconds(0));
+			ccstAssertFalse(context3.isValid());
+			ccstAssertEqual(context3.remainingAttempts(), 0);
+			ccstAssertEqual(context3.decryptResponse(response, client_data), EC_WrongState);
+			
+			// Invalid encryptor
+			ECIESEncryptor empty_encryptor;
+			ECIESRetryContext context4(empty_encryptor, request, 10, std::chrono::seconds(60));
+			ccstAssertFalse(context4.isValid());
+			ccstAssertFalse(context4.hasKeys());
+			ECIESRetryContext context5;
+			ccstAssertFalse(context5.isValid());
+			ccstAssertFalse(context5.hasKeys());
+		}
+		
+		void testJSONCodec()
+		{
+			ECIESCryptogram request;
+			request.key  = cc7::FromHexString("02B70BF043C144935756F8F4578C369CF960EE510A5A0F90E93A373A21F0D1397F");
+			request.body = cc7::FromHexString("FBFF00112233445566778899AABBCCDDEEFF");
+			request.mac  = cc7::FromHexString("000102030405060708090A0B0C0D0E0F101112131415161718191A1B1C1D1E1F");
+			
+			// Encode to caller's buffer
+			std::string expected = "{\"ephemeralPublicKey\":\"" + request.key.base64String() +
+									"\",\"encryptedData\":\"" + request.body.base64String() +
+									"\",\"mac\":\"" + request.mac.base64String() + "\"}";
+			ccstAssertEqual(ECIESCryptogram_JSONSize(request), expected.size());
+			cc7::byte buffer[256];
+			size_t size = 0;
+			ccstAssertEqual(ECIESCryptogram_EncodeJSON(request, buffer, 10, size), EC_WrongParam);
+			ccstAssertEqual(size, expected.size());
+			ccstAssertEqual(ECIESCryptogram_EncodeJSON(request, buffer, sizeof(buffer), size), EC_Ok);
+			ccstAssertEqual(std::string((const char*)buffer, size), expected);
+			
+			// Round trip
+			ECIESCryptogram decoded;
+			ccstAssertEqual(ECIESCryptogram_DecodeJSON(cc7::ByteRange(buffer, size), decoded), EC_Ok);
+			ccstAssertEqual(decoded.key, request.key);
+			ccstAssertEqual(decoded.body, request.body);
+			ccstAssertEqual(decoded.mac, request.mac);
+			
+			// Response without key, into byte array
+			ECIESCryptogram response;
+			response.body = request.body;
+			response.mac = request.mac;
+			cc7::ByteArray json;
+			ccstAssertEqual(ECIESCryptogram_EncodeJSON(response, json), EC_Ok);
+			ccstAssertEqual(cc7::CopyToString(json), "{\"encryptedData\":\"" + request.body.base64String() + "\",\"mac\":\"" + request.mac.base64String() + "\"}");
+			// Decoding reuses capacity of the arrays
+			const cc7::byte * body_ptr = decoded.body.data();
+			ccstAssertEqual(ECIESCryptogram_DecodeJSON(json, decoded), EC_Ok);
+			ccstAssertTrue(decoded.key.empty());
+			ccstAssertEqual(decoded.body, request.body);
+			ccstAssertEqual(decoded.mac, request.mac);
+			ccstAssertTrue(body_ptr == decoded.body.data());
+			
+			// Formatting produced by platform encoders
+			std::string formatted = " {\n  \"mac\" : \"" + request.mac.base64String() + "\",\n"
+									"  \"encryptedData\" : \"+\\/8AESIzRFVmd4iZqrvM3e7\\/\",\n"
+									"  \"ephemeralPublicKey\" : null,\n  \"status\" : \"OK\", \"count\": 12, \"ok\": true\n} ";
+			ccstAssertEqual(ECIESCryptogram_DecodeJSON(cc7::MakeRange(formatted), decoded), EC_Ok);
+			ccstAssertTrue(decoded.key.empty());
+			ccstAssertEqual(decoded.body, request.body);
+			ccstAssertEqual(decoded.mac, request.mac);
+			ccstAssertEqual(ECIESCryptogram_DecodeJSON(cc7::MakeRange("{}"), decoded), EC_Ok);
+			ccstAssertTrue(decoded.body.empty());
+			
+			// Invalid envelopes
+			const char * invalid[] = {
+				"", "[]", "{", "{\"mac\":\"AA==\"", "{\"mac\":\"A\"}", "{\"mac\":12}",
+				"{\"mac\":\"AA==\"} x", "{\"mac\":\"AA\\n==\"}", "{\"a\":{}}", "{\"mac\":\"AA==\",}",
+				"{\"mac\" \"AA==\"}", "{\"mac\":\"AA==", nullptr
+			};
+			for (const char ** p = invalid; *p; p++) {
+				ccstAssertEqual(ECIESCryptogram_DecodeJSON(cc7::MakeRange(*p), decoded), EC_WrongParam, "Envelope: %s", *p);
+				ccstAssertTrue(decoded.mac.empty());
+			}
+			
+			// Large body
+			cc7::ByteArray large_body(4096, 0xA5);
+			request.body = large_body;
+			ccstAssertEqual(ECIESCryptogram_EncodeJSON(request, json), EC_Ok);
+			ccstAssertEqual(ECIESCryptogram_DecodeJSON(json, decoded), EC_Ok);
+			ccstAssertEqual(decoded.body, large_body);
+		}
 	};
 	
 	CC7_CREATE_UNIT_TEST(pa2ECIESTests, "pa2")
@@ -21,6 +21,10 @@
 #include <cc7/Base32.h>
 #include <cc7/Endian.h>
 #include "../PowerAuth/utils/CRC16.h"
+#include "../PowerAuth/crypto/CryptoUtils.h"
+#include "../PowerAuth/protocol/ProtocolUtils.h"
+#include <memory>
+#include <set>
 
 using namespace cc7;
 using namespace cc7::tests;
@@ -45,6 +49,9 @@ namespace powerAuthTests
 			CC7_REGISTER_TEST_METHOD(testRecoveryCodeValidation)
 			CC7_REGISTER_TEST_METHOD(testRecoveryPukValidation)
 			CC7_REGISTER_TEST_METHOD(testRecoveryCodeParser)
+			CC7_REGISTER_TEST_METHOD(testBatchValidation)
+			CC7_REGISTER_TEST_METHOD(testActivationCodeGenerator)
+			CC7_REGISTER_TEST_METHOD(testRecoveryCodeGenerator)
 			CC7_REGISTER_TEST_METHOD(niceCodeGenerator)
 		}
 		
@@ -378,6 +385,176 @@ namespace powerAuthTests
 			ccstAssertFalse(result);
 		}
 		
+		// Batch validation
+		
+		static std::string makeCode(const cc7::ByteRange & data)
+		{
+			ByteArray bytes(data);
+			auto check_sum = cc7::ToBigEndian(utils::CRC16_Calculate(bytes));
+			bytes.append(cc7::MakeRange(check_sum));
+			auto code = cc7::ToBase32String(bytes, false);
+			return code.substr(0, 5) + "-" + code.substr(5, 5) + "-" + code.substr(10, 5) + "-" + code.substr(15, 5);
+		}
+		
+		static std::vector<std::string> makeCodes(size_t count)
+		{
+			// Every second code is valid, the others have one random character modified.
+			static const char * alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567-#a01";
+			std::vector<std::string> codes;
+			codes.reserve(count);
+			for (size_t i = 0; i < count; i++) {
+				std::string code = makeCode(crypto::GetRandomData(10));
+				if (i & 1) {
+					code[arc4random_uniform((cc7::U32)code.length())] = alphabet[arc4random_uniform(37)];
+				}
+				codes.push_back(code);
+			}
+			return codes;
+		}
+		
+		// The original implementation, used as a reference
+		static bool referenceValidateActivationCode(const std::string & code)
+		{
+			if (code.length() != 23) {
+				return false;
+			}
+			std::string code_base32;
+			for (size_t i = 0; i < code.length(); i++) {
+				if ((i % 6) == 5) {
+					if (code[i] != '-') {
+						return false;
+					}
+				} else {
+					code_base32.push_back(code[i]);
+				}
+			}
+			cc7::ByteArray code_bytes;
+			if (!cc7::Base32_Decode(code_base32, false, code_bytes)) {
+				return false;
+			}
+			return utils::CRC16_Validate(code_bytes);
+		}
+		
+		void testBatchValidation()
+		{
+			std::vector<std::string> codes = makeCodes(40000);
+			std::vector<bool> expected;
+			size_t expected_valid_count = 0;
+			for (auto && code : codes) {
+				bool valid = referenceValidateActivationCode(code);
+				ccstAssertEqual(OtpUtil::validateActivationCode(code), valid, "Code %s", code.c_str());
+				expected.push_back(valid);
+				expected_valid_count += valid;
+			}
+			ccstAssertTrue(expected_valid_count >= 20000);
+			
+			const size_t max_threads[] = { 1, 4, 0 };
+			for (size_t threads : max_threads) {
+				std::unique_ptr<bool[]> results(new bool[codes.size()]);
+				size_t valid_count = OtpUtil::validateActivationCodes(codes, results.get(), threads);
+				ccstAssertEqual(valid_count, expected_valid_count);
+				for (size_t i = 0; i < codes.size(); i++) {
+					ccstAssertEqual(results[i], expected[i]);
+				}
+				ccstAssertEqual(OtpUtil::validateActivationCodes(codes, nullptr, threads), expected_valid_count);
+				ccstAssertEqual(OtpUtil::validateActivationCodes(codes.data(), codes.size(), nullptr, threads), expected_valid_count);
+			}
+			// Empty batch
+			ccstAssertEqual(OtpUtil::validateActivationCodes(std::vector<std::string>()), 0);
+		}
+		
+		// Generators
+		
+		void testActivationCodeGenerator()
+		{
+			EC_KEY * master_key = crypto::ECC_GenerateKeyPair();
+			cc7::ByteArray master_private_key = crypto::ECC_ExportPrivateKey(master_key);
+			
+			// Codes without signature
+			std::vector<OtpComponents> codes;
+			ccstAssertTrue(OtpUtil::generateActivationCodes(1234, 0, 20000, cc7::ByteRange(), codes));
+			ccstAssertEqual(codes.size(), 20000);
+			std::set<std::string> unique_codes;
+			for (auto && code : codes) {
+				ccstAssertTrue(OtpUtil::validateActivationCode(code.activationCode), "Code %s", code.activationCode.c_str());
+				ccstAssertTrue(referenceValidateActivationCode(code.activationCode));
+				ccstAssertFalse(code.hasSignature());
+				unique_codes.insert(code.activationCode);
+			}
+			ccstAssertEqual(unique_codes.size(), codes.size());
+			
+			// The same codes must be produced in multiple threads and in smaller batches
+			std::vector<OtpComponents> codes_mt;
+			ccstAssertTrue(OtpUtil::generateActivationCodes(1234, 0, 20000, cc7::ByteRange(), codes_mt, 0));
+			std::vector<OtpComponents> codes_batch;
+			ccstAssertTrue(OtpUtil::generateActivationCodes(1234, 100, 50, cc7::ByteRange(), codes_batch, 4));
+			for (size_t i = 0; i < codes.size(); i++) {
+				ccstAssertEqual(codes[i].activationCode, codes_mt[i].activationCode);
+			}
+			for (size_t i = 0; i < codes_batch.size(); i++) {
+				ccstAssertEqual(codes[100 + i].activationCode, codes_batch[i].activationCode);
+			}
+			// Different seed produces different codes
+			std::vector<OtpComponents> codes_other;
+			ccstAssertTrue(OtpUtil::generateActivationCodes(1235, 0, 10, cc7::ByteRange(), codes_other));
+			ccstAssertNotEqual(codes_other[0].activationCode, codes[0].activationCode);
+			
+			// Signed codes
+			std::vector<OtpComponents> signed_codes;
+			ccstAssertTrue(OtpUtil::generateActivationCodes(1234, 0, 200, master_private_key, signed_codes, 0));
+			for (size_t i = 0; i < signed_codes.size(); i++) {
+				const OtpComponents & code = signed_codes[i];
+				ccstAssertEqual(code.activationCode, codes[i].activationCode);
+				ccstAssertTrue(code.hasSignature());
+				ccstAssertTrue(protocol::ValidateActivationCodeSignature(code.activationCode, code.activationSignature, master_key));
+				// Parser must accept the combined string
+				OtpComponents parsed;
+				ccstAssertTrue(OtpUtil::parseActivationCode(code.activationCode + "#" + code.activationSignature, parsed));
+				ccstAssertEqual(parsed.activationSignature, code.activationSignature);
+			}
+			
+			// Count which is not a multiple of the batch size, with many threads. The rounded batch size
+			// (65 codes in 100 threads) would cover more than 6401 codes, so the last threads have no work.
+			std::vector<OtpComponents> signed_codes_mt;
+			ccstAssertTrue(OtpUtil::generateActivationCodes(1234, 0, 6401, master_private_key, signed_codes_mt, 100));
+			ccstAssertEqual(signed_codes_mt.size(), 6401);
+			for (size_t i = 0; i < signed_codes_mt.size(); i++) {
+				ccstAssertEqual(signed_codes_mt[i].activationCode, codes[i].activationCode);
+				ccstAssertTrue(signed_codes_mt[i].hasSignature());
+			}
+			const OtpComponents & last_code = signed_codes_mt.back();
+			ccstAssertTrue(protocol::ValidateActivationCodeSignature(last_code.activationCode, last_code.activationSignature, master_key));
+			
+			// Signatures must not be valid for a different master key
+			EC_KEY * other_key = crypto::ECC_GenerateKeyPair();
+			ccstAssertFalse(protocol::ValidateActivationCodeSignature(signed_codes[0].activationCode, signed_codes[0].activationSignature, other_key));
+			
+			EC_KEY_free(other_key);
+			EC_KEY_free(master_key);
+		}
+		
+		void testRecoveryCodeGenerator()
+		{
+			std::vector<std::string> codes, codes_with_prefix;
+			OtpUtil::generateRecoveryCodes(42, 1000, 10000, false, codes);
+			OtpUtil::generateRecoveryCodes(42, 1000, 10000, true, codes_with_prefix, 0);
+			ccstAssertEqual(codes.size(), 10000);
+			ccstAssertEqual(codes_with_prefix.size(), 10000);
+			OtpComponents components;
+			for (size_t i = 0; i < codes.size(); i++) {
+				ccstAssertTrue(OtpUtil::validateRecoveryCode(codes[i], false));
+				ccstAssertTrue(OtpUtil::validateRecoveryCode(codes_with_prefix[i]));
+				ccstAssertTrue(OtpUtil::parseRecoveryCode(codes_with_prefix[i], components));
+				ccstAssertEqual(components.activationCode, codes[i]);
+			}
+			// Recovery codes are generated in the same way as activation codes
+			std::vector<OtpComponents> activation_codes;
+			ccstAssertTrue(OtpUtil::generateActivationCodes(42, 1000, 10, cc7::ByteRange(), activation_codes));
+			for (size_t i = 0; i < activation_codes.size(); i++) {
+				ccstAssertEqual(activation_codes[i].activationCode, codes[i]);
+			}
+		}
+		
 		//////
 		
 		void niceCodeGenerator()
@@ -16,6 +16,13 @@
 
 #include <cc7tests/CC7Tests.h>
 #include <PowerAuth/Password.h>
+#include <PowerAuth/Executor.h>
+#include "protocol/ProtocolUtils.h"
+#include "utils/SecureMemory.h"
+#include <unistd.h>
+#include <string.h>
+#include <vector>
+#include <thread>
 
 using namespace cc7;
 using namespace cc7::tests;
@@ -36,8 +43,32 @@ namespace powerAuthTests
 			CC7_REGISTER_TEST_METHOD(testImmutable)
 			CC7_REGISTER_TEST_METHOD(testMutableNumbers)
 			CC7_REGISTER_TEST_METHOD(testMutableUnicode)
+			CC7_REGISTER_TEST_METHOD(testMutableRandomEdits)
+			CC7_REGISTER_TEST_METHOD(testSpeculativeKeyDerivation)
+			CC7_REGISTER_TEST_METHOD(testSecureStorage)
 		}
 		
+		/**
+		 Executor which keeps tasks until runAll() is called.
+		 */
+		struct DeferredExecutor : public Executor
+		{
+			std::vector<std::function<void()>> tasks;
+			
+			void execute(std::function<void()> task) override
+			{
+				tasks.push_back(task);
+			}
+			
+			void runAll()
+			{
+				for (auto & task : tasks) {
+					task();
+				}
+				tasks.clear();
+			}
+		};
+		
 		// unit tests
 
 		void testImmutable()
@@ -46,7 +77,7 @@ namespace powerAuthTests
 			p1.initAsImmutable(cc7::MakeRange("HelloWorld"));
 			ccstAssertFalse(p1.isMutable());
 			ccstAssertEqual(p1.length(), 10);
-			ccstAssertEqual(p1.passwordData().byteRange(), cc7::MakeRange("HelloWorld"));
+			ccstAssertEqual(p1.passwordData(), cc7::MakeRange("HelloWorld"));
 			
 			Password p2;
 			p2.initAsImmutable(cc7::MakeRange("HelloWorld"));
@@ -170,6 +201,219 @@ namespace powerAuthTests
 			ccstAssertEqual(p1.length(), 7);
 		}
 		
+		static void appendUTF8(cc7::U32 c, cc7::ByteArray & out)
+		{
+			if (c < 0x80) {
+				out.push_back(c);
+			} else if (c < 0x800) {
+				out.push_back(0xC0 | (c >> 6));
+				out.push_back(0x80 | (c & 0x3F));
+			} else if (c < 0x10000) {
+				out.push_back(0xE0 | (c >> 12));
+				out.push_back(0x80 | ((c >> 6) & 0x3F));
+				out.push_back(0x80 | (c & 0x3F));
+			} else {
+				out.push_back(0xF0 | (c >> 18));
+				out.push_back(0x80 | ((c >> 12) & 0x3F));
+				out.push_back(0x80 | ((c >> 6) & 0x3F));
+				out.push_back(0x80 | (c & 0x3F));
+			}
+		}
+		
+		void testMutableRandomEdits()
+		{
+			static const cc7::U32 codepoints[] = { 'a', 'Z', '0', 0x397, 0x206, 0x20AC, 0x1F600 };
+			const size_t codepoints_count = sizeof(codepoints) / sizeof(codepoints[0]);
+			
+			Password p1;
+			p1.initAsMutable();
+			std::vector<cc7::U32> expected;
+			size_t cursor = 0;
+			// Enough operations to grow the storage several times.
+			for (size_t i = 0; i < 20000; i++) {
+				cc7::U32 op = arc4random_uniform(10);
+				if (arc4random_uniform(8) == 0) {
+					// Jump to a random position
+					cursor = expected.empty() ? 0 : arc4random_uniform((cc7::U32)expected.size() + 1);
+				}
+				if (op < 6 || expected.empty()) {
+					cc7::U32 c = codepoints[arc4random_uniform(codepoints_count)];
+					ccstAssertTrue(p1.insertCharacter(c, cursor));
+					expected.insert(expected.begin() + cursor, c);
+					cursor++;
+				} else if (op < 8 && cursor > 0) {
+					// Backspace
+					cursor--;
+					ccstAssertTrue(p1.removeCharacter(cursor));
+					expected.erase(expected.begin() + cursor);
+				} else if (cursor < expected.size()) {
+					// Delete
+					ccstAssertTrue(p1.removeCharacter(cursor));
+					expected.erase(expected.begin() + cursor);
+				}
+				ccstAssertEqual(p1.length(), expected.size());
+				if ((i & 0x3FF) == 0 || i > 19990) {
+					cc7::ByteArray expected_data;
+					for (auto c : expected) {
+						appendUTF8(c, expected_data);
+					}
+					ccstAssertEqual(p1.passwordData(), expected_data);
+					ccstAssertTrue(p1.passwordRange() == expected_data);
+				}
+			}
+			ccstAssertFalse(p1.insertCharacter('x', p1.length() + 1));
+			ccstAssertFalse(p1.removeCharacter(p1.length()));
+			
+			// Concurrent reads after the edit in the middle of the passphrase
+			ccstAssertTrue(p1.insertCharacter('#', p1.length() / 2));
+			cc7::ByteRange joined[4];
+			std::vector<std::thread> readers;
+			for (size_t t = 0; t < 4; t++) {
+				readers.push_back(std::thread([&p1, &joined, t]() {
+					joined[t] = p1.passwordRange();
+				}));
+			}
+			for (auto && reader : readers) {
+				reader.join();
+			}
+			for (size_t t = 0; t < 4; t++) {
+				ccstAssertTrue(joined[t] == p1.passwordRange());
+				ccstAssertTrue(joined[t].data() == p1.passwordRange().data());
+			}
+			
+			// Clear & reuse
+			ccstAssertTrue(p1.clear());
+			ccstAssertEqual(p1.length(), 0);
+			ccstAssertTrue(p1.passwordRange().empty());
+			ccstAssertTrue(p1.addCharacter('x'));
+			ccstAssertTrue(p1.passwordData() == cc7::MakeRange("x"));
+			
+			// Compare mutable with immutable
+			Password p2;
+			p2.initAsImmutable(cc7::MakeRange("x"));
+			ccstAssertTrue(p1.isEqualToPassword(p2));
+			ccstAssertTrue(p2.isEqualToPassword(p1));
+		}
+		
+		void testSpeculativeKeyDerivation()
+		{
+			WorkerPoolExecutor executor(1);
+			const cc7::ByteArray salt = cc7::MakeRange("0123456789ABCDEF");
+			const cc7::U32 iterations = 1000;
+			const cc7::ByteArray expected_key = protocol::DeriveSecretKeyFromPassword(cc7::MakeRange("1234"), salt, iterations);
+			
+			// Valid derivation, one-shot
+			Password p1;
+			p1.initAsMutable();
+			for (char c : std::string("1234")) {
+				p1.addCharacter(c);
+			}
+			auto handle = p1.startKeyDerivation(salt, iterations, executor);
+			ccstAssertNotNull(handle.get());
+			ccstAssertTrue(handle->isValid());
+			executor.waitUntilIdle();
+			ccstAssertTrue(handle->isFinished());
+			cc7::ByteArray key;
+			ccstAssertTrue(handle->consumeDerivedKey(p1.passwordRange(), salt, iterations, key));
+			ccstAssertEqual(key, expected_key);
+			ccstAssertFalse(handle->isValid());
+			key.clear();
+			ccstAssertFalse(handle->consumeDerivedKey(p1.passwordRange(), salt, iterations, key));
+			ccstAssertTrue(key.empty());
+			
+			// Modified password invalidates the handle
+			handle = p1.startKeyDerivation(salt, iterations, executor);
+			ccstAssertNotNull(handle.get());
+			p1.removeLastCharacter();
+			p1.addCharacter('4');
+			ccstAssertFalse(handle->isValid());
+			ccstAssertFalse(handle->consumeDerivedKey(p1.passwordRange(), salt, iterations, key));
+			
+			// New derivation invalidates the previous one
+			auto handle1 = p1.startKeyDerivation(salt, iterations, executor);
+			auto handle2 = p1.startKeyDerivation(salt, iterations, executor);
+			ccstAssertFalse(handle1->isValid());
+			ccstAssertTrue(handle2->isValid());
+			
+			// Different parameters
+			ccstAssertFalse(handle2->consumeDerivedKey(cc7::MakeRange("1235"), salt, iterations, key));
+			handle = p1.startKeyDerivation(salt, iterations, executor);
+			ccstAssertFalse(handle->consumeDerivedKey(p1.passwordRange(), salt, iterations + 1, key));
+			handle = p1.startKeyDerivation(salt, iterations, executor);
+			ccstAssertFalse(handle->consumeDerivedKey(p1.passwordRange(), cc7::MakeRange("FEDCBA9876543210"), iterations, key));
+			ccstAssertTrue(key.empty());
+			
+			// Consume before the executor starts the derivation
+			DeferredExecutor deferred;
+			handle = p1.startKeyDerivation(salt, iterations, deferred);
+			ccstAssertNotNull(handle.get());
+			ccstAssertFalse(handle->isFinished());
+			ccstAssertFalse(handle->consumeDerivedKey(p1.passwordRange(), salt, iterations, key));
+			ccstAssertTrue(key.empty());
+			ccstAssertFalse(handle->isValid());
+			// The derivation of consumed handle does nothing
+			deferred.runAll();
+			ccstAssertFalse(handle->isValid());
+			ccstAssertFalse(handle->isFinished());
+			
+			// Empty password, or missing parameters
+			Password p2;
+			ccstAssertNull(p2.startKeyDerivation(salt, iterations, executor).get());
+			p2.initAsImmutable(cc7::MakeRange("1234"));
+			ccstAssertNull(p2.startKeyDerivation(cc7::ByteRange(), iterations, executor).get());
+			ccstAssertNull(p2.startKeyDerivation(salt, 0, executor).get());
+			executor.waitUntilIdle();
+		}
+		
+		void testSecureStorage()
+		{
+			// Small blocks don't occupy the whole page
+			const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+			size_t size1, size2;
+			cc7::byte * block1 = utils::SecureMemory_Alloc(16, size1);
+			cc7::byte * block2 = utils::SecureMemory_Alloc(16, size2);
+			ccstAssertNotNull(block1);
+			ccstAssertNotNull(block2);
+			ccstAssertTrue(block1 != block2);
+			ccstAssertTrue(size1 >= 16 && size1 < page_size);
+			ccstAssertEqual(size1, size2);
+			memset(block1, 0xAA, size1);
+			utils::SecureMemory_Free(block1, size1);
+			// Released block is wiped, so the next allocation is zero filled
+			block1 = utils::SecureMemory_Alloc(size1, size1);
+			ccstAssertNotNull(block1);
+			for (size_t i = 0; i < size1; i++) {
+				ccstAssertEqual(block1[i], 0);
+			}
+			utils::SecureMemory_Free(block1, size1);
+			utils::SecureMemory_Free(block2, size2);
+			// Large blocks are allocated in whole pages
+			cc7::byte * large = utils::SecureMemory_Alloc(page_size + 1, size1);
+			ccstAssertNotNull(large);
+			ccstAssertEqual(size1, 2 * page_size);
+			utils::SecureMemory_Free(large, size1);
+			
+			// Reading of password doesn't modify the storage
+			Password p1;
+			p1.initAsMutable();
+			for (char c : std::string("passwrd")) {
+				p1.addCharacter(c);
+			}
+			ccstAssertTrue(p1.insertCharacter('o', 5));
+			const Password & const_p1 = p1;
+			cc7::ByteRange r1 = const_p1.passwordRange();
+			cc7::ByteRange r2 = const_p1.passwordData();
+			ccstAssertTrue(r1 == cc7::MakeRange("password"));
+			ccstAssertTrue(r1.data() == r2.data() && r1.size() == r2.size());
+			
+			// Password in the unlock keys can be provided as a range
+			SignatureUnlockKeys keys;
+			keys.userPassword = cc7::MakeRange("heap");
+			ccstAssertTrue(keys.password() == cc7::MakeRange("heap"));
+			keys.userPasswordRange = p1.passwordRange();
+			ccstAssertTrue(keys.password().data() == r1.data());
+		}
+		
 	};
 	
 	CC7_CREATE_UNIT_TEST(pa2PasswordTests, "pa2")
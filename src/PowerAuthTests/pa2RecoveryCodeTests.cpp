@@ -38,6 +38,7 @@ namespace powerAuthTests
 		{
 			CC7_REGISTER_TEST_METHOD(testGoodRecoveryData)
 			CC7_REGISTER_TEST_METHOD(testBadRecoveryData)
+			CC7_REGISTER_TEST_METHOD(testRecoveryDataSerialization)
 		}
 		
 		// unit tests
@@ -80,6 +81,29 @@ namespace powerAuthTests
 			}
 		}
 		
+		void testRecoveryDataSerialization()
+		{
+			RecoveryData rd;
+			rd.recoveryCode = "VVVVV-VVVVV-VVVVV-VTFVA";
+			rd.puk = "1111122222";
+			
+			cc7::ByteArray vault_key = crypto::GetRandomData(16);
+			cc7::ByteArray serialized;
+			ccstAssertTrue(protocol::SerializeRecoveryData(rd, vault_key, serialized));
+			// Data is encrypted in place, so the capacity must match the final size.
+			ccstAssertEqual(serialized.size() % 16, 0);
+			ccstAssertEqual(serialized.capacity(), serialized.size());
+			
+			RecoveryData restored;
+			ccstAssertTrue(protocol::DeserializeRecoveryData(serialized, vault_key, restored));
+			ccstAssertEqual(restored.recoveryCode, rd.recoveryCode);
+			ccstAssertEqual(restored.puk, rd.puk);
+			
+			// Empty data produces empty array
+			ccstAssertTrue(protocol::SerializeRecoveryData(RecoveryData(), vault_key, serialized));
+			ccstAssertTrue(serialized.empty());
+		}
+		
 	};
 	
 	CC7_CREATE_UNIT_TEST(pa2RecoveryCodeTests, "pa2")
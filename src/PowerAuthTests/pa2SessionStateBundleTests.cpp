@@ -0,0 +1,214 @@
+/*
+ * Copyright 2019 Wultra s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cc7tests/CC7Tests.h>
+#include "crypto/CryptoUtils.h"
+#include <cc7/Base64.h>
+#include <PowerAuth/SessionStateBundle.h>
+#include <memory>
+#include <stdio.h>
+#include <unistd.h>
+
+using namespace cc7;
+using namespace cc7::tests;
+using namespace io::getlime::powerAuth;
+
+namespace io
+{
+namespace getlime
+{
+namespace powerAuthTests
+{
+	class pa2SessionStateBundleTests : public UnitTest
+	{
+	public:
+		
+		pa2SessionStateBundleTests()
+		{
+			CC7_REGISTER_TEST_METHOD(testBuildAndOpen)
+			CC7_REGISTER_TEST_METHOD(testCorruptedBundle)
+			CC7_REGISTER_TEST_METHOD(testExportImportFile)
+		}
+		
+		cc7::ByteArray _v3_data;
+		SessionSetup _setup;
+		
+		void setUp() override
+		{
+			EC_KEY * master_key = crypto::ECC_GenerateKeyPair();
+			ccstAssertNotNull(master_key);
+			_setup.applicationKey			= "MDEyMzQ1Njc4OUFCQ0RFRg==";
+			_setup.applicationSecret		= "QUJDREVGMDEyMzQ1Njc4OQ==";
+			_setup.masterServerPublicKey	= crypto::ECC_ExportPublicKeyToB64(master_key);
+			EC_KEY_free(master_key);
+			// Test data are the same as in pa2SessionTests
+			_v3_data = cc7::FromBase64String("UEECUDQQcXKzF7KLEfVzcb6F7dQ2jhtGVUxMLUJVVC1GQUtFLUFDVElWQVRJT04tSUQAACcQEFxD"
+												   "134A7jgrfXqjmzRSNEoQ+WilNdYscLQ/pbrYJqh9bhDqVVY8lLy2ZvMAtpwZwGrtEGAsKs9Rh8mZ"
+												   "L1u+aQ3kdsgQKe2HE5aMUP+3mc0Zgzo1XSEC+N8Q8lTW59BH/5x6H+eahxi9n7A4ajzLgtaC3tTJ"
+												   "hD8AMA3jUBawHBE2zowK9ThJL4kCPJPfzZVEcZhh6v1+IrQybj5WeD2HhFLwEJr1nHvmSQAAAAA=");
+		}
+		
+		std::vector<std::unique_ptr<Session>> createSessions(size_t count, bool activated)
+		{
+			std::vector<std::unique_ptr<Session>> sessions;
+			for (size_t i = 0; i < count; i++) {
+				SessionSetup setup = _setup;
+				setup.sessionIdentifier = (cc7::U32)(1000 + i * 7);
+				std::unique_ptr<Session> session(new Session(setup));
+				if (activated) {
+					session->loadSessionState(_v3_data);
+				}
+				sessions.push_back(std::move(session));
+			}
+			return sessions;
+		}
+		
+		// unit tests
+		
+		void testBuildAndOpen()
+		{
+			cc7::ByteArray bundle_data;
+			std::vector<SessionStateBundle::Record> records = {
+				{ 30, cc7::MakeRange("thirty") },
+				{ 10, cc7::MakeRange("ten") },
+				{ 20, cc7::ByteRange() },
+			};
+			ccstAssertEqual(SessionStateBundle::build(records, bundle_data), EC_Ok);
+			
+			SessionStateBundle bundle;
+			ccstAssertEqual(bundle.open(bundle_data), EC_Ok);
+			ccstAssertEqual(bundle.count(), 3);
+			std::vector<cc7::U32> expected_ids = { 10, 20, 30 };
+			ccstAssertTrue(bundle.sessionIdentifiers() == expected_ids);
+			
+			cc7::ByteRange state;
+			ccstAssertEqual(bundle.stateForSession(10, state), EC_Ok);
+			ccstAssertEqual(state, cc7::MakeRange("ten"));
+			ccstAssertEqual(bundle.stateForSession(20, state), EC_Ok);
+			ccstAssertTrue(state.empty());
+			ccstAssertEqual(bundle.stateForSession(30, state), EC_Ok);
+			ccstAssertEqual(state, cc7::MakeRange("thirty"));
+			// The state points to the bundle's data
+			ccstAssertTrue(state.data() >= bundle_data.data() && state.data() < bundle_data.data() + bundle_data.size());
+			ccstAssertEqual(bundle.stateForSession(15, state), EC_WrongParam);
+			ccstAssertEqual(bundle.stateForSession(31, state), EC_WrongParam);
+			
+			// Duplicate identifiers
+			records.push_back({ 20, cc7::MakeRange("twenty") });
+			ccstAssertEqual(SessionStateBundle::build(records, bundle_data), EC_WrongParam);
+			ccstAssertTrue(bundle_data.empty());
+			
+			// Empty bundle
+			ccstAssertEqual(SessionStateBundle::build({}, bundle_data), EC_Ok);
+			ccstAssertEqual(bundle.open(bundle_data), EC_Ok);
+			ccstAssertEqual(bundle.count(), 0);
+			ccstAssertEqual(bundle.stateForSession(10, state), EC_WrongParam);
+		}
+		
+		void testCorruptedBundle()
+		{
+			cc7::ByteArray bundle_data;
+			std::vector<SessionStateBundle::Record> records = {
+				{ 1, cc7::MakeRange("first") },
+				{ 2, cc7::MakeRange("second") },
+			};
+			ccstAssertEqual(SessionStateBundle::build(records, bundle_data), EC_Ok);
+			SessionStateBundle bundle;
+			
+			// Corrupted state is detected lazily, on access
+			cc7::ByteArray corrupted = bundle_data;
+			corrupted[corrupted.size() - 1] ^= 0x55;
+			ccstAssertEqual(bundle.open(corrupted), EC_Ok);
+			cc7::ByteRange state;
+			ccstAssertEqual(bundle.stateForSession(1, state), EC_Ok);
+			ccstAssertEqual(bundle.stateForSession(2, state), EC_WrongParam);
+			
+			// Truncated data
+			ccstAssertEqual(bundle.open(bundle_data.byteRange().subRangeTo(bundle_data.size() - 1)), EC_WrongParam);
+			ccstAssertEqual(bundle.count(), 0);
+			// Truncated index
+			ccstAssertEqual(bundle.open(bundle_data.byteRange().subRangeTo(10)), EC_WrongParam);
+			// Wrong header
+			corrupted = bundle_data;
+			corrupted[0] = 'X';
+			ccstAssertEqual(bundle.open(corrupted), EC_WrongParam);
+			// Unsupported version
+			corrupted = bundle_data;
+			corrupted[1] = '2';
+			ccstAssertEqual(bundle.open(corrupted), EC_WrongParam);
+			corrupted[1] = '0';
+			ccstAssertEqual(bundle.open(corrupted), EC_WrongParam);
+			// Unsorted index
+			corrupted = bundle_data;
+			corrupted[6 + 3] = 3;
+			ccstAssertEqual(bundle.open(corrupted), EC_WrongParam);
+			ccstAssertEqual(bundle.open(cc7::ByteRange()), EC_WrongParam);
+		}
+		
+		void testExportImportFile()
+		{
+			const size_t count = 2000;
+			WorkerPoolExecutor executor;
+			auto sessions = createSessions(count, true);
+			std::vector<const Session*> export_list;
+			for (auto && session : sessions) {
+				export_list.push_back(session.get());
+			}
+			cc7::ByteArray bundle_data;
+			ccstAssertEqual(SessionStateBundle::exportSessions(export_list, executor, bundle_data), EC_Ok);
+			
+			char path[] = "/tmp/pa2BundleTestXXXXXX";
+			int fd = mkstemp(path);
+			ccstAssertTrue(fd >= 0);
+			ccstAssertTrue(write(fd, bundle_data.data(), bundle_data.size()) == (ssize_t)bundle_data.size());
+			close(fd);
+			
+			// Restore to new sessions, in reversed order
+			auto restored = createSessions(count, false);
+			std::vector<Session*> import_list;
+			for (auto it = restored.rbegin(); it != restored.rend(); ++it) {
+				import_list.push_back(it->get());
+			}
+			SessionStateBundle bundle;
+			ccstAssertEqual(bundle.open(std::string(path)), EC_Ok);
+			auto results = bundle.loadSessions(import_list, executor);
+			unlink(path);
+			
+			ccstAssertEqual(bundle.count(), count);
+			ccstAssertEqual(results.size(), count);
+			for (size_t i = 0; i < count; i++) {
+				ccstAssertEqual(results[i], EC_Ok);
+				ccstAssertTrue(restored[i]->hasValidActivation());
+				ccstAssertEqual(restored[i]->saveSessionState(), sessions[i]->saveSessionState());
+			}
+			
+			// Session which is not in the bundle
+			SessionSetup setup = _setup;
+			setup.sessionIdentifier = 1;
+			Session unknown(setup);
+			ccstAssertEqual(bundle.loadSession(unknown), EC_WrongParam);
+			
+			// Missing file
+			ccstAssertEqual(bundle.open(std::string(path)), EC_WrongParam);
+			ccstAssertEqual(bundle.count(), 0);
+		}
+	};
+	
+	CC7_CREATE_UNIT_TEST(pa2SessionStateBundleTests, "pa2")
+	
+} // io::getlime::powerAuthTests
+} // io::getlime
+} // io
@@ -0,0 +1,319 @@
+/*
+ * Copyright 2019 Wultra s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cc7tests/CC7Tests.h>
+#include <cc7/Base64.h>
+#include <PowerAuth/SessionStateMigrator.h>
+#include <PowerAuth/Session.h>
+#include "protocol/PrivateTypes.h"
+#include "protocol/Constants.h"
+#include "crypto/CryptoUtils.h"
+#include "utils/DataReader.h"
+#include "utils/DataWriter.h"
+#include <stdio.h>
+#include <unistd.h>
+
+using namespace cc7;
+using namespace cc7::tests;
+using namespace io::getlime::powerAuth;
+
+namespace io
+{
+namespace getlime
+{
+namespace powerAuthTests
+{
+	class pa2SessionStateMigratorTests : public UnitTest
+	{
+	public:
+		
+		pa2SessionStateMigratorTests()
+		{
+			CC7_REGISTER_TEST_METHOD(testFormatDetection)
+			CC7_REGISTER_TEST_METHOD(testMigrateStates)
+			CC7_REGISTER_TEST_METHOD(testMigrateArchive)
+			CC7_REGISTER_TEST_METHOD(testBulkMigration)
+			CC7_REGISTER_TEST_METHOD(testServerPublicKeyCoordinates)
+		}
+		
+		cc7::ByteArray _legacy_empty;
+		cc7::ByteArray _legacy_data;
+		cc7::ByteArray _v2_data;
+		cc7::ByteArray _v3_data;
+		cc7::ByteArray _empty_data;
+		SessionSetup _setup;
+		
+		void setUp() override
+		{
+			// Test data are the same as in pa2SessionTests
+			_legacy_empty = cc7::FromBase64String("UEFNMmn/");
+			_legacy_data  = cc7::FromBase64String("UEFNMmEAG0ZVTEwtQlVULUZBS0UtQUNUSVZBVElPTi1JRAAAAAAAAAAAAAAAAAAQXEPXfgDuOCt9"
+												   "eqObNFI0SgAAJxAAEPlopTXWLHC0P6W62CaofW4AEOpVVjyUvLZm8wC2nBnAau0AEGAsKs9Rh8mZ"
+												   "L1u+aQ3kdsgAECnthxOWjFD/t5nNGYM6NV0AIQL43xDyVNbn0Ef/nHof55qHGL2fsDhqPMuC1oLe"
+												   "1MmEPwAwDeNQFrAcETbOjAr1OEkviQI8k9/NlURxmGHq/X4itDJuPlZ4PYeEUvAQmvWce+ZJAAdL"
+												   "RVkwMDAx/w==");
+			_v2_data      = cc7::FromBase64String("UEECUDMAAAAAAAAAABtGVUxMLUJVVC1GQUtFLUFDVElWQVRJT04tSUQAACcQEFxD134A7jgrfXqj"
+												   "mzRSNEoQ+WilNdYscLQ/pbrYJqh9bhDqVVY8lLy2ZvMAtpwZwGrtEGAsKs9Rh8mZL1u+aQ3kdsgQ"
+												   "Ke2HE5aMUP+3mc0Zgzo1XSEC+N8Q8lTW59BH/5x6H+eahxi9n7A4ajzLgtaC3tTJhD8AMA3jUBaw"
+												   "HBE2zowK9ThJL4kCPJPfzZVEcZhh6v1+IrQybj5WeD2HhFLwEJr1nHvmSQAAAAA=");
+			_v3_data      = cc7::FromBase64String("UEECUDQQcXKzF7KLEfVzcb6F7dQ2jhtGVUxMLUJVVC1GQUtFLUFDVElWQVRJT04tSUQAACcQEFxD"
+												   "134A7jgrfXqjmzRSNEoQ+WilNdYscLQ/pbrYJqh9bhDqVVY8lLy2ZvMAtpwZwGrtEGAsKs9Rh8mZ"
+												   "L1u+aQ3kdsgQKe2HE5aMUP+3mc0Zgzo1XSEC+N8Q8lTW59BH/5x6H+eahxi9n7A4ajzLgtaC3tTJ"
+												   "hD8AMA3jUBawHBE2zowK9ThJL4kCPJPfzZVEcZhh6v1+IrQybj5WeD2HhFLwEJr1nHvmSQAAAAA=");
+			Session session(_setup);
+			_empty_data   = session.saveSessionState();
+		}
+		
+		std::string tempFilePath()
+		{
+			char path[] = "/tmp/pa2MigratorTestXXXXXX";
+			int fd = mkstemp(path);
+			if (fd >= 0) {
+				close(fd);
+			}
+			return path;
+		}
+		
+		bool writeFile(const std::string & path, const cc7::ByteRange & data)
+		{
+			FILE * f = fopen(path.c_str(), "wb");
+			if (!f) {
+				return false;
+			}
+			bool result = fwrite(data.data(), 1, data.size(), f) == data.size();
+			fclose(f);
+			return result;
+		}
+		
+		// unit tests
+		
+		void testFormatDetection()
+		{
+			ccstAssertEqual(SessionStateMigrator::detectFormat(_legacy_empty), SSF_Legacy);
+			ccstAssertEqual(SessionStateMigrator::detectFormat(_legacy_data), SSF_Legacy);
+			ccstAssertEqual(SessionStateMigrator::detectFormat(_v2_data), SSF_PD_V2);
+			ccstAssertEqual(SessionStateMigrator::detectFormat(_v3_data), SSF_PD_V3);
+			ccstAssertEqual(SessionStateMigrator::detectFormat(_empty_data), SSF_Empty);
+			ccstAssertEqual(SessionStateMigrator::detectFormat(cc7::ByteRange()), SSF_Unknown);
+			ccstAssertEqual(SessionStateMigrator::detectFormat(cc7::MakeRange("PA")), SSF_Unknown);
+			ccstAssertEqual(SessionStateMigrator::detectFormat(cc7::MakeRange("XYZ")), SSF_Unknown);
+			ccstAssertEqual(SessionStateMigrator::detectFormat(_v3_data.byteRange().subRangeTo(4)), SSF_Unknown);
+		}
+		
+		void testMigrateStates()
+		{
+			WorkerPoolExecutor executor;
+			SessionStateMigrator migrator(executor);
+			std::vector<cc7::ByteRange> states = {
+				_legacy_empty, _legacy_data, _v2_data, _v3_data, _empty_data, cc7::MakeRange("garbage")
+			};
+			auto results = migrator.migrateStates(states);
+			ccstAssertEqual(results.size(), states.size());
+			
+			// Legacy empty
+			ccstAssertEqual(results[0].code, EC_Ok);
+			ccstAssertEqual(results[0].sourceFormat, SSF_Legacy);
+			ccstAssertEqual(results[0].protocolVersion, Version_NA);
+			ccstAssertTrue(results[0].migrated);
+			ccstAssertEqual(results[0].state, _empty_data);
+			// Legacy with activation
+			ccstAssertEqual(results[1].code, EC_Ok);
+			ccstAssertEqual(results[1].sourceFormat, SSF_Legacy);
+			ccstAssertEqual(results[1].protocolVersion, Version_V2);
+			ccstAssertTrue(results[1].migrated);
+			ccstAssertEqual(SessionStateMigrator::detectFormat(results[1].state), SSF_PD_V2);
+			// V2 stored by older library, without recovery data
+			ccstAssertEqual(results[2].code, EC_Ok);
+			ccstAssertEqual(results[2].sourceFormat, SSF_PD_V2);
+			ccstAssertEqual(results[2].protocolVersion, Version_V2);
+			ccstAssertTrue(results[2].migrated);
+			ccstAssertEqual(SessionStateMigrator::detectFormat(results[2].state), SSF_PD_V2);
+			// V3 without recovery data
+			ccstAssertEqual(results[3].code, EC_Ok);
+			ccstAssertEqual(results[3].sourceFormat, SSF_PD_V3);
+			ccstAssertEqual(results[3].protocolVersion, Version_V3);
+			ccstAssertTrue(results[3].migrated);
+			ccstAssertEqual(SessionStateMigrator::detectFormat(results[3].state), SSF_PD_V5);
+			// Empty
+			ccstAssertEqual(results[4].code, EC_Ok);
+			ccstAssertEqual(results[4].sourceFormat, SSF_Empty);
+			ccstAssertFalse(results[4].migrated);
+			ccstAssertEqual(results[4].state, _empty_data);
+			// Garbage
+			ccstAssertEqual(results[5].code, EC_WrongParam);
+			ccstAssertEqual(results[5].sourceFormat, SSF_Unknown);
+			ccstAssertTrue(results[5].state.empty());
+			
+			// Migrated states must be loadable and equal to states saved by the session
+			for (size_t i = 0; i < 4; i++) {
+				Session session(_setup);
+				ccstAssertEqual(session.loadSessionState(states[i]), EC_Ok);
+				ccstAssertEqual(session.saveSessionState(), results[i].state);
+				ccstAssertEqual(session.loadSessionState(results[i].state), EC_Ok);
+				if (results[i].protocolVersion != Version_NA) {
+					ccstAssertEqual(session.activationIdentifier(), "FULL-BUT-FAKE-ACTIVATION-ID");
+					ccstAssertEqual(session.protocolVersion(), results[i].protocolVersion);
+				}
+				// Second migration does nothing
+				auto result = SessionStateMigrator::migrateState(results[i].state);
+				ccstAssertEqual(result.code, EC_Ok);
+				ccstAssertFalse(result.migrated);
+				ccstAssertEqual(result.state, results[i].state);
+			}
+		}
+		
+		void testMigrateArchive()
+		{
+			WorkerPoolExecutor executor;
+			SessionStateMigrator migrator(executor);
+			std::vector<cc7::ByteRange> states = {
+				_legacy_empty, _legacy_data, _v2_data, _v3_data, _empty_data, cc7::MakeRange("garbage")
+			};
+			auto expected = migrator.migrateStates(states);
+			
+			std::string path = tempFilePath();
+			cc7::ByteArray archive = SessionStateMigrator::buildArchive(states);
+			ccstAssertTrue(writeFile(path, archive));
+			
+			std::vector<SessionStateMigrationResult> results;
+			ccstAssertEqual(migrator.migrateArchive(path, results), EC_Ok);
+			ccstAssertEqual(results.size(), expected.size());
+			for (size_t i = 0; i < results.size(); i++) {
+				ccstAssertEqual(results[i].code, expected[i].code);
+				ccstAssertEqual(results[i].sourceFormat, expected[i].sourceFormat);
+				ccstAssertEqual(results[i].migrated, expected[i].migrated);
+				ccstAssertEqual(results[i].state, expected[i].state);
+			}
+			
+			// Empty archive
+			ccstAssertTrue(writeFile(path, cc7::ByteRange()));
+			ccstAssertEqual(migrator.migrateArchive(path, results), EC_Ok);
+			ccstAssertTrue(results.empty());
+			
+			// Truncated archive
+			ccstAssertTrue(writeFile(path, archive.byteRange().subRangeTo(archive.size() - 1)));
+			ccstAssertEqual(migrator.migrateArchive(path, results), EC_WrongParam);
+			ccstAssertTrue(results.empty());
+			
+			// Missing file
+			unlink(path.c_str());
+			ccstAssertEqual(migrator.migrateArchive(path, results), EC_WrongParam);
+		}
+		
+		void testBulkMigration()
+		{
+			const size_t count = 5000;
+			std::vector<cc7::ByteRange> states;
+			states.reserve(count);
+			for (size_t i = 0; i < count; i++) {
+				states.push_back(i & 1 ? _v3_data : _legacy_data);
+			}
+			std::string path = tempFilePath();
+			ccstAssertTrue(writeFile(path, SessionStateMigrator::buildArchive(states)));
+			
+			WorkerPoolExecutor executor;
+			SessionStateMigrator migrator(executor);
+			std::vector<SessionStateMigrationResult> results;
+			ccstAssertEqual(migrator.migrateArchive(path, results), EC_Ok);
+			unlink(path.c_str());
+			
+			ccstAssertEqual(results.size(), count);
+			size_t failures = 0;
+			for (auto && result : results) {
+				if (result.code != EC_Ok || !result.migrated) {
+					failures++;
+				}
+			}
+			ccstAssertEqual(failures, 0);
+		}
+		
+		bool deserializeState(const cc7::ByteRange & state, protocol::PersistentData & pd)
+		{
+			bool has_data = false;
+			utils::DataReader reader(state);
+			return protocol::DeserializeSessionState(pd, has_data, reader) && has_data;
+		}
+		
+		cc7::ByteArray serializeState(const protocol::PersistentData & pd)
+		{
+			cc7::ByteArray state;
+			utils::DataWriter writer(&state);
+			protocol::SerializeSessionState(&pd, writer);
+			return state;
+		}
+		
+		void testServerPublicKeyCoordinates()
+		{
+			// Old states don't contain coordinates, so they're calculated during the load
+			std::vector<cc7::ByteRange> states = { _legacy_data, _v2_data, _v3_data };
+			for (auto && state : states) {
+				protocol::PersistentData pd;
+				ccstAssertTrue(deserializeState(state, pd));
+				ccstAssertEqual(pd.serverPublicKeyCoordinates.size(), protocol::SERVER_PUBLIC_KEY_COORDINATES_SIZE);
+				EC_KEY * key = crypto::ECC_ImportPublicKey(nullptr, pd.serverPublicKey);
+				ccstAssertNotNull(key);
+				ccstAssertEqual(crypto::ECC_ExportPublicKeyToCoordinates(key), pd.serverPublicKeyCoordinates);
+				EC_KEY_free(key);
+				key = protocol::ImportServerPublicKey(pd);
+				ccstAssertNotNull(key);
+				ccstAssertEqual(crypto::ECC_ExportPublicKey(key), pd.serverPublicKey);
+				EC_KEY_free(key);
+			}
+			
+			// Migrated V3 state keeps coordinates
+			auto result = SessionStateMigrator::migrateState(_v3_data);
+			ccstAssertEqual(result.code, EC_Ok);
+			ccstAssertEqual(SessionStateMigrator::detectFormat(result.state), SSF_PD_V5);
+			protocol::PersistentData pd_v3, pd_v5;
+			ccstAssertTrue(deserializeState(_v3_data, pd_v3));
+			ccstAssertTrue(deserializeState(result.state, pd_v5));
+			ccstAssertEqual(pd_v5.serverPublicKey, pd_v3.serverPublicKey);
+			ccstAssertEqual(pd_v5.serverPublicKeyCoordinates, pd_v3.serverPublicKeyCoordinates);
+			// The coordinates are the last item in the persistent data
+			cc7::ByteRange tail = result.state.byteRange().subRangeFrom(result.state.size() - pd_v5.serverPublicKeyCoordinates.size());
+			ccstAssertEqual(tail, pd_v5.serverPublicKeyCoordinates);
+			
+			// Coordinates not matching the key are recalculated
+			protocol::PersistentData pd_wrong = pd_v5;
+			pd_wrong.serverPublicKeyCoordinates[0] ^= 0x01;
+			protocol::PersistentData pd_loaded;
+			ccstAssertTrue(deserializeState(serializeState(pd_wrong), pd_loaded));
+			ccstAssertEqual(pd_loaded.serverPublicKeyCoordinates, pd_v5.serverPublicKeyCoordinates);
+			pd_wrong = pd_v5;
+			pd_wrong.serverPublicKeyCoordinates.resize(32);
+			ccstAssertTrue(deserializeState(serializeState(pd_wrong), pd_loaded));
+			ccstAssertEqual(pd_loaded.serverPublicKeyCoordinates, pd_v5.serverPublicKeyCoordinates);
+			
+			// Invalid server's public key doesn't break the load, the key is imported from its original encoding
+			protocol::PersistentData pd_invalid = pd_v5;
+			pd_invalid.serverPublicKey[0] = 0x05;
+			pd_invalid.serverPublicKeyCoordinates.clear();
+			ccstAssertTrue(deserializeState(serializeState(pd_invalid), pd_loaded));
+			ccstAssertTrue(pd_loaded.serverPublicKeyCoordinates.empty());
+			ccstAssertNull(protocol::ImportServerPublicKey(pd_loaded));
+			
+			// Session loads the new state
+			Session session(_setup);
+			ccstAssertEqual(session.loadSessionState(result.state), EC_Ok);
+			ccstAssertEqual(session.saveSessionState(), result.state);
+		}
+	};
+	
+	CC7_CREATE_UNIT_TEST(pa2SessionStateMigratorTests, "pa2")
+	
+} // io::getlime::powerAuthTests
+} // io::getlime
+} // io
@@ -24,7 +24,9 @@
 #include "protocol/Constants.h"
 #include <PowerAuth/Session.h>
 #include <PowerAuth/ECIES.h>
+#include <PowerAuth/Executor.h>
 #include <map>
+#include <thread>
 
 using namespace cc7;
 using namespace cc7::tests;
@@ -45,6 +47,7 @@ namespace powerAuthTests
 		pa2SessionTests()
 		{
 			CC7_REGISTER_TEST_METHOD(testKeyValueMapNormalization);
+			CC7_REGISTER_TEST_METHOD(testKeyValuePairsNormalization);
 			CC7_REGISTER_TEST_METHOD(testBeforeActivation);
 			CC7_REGISTER_TEST_METHOD(testActivationWithoutEEK);
 			CC7_REGISTER_TEST_METHOD(testActivationWithEEKUsingSetup);
@@ -116,6 +119,45 @@ namespace powerAuthTests
 			}
 		}
 		
+		void testKeyValuePairsNormalization()
+		{
+			// Unsorted vector, with multiple values for the same key
+			std::vector<std::pair<std::string, std::string>> pairs = {
+				{ "zingly", "is da best" },
+				{ "id[]", "2" },
+				{ "420", "is equal to 10*42" },
+				{ "id[]", "1" },
+				{ "hello", "world" },
+				{ "id[]", "3" },
+			};
+			const char * expected = "420=is+equal+to+10*42&hello=world&id%5B%5D=2&id%5B%5D=1&id%5B%5D=3&zingly=is+da+best";
+			ccstAssertEqual(Session::prepareKeyValuePairsForDataSigning(pairs), cc7::MakeRange(expected));
+			
+			// Multimap
+			std::multimap<std::string, std::string> multimap(pairs.begin(), pairs.end());
+			ccstAssertEqual(Session::prepareKeyValuePairsForDataSigning(multimap), cc7::MakeRange(expected));
+			
+			// Plain array and iterators
+			const std::pair<std::string, std::string> array[] = {
+				{ "b", u8"ľšč" },
+				{ "a", "" },
+				{ "", "empty key" },
+			};
+			ccstAssertEqual(Session::prepareKeyValuePairsForDataSigning(array), cc7::MakeRange("=empty+key&a=&b=%C4%BE%C5%A1%C4%8D"));
+			ccstAssertEqual(Session::prepareKeyValuePairsForDataSigning(array, array + 1), cc7::MakeRange("b=%C4%BE%C5%A1%C4%8D"));
+			ccstAssertEqual(Session::prepareKeyValuePairsForDataSigning(array, array), cc7::ByteArray());
+			
+			// Must produce the same result as the map based function
+			std::map<std::string, std::string> map;
+			for (int i = 0; i < 100; i++) {
+				std::string key = cc7::ToBase64String(crypto::GetRandomData(1 + arc4random_uniform(20)));
+				std::string value = cc7::CopyToString(crypto::GetRandomData(arc4random_uniform(100)));
+				map[key] = value;
+			}
+			std::vector<std::pair<std::string, std::string>> map_pairs(map.rbegin(), map.rend());
+			ccstAssertEqual(Session::prepareKeyValuePairsForDataSigning(map_pairs), Session::prepareKeyValueMapForDataSigning(map));
+		}
+		
 		void compareSetup(const SessionSetup * ss, const char * message)
 		{
 			if (!ss) {
@@ -562,6 +604,9 @@ namespace powerAuthTests
 					ccstAssertNotEqual(signature, our_signature);
 				}
 				
+				// Keep the state, for the speculative derivation test
+				cc7::ByteArray state_before_test4 = s1.saveSessionState();
+				
 				// Signature test #4 ... yet another valid test, now use "offline" nonce.
 				{
 					SignatureUnlockKeys keys;
@@ -587,6 +632,42 @@ namespace powerAuthTests
 					ccstAssertEqual(signature, our_signature);
 				}
 				
+				// Signature test #5 ... the same as #4, but the knowledge key is derived speculatively.
+				//                      The test signs with the state before #4, so the counter is not moved.
+				{
+					cc7::ByteArray state_after_test4 = s1.saveSessionState();
+					ec = s1.loadSessionState(state_before_test4);
+					ccstAssertEqual(ec, EC_Ok);
+					
+					WorkerPoolExecutor executor(1);
+					Password user_password;
+					user_password.initAsImmutable(cc7::MakeRange(new_password));
+					std::shared_ptr<PasswordKeyDerivation> password_key;
+					ec = s1.startPasswordKeyDerivation(user_password, executor, password_key);
+					ccstAssertEqual(ec, EC_Ok);
+					ccstAssertTrue(password_key->isValid());
+					
+					SignatureUnlockKeys keys;
+					keys.possessionUnlockKey = possessionUnlock;
+					keys.userPasswordRange   = user_password.passwordRange();
+					keys.userPasswordKey     = password_key;
+					
+					HTTPRequestData requestData(cc7::MakeRange("My creativity ends here!"), "POST", "/hack.me/if-you-can", "Q2hhcm1pbmdOb25jZTEyMw==");
+					HTTPRequestDataSignature sigData;
+					ec = s1.signHTTPRequestData(requestData, keys, SF_Possession_Knowledge, sigData);
+					ccstAssertEqual(ec, EC_Ok);
+					ccstAssertEqual(requestData.offlineNonce, sigData.nonce);
+					std::string our_signature = T_calculateSignatureForData(cc7::MakeRange("My creativity ends here!"), "POST", "/hack.me/if-you-can", MASTER_SHARED_SECRET, sigData.nonce, "offline", SF_Possession_Knowledge, 3, CTR_DATA);
+					// Signatures must match.
+					ccstAssertEqual(sigData.signature, our_signature);
+					// The handle is consumed
+					ccstAssertFalse(password_key->isValid());
+					
+					// Restore state after #4
+					ec = s1.loadSessionState(state_after_test4);
+					ccstAssertEqual(ec, EC_Ok);
+				}
+				
 				// Add / Remove EEK (2nd test)
 				if (eek) {
 					// Add EEK
@@ -851,6 +932,70 @@ namespace powerAuthTests
 					cc7::ByteArray expected_derived_key = protocol::DeriveSecretKey(vault_key, 1977);
 					ccstAssertEqual(derived_key, expected_derived_key);
 				}
+				// Vault test #3-C, vault session
+				{
+					SignatureUnlockKeys keys;
+					keys.possessionUnlockKey = possessionUnlock;
+					VaultSession vault;
+					ccstAssertFalse(vault.isValid());
+					cc7::ByteArray derived_key;
+					ccstAssertEqual(vault.deriveCryptographicKey(1977, derived_key), EC_WrongState);
+					
+					// Wrong vault key. The decrypted private key may have a valid padding, but it never
+					// matches the device's public key.
+					for (int i = 0; i < 32; i++) {
+						ec = s1.openVaultSession(T_encryptedVaultKey(crypto::GetRandomData(16)), keys, vault);
+						ccstAssertEqual(ec, EC_Encryption);
+						ccstAssertFalse(vault.isValid());
+					}
+					
+					ec = s1.openVaultSession(cVaultKey, keys, vault);
+					ccstAssertEqual(ec, EC_Ok);
+					ccstAssertTrue(vault.isValid());
+					ec = vault.deriveCryptographicKey(1977, derived_key);
+					ccstAssertEqual(ec, EC_Ok);
+					cc7::ByteArray vault_key = protocol::DeriveSecretKey(MASTER_SHARED_SECRET, 2000);
+					ccstAssertEqual(derived_key, protocol::DeriveSecretKey(vault_key, 1977));
+					cc7::ByteArray signature;
+					ec = vault.signDataWithDevicePrivateKey(cc7::MakeRange("Hello World!"), signature);
+					ccstAssertEqual(ec, EC_Ok);
+					ccstAssertTrue(crypto::ECDSA_ValidateSignature(cc7::MakeRange("Hello World!"), signature, devicePublicKey));
+					if (USE_RECOVERY_CODE) {
+						RecoveryData recovery_data;
+						ec = vault.getActivationRecoveryData(recovery_data);
+						ccstAssertEqual(ec, EC_Ok);
+						ccstAssertEqual(recovery_data.recoveryCode, _recovery_code);
+					}
+					
+					// Invalidation by loading a state
+					auto state = s1.saveSessionState();
+					ec = s1.loadSessionState(state);
+					ccstAssertEqual(ec, EC_Ok);
+					ccstAssertFalse(vault.isValid());
+					ccstAssertEqual(vault.deriveCryptographicKey(1977, derived_key), EC_WrongState);
+					ccstAssertEqual(vault.signDataWithDevicePrivateKey(cc7::MakeRange("Hello World!"), signature), EC_WrongState);
+					
+					// Invalidation by reset, and by destroying the session
+					VaultSession vault2;
+					{
+						Session s2(_setup);
+						ccstAssertEqual(s2.loadSessionState(state), EC_Ok);
+						ccstAssertEqual(s2.openVaultSession(cVaultKey, keys, vault), EC_Ok);
+						ccstAssertEqual(s2.openVaultSession(cVaultKey, keys, vault2), EC_Ok);
+						vault2.close();
+						ccstAssertFalse(vault2.isValid());
+						ccstAssertEqual(s2.openVaultSession(cVaultKey, keys, vault2), EC_Ok);
+						s2.resetSession();
+						ccstAssertFalse(vault.isValid());
+						ccstAssertFalse(vault2.isValid());
+						ccstAssertEqual(vault.addBiometryFactor(keys), EC_WrongState);
+						ccstAssertEqual(s2.loadSessionState(state), EC_Ok);
+						ccstAssertEqual(s2.openVaultSession(cVaultKey, keys, vault2), EC_Ok);
+					}
+					ccstAssertFalse(vault2.isValid());
+					RecoveryData recovery_data;
+					ccstAssertEqual(vault2.getActivationRecoveryData(recovery_data), EC_WrongState);
+				}
 				// Server signed data with personalized key
 				{
 					SignedData signedData;
@@ -870,6 +1015,14 @@ namespace powerAuthTests
 					signedData.signature.clear();
 					ec = s1.verifyServerSignedData(signedData);
 					ccstAssertTrue(ec == EC_WrongParam);
+					
+					// Verify data referenced by view
+					cc7::ByteArray data = cc7::MakeRange("This piece of text needs to be signed.");
+					cc7::ByteArray signature = T_calculateServerSignature(data, serverPrivateKey);
+					ec = s1.verifyServerSignedData(SignedDataView(data, signature, SignedData::ECDSA_PersonalizedKey));
+					ccstAssertTrue(ec == EC_Ok);
+					ec = s1.verifyServerSignedData(SignedDataView(data.byteRange().subRangeFrom(1), signature, SignedData::ECDSA_PersonalizedKey));
+					ccstAssertTrue(ec == EC_Encryption);
 				}
 				// ECIES "application" scope
 				{
@@ -921,6 +1074,225 @@ namespace powerAuthTests
 					ec = decryptor.decryptRequest(request_enc, request_data);
 					ccstAssertEqual(ec, EC_Ok);
 					ccstAssertEqual(request_data, cc7::MakeRange("Plan9!"));
+					
+					// The next encryptor is created from the cached prototype
+					ECIESEncryptor encryptor2;
+					ec = s1.getEciesEncryptor(ECIES_ActivationScope, keys, cc7::MakeRange("/pa/another/test"), encryptor2);
+					ccstAssertEqual(ec, EC_Ok);
+					ccstAssertEqual(encryptor2.sharedInfo1(), cc7::MakeRange("/pa/another/test"));
+					ccstAssertEqual(encryptor2.sharedInfo2(), encryptor.sharedInfo2());
+					ccstAssertEqual(encryptor2.publicKey(), encryptor.publicKey());
+					ccstAssertFalse(encryptor2.canDecryptResponse());
+					
+					// The cached prototype must not be used for a different possession key
+					SignatureUnlockKeys other_keys;
+					other_keys.possessionUnlockKey = crypto::GetRandomData(16);
+					ec = s1.getEciesEncryptor(ECIES_ActivationScope, other_keys, cc7::MakeRange("/pa/activation/test"), encryptor2);
+					ccstAssertEqual(ec, EC_Ok);
+					ccstAssertNotEqual(encryptor2.sharedInfo2(), encryptor.sharedInfo2());
+					other_keys.possessionUnlockKey.clear();
+					ec = s1.getEciesEncryptor(ECIES_ActivationScope, other_keys, cc7::MakeRange("/pa/activation/test"), encryptor2);
+					ccstAssertEqual(ec, EC_Encryption);
+					ec = s1.getEciesEncryptor(ECIES_ActivationScope, keys, cc7::MakeRange("/pa/activation/test"), encryptor2);
+					ccstAssertEqual(ec, EC_Ok);
+					ccstAssertEqual(encryptor2.sharedInfo2(), encryptor.sharedInfo2());
+				}
+				// Activation status
+				{
+					SignatureUnlockKeys keys;
+					keys.possessionUnlockKey = possessionUnlock;
+					const cc7::byte status_data[] = {
+						0xDE, 0xC0, 0xDE, 0xD1,		// HDR
+						ActivationStatus::Blocked,	// state
+						3, 3,						// current & upgrade version
+						0, 0, 0, 0, 0, 0,			// reserved
+						2, 5,						// fail & max fail counter
+						0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+					};
+					static_assert(sizeof(status_data) == protocol::STATUS_BLOB_SIZE, "Wrong test data");
+					auto transport_key = protocol::DeriveSecretKey(MASTER_SHARED_SECRET, 1000);
+					auto status_blob = cc7::ToBase64String(crypto::AES_CBC_Encrypt(transport_key, protocol::ZERO_IV, cc7::MakeRange(status_data)));
+					
+					// Decode twice, the second decode uses the cached transport key
+					for (int i = 0; i < 2; i++) {
+						ActivationStatus status;
+						ec = s1.decodeActivationStatus(status_blob, keys, status);
+						ccstAssertEqual(ec, EC_Ok);
+						ccstAssertEqual(status.state, ActivationStatus::Blocked);
+						ccstAssertEqual(status.currentVersion, 3);
+						ccstAssertEqual(status.upgradeVersion, 3);
+						ccstAssertEqual(status.failCount, 2);
+						ccstAssertEqual(status.maxFailCount, 5);
+					}
+					// Different possession key must not use the cached key
+					ActivationStatus status;
+					SignatureUnlockKeys other_keys;
+					other_keys.possessionUnlockKey = crypto::GetRandomData(16);
+					ec = s1.decodeActivationStatus(status_blob, other_keys, status);
+					ccstAssertEqual(ec, EC_Encryption);
+					other_keys.possessionUnlockKey.clear();
+					ec = s1.decodeActivationStatus(status_blob, other_keys, status);
+					ccstAssertEqual(ec, EC_WrongParam);
+					// Wrong blobs
+					ec = s1.decodeActivationStatus("", keys, status);
+					ccstAssertEqual(ec, EC_WrongParam);
+					ec = s1.decodeActivationStatus(status_blob.substr(4), keys, status);
+					ccstAssertEqual(ec, EC_Encryption);
+					ec = s1.decodeActivationStatus(status_blob.substr(0, 40) + "!!!!", keys, status);
+					ccstAssertEqual(ec, EC_Encryption);
+					ec = s1.decodeActivationStatus(cc7::ToBase64String(crypto::GetRandomData(protocol::STATUS_BLOB_SIZE)), keys, status);
+					ccstAssertEqual(ec, EC_Encryption);
+				}
+				// Signature written directly to the header value
+				{
+					SignatureUnlockKeys keys;
+					keys.possessionUnlockKey = possessionUnlock;
+					keys.biometryUnlockKey   = biometryUnlock;
+					HTTPRequestData request(cc7::MakeRange("{}"), "POST", "/header/test");
+					
+					std::string header_value;
+					ec = s1.signHTTPRequestDataToHeader(request, keys, SF_Possession, header_value);
+					ccstAssertEqual(ec, EC_Ok);
+					HTTPAuthHeaderView view;
+					ec = view.parse(cc7::MakeRange(header_value));
+					ccstAssertEqual(ec, EC_Ok);
+					StringMap parsedSignature = T_parseSignature(header_value);
+					ccstAssertEqual(cc7::CopyToString(view.version), PA_VER);
+					ccstAssertEqual(cc7::CopyToString(view.activationId), _activation_id);
+					ccstAssertEqual(cc7::CopyToString(view.applicationKey), _setup.applicationKey);
+					ccstAssertEqual(cc7::CopyToString(view.nonce), parsedSignature["pa_nonce"]);
+					ccstAssertTrue(cc7::FromBase64String(cc7::CopyToString(view.nonce)).size() == 16);
+					ccstAssertEqual(cc7::CopyToString(view.factor), "possession");
+					ccstAssertEqual(cc7::CopyToString(view.signature), parsedSignature["pa_signature"]);
+					ccstAssertEqual(view.signature.size(), 8);
+					
+					// Offline signature must be equal to the signature calculated by signHTTPRequestData()
+					request.offlineNonce = "QUJDREVGR0hJSktMTU5PUA==";
+					auto state = s1.saveSessionState();
+					ec = s1.signHTTPRequestDataToHeader(request, keys, SF_Possession_Biometry, header_value);
+					ccstAssertEqual(ec, EC_Ok);
+					ec = s1.loadSessionState(state);
+					ccstAssertEqual(ec, EC_Ok);
+					HTTPRequestDataSignature sigData;
+					ec = s1.signHTTPRequestData(request, keys, SF_Possession_Biometry, sigData);
+					ccstAssertEqual(ec, EC_Ok);
+					ccstAssertEqual(header_value, sigData.buildAuthHeaderValue());
+					ccstAssertEqual(view.parse(cc7::MakeRange(header_value)), EC_Ok);
+					ccstAssertEqual(cc7::CopyToString(view.nonce), request.offlineNonce);
+					ccstAssertEqual(view.signature.size(), 17);
+					
+					// Invalid header values
+					ccstAssertEqual(view.parse(cc7::MakeRange(header_value.substr(0, header_value.size() - 1))), EC_WrongParam);
+					ccstAssertTrue(view.signature.empty());
+					ccstAssertEqual(view.parse(cc7::MakeRange(header_value + " ")), EC_WrongParam);
+					ccstAssertEqual(view.parse(cc7::MakeRange(header_value.substr(1))), EC_WrongParam);
+					ccstAssertEqual(view.parse(cc7::ByteRange()), EC_WrongParam);
+				}
+				// Body signed through the view
+				{
+					SignatureUnlockKeys keys;
+					keys.possessionUnlockKey = possessionUnlock;
+					keys.biometryUnlockKey   = biometryUnlock;
+					const size_t body_size = 64 * 1024;
+					cc7::ByteArray body(body_size, 0x5A);
+					const char * nonce = "QUJDREVGR0hJSktMTU5PUA==";
+					HTTPRequestDataView request(body, cc7::MakeRange("POST"), cc7::MakeRange("/large/body"), cc7::MakeRange(nonce));
+					// The view must refer to the caller's memory, the body is never copied.
+					ccstAssertTrue(request.body.data() == body.data());
+					ccstAssertEqual(request.body.size(), body_size);
+					HTTPRequestData owned_request(body, "POST", "/large/body", nonce);
+					HTTPRequestDataView owned_view(owned_request);
+					ccstAssertTrue(owned_view.body.data() == owned_request.body.data());
+					ccstAssertTrue(owned_view.method.data() == (const cc7::byte*)owned_request.method.data());
+					ccstAssertTrue(owned_view.uri.data() == (const cc7::byte*)owned_request.uri.data());
+					
+					auto state = s1.saveSessionState();
+					std::string header_value;
+					ec = s1.signHTTPRequestDataToHeader(request, keys, SF_Possession_Biometry, header_value);
+					ccstAssertEqual(ec, EC_Ok);
+					
+					// Compare with the signature calculated over the owned data
+					ec = s1.loadSessionState(state);
+					ccstAssertEqual(ec, EC_Ok);
+					HTTPRequestDataSignature sigData;
+					ec = s1.signHTTPRequestData(owned_request, keys, SF_Possession_Biometry, sigData);
+					ccstAssertEqual(ec, EC_Ok);
+					ccstAssertEqual(header_value, sigData.buildAuthHeaderValue());
+				}
+				// Reserved counter values, signed in parallel
+				{
+					SignatureUnlockKeys keys;
+					keys.possessionUnlockKey = possessionUnlock;
+					keys.biometryUnlockKey   = biometryUnlock;
+					const size_t count = 64;
+					std::vector<std::string> nonces(count);
+					for (auto && nonce : nonces) {
+						nonce = crypto::GetRandomData(16).base64String();
+					}
+					auto state = s1.saveSessionState();
+					
+					SignatureCounterReservation reservation;
+					ccstAssertEqual(s1.reserveSignatureCounters(0, keys, SF_Possession_Biometry, reservation), EC_WrongParam);
+					ccstAssertEqual(s1.reserveSignatureCounters(count, SignatureUnlockKeys(), SF_Possession_Biometry, reservation), EC_Encryption);
+					ccstAssertFalse(reservation.isValid());
+					ec = s1.reserveSignatureCounters(count, keys, SF_Possession_Biometry, reservation);
+					ccstAssertEqual(ec, EC_Ok);
+					ccstAssertTrue(reservation.isValid());
+					ccstAssertEqual(reservation.count(), count);
+					
+					std::string header_value;
+					HTTPRequestData request(cc7::MakeRange("{}"), "POST", "/reserved/test");
+					ccstAssertEqual(reservation.signHTTPRequestData(count, request, header_value), EC_WrongParam);
+					
+					// Sign all reserved values on multiple threads
+					const size_t threads_count = 4;
+					std::vector<std::string> headers(count);
+					std::vector<ErrorCode> results(count, EC_WrongState);
+					std::vector<std::thread> threads;
+					for (size_t t = 0; t < threads_count; t++) {
+						threads.push_back(std::thread([&, t]() {
+							for (size_t i = t; i < count; i += threads_count) {
+								HTTPRequestDataView view(cc7::MakeRange("{}"), cc7::MakeRange("POST"), cc7::MakeRange("/reserved/test"), cc7::MakeRange(nonces[i]));
+								results[i] = reservation.signHTTPRequestData(i, view, headers[i]);
+							}
+						}));
+					}
+					for (auto && thread : threads) {
+						thread.join();
+					}
+					
+					// Each signature must be equal to the signature calculated in order, from the state before the reservation.
+					auto state_after_reservation = s1.saveSessionState();
+					ccstAssertEqual(s1.loadSessionState(state), EC_Ok);
+					for (size_t i = 0; i < count; i++) {
+						ccstAssertEqual(results[i], EC_Ok);
+						request.offlineNonce = nonces[i];
+						ec = s1.signHTTPRequestDataToHeader(request, keys, SF_Possession_Biometry, header_value);
+						ccstAssertEqual(ec, EC_Ok);
+						ccstAssertEqual(headers[i], header_value);
+					}
+					// The counter must be at the same position as after the reservation
+					request.offlineNonce = nonces[0];
+					ccstAssertEqual(s1.signHTTPRequestDataToHeader(request, keys, SF_Possession, header_value), EC_Ok);
+					ccstAssertEqual(s1.loadSessionState(state_after_reservation), EC_Ok);
+					std::string next_header_value;
+					ccstAssertEqual(s1.signHTTPRequestDataToHeader(request, keys, SF_Possession, next_header_value), EC_Ok);
+					ccstAssertEqual(header_value, next_header_value);
+					
+					// Online signature from the reservation
+					request.offlineNonce.clear();
+					ccstAssertEqual(reservation.signHTTPRequestData(0, request, header_value), EC_Ok);
+					HTTPAuthHeaderView header_view;
+					ccstAssertEqual(header_view.parse(cc7::MakeRange(header_value)), EC_Ok);
+					ccstAssertEqual(cc7::CopyToString(header_view.applicationKey), _setup.applicationKey);
+					ccstAssertEqual(header_view.signature.size(), 17);
+					
+					reservation.clear();
+					ccstAssertFalse(reservation.isValid());
+					ccstAssertEqual(reservation.signHTTPRequestData(0, request, header_value), EC_WrongState);
+					
+					// Leave the session in the state before this block
+					ccstAssertEqual(s1.loadSessionState(state), EC_Ok);
 				}
 				// Recovery codes
 				if (USE_RECOVERY_CODE) {
@@ -963,6 +1335,10 @@ namespace powerAuthTests
 			ec = s1.verifyServerSignedData(signedData);
 			ccstAssertTrue(ec == EC_Ok);
 
+			// Verify again, the key is now imported from cached coordinates
+			ec = s1.verifyServerSignedData(signedData);
+			ccstAssertTrue(ec == EC_Ok);
+
 			// modify data
 			signedData.data.pop_back();
 			ec = s1.verifyServerSignedData(signedData);
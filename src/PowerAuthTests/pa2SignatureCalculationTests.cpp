@@ -18,6 +18,9 @@
 #include <cc7tests/detail/StringUtils.h>
 #include "../PowerAuth/crypto/CryptoUtils.h"
 #include "../PowerAuth/protocol/ProtocolUtils.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
 using namespace cc7;
 using namespace cc7::tests;
@@ -39,6 +42,9 @@ namespace powerAuthTests
 			CC7_REGISTER_TEST_METHOD(testV2Signatures)
 			CC7_REGISTER_TEST_METHOD(testV3Signatures)
 			CC7_REGISTER_TEST_METHOD(testDataNormalization)
+			CC7_REGISTER_TEST_METHOD(testSignatureStream)
+			CC7_REGISTER_TEST_METHOD(testSignatureStreamFromFile)
+			CC7_REGISTER_TEST_METHOD(testDecimalFormatting)
 		}
 		
 		void testV2Signatures()
@@ -136,6 +142,160 @@ namespace powerAuthTests
 			ByteArray normalizedData = protocol::NormalizeDataForSignature(method, uri, nonceB64, body, secret);
 			ccstAssertEqual(normalizedData, expectedNormalizedData);
 		}
+		
+		protocol::SignatureKeys randomSignatureKeys()
+		{
+			protocol::SignatureKeys keys;
+			keys.possessionKey = crypto::GetRandomData(16);
+			keys.knowledgeKey  = crypto::GetRandomData(16);
+			keys.biometryKey   = crypto::GetRandomData(16);
+			return keys;
+		}
+		
+		void testSignatureStream()
+		{
+			static const SignatureFactor allFactors[] = {
+				SF_Possession, SF_Knowledge, SF_Biometry,
+				SF_Possession_Knowledge, SF_Possession_Biometry,
+				SF_Possession_Knowledge_Biometry
+			};
+			std::string method("POST");
+			std::string nonceB64("fNJQBWeKTG5Zp+zrdNu/PQ==");
+			std::string secret("MDEyMzQ1Njc4OUFCQ0RFRg==");
+			// Body sizes, covering all Base64 tails and crossing the internal block size.
+			static const size_t bodySizes[] = { 0, 1, 2, 3, 4, 5, 767, 768, 769, 770, 3071, 3072, 3073, 10001 };
+			
+			for (size_t bi = 0; bi < sizeof(bodySizes)/sizeof(size_t); bi++) {
+				protocol::SignatureKeys keys = randomSignatureKeys();
+				ByteArray ctr_data = crypto::GetRandomData(16);
+				ByteArray body = crypto::GetRandomData(bodySizes[bi]);
+				std::string uri = "/pa/some/uri/" + std::to_string(bi);
+				for (size_t fi = 0; fi < sizeof(allFactors)/sizeof(SignatureFactor); fi++) {
+					SignatureFactor factor = allFactors[fi];
+					ByteArray data = protocol::NormalizeDataForSignature(method, uri, nonceB64, body, secret);
+					std::string expected = protocol::CalculateSignature(keys, factor, ctr_data, data);
+					ccstAssertFalse(expected.empty());
+					
+					// Whole body at once
+					protocol::SignatureStream stream;
+					ccstAssertTrue(stream.begin(keys, factor, ctr_data, method, uri, nonceB64));
+					ccstAssertTrue(stream.updateBody(body));
+					ccstAssertEqual(stream.finish(secret), expected);
+					
+					// Body in random chunks
+					ccstAssertTrue(stream.begin(keys, factor, ctr_data, method, uri, nonceB64));
+					size_t offset = 0;
+					while (offset < body.size()) {
+						size_t chunk = std::min((size_t)arc4random_uniform(7) + (arc4random_uniform(3) == 0 ? 1000 : 0), body.size() - offset);
+						ccstAssertTrue(stream.updateBody(body.byteRange().subRange(offset, chunk)));
+						offset += chunk;
+					}
+					ccstAssertEqual(stream.finish(secret), expected);
+					
+					// Body provided by the stream function
+					offset = 0;
+					HTTPRequestBodyStream body_stream = [&body, &offset](cc7::byte * buffer, size_t capacity, size_t & out_size) -> bool {
+						out_size = std::min(std::min(capacity, (size_t)333), body.size() - offset);
+						memcpy(buffer, body.data() + offset, out_size);
+						offset += out_size;
+						return true;
+					};
+					ccstAssertTrue(stream.begin(keys, factor, ctr_data, method, uri, nonceB64));
+					ccstAssertTrue(stream.updateBody(body_stream));
+					ccstAssertEqual(stream.finish(secret), expected);
+				}
+			}
+			
+			// Failing stream
+			protocol::SignatureKeys keys = randomSignatureKeys();
+			HTTPRequestBodyStream failing_stream = [](cc7::byte * buffer, size_t capacity, size_t & out_size) -> bool {
+				out_size = 0;
+				return false;
+			};
+			protocol::SignatureStream stream;
+			ccstAssertTrue(stream.begin(keys, SF_Possession_Knowledge, crypto::GetRandomData(16), method, "/uri", nonceB64));
+			ccstAssertFalse(stream.updateBody(failing_stream));
+			ccstAssertTrue(stream.finish(secret).empty());
+		}
+		
+		void testSignatureStreamFromFile()
+		{
+			std::string method("POST");
+			std::string uri("/pa/upload");
+			std::string nonceB64("fNJQBWeKTG5Zp+zrdNu/PQ==");
+			std::string secret("MDEyMzQ1Njc4OUFCQ0RFRg==");
+			protocol::SignatureKeys keys = randomSignatureKeys();
+			ByteArray ctr_data = crypto::GetRandomData(16);
+			ByteArray body = crypto::GetRandomData(100000 + arc4random_uniform(1000));
+			
+			FILE * file = tmpfile();
+			ccstAssertNotNull(file);
+			if (!file) {
+				return;
+			}
+			ccstAssertEqual(fwrite(body.data(), 1, body.size(), file), body.size());
+			fflush(file);
+			lseek(fileno(file), 0, SEEK_SET);
+			
+			ByteArray data = protocol::NormalizeDataForSignature(method, uri, nonceB64, body, secret);
+			std::string expected = protocol::CalculateSignature(keys, SF_Possession_Knowledge_Biometry, ctr_data, data);
+			
+			protocol::SignatureStream stream;
+			ccstAssertTrue(stream.begin(keys, SF_Possession_Knowledge_Biometry, ctr_data, method, uri, nonceB64));
+			ccstAssertTrue(stream.updateBody(HTTPRequestBodyStreamFromFileDescriptor(fileno(file))));
+			ccstAssertEqual(stream.finish(secret), expected);
+			fclose(file);
+			
+			// Invalid descriptor
+			ccstAssertTrue(stream.begin(keys, SF_Possession, ctr_data, method, uri, nonceB64));
+			ccstAssertFalse(stream.updateBody(HTTPRequestBodyStreamFromFileDescriptor(-1)));
+		}
+		
+		void testDecimalFormatting()
+		{
+			char buffer[16];
+			struct { U32 value; size_t digits; const char * expected; } vectors[] = {
+				{ 0,          8, "00000000" },
+				{ 7,          8, "00000007" },
+				{ 99,         8, "00000099" },
+				{ 12345678,   8, "12345678" },
+				{ 99999999,   8, "99999999" },
+				{ 123456789,  8, "23456789" },
+				{ 4294967295, 10, "4294967295" },
+				{ 305,        3, "305" },
+				{ 5,          1, "5" },
+			};
+			for (auto && v : vectors) {
+				memset(buffer, 'x', sizeof(buffer));
+				protocol::FormatDecimalDigits(v.value, v.digits, buffer);
+				ccstAssertEqual(std::string(buffer, v.digits), std::string(v.expected));
+				ccstAssertEqual(buffer[v.digits], 'x');
+			}
+			
+			// Signature writer
+			ByteArray sig1 = crypto::GetRandomData(32);
+			ByteArray sig2 = crypto::GetRandomData(32);
+			ByteArray sig3 = crypto::GetRandomData(32);
+			protocol::SignatureWriter writer;
+			ccstAssertEqual(writer.length(), 0);
+			ccstAssertTrue(writer.append(sig1));
+			ccstAssertTrue(writer.append(sig2));
+			ccstAssertTrue(writer.append(sig3));
+			std::string expected = protocol::CalculateDecimalizedSignature(sig1) + "-" +
+									protocol::CalculateDecimalizedSignature(sig2) + "-" +
+									protocol::CalculateDecimalizedSignature(sig3);
+			ccstAssertEqual(writer.length(), protocol::SignatureWriter::MAX_LENGTH);
+			ccstAssertEqual(writer.toString(), expected);
+			
+			// Compare with the legacy to_string() based formatting
+			for (size_t i = 0; i < 20000; i++) {
+				const U32 value = (U32)(i * 7919) % 100000000;
+				std::string s = std::to_string(value);
+				s.insert(0, 8 - s.size(), '0');
+				protocol::FormatDecimalDigits(value, 8, buffer);
+				ccstAssertEqual(std::string(buffer, 8), s);
+			}
+		}
 	};
 	
 	CC7_CREATE_UNIT_TEST(pa2SignatureCalculationTests, "pa2")
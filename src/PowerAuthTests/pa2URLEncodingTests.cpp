@@ -16,6 +16,8 @@
 
 #include <cc7tests/CC7Tests.h>
 #include "utils/URLEncoding.h"
+#include "crypto/CryptoUtils.h"
+#include <map>
 
 using namespace cc7;
 using namespace cc7::tests;
@@ -34,6 +36,9 @@ namespace powerAuthTests
 		pa2URLEncodingTests()
 		{
 			CC7_REGISTER_TEST_METHOD(testEncoding)
+			CC7_REGISTER_TEST_METHOD(testEncodingOfRandomData)
+			CC7_REGISTER_TEST_METHOD(testAppendEncodedString)
+			CC7_REGISTER_TEST_METHOD(testEncodingOfQuery)
 		}
 		
 		void testEncoding()
@@ -89,6 +94,94 @@ namespace powerAuthTests
 			}
 		}
 		
+		// Simple, byte by byte implementation used as a reference
+		
+		static cc7::ByteArray referenceEncode(const cc7::ByteRange & str)
+		{
+			static const char * hex = "0123456789ABCDEF";
+			cc7::ByteArray result;
+			for (cc7::byte c : str) {
+				if ((c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+					(c == '-' || c == '_' || c == '.' || c == '*')) {
+					result.push_back(c);
+				} else if (c == ' ') {
+					result.push_back('+');
+				} else {
+					result.push_back('%');
+					result.push_back(hex[c >> 4]);
+					result.push_back(hex[c & 0xF]);
+				}
+			}
+			return result;
+		}
+		
+		void testEncodingOfRandomData()
+		{
+			// Each character at each position of the block, followed by a long unreserved run
+			std::string unreserved = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_.*";
+			for (int c = 0; c < 256; c++) {
+				for (size_t pos = 0; pos < 40; pos++) {
+					std::string str = unreserved;
+					str[pos] = (char)c;
+					cc7::ByteArray result = utils::ConvertStringToUrlEncodedData(str);
+					ccstAssertEqual(result, referenceEncode(cc7::MakeRange(str)), "Char 0x%02x at %d", c, (int)pos);
+				}
+			}
+			// Random data with various density of characters to escape
+			for (size_t size = 0; size < 300; size++) {
+				cc7::ByteArray data = crypto::GetRandomData(size);
+				const cc7::U32 density = arc4random_uniform(4);
+				for (auto && c : data) {
+					if (density > 0 && arc4random_uniform(density + 1) > 0) {
+						c = unreserved[c % unreserved.size()];
+					}
+				}
+				std::string str(data.begin(), data.end());
+				cc7::ByteArray expected = referenceEncode(data);
+				ccstAssertEqual(utils::ConvertStringToUrlEncodedData(str), expected);
+				ccstAssertEqual(utils::URLEncoding_EncodedLength(data), expected.size());
+				// Direct write to buffer with exact size
+				cc7::ByteArray buffer(expected.size() + 1, 0xEE);
+				size_t written = utils::ConvertStringToUrlEncodedBuffer(data, buffer.data());
+				ccstAssertEqual(written, expected.size());
+				ccstAssertEqual(buffer.byteRange().subRangeTo(written), expected.byteRange());
+				ccstAssertEqual(buffer.back(), 0xEE);
+			}
+		}
+		
+		void testAppendEncodedString()
+		{
+			cc7::ByteArray result = cc7::MakeRange("prefix=");
+			utils::AppendUrlEncodedString("", result);
+			ccstAssertEqual(result, cc7::MakeRange("prefix="));
+			utils::AppendUrlEncodedString(u8"ľščťžýáíé & more", result);
+			ccstAssertEqual(result, cc7::MakeRange("prefix=%C4%BE%C5%A1%C4%8D%C5%A5%C5%BE%C3%BD%C3%A1%C3%AD%C3%A9+%26+more"));
+		}
+		
+		void testEncodingOfQuery()
+		{
+			// Realistic GET query map, with long unicode values
+			std::map<std::string, std::string> query;
+			query["type"] = "ANDROID";
+			query["pageSize"] = "50";
+			query["query"] = u8"Referenční korpus je stálý, takže opakované dotazy dávají vždy stejné výsledky.";
+			query["note"] = u8"Jednou z dôležitých vlastností korpusov je ich reprezentatívnosť. "
+							u8"Jednou z dôležitých vlastností korpusov je ich reprezentatívnosť.";
+			query["identifier"] = "ZmFrZS1pZGVudGlmaWVyLWZvci10ZXN0aW5nLXB1cnBvc2Vz";
+			query["redirectUri"] = "https://www.example.com/callback/path?state=AbCdEf0123456789&scope=read write";
+			
+			cc7::ByteArray result, expected;
+			for (auto && kv : query) {
+				expected.append(referenceEncode(cc7::MakeRange(kv.first)));
+				expected.append('=');
+				expected.append(referenceEncode(cc7::MakeRange(kv.second)));
+				utils::AppendUrlEncodedString(kv.first, result);
+				result.append('=');
+				utils::AppendUrlEncodedString(kv.second, result);
+			}
+			ccstAssertEqual(result, expected);
+		}
+		
 	};
 	
 	CC7_CREATE_UNIT_TEST(pa2URLEncodingTests, "pa2")